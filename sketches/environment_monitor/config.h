@@ -8,6 +8,7 @@
 #define MQTT_PORT       1883
 #define MQTT_USER       "bille_mqtt"
 #define MQTT_PASSWORD   "BillE2025_Secure!" 
+#define MQTT_BUFFER_SIZE 512                // PubSubClient packet buffer; bille/status/fan is ~350 with the controller fields
 
 // Pin definitions
 #define DHT_PIN         D6
@@ -18,7 +19,29 @@
 
 // Fan control thresholds
 #define FAN_ON_TEMP     24.0    // Turn fan ON when temp >= 24°C
-#define FAN_OFF_TEMP    22.0    // Turn fan OFF when temp <= 22°C 
+#define FAN_OFF_TEMP    22.0    // Turn fan OFF when temp <= 22°C
+
+// Predictive control and relay protection
+#define FAN_PREDICT_HORIZON_S   120        // Switch early if the trend crosses a threshold within 2 min
+#define FAN_MIN_SLOPE_SAMPLES   4          // Samples needed before the slope is trusted
+#define FAN_MIN_ON_TIME_MS      120000UL   // Relay stays ON for at least 2 min
+#define FAN_MIN_OFF_TIME_MS     180000UL   // Relay stays OFF for at least 3 min
+
+// Compressed reading history on LittleFS (needs a flash layout with a filesystem, e.g. 4MB FS:1MB)
+#define ENV_HISTORY_BLOCK_SIZE  1024    // RAM block, ~150 readings (~25 min at 10 s)
+#define ENV_HISTORY_MAX_BLOCKS  256     // 256 KB of flash, ~4 days
+#define ENV_HISTORY_UPLOAD_BLOCKS 16    // Default for bille/commands/history
+
+// Fast WiFi connect (fast_connect.h)
+#define RTC_WIFI_BLOCK        96        // Cached AP and lease in RTC user memory; 0-31 are left to OTA (eboot)
+#define WIFI_FAST_TIMEOUT_MS  1500      // Direct association allowed this long before a full scan
+
+// Logging
+#define LOG_NODE_NAME       "environment"
+#define LOG_COMPILE_LEVEL   LOG_LEVEL_DEBUG  // Lower to LOG_LEVEL_WARN to strip the rest
+#define LOG_DEFAULT_LEVEL   LOG_LEVEL_INFO   // Runtime level per module, changeable over MQTT
+#define LOG_BUFFER_SIZE     2048             // In-RAM ring buffer, dumped on bille/commands/log
+#define LOG_SERIAL_ENABLED  1                // 0 for production: ring buffer + MQTT only
 
 
 #endif
\ No newline at end of file
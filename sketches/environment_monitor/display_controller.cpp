@@ -1,5 +1,6 @@
 #include "display_controller.h"
 #include "environment_data.h"
+#include "logger.h"
 #include <LiquidCrystal_I2C.h>
 #include <ESP8266WiFi.h>
 #include <Arduino.h>
@@ -45,11 +46,7 @@ void displayEnvironment() {
 }
 
 void printEnvironment() {
-  Serial.println("=== Environmental Data ===");
-  Serial.printf("Temperature: %.1fÂ°C\n", currentEnv.temperature);
-  Serial.printf("Humidity: %.1f%%\n", currentEnv.humidity);
-  Serial.printf("Light Level: %d lux\n", currentEnv.lightLevel);
-  Serial.printf("Noise Level: %d\n", currentEnv.noiseLevel);
-  Serial.printf("Sound Detected: %s\n", currentEnv.soundDetected ? "YES" : "NO");
-  Serial.println("==========================");
+  LOG_DEBUG(LOG_SENSOR, "Temp %.1f°C, Hum %.1f%%, Light %d lux, Noise %d, Sound %s",
+            currentEnv.temperature, currentEnv.humidity, currentEnv.lightLevel,
+            currentEnv.noiseLevel, currentEnv.soundDetected ? "YES" : "NO");
 }
\ No newline at end of file
@@ -0,0 +1,167 @@
+#include "env_history.h"
+#include "config.h"
+#include "logger.h"
+#include "series_codec.h"
+#include <LittleFS.h>
+
+#define HISTORY_DIR   "/history"
+#define BOOT_FILE     HISTORY_DIR "/boot"
+
+static const uint8_t columnTypes[ENV_HISTORY_COLUMNS] = {
+  CODEC_FLOAT, CODEC_FLOAT, CODEC_INT, CODEC_INT, CODEC_INT
+};
+
+static bool ready = false;
+static uint16_t bootNumber = 0;
+static uint32_t oldestSeq = 0;       // Oldest block on flash
+static uint32_t nextSeq = 0;         // Sequence number of the block in RAM
+static uint8_t block[ENV_HISTORY_BLOCK_SIZE];
+static CodecWriter writer;
+
+static unsigned long samples = 0;
+static unsigned long blocksWritten = 0;
+static unsigned long rawBytes = 0;
+static unsigned long storedBytes = 0;
+
+static void blockPath(char* path, size_t size, uint32_t seq) {
+  snprintf(path, size, HISTORY_DIR "/%08lu.blk", (unsigned long)seq);
+}
+
+static void startBlock() {
+  codecBegin(writer, block, sizeof(block), ENV_HISTORY_COLUMNS, columnTypes);
+}
+
+bool envHistoryInit() {
+  if (!LittleFS.begin()) {
+    LOG_ERROR(LOG_SENSOR, "LittleFS mount failed, history disabled");
+    return false;
+  }
+  LittleFS.mkdir(HISTORY_DIR);
+
+  // Boot number tells uploads which blocks share the current millis() epoch
+  File f = LittleFS.open(BOOT_FILE, "r");
+  if (f) {
+    f.read((uint8_t*)&bootNumber, sizeof(bootNumber));
+    f.close();
+  }
+  bootNumber++;
+  f = LittleFS.open(BOOT_FILE, "w");
+  if (f) {
+    f.write((const uint8_t*)&bootNumber, sizeof(bootNumber));
+    f.close();
+  }
+
+  bool any = false;
+  Dir dir = LittleFS.openDir(HISTORY_DIR);
+  while (dir.next()) {
+    unsigned long seq;
+    if (sscanf(dir.fileName().c_str(), "%lu.blk", &seq) != 1) continue;
+    if (!any || seq < oldestSeq) oldestSeq = seq;
+    if (!any || seq >= nextSeq) nextSeq = seq + 1;
+    any = true;
+  }
+  if (!any) oldestSeq = nextSeq = 0;
+
+  startBlock();
+  ready = true;
+  LOG_INFO(LOG_SENSOR, "History: boot %u, %lu blocks on flash", bootNumber, (unsigned long)(nextSeq - oldestSeq));
+  return true;
+}
+
+static void sealBlock() {
+  size_t length = codecFinish(writer);
+  char path[32];
+  blockPath(path, sizeof(path), nextSeq);
+  File f = LittleFS.open(path, "w");
+  bool ok = f && f.write((const uint8_t*)&bootNumber, sizeof(bootNumber)) == sizeof(bootNumber) &&
+            f.write(block, length) == length;
+  if (f) f.close();
+  if (!ok) {
+    LOG_WARN(LOG_SENSOR, "History block %lu not written", (unsigned long)nextSeq);
+    LittleFS.remove(path);
+    startBlock();
+    return;
+  }
+
+  blocksWritten++;
+  rawBytes += (unsigned long)writer.count * sizeof(EnvironmentData);
+  storedBytes += length;
+  LOG_INFO(LOG_SENSOR, "History block %lu: %u samples in %u bytes (%.1fx)", (unsigned long)nextSeq,
+           writer.count, (unsigned)length, (float)writer.count * sizeof(EnvironmentData) / length);
+  nextSeq++;
+
+  while (nextSeq - oldestSeq > ENV_HISTORY_MAX_BLOCKS) {
+    blockPath(path, sizeof(path), oldestSeq++);
+    LittleFS.remove(path);
+  }
+  startBlock();
+}
+
+void envHistoryAdd(const EnvironmentData& env) {
+  if (!ready) return;
+  double values[ENV_HISTORY_COLUMNS] = {
+    env.temperature, env.humidity, (double)env.lightLevel, (double)env.noiseLevel, env.soundDetected ? 1.0 : 0.0
+  };
+  if (!codecAdd(writer, env.timestamp, values)) {
+    sealBlock();
+    codecAdd(writer, env.timestamp, values);  // An empty block always has room for one sample
+  }
+  samples++;
+}
+
+static bool publishBlock(PubSubClient& mqtt, const char* topic, uint32_t seq, uint16_t boot,
+                         const uint8_t* data, size_t length) {
+  uint8_t header[ENV_HISTORY_UPLOAD_HEADER];
+  uint32_t now = millis();
+  memcpy(header, &seq, 4);
+  memcpy(header + 4, &boot, 2);
+  memcpy(header + 6, &bootNumber, 2);
+  memcpy(header + 8, &now, 4);
+  // Streamed so a block does not need PubSubClient's packet buffer
+  if (!mqtt.beginPublish(topic, sizeof(header) + length, false)) return false;
+  mqtt.write(header, sizeof(header));
+  mqtt.write(data, length);
+  return mqtt.endPublish();
+}
+
+int envHistoryPublish(PubSubClient& mqtt, const char* topic, int maxBlocks) {
+  if (!ready || maxBlocks <= 0) return 0;
+  uint32_t first = oldestSeq;
+  if (nextSeq - first > (uint32_t)(maxBlocks - 1)) first = nextSeq - (maxBlocks - 1);
+
+  int sent = 0;
+  static uint8_t stored[ENV_HISTORY_BLOCK_SIZE + sizeof(uint16_t)];
+  char path[32];
+  for (uint32_t seq = first; seq < nextSeq; seq++) {
+    blockPath(path, sizeof(path), seq);
+    File f = LittleFS.open(path, "r");
+    if (!f) continue;
+    size_t length = f.read(stored, sizeof(stored));
+    f.close();
+    if (length <= sizeof(uint16_t)) continue;
+    uint16_t boot;
+    memcpy(&boot, stored, sizeof(boot));
+    if (publishBlock(mqtt, topic, seq, boot, stored + sizeof(boot), length - sizeof(boot))) sent++;
+    delay(0);  // Keep WiFi and the watchdog serviced between blocks
+  }
+
+  if (writer.count > 0) {
+    // Finishing only stamps the count; the block keeps filling afterwards
+    size_t length = codecFinish(writer);
+    if (publishBlock(mqtt, topic, nextSeq, bootNumber, block, length)) sent++;
+  }
+  LOG_INFO(LOG_MQTT, "History: %d blocks published", sent);
+  return sent;
+}
+
+unsigned long envHistorySamples() {
+  return samples;
+}
+
+unsigned long envHistoryBlocksWritten() {
+  return blocksWritten;
+}
+
+float envHistoryRatio() {
+  return storedBytes ? (float)rawBytes / storedBytes : 0;
+}
@@ -0,0 +1,33 @@
+#ifndef ENV_HISTORY_H
+#define ENV_HISTORY_H
+
+#include <Arduino.h>
+#include <PubSubClient.h>
+#include "environment_data.h"
+
+// Compressed reading history on LittleFS (series_codec.h). Readings fill a
+// block in RAM; a full block is written once to /history/<seq>.blk and the
+// oldest blocks beyond ENV_HISTORY_MAX_BLOCKS are deleted, so the flash sees
+// one small write every ~20 minutes. The block still in RAM is lost on reset.
+//
+// Block columns: temperature (float), humidity (float), lightLevel,
+// noiseLevel, soundDetected (int); times are millis().
+//
+// Upload on bille/commands/history, one message per block, newest last:
+//   u32 block seq, u16 boot of the block, u16 current boot, u32 millis() now,
+//   then the codec block. Times of blocks from the current boot map to wall
+//   clock as receivedAt - (now - t); older boots only keep relative times.
+
+#define ENV_HISTORY_COLUMNS        5
+#define ENV_HISTORY_UPLOAD_HEADER  12
+
+bool envHistoryInit();
+void envHistoryAdd(const EnvironmentData& env);
+// Publishes the newest maxBlocks blocks (including the one in RAM); returns blocks sent
+int envHistoryPublish(PubSubClient& mqtt, const char* topic, int maxBlocks);
+
+unsigned long envHistorySamples();        // Since boot
+unsigned long envHistoryBlocksWritten();  // Since boot
+float envHistoryRatio();                  // Raw struct bytes / encoded bytes, sealed blocks
+
+#endif
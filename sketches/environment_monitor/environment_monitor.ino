@@ -10,6 +10,7 @@ DEVICE OVERVIEW:
 - Temperature, humidity, light, and noise level sensing
 - Automatic fan control based on temperature thresholds
 - LCD display for real-time environmental data
+- Compressed on-flash history of every reading (uploaded on request)
 - MQTT client for data transmission to main brain
 
 PIN CONNECTIONS:
@@ -35,12 +36,13 @@ SENSOR SPECIFICATIONS:
 - KY-038: Noise level detection (analog) + sound threshold (digital)
 
 FAN CONTROL THRESHOLDS:
-- Fan ON: Temperature >= 24.0°C
-- Fan OFF: Temperature <= 22.0°C
+- Fan ON: Temperature >= 24.0°C, or trend predicts >= 24.0°C within 2 min
+- Fan OFF: Smoothed temperature <= 22.0°C (no prediction)
+- Relay protection: minimum 2 min ON / 3 min OFF between switches
 - Manual override supported via MQTT commands
 
 MQTT TOPICS (Published):
-- bille/data/environment     - Combined environmental data
+- bille/data/environment     - Combined environmental data (retained, cleared by the will)
 - bille/sensors/temperature  - Individual temperature reading
 - bille/sensors/humidity     - Individual humidity reading
 - bille/sensors/light        - Individual light level
@@ -48,11 +50,16 @@ MQTT TOPICS (Published):
 - bille/sensors/fan_state    - Fan on/off status
 - bille/status/fan          - Detailed fan control info
 - bille/alerts/environment  - Environmental quality alerts
+- bille/logs/environment    - Log ring buffer dump (on request)
+- bille/data/environment_history - Compressed history blocks (on request)
+- bille/status/environment_system - Node status with boot timing (every minute)
 
 MQTT TOPICS (Subscribed):
 - bille/environment/request  - Data request from main brain
 - bille/session/state        - Session status updates
 - bille/commands/fan         - Fan control commands (manual_on/manual_off/auto)
+- bille/commands/log         - Log dump / per-module level commands
+- bille/commands/history     - History upload ({"node":"environment","blocks":16})
 
 DEPENDENCIES:
 - DHT Library
@@ -60,6 +67,7 @@ DEPENDENCIES:
 - ArduinoJson Library
 - ESP8266WiFi Library
 - PubSubClient Library
+- LittleFS (ESP8266 core; select a flash layout with a filesystem)
 
 NETWORK CONFIGURATION:
 - WiFi SSID: TechLabNet
@@ -84,6 +92,9 @@ NETWORK CONFIGURATION:
 #include "display_controller.h"
 #include "mqtt_client.h"
 #include "environmental_analysis.h"
+#include "fan_controller.h"
+#include "logger.h"
+#include "env_history.h"
 
 // MQTT Client
 WiFiClient espClient;
@@ -101,15 +112,21 @@ bool fanState = false;
 bool manualOverride = false;     
 bool manualFanState = false;     
 
+// Predictive fan model, relay dwell protection and actuation statistics
+FanController fanController;
+
 void setup() {
   Serial.begin(115200);
+  logInit();
   delay(1000);
-  Serial.println("Bill-E Environment Monitor with MQTT Starting...");
+  LOG_INFO(LOG_SYSTEM, "Bill-E Environment Monitor with MQTT Starting...");
   
   // Initialize pins
   pinMode(SOUND_DIGITAL, INPUT);
   pinMode(FAN_RELAY_PIN, OUTPUT);
   digitalWrite(FAN_RELAY_PIN, LOW);  // Start with fan OFF
+  fanControllerInit(fanController, millis());
+  envHistoryInit();
   
   // Initialize DHT sensor
   dht.begin();
@@ -123,6 +140,7 @@ void setup() {
   setup_wifi();
   client.setServer(MQTT_SERVER, MQTT_PORT);
   client.setCallback(mqtt_callback);
+  client.setBufferSize(MQTT_BUFFER_SIZE);
   
   
   // Welcome message
@@ -132,11 +150,11 @@ void setup() {
   lcd.setCursor(0, 1);
   lcd.print("MQTT + Fan Ready");
   
-  Serial.println("Environment Monitor with MQTT and Fan Control Ready!");
-  Serial.print("IP Address: ");
-  Serial.println(WiFi.localIP());
-  Serial.println("Fan relay pin: D7");
-  Serial.printf("Auto fan thresholds: ON >= %.1f°C, OFF <= %.1f°C\n", FAN_ON_TEMP, FAN_OFF_TEMP);
+  LOG_INFO(LOG_SYSTEM, "Environment Monitor with MQTT and Fan Control Ready!");
+  LOG_INFO(LOG_SYSTEM, "IP Address: %s", WiFi.localIP().toString().c_str());
+  LOG_INFO(LOG_FAN, "Fan relay pin: D7");
+  LOG_INFO(LOG_FAN, "Auto fan thresholds: ON >= %.1f°C, OFF <= %.1f°C", FAN_ON_TEMP, FAN_OFF_TEMP);
+  LOG_INFO(LOG_FAN, "Fan dwell: min ON %lus, min OFF %lus", FAN_MIN_ON_TIME_MS / 1000, FAN_MIN_OFF_TIME_MS / 1000);
 }
 
 void loop() {
@@ -149,11 +167,19 @@ void loop() {
   static unsigned long lastRead = 0;
   if (millis() - lastRead > 10000) {
     readEnvironment();
+    envHistoryAdd(currentEnv);
     publishEnvironmentalData();
     checkEnvironmentalAlerts();  // This now includes fan control
     lastRead = millis();
   }
   
+  // Node status once a minute
+  static unsigned long lastStatus = 0;
+  if (millis() - lastStatus > 60000) {
+    publishEnvironmentStatus();
+    lastStatus = millis();
+  }
+  
   // Update display every 5 seconds
   static unsigned long lastDisplay = 0;
   if (millis() - lastDisplay > 5000) {
@@ -161,4 +187,7 @@ void loop() {
     printEnvironment();
     lastDisplay = millis();
   }
+  
+  // Flush buffered log output without blocking on the UART
+  logDrain();
 }
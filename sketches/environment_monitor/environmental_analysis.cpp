@@ -1,5 +1,7 @@
 #include "environmental_analysis.h"
 #include "environment_data.h"
+#include "fan_controller.h"
+#include "logger.h"
 #include "config.h"
 #include <PubSubClient.h>
 #include <ArduinoJson.h>
@@ -7,6 +9,7 @@
 
 extern PubSubClient client;
 extern EnvironmentData currentEnv;
+extern FanController fanController;
 
 void checkEnvironmentalAlerts() {
   // Smart environmental analysis for HA dashboard
@@ -54,36 +57,38 @@ void checkEnvironmentalAlerts() {
     serializeJson(alertDoc, alertString);
     client.publish("bille/alerts/environment", alertString.c_str());
     
-    Serial.println("Environmental alert: " + alertMessage);
+    LOG_INFO(LOG_SENSOR, "Environmental alert: %s", alertMessage.c_str());
   }
 
   controlFan();
 }
 
 void controlFan() {
+  unsigned long now = millis();
+  fanControllerAddSample(fanController, currentEnv.temperature, currentEnv.timestamp);
+  
   bool newFanState = fanState;
   
   // Check if manual override is active
   if (manualOverride) {
+    // Manual commands are explicit user intent and bypass the dwell protection
     newFanState = manualFanState;
-    Serial.println("Fan manual override active: " + String(newFanState ? "ON" : "OFF"));
+    LOG_DEBUG(LOG_FAN, "Fan manual override active: %s", newFanState ? "ON" : "OFF");
   } else {
-    // Automatic temperature-based control with hysteresis
-    if (currentEnv.temperature >= FAN_ON_TEMP && !fanState) {
-      newFanState = true;
-      Serial.printf("Auto fan ON: Temperature %.1f°C >= %.1f°C\n", currentEnv.temperature, FAN_ON_TEMP);
-    } else if (currentEnv.temperature <= FAN_OFF_TEMP && fanState) {
-      newFanState = false;
-      Serial.printf("Auto fan OFF: Temperature %.1f°C <= %.1f°C\n", currentEnv.temperature, FAN_OFF_TEMP);
-    }
+    // Predictive control: trend-based switching with minimum on/off dwell times
+    newFanState = fanControllerDesiredState(fanController, now);
+    LOG_DEBUG(LOG_FAN, "Fan model: %.1f°C, slope %.2f°C/min, predicted %.1f°C (%s)",
+              fanController.smoothedTemp, fanController.slope,
+              fanController.predictedTemp, fanController.reason);
   }
   
   // Update fan state if changed
   if (newFanState != fanState) {
     fanState = newFanState;
+    fanControllerSetRelay(fanController, fanState, now);
     digitalWrite(FAN_RELAY_PIN, fanState ? HIGH : LOW);
     
-    Serial.println("Fan state changed to: " + String(fanState ? "ON" : "OFF"));
+    LOG_INFO(LOG_FAN, "Fan state changed to: %s", fanState ? "ON" : "OFF");
     publishFanStatus();
   }
 }
@@ -92,9 +97,9 @@ void setFanManualOverride(bool enabled, bool state) {
   manualOverride = enabled;
   if (enabled) {
     manualFanState = state;
-    Serial.println("Manual override enabled, fan set to: " + String(state ? "ON" : "OFF"));
+    LOG_INFO(LOG_FAN, "Manual override enabled, fan set to: %s", state ? "ON" : "OFF");
   } else {
-    Serial.println("Manual override disabled, returning to automatic control");
+    LOG_INFO(LOG_FAN, "Manual override disabled, returning to automatic control");
   }
   
   // Immediately apply the control logic
@@ -107,21 +112,32 @@ void publishFanStatus() {
   client.publish("bille/sensors/fan_manual_override", manualOverride ? "true" : "false");
   
   // Publish detailed fan status
-  StaticJsonDocument<200> fanDoc;
+  unsigned long now = millis();
+  StaticJsonDocument<384> fanDoc;
   fanDoc["nodeType"] = "ENVIRONMENT";
-  fanDoc["timestamp"] = millis();
+  fanDoc["timestamp"] = now;
   fanDoc["fanState"] = fanState;
   fanDoc["manualOverride"] = manualOverride;
   fanDoc["temperature"] = currentEnv.temperature;
   fanDoc["controlMode"] = manualOverride ? "manual" : "automatic";
   
+  fanDoc["smoothedTemperature"] = fanController.smoothedTemp;
+  fanDoc["temperatureSlope"] = fanController.slope;          // °C per minute
+  fanDoc["predictedTemperature"] = fanController.predictedTemp;
+  fanDoc["relayActuations"] = fanController.actuations;
+  fanDoc["onTimeSeconds"] = fanControllerOnTime(fanController, now) / 1000;
+  fanDoc["dwellRemaining"] = fanControllerDwellRemaining(fanController, now) / 1000;
+  
   if (!manualOverride) {
-    fanDoc["autoReason"] = fanState ? "temperature_high" : "temperature_ok";
+    fanDoc["autoReason"] = fanController.reason;
   }
   
   String fanString;
   serializeJson(fanDoc, fanString);
-  client.publish("bille/status/fan", fanString.c_str());
+  if (!client.publish("bille/status/fan", fanString.c_str())) {
+    LOG_WARN(LOG_MQTT, "Fan status not published (%u bytes, buffer %d)", fanString.length(), MQTT_BUFFER_SIZE);
+    return;
+  }
   
-  Serial.println("Fan status published to MQTT");
+  LOG_DEBUG(LOG_MQTT, "Fan status published to MQTT");
 }
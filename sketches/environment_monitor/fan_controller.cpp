@@ -0,0 +1,127 @@
+#include "fan_controller.h"
+#include "config.h"
+
+void fanControllerInit(FanController& fc, unsigned long now) {
+  fc.head = 0;
+  fc.count = 0;
+  fc.smoothedTemp = 0;
+  fc.slope = 0;
+  fc.predictedTemp = 0;
+  fc.fanOn = false;
+  fc.lastSwitchTime = now;
+  fc.onSince = now;
+  fc.accumulatedOnTime = 0;
+  fc.actuations = 0;
+  fc.reason = "no_data";
+}
+
+// Least-squares fit over the sample window. Times are taken relative to the
+// newest sample so the intercept is the smoothed "current" temperature.
+static void updateModel(FanController& fc) {
+  int newest = (fc.head + FAN_HISTORY_SIZE - 1) % FAN_HISTORY_SIZE;
+  unsigned long tNewest = fc.times[newest];
+
+  float sumX = 0, sumY = 0, sumXX = 0, sumXY = 0;
+  for (int i = 0; i < fc.count; i++) {
+    int idx = (fc.head + FAN_HISTORY_SIZE - 1 - i) % FAN_HISTORY_SIZE;
+    float x = -(float)(tNewest - fc.times[idx]) / 60000.0f;  // minutes, <= 0
+    float y = fc.temps[idx];
+    sumX += x;
+    sumY += y;
+    sumXX += x * x;
+    sumXY += x * y;
+  }
+
+  float n = (float)fc.count;
+  float denom = n * sumXX - sumX * sumX;
+  if (fc.count < 2 || denom < 1e-6f) {
+    fc.slope = 0;
+    fc.smoothedTemp = fc.temps[newest];
+  } else {
+    fc.slope = (n * sumXY - sumX * sumY) / denom;
+    fc.smoothedTemp = (sumY - fc.slope * sumX) / n;
+  }
+
+  fc.predictedTemp = fc.smoothedTemp + fc.slope * (FAN_PREDICT_HORIZON_S / 60.0f);
+}
+
+void fanControllerAddSample(FanController& fc, float temperature, unsigned long now) {
+  // Skip DHT failures (-999 / NaN) so they never reach the model
+  if (temperature != temperature || temperature <= -100) return;
+
+  // The same reading can be offered twice (e.g. manual override re-runs control)
+  if (fc.count > 0) {
+    int newest = (fc.head + FAN_HISTORY_SIZE - 1) % FAN_HISTORY_SIZE;
+    if (fc.times[newest] == now) return;
+  }
+
+  fc.temps[fc.head] = temperature;
+  fc.times[fc.head] = now;
+  fc.head = (fc.head + 1) % FAN_HISTORY_SIZE;
+  if (fc.count < FAN_HISTORY_SIZE) fc.count++;
+
+  updateModel(fc);
+}
+
+bool fanControllerDesiredState(FanController& fc, unsigned long now) {
+  if (fc.count == 0) {
+    fc.reason = "no_data";
+    return fc.fanOn;
+  }
+
+  bool slopeTrusted = fc.count >= FAN_MIN_SLOPE_SAMPLES;
+  bool want = fc.fanOn;
+
+  if (!fc.fanOn) {
+    if (fc.smoothedTemp >= FAN_ON_TEMP) {
+      want = true;
+      fc.reason = "temperature_high";
+    } else if (slopeTrusted && fc.slope > 0 && fc.predictedTemp >= FAN_ON_TEMP) {
+      want = true;
+      fc.reason = "predicted_high";
+    } else {
+      fc.reason = "temperature_ok";
+    }
+  } else {
+    if (fc.smoothedTemp <= FAN_OFF_TEMP) {
+      want = false;
+      fc.reason = "temperature_ok";
+    } else {
+      fc.reason = "temperature_high";
+    }
+  }
+
+  // Anti-chatter: hold the relay until the minimum dwell time has passed
+  if (want != fc.fanOn && fanControllerDwellRemaining(fc, now) > 0) {
+    fc.reason = fc.fanOn ? "min_on_time" : "min_off_time";
+    return fc.fanOn;
+  }
+
+  return want;
+}
+
+unsigned long fanControllerDwellRemaining(const FanController& fc, unsigned long now) {
+  if (fc.actuations == 0) return 0;  // Nothing to protect before the first switch
+
+  unsigned long minDwell = fc.fanOn ? FAN_MIN_ON_TIME_MS : FAN_MIN_OFF_TIME_MS;
+  unsigned long elapsed = now - fc.lastSwitchTime;
+  return elapsed >= minDwell ? 0 : minDwell - elapsed;
+}
+
+void fanControllerSetRelay(FanController& fc, bool on, unsigned long now) {
+  if (on == fc.fanOn) return;
+
+  if (fc.fanOn) {
+    fc.accumulatedOnTime += now - fc.onSince;
+  } else {
+    fc.onSince = now;
+  }
+
+  fc.fanOn = on;
+  fc.lastSwitchTime = now;
+  fc.actuations++;
+}
+
+unsigned long fanControllerOnTime(const FanController& fc, unsigned long now) {
+  return fc.accumulatedOnTime + (fc.fanOn ? now - fc.onSince : 0);
+}
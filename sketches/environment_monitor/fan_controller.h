@@ -0,0 +1,38 @@
+#ifndef FAN_CONTROLLER_H
+#define FAN_CONTROLLER_H
+
+// Predictive fan controller with relay anti-chatter protection.
+// Plain C++ with no Arduino dependencies so it can be compiled and
+// exercised on the host against a simulated room.
+
+#define FAN_HISTORY_SIZE 12     // 12 samples at 10 s = 2 minute slope window
+
+struct FanController {
+  // Recent temperature samples (ring buffer)
+  float temps[FAN_HISTORY_SIZE];
+  unsigned long times[FAN_HISTORY_SIZE];
+  int head;
+  int count;
+
+  // Model output
+  float smoothedTemp;           // regression value at the latest sample
+  float slope;                  // °C per minute
+  float predictedTemp;          // smoothedTemp projected FAN_PREDICT_HORIZON_S ahead
+
+  // Relay state and statistics
+  bool fanOn;
+  unsigned long lastSwitchTime;
+  unsigned long onSince;
+  unsigned long accumulatedOnTime;  // ms, completed ON periods only
+  unsigned long actuations;
+  const char* reason;
+};
+
+void fanControllerInit(FanController& fc, unsigned long now);
+void fanControllerAddSample(FanController& fc, float temperature, unsigned long now);
+bool fanControllerDesiredState(FanController& fc, unsigned long now);
+unsigned long fanControllerDwellRemaining(const FanController& fc, unsigned long now);
+void fanControllerSetRelay(FanController& fc, bool on, unsigned long now);
+unsigned long fanControllerOnTime(const FanController& fc, unsigned long now);
+
+#endif
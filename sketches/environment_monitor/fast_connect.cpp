@@ -0,0 +1,127 @@
+#include "fast_connect.h"
+#include "logger.h"
+#include <ESP8266WiFi.h>
+
+#define WIFI_CACHE_MAGIC  0xF1CAC4E1UL
+
+struct WifiCache {
+  uint32_t magic;
+  uint32_t ip;               // Lease, reused as a static address
+  uint32_t gateway;
+  uint32_t subnet;
+  uint32_t dns;
+  uint8_t bssid[6];
+  uint8_t channel;
+  uint8_t reserved;
+  uint32_t crc;
+};
+
+static_assert(sizeof(WifiCache) % 4 == 0, "RTC memory is written in 4-byte blocks");
+static_assert(RTC_WIFI_BLOCK * 4 + sizeof(WifiCache) <= 512, "WiFi cache does not fit in RTC user memory");
+
+static WifiCache cache;
+static bool attemptFast = false;
+static bool connected = false;
+static bool lastFast = false;
+static unsigned long startedAt = 0;      // wifiStart()
+static unsigned long attemptAt = 0;      // Current attempt, after a fallback
+static unsigned long lastConnectMs = 0;
+static unsigned long fallbacks = 0;
+static unsigned long phaseAt[BOOT_PHASES];
+
+static uint32_t crc32(const uint8_t* data, size_t length) {
+  uint32_t crc = 0xFFFFFFFF;
+  while (length--) {
+    crc ^= *data++;
+    for (int k = 0; k < 8; k++) crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+  }
+  return ~crc;
+}
+
+static bool loadCache() {
+  return ESP.rtcUserMemoryRead(RTC_WIFI_BLOCK, (uint32_t*)&cache, sizeof(cache)) &&
+         cache.magic == WIFI_CACHE_MAGIC && cache.crc == crc32((const uint8_t*)&cache, offsetof(WifiCache, crc));
+}
+
+static void storeCache() {
+  cache.magic = WIFI_CACHE_MAGIC;
+  cache.ip = (uint32_t)WiFi.localIP();
+  cache.gateway = (uint32_t)WiFi.gatewayIP();
+  cache.subnet = (uint32_t)WiFi.subnetMask();
+  cache.dns = (uint32_t)WiFi.dnsIP();
+  memcpy(cache.bssid, WiFi.BSSID(), sizeof(cache.bssid));
+  cache.channel = WiFi.channel();
+  cache.reserved = 0;
+  cache.crc = crc32((const uint8_t*)&cache, offsetof(WifiCache, crc));
+  ESP.rtcUserMemoryWrite(RTC_WIFI_BLOCK, (uint32_t*)&cache, sizeof(cache));
+}
+
+static void beginScan() {
+  attemptFast = false;
+  attemptAt = millis();
+  WiFi.config(IPAddress(), IPAddress(), IPAddress());   // Back to DHCP
+  WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+}
+
+void wifiStart() {
+  WiFi.persistent(false);
+  WiFi.mode(WIFI_STA);
+  connected = false;
+  startedAt = millis();
+  if (!loadCache()) {
+    beginScan();
+    return;
+  }
+  attemptFast = true;
+  attemptAt = startedAt;
+  WiFi.config(IPAddress(cache.ip), IPAddress(cache.gateway), IPAddress(cache.subnet), IPAddress(cache.dns));
+  WiFi.begin(WIFI_SSID, WIFI_PASSWORD, cache.channel, cache.bssid, true);
+}
+
+bool wifiPoll() {
+  if (WiFi.status() == WL_CONNECTED) {
+    if (!connected) {
+      connected = true;
+      lastFast = attemptFast;
+      lastConnectMs = millis() - startedAt;
+      bootMark(BOOT_WIFI);
+      storeCache();   // The AP may have changed even on the fast path
+    }
+    return true;
+  }
+  if (attemptFast && millis() - attemptAt > WIFI_FAST_TIMEOUT_MS) {
+    LOG_WARN(LOG_SYSTEM, "Cached access point did not answer, scanning");
+    fallbacks++;
+    cache.magic = 0;
+    ESP.rtcUserMemoryWrite(RTC_WIFI_BLOCK, (uint32_t*)&cache, sizeof(cache));
+    WiFi.disconnect();
+    beginScan();
+  }
+  return false;
+}
+
+bool wifiConnectedFast() {
+  return lastFast;
+}
+
+unsigned long wifiConnectMs() {
+  return lastConnectMs;
+}
+
+unsigned long wifiFallbacks() {
+  return fallbacks;
+}
+
+void bootMark(BootPhase phase) {
+  if (phaseAt[phase] == 0) phaseAt[phase] = millis();
+}
+
+void bootReport(JsonObject boot) {
+  boot["setupMs"] = phaseAt[BOOT_SETUP];
+  boot["wifiMs"] = phaseAt[BOOT_WIFI];
+  boot["mqttMs"] = phaseAt[BOOT_MQTT];
+  boot["firstPublishMs"] = phaseAt[BOOT_FIRST_PUBLISH];
+  boot["wifiFast"] = lastFast;
+  boot["wifiConnectMs"] = lastConnectMs;
+  boot["wifiFallbacks"] = fallbacks;
+}
@@ -0,0 +1,67 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <Arduino.h>
+#include <PubSubClient.h>
+#include "config.h"
+
+// Log levels - numeric so they can be compared in #if
+#define LOG_LEVEL_NONE   0
+#define LOG_LEVEL_ERROR  1
+#define LOG_LEVEL_WARN   2
+#define LOG_LEVEL_INFO   3
+#define LOG_LEVEL_DEBUG  4
+
+// Statements above this level are compiled out entirely
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_INFO
+#endif
+
+// Log modules for this node
+enum LogModule {
+  LOG_SYSTEM,
+  LOG_SENSOR,
+  LOG_DISPLAY,
+  LOG_MQTT,
+  LOG_FAN,
+  LOG_MODULE_COUNT
+};
+
+extern uint8_t logLevels[LOG_MODULE_COUNT];
+
+void logInit();
+void logWrite(uint8_t module, uint8_t level, PGM_P format, ...);
+void logDrain();
+bool logSetLevel(const char* moduleName, const char* levelName);
+void logPublish(PubSubClient& mqtt, const char* topic);
+unsigned long logDroppedBytes();
+
+// Runtime filter first so disabled messages cost one compare, no formatting
+#define LOG_AT(level, module, fmt, ...) \
+  do { if (logLevels[module] >= (level)) logWrite((module), (level), PSTR(fmt), ##__VA_ARGS__); } while (0)
+
+#if LOG_COMPILE_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(module, fmt, ...) LOG_AT(LOG_LEVEL_ERROR, module, fmt, ##__VA_ARGS__)
+#else
+#define LOG_ERROR(module, fmt, ...) do {} while (0)
+#endif
+
+#if LOG_COMPILE_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(module, fmt, ...) LOG_AT(LOG_LEVEL_WARN, module, fmt, ##__VA_ARGS__)
+#else
+#define LOG_WARN(module, fmt, ...) do {} while (0)
+#endif
+
+#if LOG_COMPILE_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(module, fmt, ...) LOG_AT(LOG_LEVEL_INFO, module, fmt, ##__VA_ARGS__)
+#else
+#define LOG_INFO(module, fmt, ...) do {} while (0)
+#endif
+
+#if LOG_COMPILE_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(module, fmt, ...) LOG_AT(LOG_LEVEL_DEBUG, module, fmt, ##__VA_ARGS__)
+#else
+#define LOG_DEBUG(module, fmt, ...) do {} while (0)
+#endif
+
+#endif
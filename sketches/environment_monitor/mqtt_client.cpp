@@ -2,6 +2,9 @@
 #include "config.h"
 #include "environment_data.h"
 #include "environmental_analysis.h"
+#include "logger.h"
+#include "env_history.h"
+#include "fast_connect.h"
 #include <ESP8266WiFi.h>
 #include <PubSubClient.h>
 #include <ArduinoJson.h>
@@ -11,64 +14,59 @@ extern PubSubClient client;
 extern EnvironmentData currentEnv;
 
 void setup_wifi() {
-  delay(10);
-  Serial.println();
-  Serial.print("Connecting to ");
-  Serial.println(WIFI_SSID);
+  bootMark(BOOT_SETUP);
+  LOG_INFO(LOG_SYSTEM, "Connecting to %s", WIFI_SSID);
 
-  WiFi.mode(WIFI_STA);
-  WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
-
-  while (WiFi.status() != WL_CONNECTED) {
-    delay(500);
-    Serial.print(".");
+  // Cached AP and lease first, full scan as the fallback (fast_connect.h)
+  wifiStart();
+  while (!wifiPoll()) {
+    delay(10);
+    logDrain();
   }
 
   randomSeed(micros());
-  Serial.println("");
-  Serial.println("WiFi connected");
-  Serial.print("IP address: ");
-  Serial.println(WiFi.localIP());
+  LOG_INFO(LOG_SYSTEM, "WiFi connected in %lu ms%s, IP address: %s", wifiConnectMs(),
+           wifiConnectedFast() ? " (cached AP)" : "", WiFi.localIP().toString().c_str());
 }
 
 void reconnect_mqtt() {
   while (!client.connected()) {
-    Serial.print("Attempting MQTT connection...");
+    LOG_INFO(LOG_MQTT, "Attempting MQTT connection...");
     
     // Create a random client ID
     String clientId = "BillE-Environment-";
     clientId += String(random(0xffff), HEX);
     
-    if (client.connect(clientId.c_str(), MQTT_USER, MQTT_PASSWORD)) {
-      Serial.println("connected");
+    // If we drop off the network the will clears our retained reading, so a
+    // restarting main brain never picks up a stale one
+    if (client.connect(clientId.c_str(), MQTT_USER, MQTT_PASSWORD, "bille/data/environment", 0, true, "")) {
+      LOG_INFO(LOG_MQTT, "MQTT connected");
+      bootMark(BOOT_MQTT);
       
       // Subscribe to control topics
       client.subscribe("bille/environment/request");
       client.subscribe("bille/session/state");
       client.subscribe("bille/commands/fan");
+      client.subscribe("bille/commands/log");
+      client.subscribe("bille/commands/history");
       
       // Announce presence
       client.publish("bille/status/environment", "online", true);
       
     } else {
-      Serial.print("failed, rc=");
-      Serial.print(client.state());
-      Serial.println(" try again in 5 seconds");
+      LOG_WARN(LOG_MQTT, "MQTT connect failed, rc=%d, try again in 5 seconds", client.state());
+      logDrain();
       delay(5000);
     }
   }
 }
 
 void mqtt_callback(char* topic, byte* payload, unsigned int length) {
-  Serial.print("Message arrived [");
-  Serial.print(topic);
-  Serial.print("] ");
-  
   String message;
   for (int i = 0; i < length; i++) {
     message += (char)payload[i];
   }
-  Serial.println(message);
+  LOG_DEBUG(LOG_MQTT, "Message arrived [%s] %s", topic, message.c_str());
   
   // Handle session state updates
   if (String(topic) == "bille/session/state") {
@@ -79,8 +77,8 @@ void mqtt_callback(char* topic, byte* payload, unsigned int length) {
     String userId = doc["userId"].as<String>();
     
     // Update local session state
-    Serial.printf("Session update: %s for user %s\n", 
-                  sessionActive ? "ACTIVE" : "INACTIVE", userId.c_str());
+    LOG_INFO(LOG_MQTT, "Session update: %s for user %s",
+             sessionActive ? "ACTIVE" : "INACTIVE", userId.c_str());
   }
   
   // Handle fan control commands
@@ -92,17 +90,44 @@ void mqtt_callback(char* topic, byte* payload, unsigned int length) {
     
     if (command == "manual_on") {
       setFanManualOverride(true, true);
-      Serial.println("Fan manual override: ON");
     } else if (command == "manual_off") {
       setFanManualOverride(true, false);
-      Serial.println("Fan manual override: OFF");
     } else if (command == "auto") {
       setFanManualOverride(false, false);
-      Serial.println("Fan set to automatic mode");
     } else if (command == "status") {
       publishFanStatus();
     }
   }
+  
+  // Handle log commands (dump ring buffer / change module level)
+  else if (String(topic) == "bille/commands/log") {
+    StaticJsonDocument<200> doc;
+    deserializeJson(doc, message);
+    
+    const char* node = doc["node"] | "all";
+    if (strcmp(node, "all") == 0 || strcmp(node, LOG_NODE_NAME) == 0) {
+      String command = doc["command"].as<String>();
+      
+      if (command == "dump") {
+        logPublish(client, "bille/logs/" LOG_NODE_NAME);
+      } else if (command == "level") {
+        if (!logSetLevel(doc["module"] | "all", doc["level"] | "info")) {
+          LOG_WARN(LOG_SYSTEM, "Unknown log module or level");
+        }
+      }
+    }
+  }
+  
+  // Handle history upload requests
+  else if (String(topic) == "bille/commands/history") {
+    StaticJsonDocument<200> doc;
+    deserializeJson(doc, message);
+    
+    const char* node = doc["node"] | "all";
+    if (strcmp(node, "all") == 0 || strcmp(node, LOG_NODE_NAME) == 0) {
+      envHistoryPublish(client, "bille/data/environment_history", doc["blocks"] | ENV_HISTORY_UPLOAD_BLOCKS);
+    }
+  }
 }
 
 void publishEnvironmentalData() {
@@ -128,7 +153,23 @@ void publishEnvironmentalData() {
   
   String jsonString;
   serializeJson(doc, jsonString);
-  client.publish("bille/data/environment", jsonString.c_str());
+  // Retained: a (re)connecting main brain gets it on subscribe
+  client.publish("bille/data/environment", jsonString.c_str(), true);
+  bootMark(BOOT_FIRST_PUBLISH);
   
-  Serial.println("Environmental data published to MQTT");
-}
\ No newline at end of file
+  LOG_DEBUG(LOG_MQTT, "Environmental data published to MQTT");
+}
+
+// Node health for HA and the host tools; boot timing included
+void publishEnvironmentStatus() {
+  StaticJsonDocument<384> doc;
+  doc["nodeType"] = "ENVIRONMENT";
+  doc["timestamp"] = millis();
+  doc["wifiRssi"] = WiFi.RSSI();
+  doc["logDroppedBytes"] = logDroppedBytes();
+  bootReport(doc.createNestedObject("boot"));
+  
+  String jsonString;
+  serializeJson(doc, jsonString);
+  client.publish("bille/status/environment_system", jsonString.c_str());
+}
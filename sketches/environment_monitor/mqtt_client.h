@@ -7,5 +7,6 @@ void setup_wifi();
 void reconnect_mqtt();
 void mqtt_callback(char* topic, byte* payload, unsigned int length);
 void publishEnvironmentalData();
+void publishEnvironmentStatus();
 
 #endif
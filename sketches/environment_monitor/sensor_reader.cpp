@@ -1,5 +1,6 @@
 #include "sensor_reader.h"
 #include "config.h"
+#include "logger.h"
 #include <DHT.h>
 #include <Arduino.h>
 
@@ -24,7 +25,7 @@ void readEnvironment() {
   
   // Validate DHT readings
   if (isnan(currentEnv.temperature) || isnan(currentEnv.humidity)) {
-    Serial.println("Failed to read from DHT sensor!");
+    LOG_WARN(LOG_SENSOR, "Failed to read from DHT sensor!");
     currentEnv.temperature = -999;
     currentEnv.humidity = -999;
   }
@@ -0,0 +1,350 @@
+#include "series_codec.h"
+
+#include <string.h>
+
+static void putU16(uint8_t* p, uint16_t v) {
+  p[0] = v & 0xFF;
+  p[1] = v >> 8;
+}
+
+static uint16_t getU16(const uint8_t* p) {
+  return (uint16_t)p[0] | ((uint16_t)p[1] << 8);
+}
+
+static void putU64(uint8_t* p, uint64_t v) {
+  for (int i = 0; i < 8; i++) p[i] = (v >> (8 * i)) & 0xFF;
+}
+
+static uint64_t getU64(const uint8_t* p) {
+  uint64_t v = 0;
+  for (int i = 0; i < 8; i++) v |= (uint64_t)p[i] << (8 * i);
+  return v;
+}
+
+// ---- Bit stream --------------------------------------------------------
+
+// Appends the low n bits of value, MSB first. Bytes are cleared as they are
+// entered, so the buffer does not need to start zeroed.
+static bool putBits(uint8_t* buffer, size_t capacityBits, size_t& pos, uint64_t value, int n) {
+  if (pos + n > capacityBits) return false;
+  while (n > 0) {
+    int used = pos & 7;
+    int room = 8 - used;
+    int take = n < room ? n : room;
+    uint8_t bits = (value >> (n - take)) & ((1u << take) - 1);
+    uint8_t& byte = buffer[pos >> 3];
+    if (used == 0) byte = 0;
+    byte |= bits << (room - take);
+    pos += take;
+    n -= take;
+  }
+  return true;
+}
+
+static bool getBits(const uint8_t* buffer, size_t lengthBits, size_t& pos, int n, uint64_t& value) {
+  if (pos + n > lengthBits) return false;
+  value = 0;
+  while (n > 0) {
+    int used = pos & 7;
+    int room = 8 - used;
+    int take = n < room ? n : room;
+    uint8_t bits = (buffer[pos >> 3] >> (room - take)) & ((1u << take) - 1);
+    value = (value << take) | bits;
+    pos += take;
+    n -= take;
+  }
+  return true;
+}
+
+static bool getBit(const uint8_t* buffer, size_t lengthBits, size_t& pos, bool& bit) {
+  if (pos >= lengthBits) return false;
+  bit = (buffer[pos >> 3] >> (7 - (pos & 7))) & 1;
+  pos++;
+  return true;
+}
+
+// ---- Columns -----------------------------------------------------------
+
+static int valueWidth(uint8_t type) {
+  return type == CODEC_FLOAT ? 32 : 64;
+}
+
+static int windowBits(uint8_t type) {
+  return type == CODEC_FLOAT ? 5 : 6;
+}
+
+static uint64_t floatBits(uint8_t type, double value) {
+  if (type == CODEC_FLOAT) {
+    float f = (float)value;
+    uint32_t bits;
+    memcpy(&bits, &f, 4);
+    return bits;
+  }
+  uint64_t bits;
+  memcpy(&bits, &value, 8);
+  return bits;
+}
+
+static double bitsFloat(uint8_t type, uint64_t bits) {
+  if (type == CODEC_FLOAT) {
+    uint32_t b = (uint32_t)bits;
+    float f;
+    memcpy(&f, &b, 4);
+    return f;
+  }
+  double d;
+  memcpy(&d, &bits, 8);
+  return d;
+}
+
+static int64_t roundInt(double value) {
+  if (!(value == value) || value > 9.2e18 || value < -9.2e18) return 0;  // NaN / out of range
+  return (int64_t)(value < 0 ? value - 0.5 : value + 0.5);
+}
+
+static bool putFloat(CodecWriter& w, CodecColumnState& s, uint8_t type, double value, size_t capacityBits) {
+  int width = valueWidth(type);
+  uint64_t bits = floatBits(type, value);
+  if (w.count == 0) {
+    s.lastBits = bits;
+    s.windowValid = false;
+    return putBits(w.buffer, capacityBits, w.bitPos, bits, width);
+  }
+
+  uint64_t x = bits ^ s.lastBits;
+  s.lastBits = bits;
+  if (x == 0) return putBits(w.buffer, capacityBits, w.bitPos, 0, 1);
+
+  int leading = __builtin_clzll(x) - (64 - width);
+  int trailing = __builtin_ctzll(x);
+  if (s.windowValid && leading >= s.leading && trailing >= s.trailing) {
+    int length = width - s.leading - s.trailing;
+    return putBits(w.buffer, capacityBits, w.bitPos, 0x2, 2) &&
+           putBits(w.buffer, capacityBits, w.bitPos, x >> s.trailing, length);
+  }
+
+  int length = width - leading - trailing;
+  int field = windowBits(type);
+  s.leading = leading;
+  s.trailing = trailing;
+  s.windowValid = true;
+  return putBits(w.buffer, capacityBits, w.bitPos, 0x3, 2) &&
+         putBits(w.buffer, capacityBits, w.bitPos, leading, field) &&
+         putBits(w.buffer, capacityBits, w.bitPos, length - 1, field) &&
+         putBits(w.buffer, capacityBits, w.bitPos, x >> trailing, length);
+}
+
+static bool getFloat(CodecReader& r, CodecColumnState& s, uint8_t type, double& value) {
+  size_t lengthBits = r.length * 8;
+  int width = valueWidth(type);
+  uint64_t bits;
+  if (r.index == 0) {
+    if (!getBits(r.buffer, lengthBits, r.bitPos, width, bits)) return false;
+    s.lastBits = bits;
+    s.windowValid = false;
+    value = bitsFloat(type, bits);
+    return true;
+  }
+
+  bool changed, newWindow;
+  if (!getBit(r.buffer, lengthBits, r.bitPos, changed)) return false;
+  if (changed) {
+    if (!getBit(r.buffer, lengthBits, r.bitPos, newWindow)) return false;
+    if (newWindow) {
+      uint64_t leading, length;
+      int field = windowBits(type);
+      if (!getBits(r.buffer, lengthBits, r.bitPos, field, leading) ||
+          !getBits(r.buffer, lengthBits, r.bitPos, field, length)) {
+        return false;
+      }
+      length++;
+      if (leading + length > (uint64_t)width) return false;
+      s.leading = (uint8_t)leading;
+      s.trailing = (uint8_t)(width - leading - length);
+      s.windowValid = true;
+    } else if (!s.windowValid) {
+      return false;
+    }
+    int length = width - s.leading - s.trailing;
+    if (!getBits(r.buffer, lengthBits, r.bitPos, length, bits)) return false;
+    s.lastBits ^= bits << s.trailing;
+  }
+  value = bitsFloat(type, s.lastBits);
+  return true;
+}
+
+static bool putInt(CodecWriter& w, CodecColumnState& s, double value, size_t capacityBits) {
+  int64_t v = roundInt(value);
+  int64_t delta = (int64_t)((uint64_t)v - s.lastBits);
+  uint64_t zigzag = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+  s.lastBits = (uint64_t)v;
+  if (zigzag == 0) return putBits(w.buffer, capacityBits, w.bitPos, 0, 1);
+  if (!putBits(w.buffer, capacityBits, w.bitPos, 1, 1)) return false;
+  do {
+    uint64_t group = zigzag & 0x7F;
+    zigzag >>= 7;
+    if (!putBits(w.buffer, capacityBits, w.bitPos, zigzag ? (group | 0x80) : group, 8)) return false;
+  } while (zigzag);
+  return true;
+}
+
+static bool getInt(CodecReader& r, CodecColumnState& s, double& value) {
+  uint64_t zigzag = 0, group;
+  bool changed;
+  if (!getBit(r.buffer, r.length * 8, r.bitPos, changed)) return false;
+  for (int shift = 0; changed; shift += 7) {
+    if (shift > 63 || !getBits(r.buffer, r.length * 8, r.bitPos, 8, group)) return false;
+    zigzag |= (group & 0x7F) << shift;
+    if (!(group & 0x80)) break;
+  }
+  int64_t delta = (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+  s.lastBits += (uint64_t)delta;
+  value = (double)(int64_t)s.lastBits;
+  return true;
+}
+
+// ---- Timestamps --------------------------------------------------------
+
+struct TimeBucket {
+  uint8_t prefix;
+  uint8_t prefixBits;
+  uint8_t valueBits;
+};
+
+static const TimeBucket timeBuckets[] = {
+  {0x2, 2, 7}, {0x6, 3, 9}, {0xE, 4, 12}, {0x1E, 5, 32},
+};
+
+static bool putTime(CodecWriter& w, int64_t timeMs, size_t capacityBits) {
+  int64_t delta = (int64_t)((uint64_t)timeMs - (uint64_t)w.lastTime);
+  int64_t dod = (int64_t)((uint64_t)delta - (uint64_t)w.lastDelta);
+  w.lastTime = timeMs;
+  w.lastDelta = delta;
+  if (dod == 0) return putBits(w.buffer, capacityBits, w.bitPos, 0, 1);
+
+  // Bucket n holds [-(2^(bits-1) - 1), 2^(bits-1)], stored offset to unsigned
+  for (const TimeBucket& b : timeBuckets) {
+    int64_t low = -(((int64_t)1 << (b.valueBits - 1)) - 1);
+    int64_t high = (int64_t)1 << (b.valueBits - 1);
+    if (dod < low || dod > high) continue;
+    return putBits(w.buffer, capacityBits, w.bitPos, b.prefix, b.prefixBits) &&
+           putBits(w.buffer, capacityBits, w.bitPos, (uint64_t)(dod - low), b.valueBits);
+  }
+  return putBits(w.buffer, capacityBits, w.bitPos, 0x1F, 5) &&
+         putBits(w.buffer, capacityBits, w.bitPos, (uint64_t)dod, 64);
+}
+
+static bool getTime(CodecReader& r, int64_t& timeMs) {
+  size_t lengthBits = r.length * 8;
+  int ones = 0;
+  bool bit = true;
+  while (ones < 5) {
+    if (!getBit(r.buffer, lengthBits, r.bitPos, bit)) return false;
+    if (!bit) break;
+    ones++;
+  }
+
+  int64_t dod = 0;
+  uint64_t raw;
+  if (ones == 5) {
+    if (!getBits(r.buffer, lengthBits, r.bitPos, 64, raw)) return false;
+    dod = (int64_t)raw;
+  } else if (ones > 0) {
+    const TimeBucket& b = timeBuckets[ones - 1];
+    if (!getBits(r.buffer, lengthBits, r.bitPos, b.valueBits, raw)) return false;
+    dod = (int64_t)raw - (((int64_t)1 << (b.valueBits - 1)) - 1);
+  }
+  r.lastDelta = (int64_t)((uint64_t)r.lastDelta + (uint64_t)dod);
+  r.lastTime = (int64_t)((uint64_t)r.lastTime + (uint64_t)r.lastDelta);
+  timeMs = r.lastTime;
+  return true;
+}
+
+// ---- Blocks ------------------------------------------------------------
+
+bool codecBegin(CodecWriter& w, uint8_t* buffer, size_t capacity, uint8_t columns, const uint8_t* types) {
+  if (columns == 0 || columns > CODEC_MAX_COLUMNS || capacity < CODEC_HEADER_SIZE(columns)) return false;
+  w.buffer = buffer;
+  w.capacity = capacity;
+  w.bitPos = CODEC_HEADER_SIZE(columns) * 8;
+  w.count = 0;
+  w.columns = columns;
+  w.lastTime = 0;
+  w.lastDelta = 0;
+  memset(w.state, 0, sizeof(w.state));
+
+  buffer[0] = CODEC_FORMAT_VERSION;
+  buffer[1] = columns;
+  putU16(buffer + 2, 0);
+  putU64(buffer + 4, 0);
+  for (uint8_t i = 0; i < columns; i++) {
+    w.types[i] = types[i] <= CODEC_INT ? types[i] : CODEC_DOUBLE;
+    buffer[12 + i] = w.types[i];
+  }
+  return true;
+}
+
+bool codecAdd(CodecWriter& w, int64_t timeMs, const double* values) {
+  if (w.count == 0xFFFF) return false;
+  size_t capacityBits = w.capacity * 8;
+  CodecWriter saved = w;
+
+  bool ok = true;
+  if (w.count == 0) {
+    putU64(w.buffer + 4, (uint64_t)timeMs);
+    w.lastTime = timeMs;
+  } else {
+    ok = putTime(w, timeMs, capacityBits);
+  }
+  for (uint8_t i = 0; ok && i < w.columns; i++) {
+    ok = w.types[i] == CODEC_INT ? putInt(w, w.state[i], values[i], capacityBits)
+                                 : putFloat(w, w.state[i], w.types[i], values[i], capacityBits);
+  }
+
+  if (!ok) {
+    w = saved;
+    // Bits past the restored position in its byte are left over from the attempt
+    if (w.bitPos & 7) w.buffer[w.bitPos >> 3] &= ~(0xFF >> (w.bitPos & 7));
+    return false;
+  }
+  w.count++;
+  return true;
+}
+
+size_t codecFinish(CodecWriter& w) {
+  putU16(w.buffer + 2, w.count);
+  return (w.bitPos + 7) / 8;
+}
+
+bool codecOpen(CodecReader& r, const uint8_t* buffer, size_t length) {
+  if (length < CODEC_HEADER_SIZE(1) || buffer[0] != CODEC_FORMAT_VERSION) return false;
+  uint8_t columns = buffer[1];
+  if (columns == 0 || columns > CODEC_MAX_COLUMNS || length < CODEC_HEADER_SIZE(columns)) return false;
+  r.buffer = buffer;
+  r.length = length;
+  r.bitPos = CODEC_HEADER_SIZE(columns) * 8;
+  r.count = getU16(buffer + 2);
+  r.index = 0;
+  r.columns = columns;
+  r.lastTime = (int64_t)getU64(buffer + 4);
+  r.lastDelta = 0;
+  memset(r.state, 0, sizeof(r.state));
+  for (uint8_t i = 0; i < columns; i++) {
+    if (buffer[12 + i] > CODEC_INT) return false;
+    r.types[i] = buffer[12 + i];
+  }
+  return true;
+}
+
+bool codecNext(CodecReader& r, int64_t& timeMs, double* values) {
+  if (r.index >= r.count) return false;
+  if (r.index == 0) timeMs = r.lastTime;
+  else if (!getTime(r, timeMs)) return false;
+  for (uint8_t i = 0; i < r.columns; i++) {
+    bool ok = r.types[i] == CODEC_INT ? getInt(r, r.state[i], values[i])
+                                      : getFloat(r, r.state[i], r.types[i], values[i]);
+    if (!ok) return false;
+  }
+  r.index++;
+  return true;
+}
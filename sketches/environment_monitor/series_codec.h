@@ -0,0 +1,79 @@
+#ifndef SERIES_CODEC_H
+#define SERIES_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Gorilla-style block codec for slowly changing, regularly sampled series:
+// one timestamp column plus up to CODEC_MAX_COLUMNS value columns. Used for
+// the environment monitor's on-flash history and by the host tools
+// (tools/codec) for archives - host builds compile this file in place.
+//
+// Header, little-endian:
+//   u8 version, u8 column count, u16 sample count, i64 time of sample 0 (ms),
+//   u8 column type per column
+// Then a bit stream, MSB first, per sample:
+//   time (not for sample 0): delta-of-delta against the previous interval
+//     '0' same interval, '10' + 7 bits, '110' + 9, '1110' + 12, '11110' + 32,
+//     '11111' + 64 (two's complement)
+//   each column:
+//     FLOAT/DOUBLE  first sample raw bits, then XOR with the previous value:
+//                   '0' unchanged, '10' + meaningful bits inside the previous
+//                   window, '11' + leading zeros + (length - 1) + meaningful
+//                   bits (5/5 bits for floats, 6/6 for doubles)
+//     INT           delta from the previous value (0 before the first):
+//                   '0' unchanged, '1' + zigzag varint in 7-bit groups
+//                   (continuation bit first)
+
+#define CODEC_FORMAT_VERSION 1
+#define CODEC_MAX_COLUMNS    8
+#define CODEC_HEADER_SIZE(columns) ((size_t)12 + (columns))
+
+#define CODEC_FLOAT   0   // 32-bit float, the sensors' own precision
+#define CODEC_DOUBLE  1
+#define CODEC_INT     2   // Whole numbers (counts, lux, booleans)
+
+struct CodecColumnState {
+  uint64_t lastBits;      // Float bits, or the integer value
+  uint8_t leading;        // XOR window of the previous changed value
+  uint8_t trailing;
+  bool windowValid;
+};
+
+struct CodecWriter {
+  uint8_t* buffer;
+  size_t capacity;
+  size_t bitPos;
+  uint16_t count;
+  uint8_t columns;
+  uint8_t types[CODEC_MAX_COLUMNS];
+  int64_t lastTime;
+  int64_t lastDelta;
+  CodecColumnState state[CODEC_MAX_COLUMNS];
+};
+
+struct CodecReader {
+  const uint8_t* buffer;
+  size_t length;
+  size_t bitPos;
+  uint16_t count;
+  uint16_t index;
+  uint8_t columns;
+  uint8_t types[CODEC_MAX_COLUMNS];
+  int64_t lastTime;
+  int64_t lastDelta;
+  CodecColumnState state[CODEC_MAX_COLUMNS];
+};
+
+// False if the buffer cannot hold the header or columns is out of range
+bool codecBegin(CodecWriter& w, uint8_t* buffer, size_t capacity, uint8_t columns, const uint8_t* types);
+// False if the sample does not fit (or the block is full) - the writer is left unchanged
+bool codecAdd(CodecWriter& w, int64_t timeMs, const double* values);
+// Writes the sample count; returns the block length in bytes
+size_t codecFinish(CodecWriter& w);
+
+bool codecOpen(CodecReader& r, const uint8_t* buffer, size_t length);
+// values needs r.columns entries; false at the end of the block or on truncation
+bool codecNext(CodecReader& r, int64_t& timeMs, double* values);
+
+#endif
@@ -0,0 +1,81 @@
+#include "bio_history.h"
+#include "data_structures.h"
+#include "logger.h"
+
+static unsigned long batchesReceived = 0;
+static unsigned long batchGaps = 0;       // Batches missing between sequence numbers
+static unsigned long senderRestarts = 0;  // Wearable reboots seen in the sequence
+static uint16_t lastSeq = 0;
+static uint16_t lastBoot = 0;
+
+static const char* const activityNames[] = { "Sitting", "Still", "Moving", "Walking", "Running" };
+
+// Decodes straight from the MQTT payload into the history ring and copies
+// the newest sample to newest. bioData is left to applyBatchSample(), in
+// loop(), so it stays in arrival order with the JSON readings. Returns
+// samples added, -1 on error.
+int ingestBiometricBatch(const uint8_t* payload, unsigned int length, BatchRecord& newest) {
+  BatchReader reader;
+  if (!batchOpen(reader, payload, length)) {
+    LOG_WARN(LOG_MQTT, "Biometric batch rejected (%u bytes, version %u)", length, length ? payload[0] : 0);
+    return -1;
+  }
+
+  // Sequence numbers only compare within one wearable boot. A new boot ID,
+  // or (from version 1 senders, which all report boot 0) a sequence that
+  // went backwards or leapt half the range, is a restart: resync, no gaps
+  if (batchesReceived > 0) {
+    int16_t ahead = (int16_t)(reader.seq - (uint16_t)(lastSeq + 1));
+    if (reader.boot != lastBoot || ahead < -1) {
+      senderRestarts++;
+      LOG_INFO(LOG_MQTT, "Wearable restarted (boot %04x, batch %u), sequence resynced", reader.boot, reader.seq);
+    } else if (ahead == -1) {
+      LOG_DEBUG(LOG_MQTT, "Duplicate biometric batch %u ignored", reader.seq);
+      return 0;
+    } else {
+      batchGaps += ahead;
+    }
+  }
+  lastSeq = reader.seq;
+  lastBoot = reader.boot;
+  batchesReceived++;
+
+  BatchRecord record;
+  int added = 0;
+  while (batchNext(reader, record)) {
+    bioHistory[bioHistoryCount % BIO_HISTORY_SIZE] = record;
+    bioHistoryCount++;
+    added++;
+  }
+  if (added < reader.count) {
+    LOG_WARN(LOG_MQTT, "Biometric batch %u truncated at %d/%d", reader.seq, added, reader.count);
+  }
+  if (added == 0) return 0;
+
+  newest = record;
+  LOG_DEBUG(LOG_MQTT, "Biometric batch %u: %d samples", reader.seq, added);
+  return added;
+}
+
+// Idle time travels instead of the wearable's clock, so lastMovement lands
+// in our millis() (late by the upload delay of the newest sample)
+void applyBatchSample(const BatchRecord& record, unsigned long receivedAt) {
+  bioData.activity = record.activity < 5 ? activityNames[record.activity] : "Unknown";
+  bioData.stepCount = record.steps;
+  bioData.acceleration = record.accelMg / 1000.0;
+  bioData.lastMovement = receivedAt - record.idleSeconds * 1000UL;
+  bioData.lastUpdate = receivedAt;
+  bioData.dataAvailable = true;
+}
+
+unsigned long bioBatchesReceived() {
+  return batchesReceived;
+}
+
+unsigned long bioBatchGaps() {
+  return batchGaps;
+}
+
+unsigned long bioBatchRestarts() {
+  return senderRestarts;
+}
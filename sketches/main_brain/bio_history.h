@@ -0,0 +1,19 @@
+#ifndef BIO_HISTORY_H
+#define BIO_HISTORY_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "biometric_batch.h"
+
+// Wearable samples unpacked from bille/data/biometric_batch, oldest first.
+// Positions are running counts, the slot is index % BIO_HISTORY_SIZE.
+extern BatchRecord bioHistory[BIO_HISTORY_SIZE];
+extern unsigned long bioHistoryCount;
+
+int ingestBiometricBatch(const uint8_t* payload, unsigned int length, BatchRecord& newest);
+void applyBatchSample(const BatchRecord& record, unsigned long receivedAt);
+unsigned long bioBatchesReceived();
+unsigned long bioBatchGaps();
+unsigned long bioBatchRestarts();
+
+#endif
@@ -0,0 +1,128 @@
+#include "biometric_batch.h"
+
+static void putU16(uint8_t* p, uint16_t v) {
+  p[0] = v & 0xFF;
+  p[1] = v >> 8;
+}
+
+static void putU32(uint8_t* p, uint32_t v) {
+  for (int i = 0; i < 4; i++) p[i] = (v >> (8 * i)) & 0xFF;
+}
+
+static uint32_t getU32(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static bool putVarint(BatchWriter& w, uint32_t v) {
+  do {
+    if (w.length >= w.capacity) return false;
+    uint8_t b = v & 0x7F;
+    v >>= 7;
+    w.buffer[w.length++] = v ? (b | 0x80) : b;
+  } while (v);
+  return true;
+}
+
+static bool getVarint(BatchReader& r, uint32_t& v) {
+  v = 0;
+  for (int shift = 0; shift < 35; shift += 7) {
+    if (r.pos >= r.length) return false;
+    uint8_t b = r.buffer[r.pos++];
+    v |= (uint32_t)(b & 0x7F) << shift;
+    if (!(b & 0x80)) return true;
+  }
+  return false;
+}
+
+void batchBegin(BatchWriter& w, uint8_t* buffer, size_t capacity, uint16_t boot, uint16_t seq,
+                uint32_t timestamp, uint32_t steps) {
+  w.buffer = buffer;
+  w.capacity = capacity;
+  w.length = BATCH_HEADER_SIZE;
+  w.count = 0;
+  w.lastTimestamp = timestamp;
+  w.lastSteps = steps;
+
+  buffer[0] = BATCH_FORMAT_VERSION;
+  buffer[1] = 0;
+  putU16(buffer + 2, seq);
+  putU16(buffer + 4, boot);
+  putU32(buffer + 6, timestamp);
+  putU32(buffer + 10, steps);
+}
+
+// False if the sample does not fit - the writer is left unchanged
+bool batchAdd(BatchWriter& w, const BatchRecord& r) {
+  if (w.count == 255) return false;
+  size_t start = w.length;
+
+  uint32_t q = (r.accelMg * 64 + 500) / 1000;
+  int32_t stepDelta = (int32_t)(r.steps - w.lastSteps);
+  uint32_t zigzag = ((uint32_t)stepDelta << 1) ^ (uint32_t)(stepDelta >> 31);
+
+  bool ok = putVarint(w, r.timestamp - w.lastTimestamp);
+  if (ok && w.length + 2 <= w.capacity) {
+    w.buffer[w.length++] = q > 255 ? 255 : q;
+    w.buffer[w.length++] = r.activity;
+  } else {
+    ok = false;
+  }
+  ok = ok && putVarint(w, zigzag) && putVarint(w, r.idleSeconds);
+
+  if (!ok) {
+    w.length = start;
+    return false;
+  }
+  w.count++;
+  w.lastTimestamp = r.timestamp;
+  w.lastSteps = r.steps;
+  return true;
+}
+
+size_t batchFinish(BatchWriter& w) {
+  w.buffer[1] = w.count;
+  return w.length;
+}
+
+// Version 1 headers have no boot field - everything after seq sits 2 bytes earlier
+bool batchOpen(BatchReader& r, const uint8_t* buffer, size_t length) {
+  if (length < 1) return false;
+  size_t header = buffer[0] == 1 ? 12 : BATCH_HEADER_SIZE;
+  if ((buffer[0] != 1 && buffer[0] != BATCH_FORMAT_VERSION) || length < header) return false;
+  size_t fields = header - 8;
+  r.buffer = buffer;
+  r.length = length;
+  r.pos = header;
+  r.version = buffer[0];
+  r.count = buffer[1];
+  r.index = 0;
+  r.seq = buffer[2] | (buffer[3] << 8);
+  r.boot = header == BATCH_HEADER_SIZE ? buffer[4] | (buffer[5] << 8) : 0;
+  r.lastTimestamp = getU32(buffer + fields);
+  r.lastSteps = getU32(buffer + fields + 4);
+  return true;
+}
+
+// False at the end of the batch or on a truncated record
+bool batchNext(BatchReader& r, BatchRecord& out) {
+  if (r.index >= r.count) return false;
+
+  uint32_t dt, zigzag, idle;
+  if (!getVarint(r, dt)) return false;
+  if (r.pos + 2 > r.length) return false;
+  uint8_t q = r.buffer[r.pos++];
+  uint8_t activity = r.buffer[r.pos++];
+  if (!getVarint(r, zigzag) || !getVarint(r, idle)) return false;
+
+  int32_t stepDelta = (int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1);
+  r.lastTimestamp += dt;
+  r.lastSteps += stepDelta;
+
+  out.timestamp = r.lastTimestamp;
+  out.idleSeconds = idle;
+  out.accelMg = (uint16_t)((q * 1000 + 32) / 64);
+  out.steps = r.lastSteps;
+  out.activity = activity;
+  r.index++;
+  return true;
+}
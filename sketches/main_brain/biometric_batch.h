@@ -0,0 +1,65 @@
+#ifndef BIOMETRIC_BATCH_H
+#define BIOMETRIC_BATCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Binary record for bille/data/biometric_batch. The same file is kept in
+// wearable_tracker (encoder side) and main_brain (decoder side) - change
+// both together and bump BATCH_FORMAT_VERSION.
+//
+// Header, 14 bytes, little-endian:
+//   u8 version, u8 count, u16 seq, u16 boot, u32 timestamp of sample 0, u32 steps before sample 0
+// seq counts batches within one sender boot; boot is picked at random when
+// the sender starts, so a reboot is told apart from lost batches. Version 1
+// (12 bytes, no boot field) is still read, with boot 0.
+// Then per sample:
+//   varint   dt ms since the previous sample (0 for the first)
+//   u8       peak acceleration, 1/64 g (0-255 = 0-3.98 g)
+//   u8       activity code
+//   varint   step delta, zigzag (a session start resets the count)
+//   varint   seconds since last movement
+
+#define BATCH_FORMAT_VERSION   2
+#define BATCH_HEADER_SIZE      14
+#define BATCH_MAX_SAMPLE_SIZE  17   // 5 + 1 + 1 + 5 + 5 varint worst case
+
+struct BatchRecord {
+  uint32_t timestamp;       // Sender millis()
+  uint32_t idleSeconds;     // Since the last movement at that sample
+  uint16_t accelMg;         // Quantized to 1/64 g
+  uint32_t steps;
+  uint8_t activity;
+};
+
+struct BatchWriter {
+  uint8_t* buffer;
+  size_t capacity;
+  size_t length;
+  uint8_t count;
+  uint32_t lastTimestamp;
+  uint32_t lastSteps;
+};
+
+struct BatchReader {
+  const uint8_t* buffer;
+  size_t length;
+  size_t pos;
+  uint8_t version;
+  uint8_t count;
+  uint8_t index;
+  uint16_t seq;
+  uint16_t boot;
+  uint32_t lastTimestamp;
+  uint32_t lastSteps;
+};
+
+void batchBegin(BatchWriter& w, uint8_t* buffer, size_t capacity, uint16_t boot, uint16_t seq,
+                uint32_t timestamp, uint32_t steps);
+bool batchAdd(BatchWriter& w, const BatchRecord& r);
+size_t batchFinish(BatchWriter& w);
+
+bool batchOpen(BatchReader& r, const uint8_t* buffer, size_t length);
+bool batchNext(BatchReader& r, BatchRecord& out);
+
+#endif
@@ -14,6 +14,12 @@
 #define MQTT_USER       "bille_mqtt"
 #define MQTT_PASSWORD   "BillE2025_Secure!" 
 
+// Persistent MQTT session: with a fixed client ID and cleanSession off the
+// broker keeps our subscriptions and queues QoS 1 bille/commands/* while we
+// are away. Must be unique per installation.
+#define MQTT_CLIENT_ID      "BillE-MainBrain"
+#define MQTT_CLEAN_SESSION  false
+
 // Pin definitions
 #define RST_PIN D1
 #define SS_PIN D2
@@ -29,9 +35,34 @@
 #define TOPIC_STEPS "bille/sensors/steps"
 #define TOPIC_ACTIVITY "bille/sensors/activity"
 #define TOPIC_POMODORO_STATE "bille/pomodoro/state"
-#define TOPIC_POMODORO_TIME "bille/pomodoro/time_remaining"
 #define TOPIC_POMODORO_CYCLES "bille/pomodoro/cycles"
 #define TOPIC_SESSION_ACTIVE "bille/session/active"
 #define TOPIC_SESSION_USER "bille/session/user"
+#define TOPIC_TIME_PING "bille/time/ping"
+#define TOPIC_TIME_PONG "bille/time/pong"
+
+// Wearable sample history (bille/data/biometric_batch)
+#define MQTT_BUFFER_SIZE    640      // Fits a full 32-sample binary batch
+#define BIO_HISTORY_SIZE    240      // Samples kept, 20 min at one per 5 s
+
+// Warm restart (session_snapshot.h)
+#define RTC_SNAPSHOT_BLOCK  32       // Two snapshot copies from here; 0-31 are left to OTA (eboot)
+#define SNAPSHOT_REFRESH_MS 10000UL  // Re-saved this often during a session, on top of every transition
+
+// Fast WiFi connect (fast_connect.h)
+#define RTC_WIFI_BLOCK        96        // Cached AP and lease in RTC user memory; after the session snapshot
+#define WIFI_FAST_TIMEOUT_MS  1500      // Direct association allowed this long before a full scan
+
+// MQTT event queue (event_queue.h)
+#define EVENT_QUEUE_SIZE    16       // Power of two; retained data after a reconnect plus queued commands
+#define EVENT_BUDGET        4        // Events handled per loop() pass
+#define EVENT_BUDGET_MS     20       // ...or until this much time has gone, whichever is first
+
+// Logging
+#define LOG_NODE_NAME       "mainbrain"
+#define LOG_COMPILE_LEVEL   LOG_LEVEL_DEBUG  // Lower to LOG_LEVEL_WARN to strip the rest
+#define LOG_DEFAULT_LEVEL   LOG_LEVEL_INFO   // Runtime level per module, changeable over MQTT
+#define LOG_BUFFER_SIZE     2048             // In-RAM ring buffer, dumped on bille/commands/log
+#define LOG_SERIAL_ENABLED  1                // 0 for production: ring buffer + MQTT only
 
 #endif
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include "data_structures.h"
 #include "audio_system.h"
 #include "mqtt_handler.h"
+#include "logger.h"
 #include <Arduino.h>
 #include <ArduinoJson.h>
 #include <PubSubClient.h>
@@ -48,12 +49,12 @@ void analyzeBiometrics() {
     // Send MQTT movement reminder
     publishMovementReminder();
     
-    Serial.println("Biometric Alert: Time to move!");
+    LOG_INFO(LOG_ANALYSIS, "Biometric Alert: Time to move!");
   }
   
   // Check heart rate
   if (bioData.heartRate > 100 && sessionActive) {
-    Serial.println("Biometric Alert: High heart rate - take a break");
+    LOG_INFO(LOG_ANALYSIS, "Biometric Alert: High heart rate - take a break");
     
     // Publish health alert
     StaticJsonDocument<200> alertDoc;
@@ -0,0 +1,45 @@
+#include "event_queue.h"
+
+static_assert((EVENT_QUEUE_SIZE & (EVENT_QUEUE_SIZE - 1)) == 0, "EVENT_QUEUE_SIZE must be a power of two");
+
+static Event events[EVENT_QUEUE_SIZE];
+static volatile unsigned long eventHead = 0;   // Events pushed, written by the producer only
+static volatile unsigned long eventTail = 0;   // Events popped, written by the consumer only
+static unsigned int highWater = 0;
+static unsigned long overflows = 0;
+
+bool eventPush(const Event& event) {
+  unsigned long head = eventHead;
+  unsigned long depth = head - eventTail;
+  if (depth >= EVENT_QUEUE_SIZE) {
+    overflows++;
+    return false;
+  }
+  events[head % EVENT_QUEUE_SIZE] = event;
+  // The slot must be complete before the consumer can see it
+  __asm__ __volatile__("" ::: "memory");
+  eventHead = head + 1;
+  if (depth + 1 > highWater) highWater = depth + 1;
+  return true;
+}
+
+bool eventPop(Event& event) {
+  unsigned long tail = eventTail;
+  if (tail == eventHead) return false;
+  event = events[tail % EVENT_QUEUE_SIZE];
+  __asm__ __volatile__("" ::: "memory");
+  eventTail = tail + 1;
+  return true;
+}
+
+unsigned int eventQueueDepth() {
+  return eventHead - eventTail;
+}
+
+unsigned int eventQueueHighWater() {
+  return highWater;
+}
+
+unsigned long eventOverflows() {
+  return overflows;
+}
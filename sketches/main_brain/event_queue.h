@@ -0,0 +1,65 @@
+#ifndef EVENT_QUEUE_H
+#define EVENT_QUEUE_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "biometric_batch.h"
+
+// Incoming MQTT messages as small typed events. mqtt_callback() only parses
+// and pushes; loop() pops up to EVENT_BUDGET events per pass and does the
+// work (analysis, publishing, session audio) outside PubSubClient's
+// callback, so its receive buffer is never re-entered.
+//
+// Single producer (the callback) and single consumer (loop()). Positions
+// are running counts, the slot is pos % EVENT_QUEUE_SIZE, and each side
+// only writes its own position. A full queue drops the new event and
+// counts an overflow.
+
+enum EventType {
+  EVENT_ENVIRONMENT,      // bille/data/environment
+  EVENT_BIOMETRIC,        // bille/data/biometric
+  EVENT_BIOMETRIC_BATCH,  // Samples already in bioHistory; bioData and analysis pending
+  EVENT_SESSION_START,
+  EVENT_SESSION_STOP,
+  EVENT_POMODORO_SNOOZE,
+  EVENT_POMODORO_SKIP,
+  EVENT_LOG_DUMP,
+  EVENT_TIME_PING
+};
+
+struct Event {
+  uint8_t type;
+  unsigned long receivedAt;            // millis() in the callback
+  union {
+    struct {
+      float temperature;
+      float humidity;
+      int lightLevel;
+      int noiseLevel;
+      bool soundDetected;
+    } environment;
+    struct {
+      int heartRate;
+      int stepCount;
+      float acceleration;
+      unsigned long idleSeconds;       // Since the wearable last moved
+      char activity[12];
+    } biometric;
+    BatchRecord batch;                 // Newest sample of the batch
+    struct {
+      unsigned long id;
+      unsigned long t0;
+    } ping;
+    char userId[24];                   // EVENT_SESSION_START, truncated
+  };
+};
+
+// False if the queue is full; the event is dropped
+bool eventPush(const Event& event);
+bool eventPop(Event& event);
+
+unsigned int eventQueueDepth();
+unsigned int eventQueueHighWater();
+unsigned long eventOverflows();
+
+#endif
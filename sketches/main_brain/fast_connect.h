@@ -0,0 +1,40 @@
+#ifndef FAST_CONNECT_H
+#define FAST_CONNECT_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "config.h"
+
+// Fast WiFi (re)connect and boot timing. The same file is kept in all
+// three sketches - change them together.
+//
+// The last good access point (BSSID, channel) and DHCP lease live in RTC
+// user memory at RTC_WIFI_BLOCK (CRC checked). With a cache, wifiStart()
+// associates straight to that AP on that channel with the lease as a static
+// address: no scan, no DHCP. If that has not connected within
+// WIFI_FAST_TIMEOUT_MS, the cache is dropped and a normal scan with DHCP
+// follows. WiFi.persistent(false) keeps the SDK from rewriting its own
+// copy of the config in flash on every connect. RTC memory does not survive
+// power loss, so the first boot after one always scans.
+
+enum BootPhase {
+  BOOT_SETUP,           // Hardware set up, WiFi about to start
+  BOOT_WIFI,            // Associated with an address
+  BOOT_MQTT,            // First CONNACK
+  BOOT_FIRST_PUBLISH,   // First data out
+  BOOT_PHASES
+};
+
+void wifiStart();
+// Call while waiting; true once connected (the AP and lease are then cached)
+bool wifiPoll();
+bool wifiConnectedFast();          // The last connect skipped the scan
+unsigned long wifiConnectMs();     // Duration of the last connect, fallback included
+unsigned long wifiFallbacks();     // Cached APs that did not answer
+
+// millis() when each phase was first reached; later calls are ignored
+void bootMark(BootPhase phase);
+// Adds the boot phases and the last WiFi connect to a status document
+void bootReport(JsonObject boot);
+
+#endif
@@ -32,15 +32,20 @@ HARDWARE COMPONENTS:
 
 MQTT TOPICS (Published):
 - bille/session/state       - Session status and user info
-- bille/pomodoro/state      - Timer state and progress
+- bille/pomodoro/state      - Timer state, duration and deadline (retained, on change only)
 - bille/status/system       - System health monitoring
 - bille/alerts/movement     - Movement reminders
+- bille/logs/mainbrain      - Log ring buffer dump (on request)
+- bille/time/pong           - Clock ping reply with main brain millis()
 
 MQTT TOPICS (Subscribed):
 - bille/data/environment    - Environmental sensor data
 - bille/data/biometric      - Wearable tracker data
-- bille/commands/session    - Remote session control
-- bille/commands/pomodoro   - Remote timer control
+- bille/data/biometric_batch - Binary wearable sample batches (biometric_batch.h)
+- bille/commands/session    - Remote session control (QoS 1)
+- bille/commands/pomodoro   - Remote timer control (QoS 1)
+- bille/commands/log        - Log dump / per-module level commands (QoS 1)
+- bille/time/ping           - Clock offset requests from other nodes
 
 DEPENDENCIES:
 - MFRC522 Library
@@ -53,6 +58,10 @@ NETWORK CONFIGURATION:
 - WiFi SSID: TechLabNet
 - MQTT Broker: 192.168.1.107:1883
 - Authentication: bille_mqtt user
+- Client ID BillE-MainBrain with a persistent session (cleanSession off),
+  so QoS 1 commands sent while it is offline are delivered on reconnect
+- Incoming messages are queued as typed events (event_queue.h) and
+  handled from loop(), never inside the MQTT callback
 ===============================================================
 */
 
@@ -74,6 +83,9 @@ NETWORK CONFIGURATION:
 #include "audio_system.h"
 #include "mqtt_handler.h"
 #include "data_analysis.h"
+#include "logger.h"
+#include "bio_history.h"
+#include "session_snapshot.h"
 
 // Objects
 MFRC522 rfid(SS_PIN, RST_PIN);
@@ -84,6 +96,9 @@ PubSubClient mqttClient(espClient);
 // MQTT state
 bool mqttConnected = false;
 
+// Set when setup() resumed a session from the RTC snapshot
+bool resumedSession = false;
+
 // Session state - defined here, declared in data_structures.h
 bool sessionActive = false;
 String currentUser = "";
@@ -94,10 +109,21 @@ PomodoroSession pomodoro;
 EnvironmentData envData;
 BiometricData bioData;
 
+// Wearable sample history - defined here, declared in bio_history.h
+BatchRecord bioHistory[BIO_HISTORY_SIZE];
+unsigned long bioHistoryCount = 0;
+
 void setup() {
   Serial.begin(115200);
-  delay(1000);
-  Serial.println("Bill-E Main Brain with MQTT Starting...");
+  logInit();
+  
+  // A watchdog reset or crash mid-session picks up where it left off: no
+  // boot wait, no welcome screen, the timer keeps its remaining time
+  resumedSession = snapshotRestore();
+  if (!resumedSession) {
+    delay(1000);
+  }
+  LOG_INFO(LOG_SYSTEM, "Bill-E Main Brain with MQTT Starting...");
   
   // Initialize pins
   pinMode(BUZZER_PIN, OUTPUT);
@@ -123,18 +149,20 @@ void setup() {
   
   // Test RFID
   byte version = rfid.PCD_ReadRegister(rfid.VersionReg);
-  Serial.printf("RFID Version: 0x%02X\n", version);
+  LOG_INFO(LOG_RFID, "RFID Version: 0x%02X", version);
   
   // Setup WiFi and MQTT
   setup_wifi();
   mqttClient.setServer(MQTT_SERVER, MQTT_PORT);
   mqttClient.setCallback(mqtt_callback);
+  mqttClient.setBufferSize(MQTT_BUFFER_SIZE);
   
-  showWelcomeScreen();
+  if (!resumedSession) {
+    showWelcomeScreen();
+  }
   
-  Serial.println("Main Brain with MQTT Ready!");
-  Serial.print("IP Address: ");
-  Serial.println(WiFi.localIP());
+  LOG_INFO(LOG_SYSTEM, "Main Brain with MQTT Ready!");
+  LOG_INFO(LOG_SYSTEM, "IP Address: %s", WiFi.localIP().toString().c_str());
 }
 
 void loop() {
@@ -143,9 +171,20 @@ void loop() {
   }
   mqttClient.loop();
   
+  // Messages from the callback, handled within a per-pass budget
+  processMqttEvents();
+  
+  // The resumed deadline is in this boot's millis(); republish it once
+  if (resumedSession) {
+    publishSessionState();
+    publishPomodoroState();
+    resumedSession = false;
+  }
+  
   handleRFID();
   updatePomodoroTimer();
   updateDisplay();
+  snapshotTick();
   
   // Publish system status every 30 seconds
   static unsigned long lastStatusUpdate = 0;
@@ -154,13 +193,6 @@ void loop() {
     lastStatusUpdate = millis();
   }
   
-  // Publish Pomodoro state every 10 seconds during active session
-  static unsigned long lastPomodoroUpdate = 0;
-  if (sessionActive && millis() - lastPomodoroUpdate > 10000) {
-    publishPomodoroState();
-    lastPomodoroUpdate = millis();
-  }
-
   // Handle touch sensor for display switching
   static bool lastTouchForDisplay = false;
   bool currentTouch = digitalRead(TOUCH_SENSOR) == HIGH;
@@ -169,5 +201,8 @@ void loop() {
   }
   lastTouchForDisplay = currentTouch;
   
+  // Flush buffered log output without blocking on the UART
+  logDrain();
+  
   delay(100);
 }
@@ -4,130 +4,291 @@
 #include "pomodoro_timer.h"
 #include "data_analysis.h"
 #include "rfid_manager.h"
+#include "logger.h"
+#include "bio_history.h"
+#include "session_snapshot.h"
+#include "fast_connect.h"
+#include "event_queue.h"
 #include <ESP8266WiFi.h>
 #include <PubSubClient.h>
 #include <ArduinoJson.h>
 
 extern PubSubClient mqttClient;
 
-void setup_wifi() {
-  delay(10);
-  Serial.println();
-  Serial.print("Connecting to ");
-  Serial.println(WIFI_SSID);
+// Time-to-first-complete-state: from the start of a connect attempt until
+// both node data topics have arrived. The nodes publish them retained, so
+// with the nodes up this is one round trip after the SUBACK.
+#define STATE_ENVIRONMENT  0x01
+#define STATE_BIOMETRIC    0x02
+#define STATE_COMPLETE     (STATE_ENVIRONMENT | STATE_BIOMETRIC)
+
+static unsigned long connectStartedAt = 0;
+static uint8_t stateSeen = 0;
+static long stateSyncMs = -1;          // -1 until complete after the last connect
+static unsigned long mqttConnects = 0;
+
+// Event queue consumer (event_queue.h)
+static unsigned long eventsHandled = 0;
+static unsigned long maxEventWaitMs = 0;   // Longest time an event sat in the queue
+
+static void noteStateArrival(uint8_t part) {
+  if (stateSeen == STATE_COMPLETE) return;
+  stateSeen |= part;
+  if (stateSeen == STATE_COMPLETE) {
+    stateSyncMs = millis() - connectStartedAt;
+    LOG_INFO(LOG_MQTT, "Complete state %ld ms after connecting", stateSyncMs);
+  }
+}
 
-  WiFi.mode(WIFI_STA);
-  WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+void setup_wifi() {
+  bootMark(BOOT_SETUP);
+  LOG_INFO(LOG_SYSTEM, "Connecting to %s", WIFI_SSID);
 
-  while (WiFi.status() != WL_CONNECTED) {
-    delay(500);
-    Serial.print(".");
+  // Cached AP and lease first, full scan as the fallback (fast_connect.h)
+  wifiStart();
+  while (!wifiPoll()) {
+    delay(10);
+    logDrain();
   }
 
   randomSeed(micros());
-  Serial.println("");
-  Serial.println("WiFi connected");
-  Serial.print("IP address: ");
-  Serial.println(WiFi.localIP());
+  LOG_INFO(LOG_SYSTEM, "WiFi connected in %lu ms%s, IP address: %s", wifiConnectMs(),
+           wifiConnectedFast() ? " (cached AP)" : "", WiFi.localIP().toString().c_str());
 }
 
 void reconnect_mqtt() {
   while (!mqttClient.connected()) {
-    Serial.print("Attempting MQTT connection...");
+    LOG_INFO(LOG_MQTT, "Attempting MQTT connection...");
     
-    // Create a random client ID
-    String clientId = "BillE-MainBrain-";
-    clientId += String(random(0xffff), HEX);
+    connectStartedAt = millis();
+    stateSeen = 0;
+    stateSyncMs = -1;
     
-    if (mqttClient.connect(clientId.c_str(), MQTT_USER, MQTT_PASSWORD)) {
-      Serial.println("connected");
+    // Fixed client ID and a persistent session: commands sent while we were
+    // away are waiting at the broker. The will clears "online" if we drop.
+    if (mqttClient.connect(MQTT_CLIENT_ID, MQTT_USER, MQTT_PASSWORD,
+                           "bille/status/mainbrain", 0, true, "offline", MQTT_CLEAN_SESSION)) {
+      LOG_INFO(LOG_MQTT, "MQTT connected");
+      bootMark(BOOT_MQTT);
+      mqttConnects++;
       
-      // Subscribe to data topics from other nodes
+      // Node data is retained, so each subscription brings the latest value
+      // straight back - no request round to the nodes and no waiting for
+      // their next publish. Subscribing again on a kept session is harmless.
       mqttClient.subscribe("bille/data/environment");
       mqttClient.subscribe("bille/data/biometric");
-      mqttClient.subscribe("bille/commands/session");
-      mqttClient.subscribe("bille/commands/pomodoro");
+      mqttClient.subscribe("bille/data/biometric_batch");
+      mqttClient.subscribe("bille/commands/session", 1);
+      mqttClient.subscribe("bille/commands/pomodoro", 1);
+      mqttClient.subscribe("bille/commands/log", 1);
+      mqttClient.subscribe(TOPIC_TIME_PING);
       
       // Announce presence as main coordinator
       mqttClient.publish("bille/status/mainbrain", "online", true);
-      
-      // Request initial data from all nodes
-      mqttClient.publish("bille/environment/request", "data");
-      mqttClient.publish("bille/wearable/request", "data");
+      bootMark(BOOT_FIRST_PUBLISH);
       
     } else {
-      Serial.print("failed, rc=");
-      Serial.print(mqttClient.state());
-      Serial.println(" try again in 5 seconds");
+      LOG_WARN(LOG_MQTT, "MQTT connect failed, rc=%d, try again in 5 seconds", mqttClient.state());
+      logDrain();
       delay(5000);
     }
   }
 }
 
+// Runs inside mqttClient.loop(): parse into a typed event and return. The
+// work happens in processMqttEvents(), so nothing here publishes or blocks.
 void mqtt_callback(char* topic, byte* payload, unsigned int length) {
-  Serial.print("Message arrived [");
-  Serial.print(topic);
-  Serial.print("] ");
+  Event event;
+  event.receivedAt = millis();
+  
+  // A node cleared its retained data (its will fired); keep what we have
+  if (length == 0) {
+    return;
+  }
   
-  String message;
-  for (int i = 0; i < length; i++) {
-    message += (char)payload[i];
+  // Binary sample batches are decoded into bioHistory in place, no JSON;
+  // bioData and the analysis wait for the event, behind any queued
+  // (older) JSON reading
+  if (strcmp(topic, "bille/data/biometric_batch") == 0) {
+    if (ingestBiometricBatch(payload, length, event.batch) > 0) {
+      event.type = EVENT_BIOMETRIC_BATCH;
+      eventPush(event);
+    }
+    return;
   }
-  Serial.println(message);
+  
+  LOG_DEBUG(LOG_MQTT, "Message arrived [%s] %.*s", topic, (int)length, (const char*)payload);
   
   StaticJsonDocument<400> doc;
-  deserializeJson(doc, message);
+  if (deserializeJson(doc, (const char*)payload, length)) {
+    LOG_WARN(LOG_MQTT, "Unparseable message on %s", topic);
+    return;
+  }
+  
+  // Clock pings are answered on the next pass of loop(); a ping that waited
+  // behind other events only makes a slow round trip, which the pinging
+  // node discards
+  if (strcmp(topic, TOPIC_TIME_PING) == 0) {
+    event.type = EVENT_TIME_PING;
+    event.ping.id = doc["id"];
+    event.ping.t0 = doc["t0"];
+    eventPush(event);
+  }
   
   // Handle environmental data updates
-  if (String(topic) == "bille/data/environment") {
-    envData.temperature = doc["temperature"];
-    envData.humidity = doc["humidity"];
-    envData.lightLevel = doc["lightLevel"];
-    envData.noiseLevel = doc["noiseLevel"];
-    envData.soundDetected = doc["soundDetected"];
-    envData.lastUpdate = millis();
-    envData.dataAvailable = true;
-    
-    Serial.println("Environmental data updated via MQTT");
-    analyzeEnvironment();
+  else if (strcmp(topic, "bille/data/environment") == 0) {
+    event.type = EVENT_ENVIRONMENT;
+    event.environment.temperature = doc["temperature"];
+    event.environment.humidity = doc["humidity"];
+    event.environment.lightLevel = doc["lightLevel"];
+    event.environment.noiseLevel = doc["noiseLevel"];
+    event.environment.soundDetected = doc["soundDetected"];
+    noteStateArrival(STATE_ENVIRONMENT);
+    eventPush(event);
   }
   
   // Handle biometric data updates
-  else if (String(topic) == "bille/data/biometric") {
-    bioData.heartRate = doc["heartRate"];
-    bioData.activity = doc["activity"].as<String>();
-    bioData.stepCount = doc["stepCount"];
-    bioData.acceleration = doc["acceleration"];
-    bioData.lastMovement = doc["lastMovement"];
-    bioData.lastUpdate = millis();
-    bioData.dataAvailable = true;
-    
-    Serial.println("Biometric data updated via MQTT");
-    analyzeBiometrics();
+  else if (strcmp(topic, "bille/data/biometric") == 0) {
+    event.type = EVENT_BIOMETRIC;
+    event.biometric.heartRate = doc["heartRate"];
+    event.biometric.stepCount = doc["stepCount"];
+    event.biometric.acceleration = doc["acceleration"];
+    // Idle time rather than the wearable's lastMovement, which is in its own
+    // millis(); derived from its timestamp if an older wearable omits it
+    unsigned long timestamp = doc["timestamp"];
+    unsigned long lastMovement = doc["lastMovement"];
+    event.biometric.idleSeconds = doc["idleSeconds"] | (timestamp > lastMovement ? (timestamp - lastMovement) / 1000 : 0UL);
+    strlcpy(event.biometric.activity, doc["activity"] | "", sizeof(event.biometric.activity));
+    noteStateArrival(STATE_BIOMETRIC);
+    eventPush(event);
   }
   
   // Handle remote session commands (for web dashboard control)
-  else if (String(topic) == "bille/commands/session") {
-    String command = doc["command"];
-    if (command == "start" && !sessionActive) {
-      String userId = doc["userId"].as<String>();
-      startSession(userId);
-    } else if (command == "stop" && sessionActive) {
-      endSession();
+  else if (strcmp(topic, "bille/commands/session") == 0) {
+    const char* command = doc["command"] | "";
+    if (strcmp(command, "start") == 0) {
+      event.type = EVENT_SESSION_START;
+      strlcpy(event.userId, doc["userId"] | "", sizeof(event.userId));
+      eventPush(event);
+    } else if (strcmp(command, "stop") == 0) {
+      event.type = EVENT_SESSION_STOP;
+      eventPush(event);
     }
   }
   
   // Handle remote Pomodoro commands
-  else if (String(topic) == "bille/commands/pomodoro") {
-    String command = doc["command"];
-    if (command == "snooze" && sessionActive) {
-      snoozeBreak();
-    } else if (command == "skip" && sessionActive) {
-      transitionToNextState();
+  else if (strcmp(topic, "bille/commands/pomodoro") == 0) {
+    const char* command = doc["command"] | "";
+    if (strcmp(command, "snooze") == 0) {
+      event.type = EVENT_POMODORO_SNOOZE;
+      eventPush(event);
+    } else if (strcmp(command, "skip") == 0) {
+      event.type = EVENT_POMODORO_SKIP;
+      eventPush(event);
+    }
+  }
+  
+  // Handle log commands (dump ring buffer / change module level). A level
+  // change is applied here; the dump publishes, so it is queued.
+  else if (strcmp(topic, "bille/commands/log") == 0) {
+    const char* node = doc["node"] | "all";
+    if (strcmp(node, "all") == 0 || strcmp(node, LOG_NODE_NAME) == 0) {
+      const char* command = doc["command"] | "";
+      
+      if (strcmp(command, "dump") == 0) {
+        event.type = EVENT_LOG_DUMP;
+        eventPush(event);
+      } else if (strcmp(command, "level") == 0) {
+        if (!logSetLevel(doc["module"] | "all", doc["level"] | "info")) {
+          LOG_WARN(LOG_SYSTEM, "Unknown log module or level");
+        }
+      }
     }
   }
 }
 
+static void handleEvent(const Event& event) {
+  switch (event.type) {
+    case EVENT_ENVIRONMENT:
+      envData.temperature = event.environment.temperature;
+      envData.humidity = event.environment.humidity;
+      envData.lightLevel = event.environment.lightLevel;
+      envData.noiseLevel = event.environment.noiseLevel;
+      envData.soundDetected = event.environment.soundDetected;
+      envData.lastUpdate = event.receivedAt;
+      envData.dataAvailable = true;
+      LOG_DEBUG(LOG_MQTT, "Environmental data updated via MQTT");
+      analyzeEnvironment();
+      break;
+      
+    case EVENT_BIOMETRIC:
+      bioData.heartRate = event.biometric.heartRate;
+      bioData.activity = event.biometric.activity;
+      bioData.stepCount = event.biometric.stepCount;
+      bioData.acceleration = event.biometric.acceleration;
+      bioData.lastMovement = event.receivedAt - event.biometric.idleSeconds * 1000UL;   // Our millis(), as for batches
+      bioData.lastUpdate = event.receivedAt;
+      bioData.dataAvailable = true;
+      LOG_DEBUG(LOG_MQTT, "Biometric data updated via MQTT");
+      analyzeBiometrics();
+      break;
+      
+    case EVENT_BIOMETRIC_BATCH:
+      applyBatchSample(event.batch, event.receivedAt);
+      analyzeBiometrics();
+      break;
+      
+    // Session and timer commands are checked against the state when they
+    // run, not when they arrived
+    case EVENT_SESSION_START:
+      if (!sessionActive) {
+        startSession(String(event.userId));
+      }
+      break;
+      
+    case EVENT_SESSION_STOP:
+      if (sessionActive) {
+        endSession();
+      }
+      break;
+      
+    case EVENT_POMODORO_SNOOZE:
+      if (sessionActive) {
+        snoozeBreak();
+      }
+      break;
+      
+    case EVENT_POMODORO_SKIP:
+      if (sessionActive) {
+        transitionToNextState();
+      }
+      break;
+      
+    case EVENT_LOG_DUMP:
+      logPublish(mqttClient, "bille/logs/" LOG_NODE_NAME);
+      break;
+      
+    case EVENT_TIME_PING:
+      answerTimePing(event.ping.id, event.ping.t0);
+      break;
+  }
+}
+
+// Called from loop() after mqttClient.loop(). Stops after EVENT_BUDGET
+// events or EVENT_BUDGET_MS, whichever comes first; the rest wait for the
+// next pass.
+void processMqttEvents() {
+  unsigned long started = millis();
+  Event event;
+  for (int handled = 0; handled < EVENT_BUDGET && eventPop(event); handled++) {
+    unsigned long waited = millis() - event.receivedAt;
+    if (waited > maxEventWaitMs) maxEventWaitMs = waited;
+    handleEvent(event);
+    eventsHandled++;
+    if (millis() - started >= EVENT_BUDGET_MS) break;
+  }
+}
+
 void publishSessionState() {
   StaticJsonDocument<200> doc;
   doc["active"] = sessionActive;
@@ -142,16 +303,21 @@ void publishSessionState() {
   String jsonString;
   serializeJson(doc, jsonString);
   
-  mqttClient.publish("bille/session/state", jsonString.c_str());
+  // Retained so nodes that only connect periodically (low-power wearable) catch up
+  mqttClient.publish("bille/session/state", jsonString.c_str(), true);
   mqttClient.publish("bille/session/active", sessionActive ? "true" : "false");
   
-  Serial.println("Session state published to MQTT");
+  LOG_DEBUG(LOG_MQTT, "Session state published to MQTT");
 }
 
+// Published on state changes only. Consumers count down to the deadline,
+// which is in main brain millis() - see bille/time/ping for the offset.
 void publishPomodoroState() {
-  StaticJsonDocument<300> doc;
+  StaticJsonDocument<384> doc;
   doc["state"] = pomodoro.currentState;
-  doc["timeRemaining"] = (pomodoro.stateDuration - (millis() - pomodoro.stateStartTime)) / 1000;
+  doc["timeRemaining"] = getTimeRemainingSeconds();
+  doc["stateDuration"] = pomodoro.stateDuration / 1000;
+  doc["deadline"] = pomodoro.currentState == IDLE ? 0 : pomodoro.stateStartTime + pomodoro.stateDuration;
   doc["completedCycles"] = pomodoro.completedCycles;
   doc["snoozed"] = pomodoro.breakSnoozed;
   doc["snoozeCount"] = pomodoro.snoozeCount;
@@ -170,17 +336,16 @@ void publishPomodoroState() {
   String jsonString;
   serializeJson(doc, jsonString);
   
-  // Publish to multiple topics for HA sensors
-  mqttClient.publish("bille/pomodoro/state", jsonString.c_str());
+  // Publish to multiple topics for HA sensors (time remaining is in the system status)
+  mqttClient.publish(TOPIC_POMODORO_STATE, jsonString.c_str(), true);
   mqttClient.publish("bille/pomodoro/cycles", String(pomodoro.completedCycles).c_str());
-  mqttClient.publish("bille/pomodoro/time_remaining", String(doc["timeRemaining"].as<long>()).c_str());
   mqttClient.publish("bille/pomodoro/current_state", stateText.c_str());
   
-  Serial.println("Pomodoro state published: " + stateText);
+  LOG_DEBUG(LOG_MQTT, "Pomodoro state published: %s", stateText.c_str());
 }
 
 void publishSystemStatus() {
-  StaticJsonDocument<300> doc;
+  StaticJsonDocument<640> doc;
   doc["nodeType"] = "MAIN_BRAIN";
   doc["timestamp"] = millis();
   doc["sessionActive"] = sessionActive;
@@ -189,10 +354,25 @@ void publishSystemStatus() {
   doc["mqttConnected"] = mqttClient.connected();
   doc["environmentDataAge"] = envData.dataAvailable ? (millis() - envData.lastUpdate) / 1000 : -1;
   doc["biometricDataAge"] = bioData.dataAvailable ? (millis() - bioData.lastUpdate) / 1000 : -1;
+  doc["logDroppedBytes"] = logDroppedBytes();
+  doc["bioBatches"] = bioBatchesReceived();
+  doc["bioBatchGaps"] = bioBatchGaps();
+  doc["bioBatchRestarts"] = bioBatchRestarts();
+  doc["mqttConnects"] = mqttConnects;
+  doc["stateSyncMs"] = stateSyncMs;
+  doc["warmRestarts"] = snapshotWarmRestarts();
+  bootReport(doc.createNestedObject("boot"));
+  
+  JsonObject events = doc.createNestedObject("events");
+  events["depth"] = eventQueueDepth();
+  events["highWater"] = eventQueueHighWater();
+  events["overflows"] = eventOverflows();
+  events["handled"] = eventsHandled;
+  events["maxWaitMs"] = maxEventWaitMs;
   
   if (sessionActive) {
     doc["pomodoroState"] = pomodoro.currentState;
-    doc["pomodoroTimeRemaining"] = (pomodoro.stateDuration - (millis() - pomodoro.stateStartTime)) / 1000;
+    doc["pomodoroTimeRemaining"] = getTimeRemainingSeconds();
     doc["completedCycles"] = pomodoro.completedCycles;
   }
   
@@ -200,7 +380,7 @@ void publishSystemStatus() {
   serializeJson(doc, jsonString);
   mqttClient.publish("bille/status/system", jsonString.c_str());
   
-  Serial.println("System status published to MQTT");
+  LOG_DEBUG(LOG_MQTT, "System status published to MQTT");
 }
 
 void publishMovementReminder() {
@@ -213,5 +393,13 @@ void publishMovementReminder() {
   serializeJson(doc, jsonString);
   mqttClient.publish("bille/alerts/movement", jsonString.c_str());
   
-  Serial.println("Movement reminder sent via MQTT");
-}
\ No newline at end of file
+  LOG_DEBUG(LOG_MQTT, "Movement reminder sent via MQTT");
+}
+
+// Echoes the caller's id and send time with our millis(). The caller keeps the
+// lowest round-trip sample, where the reply time is closest to the midpoint.
+void answerTimePing(unsigned long id, unsigned long t0) {
+  char reply[96];
+  snprintf(reply, sizeof(reply), "{\"id\":%lu,\"t0\":%lu,\"brain\":%lu}", id, t0, millis());
+  mqttClient.publish(TOPIC_TIME_PONG, reply);
+}
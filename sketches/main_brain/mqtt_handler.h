@@ -6,8 +6,10 @@
 void setup_wifi();
 void reconnect_mqtt();
 void mqtt_callback(char* topic, byte* payload, unsigned int length);
+void processMqttEvents();
 void publishSessionState();
 void publishPomodoroState();
+void answerTimePing(unsigned long id, unsigned long t0);
 void publishSystemStatus();
 void publishMovementReminder();
 
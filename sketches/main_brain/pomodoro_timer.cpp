@@ -3,6 +3,8 @@
 #include "audio_system.h"
 #include "mqtt_handler.h"
 #include "config.h"
+#include "logger.h"
+#include "session_snapshot.h"
 #include <Arduino.h>
 
 
@@ -18,7 +20,7 @@ void initializePomodoro() {
   playWorkSessionStartSound();
   publishPomodoroState();
   
-  Serial.println("Pomodoro work session started!");
+  LOG_INFO(LOG_POMODORO, "Pomodoro work session started!");
 }
 
 void updatePomodoroTimer() {
@@ -38,7 +40,8 @@ void updatePomodoroTimer() {
   if (elapsed >= pomodoro.stateDuration) {
     // Instead of transitioning immediately, wait for confirmation
     pomodoro.awaitingConfirmation = true;
-    Serial.println("Timer completed - awaiting touch confirmation");
+    LOG_INFO(LOG_POMODORO, "Timer completed - awaiting touch confirmation");
+    snapshotSave();
     publishPomodoroState(); // Update MQTT with awaiting status
   }
   
@@ -59,12 +62,12 @@ void transitionToNextState() {
         pomodoro.currentState = LONG_BREAK;
         pomodoro.stateDuration = pomodoro.longBreakDuration * 60 * 1000UL;
         playLongBreakStartSound();
-        Serial.printf("Long break started! Cycle %d completed.\n", pomodoro.completedCycles);
+        LOG_INFO(LOG_POMODORO, "Long break started! Cycle %d completed.", pomodoro.completedCycles);
       } else {
         pomodoro.currentState = SHORT_BREAK;
         pomodoro.stateDuration = pomodoro.shortBreakDuration * 60 * 1000UL;
         playBreakStartSound();
-        Serial.printf("Short break started! Cycle %d completed.\n", pomodoro.completedCycles);
+        LOG_INFO(LOG_POMODORO, "Short break started! Cycle %d completed.", pomodoro.completedCycles);
       }
       break;
       
@@ -73,7 +76,7 @@ void transitionToNextState() {
       pomodoro.currentState = WORK_SESSION;
       pomodoro.stateDuration = pomodoro.workDuration * 60 * 1000UL;
       playWorkSessionStartSound();
-      Serial.println("Work session started!");
+      LOG_INFO(LOG_POMODORO, "Work session started!");
       break;
       
     default:
@@ -84,6 +87,7 @@ void transitionToNextState() {
   pomodoro.breakSnoozed = false;
   pomodoro.snoozeCount = 0;
   pomodoro.breakComplianceChecked = false;
+  snapshotSave();
   
   playTouchAcknoledgmentSound();
   publishPomodoroState();
@@ -94,13 +98,14 @@ void snoozeBreak() {
     pomodoro.stateDuration += 5 * 60 * 1000UL; // Add 5 minutes
     pomodoro.snoozeCount++;
     pomodoro.breakSnoozed = true;
+    snapshotSave();
     
     // Brief acknowledgment sound
     tone(BUZZER_PIN, 440, 200);
     delay(300);
     noTone(BUZZER_PIN);
     
-    Serial.printf("Break snoozed for 5 minutes. Snooze count: %d\n", pomodoro.snoozeCount);
+    LOG_INFO(LOG_POMODORO, "Break snoozed for 5 minutes. Snooze count: %d", pomodoro.snoozeCount);
     publishPomodoroState();
   }
 }
@@ -111,12 +116,13 @@ void checkBreakCompliance() {
   unsigned long timeSinceMovement = millis() - bioData.lastMovement;
   
   if (timeSinceMovement < 30000) { // Moved within last 30 seconds
-    Serial.println("Break compliance: User is moving - good!");
+    LOG_INFO(LOG_POMODORO, "Break compliance: User is moving - good!");
   } else {
-    Serial.println("Break compliance: Consider moving around!");
+    LOG_INFO(LOG_POMODORO, "Break compliance: Consider moving around!");
   }
   
   pomodoro.breakComplianceChecked = true;
+  snapshotSave();
 }
 
 String getTimeRemainingText() {
@@ -179,11 +185,11 @@ bool readTouchSensor() {
 void handleTouchConfirmation() {
   if (readTouchSensor()) {
     if (pomodoro.awaitingConfirmation) {
-      Serial.println("Touch confirmed - transitioning state");
+      LOG_INFO(LOG_POMODORO, "Touch confirmed - transitioning state");
       pomodoro.awaitingConfirmation = false;
       transitionToNextState();
     } else {
-      Serial.println("Touch detected - forcing state transition");
+      LOG_INFO(LOG_POMODORO, "Touch detected - forcing state transition");
       // Force immediate transition regardless of timer
       transitionToNextState();
     }
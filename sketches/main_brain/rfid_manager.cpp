@@ -5,6 +5,8 @@
 #include "audio_system.h"
 #include "mqtt_handler.h"
 #include "display_manager.h"
+#include "logger.h"
+#include "session_snapshot.h"
 #include <MFRC522.h>
 #include <Arduino.h>
 
@@ -20,7 +22,7 @@ void handleRFID() {
     cardId += String(rfid.uid.uidByte[i], HEX);
   }
   
-  Serial.println("Card detected: " + cardId);
+  LOG_INFO(LOG_RFID, "Card detected: %s", cardId.c_str());
 
    // Simple authentication - add your known card IDs here
   if (cardId == "9c13c3") { // Temporary: accept any card->  || cardId.length() > 0
@@ -37,7 +39,7 @@ void handleRFID() {
   } else {
     // Authentication failed
     playAuthFailSound();
-    Serial.println("Authentication failed for card: " + cardId);
+    LOG_WARN(LOG_RFID, "Authentication failed for card: %s", cardId.c_str());
   }
   
   rfid.PICC_HaltA();
@@ -54,11 +56,12 @@ void startSession(String userId) {
   
   // Initialize Pomodoro timer
   initializePomodoro();
+  snapshotSave();
   
   // Publish session state to MQTT
   publishSessionState();
   
-  Serial.println("Session started for: " + userId);
+  LOG_INFO(LOG_RFID, "Session started for: %s", userId.c_str());
 }
 
 void endSession() {
@@ -71,6 +74,7 @@ void endSession() {
   
   // Reset Pomodoro timer
   pomodoro.currentState = IDLE;
+  snapshotSave();
   
   // Publish final session state
   publishSessionState();
@@ -78,5 +82,5 @@ void endSession() {
   
   showWelcomeScreen();
   
-  Serial.printf("Session ended. Completed %d Pomodoro cycles.\n", pomodoro.completedCycles);
+  LOG_INFO(LOG_RFID, "Session ended. Completed %d Pomodoro cycles.", pomodoro.completedCycles);
 }
\ No newline at end of file
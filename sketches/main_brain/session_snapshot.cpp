@@ -0,0 +1,134 @@
+#include "session_snapshot.h"
+#include "data_structures.h"
+#include "logger.h"
+
+extern "C" {
+#include <user_interface.h>
+}
+
+#define SNAPSHOT_MAGIC    0xB1E55E01UL
+
+#define FLAG_SNOOZED      0x01
+#define FLAG_COMPLIANCE   0x02
+#define FLAG_AWAITING     0x04
+
+struct Snapshot {
+  uint32_t magic;
+  uint32_t seq;              // The newer of the two valid copies wins
+  uint32_t rtcTicks;         // RTC counter at the save
+  uint32_t rtcCalibration;   // us per RTC tick, Q12 (system_rtc_clock_cali_proc)
+  uint32_t sessionAgeMs;     // millis() - sessionStart
+  uint32_t stateElapsedMs;   // millis() - pomodoro.stateStartTime
+  uint32_t stateDurationMs;
+  uint16_t completedCycles;
+  uint16_t snoozeCount;
+  uint16_t warmRestarts;     // Sessions resumed since the last power-on
+  uint8_t sessionActive;
+  uint8_t state;             // PomodoroState
+  uint8_t workMinutes;
+  uint8_t shortBreakMinutes;
+  uint8_t longBreakMinutes;
+  uint8_t flags;
+  char user[24];
+  uint32_t crc;
+};
+
+#define SNAPSHOT_BLOCKS   (sizeof(Snapshot) / 4)
+
+static_assert(sizeof(Snapshot) % 4 == 0, "RTC memory is written in 4-byte blocks");
+static_assert(RTC_SNAPSHOT_BLOCK * 4 + 2 * sizeof(Snapshot) <= 512, "snapshot copies do not fit in RTC user memory");
+
+static Snapshot current;
+static unsigned long lastSave = 0;
+
+static uint32_t crc32(const uint8_t* data, size_t length) {
+  uint32_t crc = 0xFFFFFFFF;
+  while (length--) {
+    crc ^= *data++;
+    for (int k = 0; k < 8; k++) crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+  }
+  return ~crc;
+}
+
+static bool readCopy(int copy, Snapshot& s) {
+  return ESP.rtcUserMemoryRead(RTC_SNAPSHOT_BLOCK + copy * SNAPSHOT_BLOCKS, (uint32_t*)&s, sizeof(s)) &&
+         s.magic == SNAPSHOT_MAGIC && s.crc == crc32((const uint8_t*)&s, offsetof(Snapshot, crc));
+}
+
+// Time since s was written, including the reset itself
+static uint32_t msSinceSave(const Snapshot& s) {
+  uint32_t ticks = system_get_rtc_time();
+  if (ticks < s.rtcTicks) return millis();   // Counter restarted; only this boot is known
+  return (uint32_t)((((uint64_t)(ticks - s.rtcTicks) * s.rtcCalibration) >> 12) / 1000);
+}
+
+void snapshotSave() {
+  unsigned long now = millis();
+  current.magic = SNAPSHOT_MAGIC;
+  current.seq++;
+  current.rtcTicks = system_get_rtc_time();
+  current.rtcCalibration = system_rtc_clock_cali_proc();
+  current.sessionActive = sessionActive;
+  current.sessionAgeMs = sessionActive ? now - sessionStart : 0;
+  strncpy(current.user, currentUser.c_str(), sizeof(current.user) - 1);
+  current.user[sizeof(current.user) - 1] = '\0';
+  current.state = pomodoro.currentState;
+  current.stateElapsedMs = now - pomodoro.stateStartTime;
+  current.stateDurationMs = pomodoro.stateDuration;
+  current.completedCycles = pomodoro.completedCycles;
+  current.snoozeCount = pomodoro.snoozeCount;
+  current.workMinutes = pomodoro.workDuration;
+  current.shortBreakMinutes = pomodoro.shortBreakDuration;
+  current.longBreakMinutes = pomodoro.longBreakDuration;
+  current.flags = (pomodoro.breakSnoozed ? FLAG_SNOOZED : 0) |
+                  (pomodoro.breakComplianceChecked ? FLAG_COMPLIANCE : 0) |
+                  (pomodoro.awaitingConfirmation ? FLAG_AWAITING : 0);
+  current.crc = crc32((const uint8_t*)&current, offsetof(Snapshot, crc));
+  ESP.rtcUserMemoryWrite(RTC_SNAPSHOT_BLOCK + (current.seq & 1) * SNAPSHOT_BLOCKS, (uint32_t*)&current,
+                         sizeof(current));
+  lastSave = now;
+}
+
+bool snapshotRestore() {
+  Snapshot copies[2];
+  bool valid[2] = {readCopy(0, copies[0]), readCopy(1, copies[1])};
+  if (!valid[0] && !valid[1]) {
+    memset(&current, 0, sizeof(current));
+    LOG_INFO(LOG_SYSTEM, "No session snapshot, cold start (%s)", ESP.getResetReason().c_str());
+    return false;
+  }
+  int newest = valid[0] && valid[1] ? ((int32_t)(copies[1].seq - copies[0].seq) > 0) : valid[1];
+  current = copies[newest];
+  if (!current.sessionActive) return false;   // Nothing was running
+
+  uint32_t gap = msSinceSave(current);
+  unsigned long now = millis();
+  sessionActive = true;
+  currentUser = current.user;
+  sessionStart = now - (current.sessionAgeMs + gap);
+  pomodoro.currentState = (PomodoroState)current.state;
+  pomodoro.stateStartTime = now - (current.stateElapsedMs + gap);
+  pomodoro.stateDuration = current.stateDurationMs;
+  pomodoro.completedCycles = current.completedCycles;
+  pomodoro.snoozeCount = current.snoozeCount;
+  pomodoro.workDuration = current.workMinutes;
+  pomodoro.shortBreakDuration = current.shortBreakMinutes;
+  pomodoro.longBreakDuration = current.longBreakMinutes;
+  pomodoro.breakSnoozed = current.flags & FLAG_SNOOZED;
+  pomodoro.breakComplianceChecked = current.flags & FLAG_COMPLIANCE;
+  pomodoro.awaitingConfirmation = current.flags & FLAG_AWAITING;
+
+  current.warmRestarts++;
+  snapshotSave();
+  LOG_INFO(LOG_SYSTEM, "Warm restart (%s): resumed session for %s, %lu ms lost to the reset",
+           ESP.getResetReason().c_str(), currentUser.c_str(), (unsigned long)gap);
+  return true;
+}
+
+void snapshotTick() {
+  if (sessionActive && millis() - lastSave >= SNAPSHOT_REFRESH_MS) snapshotSave();
+}
+
+unsigned int snapshotWarmRestarts() {
+  return current.warmRestarts;
+}
@@ -0,0 +1,24 @@
+#ifndef SESSION_SNAPSHOT_H
+#define SESSION_SNAPSHOT_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Warm restart: the live session and Pomodoro state checkpointed into RTC
+// user memory on every transition (and every SNAPSHOT_REFRESH_MS while a
+// session runs). Two CRC-checked copies are written alternately, so a
+// reset in the middle of a write still leaves the previous one.
+//
+// Times are stored as ages at the save. On restore the RTC tick counter,
+// which keeps running through a watchdog reset or crash, gives the time
+// spent resetting; if it restarted, only this boot's millis() is added.
+// RTC memory does not survive power loss.
+
+// True if a running session was restored; call first thing in setup()
+bool snapshotRestore();
+void snapshotSave();
+// Keeps the stored ages fresh between transitions; call from loop()
+void snapshotTick();
+unsigned int snapshotWarmRestarts();
+
+#endif
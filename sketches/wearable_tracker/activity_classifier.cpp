@@ -0,0 +1,151 @@
+#include "activity_classifier.h"
+#include <math.h>
+
+// Decision tree node: internal nodes compare one feature against a threshold
+// (<= goes left), leaves carry the class. Thresholds were fitted by hand on
+// labelled host traces.
+struct TreeNode {
+  int8_t feature;       // -1 for a leaf
+  int32_t threshold;
+  uint8_t left;
+  uint8_t right;
+  ActivityClass label;
+};
+
+#define LEAF(label) { -1, 0, 0, 0, label }
+
+static constexpr TreeNode ACTIVITY_TREE[] = {
+  /* 0 */ { FEATURE_SMA, 60, 1, 6, ACTIVITY_STILL },          // Barely any dynamic acceleration?
+  /* 1 */ { FEATURE_IDLE, 30, 2, 3, ACTIVITY_STILL },         // Moved in the last 30 s?
+  /* 2 */ LEAF(ACTIVITY_STILL),
+  /* 3 */ { FEATURE_TILT, 60, 4, 5, ACTIVITY_STILL },         // Forearm flat on a desk vs hanging
+  /* 4 */ LEAF(ACTIVITY_SITTING),
+  /* 5 */ LEAF(ACTIVITY_STILL),
+  /* 6 */ { FEATURE_FREQUENCY, 12, 7, 8, ACTIVITY_MOVING },   // Below 1.2 Hz is not a gait
+  /* 7 */ LEAF(ACTIVITY_MOVING),
+  /* 8 */ { FEATURE_VARIANCE, 20000, 9, 10, ACTIVITY_MOVING }, // Periodic but weak: fidgeting
+  /* 9 */ LEAF(ACTIVITY_MOVING),
+  /*10 */ { FEATURE_VARIANCE, 250000, 11, 12, ACTIVITY_WALKING }, // Above 0.5 g rms is a hard gait
+  /*11 */ LEAF(ACTIVITY_WALKING),
+  /*12 */ { FEATURE_FREQUENCY, 22, 13, 14, ACTIVITY_WALKING }, // ...and fast: running
+  /*13 */ LEAF(ACTIVITY_WALKING),
+  /*14 */ LEAF(ACTIVITY_RUNNING),
+};
+
+static constexpr int TREE_SIZE = sizeof(ACTIVITY_TREE) / sizeof(ACTIVITY_TREE[0]);
+
+// Every child index must point forward into the table, so evaluation always terminates
+static constexpr bool treeIsValid(int i = 0) {
+  return i >= TREE_SIZE ||
+         ((ACTIVITY_TREE[i].feature < 0 ||
+           (ACTIVITY_TREE[i].feature < FEATURE_COUNT &&
+            ACTIVITY_TREE[i].left > i && ACTIVITY_TREE[i].left < TREE_SIZE &&
+            ACTIVITY_TREE[i].right > i && ACTIVITY_TREE[i].right < TREE_SIZE)) &&
+          treeIsValid(i + 1));
+}
+static_assert(treeIsValid(), "activity decision tree has an invalid child index");
+
+void activityClassifierInit(ActivityClassifier& ac, int sampleRateHz, int lsbPerG) {
+  ac.head = 0;
+  ac.filled = 0;
+  ac.sinceDecision = 0;
+  ac.lsbPerG = lsbPerG;
+  ac.sampleRateHz = sampleRateHz;
+  for (int i = 0; i < FEATURE_COUNT; i++) ac.features[i] = 0;
+  ac.current = ACTIVITY_STILL;
+}
+
+// Returns true when a new window is ready to classify
+bool activityClassifierAddSample(ActivityClassifier& ac, int16_t x, int16_t y, int16_t z) {
+  ac.x[ac.head] = x;
+  ac.y[ac.head] = y;
+  ac.z[ac.head] = z;
+  ac.head = (ac.head + 1) % ACTIVITY_WINDOW;
+  if (ac.filled < ACTIVITY_WINDOW) ac.filled++;
+  ac.sinceDecision++;
+
+  if (ac.filled == ACTIVITY_WINDOW && ac.sinceDecision >= ACTIVITY_HOP) {
+    ac.sinceDecision = 0;
+    return true;
+  }
+  return false;
+}
+
+static void extractFeatures(ActivityClassifier& ac) {
+  const int n = ACTIVITY_WINDOW;
+  int32_t sumX = 0, sumY = 0, sumZ = 0;
+
+  for (int i = 0; i < n; i++) {
+    sumX += ac.x[i];
+    sumY += ac.y[i];
+    sumZ += ac.z[i];
+  }
+
+  int32_t meanX = sumX / n, meanY = sumY / n, meanZ = sumZ / n;
+
+  // The window mean is gravity; projecting onto it gives the vertical
+  // acceleration, where a gait shows up at the step rate. Arm gestures
+  // mostly swing across gravity and stay weak here.
+  float gravity = sqrtf((float)meanX * meanX + (float)meanY * meanY + (float)meanZ * meanZ);
+  if (gravity < 1.0f) gravity = 1.0f;
+
+  // Second pass: variance, SMA and mean crossings with a small hysteresis band
+  int64_t sumSq = 0;
+  int64_t sma = 0;
+  int32_t gravityLsb = (int32_t)gravity;
+  int32_t band = ac.lsbPerG / 20;   // 50 mg
+  int crossings = 0;
+  int side = 0;
+
+  // Walk the window oldest-first so crossings follow time order
+  for (int k = 0; k < n; k++) {
+    int i = (ac.head + k) % n;
+    int32_t dx = ac.x[i] - meanX, dy = ac.y[i] - meanY, dz = ac.z[i] - meanZ;
+    sma += (dx < 0 ? -dx : dx) + (dy < 0 ? -dy : dy) + (dz < 0 ? -dz : dz);
+
+    int64_t dot = (int64_t)ac.x[i] * meanX + (int64_t)ac.y[i] * meanY + (int64_t)ac.z[i] * meanZ;
+    int32_t vertical = (int32_t)(dot / gravityLsb) - gravityLsb;
+    sumSq += (int64_t)vertical * vertical;
+
+    int newSide = vertical > band ? 1 : (vertical < -band ? -1 : side);
+    if (side != 0 && newSide != side) crossings++;
+    side = newSide;
+  }
+
+  int64_t lsb2 = (int64_t)ac.lsbPerG * ac.lsbPerG;
+  ac.features[FEATURE_VARIANCE] = (int32_t)(sumSq / n * 1000000 / lsb2);
+  ac.features[FEATURE_SMA] = (int32_t)(sma / n * 1000 / ac.lsbPerG);
+
+  // Two crossings per cycle; window length is n / rate seconds
+  ac.features[FEATURE_FREQUENCY] = crossings * 10 * ac.sampleRateHz / (2 * n);
+
+  float cosTilt = fabsf((float)meanZ) / gravity;
+  if (cosTilt > 1.0f) cosTilt = 1.0f;
+  ac.features[FEATURE_TILT] = (int32_t)(acosf(cosTilt) * 57.2958f);
+}
+
+ActivityClass activityClassify(ActivityClassifier& ac, uint32_t idleSeconds) {
+  if (ac.filled < ACTIVITY_WINDOW) return ac.current;
+
+  extractFeatures(ac);
+  ac.features[FEATURE_IDLE] = (int32_t)idleSeconds;
+
+  int node = 0;
+  while (ACTIVITY_TREE[node].feature >= 0) {
+    const TreeNode& t = ACTIVITY_TREE[node];
+    node = ac.features[t.feature] <= t.threshold ? t.left : t.right;
+  }
+
+  ac.current = ACTIVITY_TREE[node].label;
+  return ac.current;
+}
+
+const char* activityName(ActivityClass activity) {
+  switch (activity) {
+    case ACTIVITY_RUNNING: return "Running";
+    case ACTIVITY_WALKING: return "Walking";
+    case ACTIVITY_MOVING:  return "Moving";
+    case ACTIVITY_STILL:   return "Still";
+    default:               return "Sitting";
+  }
+}
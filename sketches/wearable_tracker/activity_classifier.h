@@ -0,0 +1,53 @@
+#ifndef ACTIVITY_CLASSIFIER_H
+#define ACTIVITY_CLASSIFIER_H
+
+#include <stdint.h>
+
+// Sliding-window activity classifier over raw accelerometer samples.
+// Plain C++ with no Arduino dependencies so it can be checked on the host
+// against labelled traces.
+//
+// Every ACTIVITY_HOP samples the last ACTIVITY_WINDOW samples are reduced to
+// a fixed feature vector and run through a small decision tree held in a
+// constexpr table, so each classification costs the same.
+
+#define ACTIVITY_WINDOW  128   // 2.56 s at 50 Hz
+#define ACTIVITY_HOP     64    // New decision every 1.28 s
+
+// Values double as the activity codes in BiometricSample
+enum ActivityClass : uint8_t {
+  ACTIVITY_SITTING = 0,
+  ACTIVITY_STILL   = 1,
+  ACTIVITY_MOVING  = 2,
+  ACTIVITY_WALKING = 3,
+  ACTIVITY_RUNNING = 4
+};
+
+enum ActivityFeature : uint8_t {
+  FEATURE_VARIANCE,     // Variance along the gravity axis, mg^2
+  FEATURE_SMA,          // Signal magnitude area of the dynamic part, mg
+  FEATURE_FREQUENCY,    // Dominant frequency from mean crossings, 0.1 Hz
+  FEATURE_TILT,         // Angle of gravity from the device Z axis, degrees
+  FEATURE_IDLE,         // Seconds since the last detected movement
+  FEATURE_COUNT
+};
+
+struct ActivityClassifier {
+  int16_t x[ACTIVITY_WINDOW];
+  int16_t y[ACTIVITY_WINDOW];
+  int16_t z[ACTIVITY_WINDOW];
+  uint16_t head;
+  uint16_t filled;
+  uint16_t sinceDecision;
+  int32_t lsbPerG;
+  int32_t sampleRateHz;
+  int32_t features[FEATURE_COUNT];
+  ActivityClass current;
+};
+
+void activityClassifierInit(ActivityClassifier& ac, int sampleRateHz, int lsbPerG);
+bool activityClassifierAddSample(ActivityClassifier& ac, int16_t x, int16_t y, int16_t z);
+ActivityClass activityClassify(ActivityClassifier& ac, uint32_t idleSeconds);
+const char* activityName(ActivityClass activity);
+
+#endif
@@ -2,16 +2,27 @@
 #define BIOMETRIC_DATA_H
 
 #include <Arduino.h>
+#include "activity_classifier.h"
 
 // Biometric data structure
 struct BiometricData {
-  String activity;
+  ActivityClass activity;
   int stepCount;
   unsigned long lastMovement;
   float acceleration;
   unsigned long timestamp;
 };
 
+// Sample buffered in RAM between radio windows
+// Activity codes are ActivityClass values: 0 Sitting, 1 Still, 2 Moving, 3 Walking, 4 Running
+struct BiometricSample {
+  unsigned long timestamp;
+  unsigned long lastMovement;
+  float acceleration;
+  int stepCount;
+  uint8_t activity;
+};
+
 //////////////// POMODORO SESSION VARIABLES /////////////////
 enum PomodoroState {
   IDLE,
@@ -22,7 +33,8 @@ enum PomodoroState {
 
 struct PomodoroInfo {
   PomodoroState currentState;
-  unsigned long timeRemaining;  // in seconds
+  unsigned long stateDuration;  // in seconds, includes snoozes
+  unsigned long deadline;       // main brain millis() when the state ends, 0 if idle
   int completedCycles;
   bool snoozed;
   int snoozeCount;
@@ -1,5 +1,9 @@
 #include "biometric_sensors.h"
 #include "config.h"
+#include "logger.h"
+#include "motion_fifo.h"
+#include "step_detector.h"
+#include "bout_tracker.h"
 #include <MPU6050.h>
 #include <Arduino.h>
 
@@ -10,11 +14,8 @@ void readBiometrics() {
   // Read accelerometer for activity detection
   readActivityData();
   
-  // Detect steps 
-  // detectSteps();
-
-  //  Since step detection was unreliable, we estimate steps based on activity 
-  estimateStepCount();
+  // Count steps up to the newest sample
+  processMotionSamples();
   
   // Detect current activity
   currentBio.activity = detectActivity();
@@ -27,87 +28,87 @@ void readBiometrics() {
 }
 
 
+// Peak magnitude over the FIFO samples collected since the previous read.
+// Movement times come from the motion interrupt, not from this poll.
 void readActivityData() {
-  // Read raw accelerometer data
-  int16_t ax, ay, az;
-  mpu.getAcceleration(&ax, &ay, &az);
+  static unsigned long cursor = 0;
   
-  // Convert to g-force
-  float accelX = ax / 16384.0;
-  float accelY = ay / 16384.0;
-  float accelZ = az / 16384.0;
+  motionDrainFifo();
   
-  // Calculate acceleration magnitude
-  float accelMagnitude = sqrt(accelX * accelX + accelY * accelY + accelZ * accelZ);
-  currentBio.acceleration = accelMagnitude;
+  if (motionWriteIndex - cursor > MOTION_RING_SIZE) {
+    cursor = motionWriteIndex - MOTION_RING_SIZE;  // Older samples were overwritten
+  }
+  if (cursor == motionWriteIndex) return;
   
-  unsigned long currentTime = millis();
+  float maxMagnitude = 0;
   
-  // Update movement tracking for other activities 
-  float delta = abs(accelMagnitude - lastAccelMagnitude);
-  if (delta > 0.05) {
-    currentBio.lastMovement = currentTime; // Update last movement
-    Serial.println("Movement detected, updating lastMovement timestamp.");
-  } else {
-    Serial.println("No significant movement detected.");
+  for (; cursor < motionWriteIndex; cursor++) {
+    const AccelSample& s = motionRing[cursor % MOTION_RING_SIZE];
+    float accelX = s.x / MOTION_LSB_PER_G;
+    float accelY = s.y / MOTION_LSB_PER_G;
+    float accelZ = s.z / MOTION_LSB_PER_G;
+    float magnitude = sqrt(accelX * accelX + accelY * accelY + accelZ * accelZ);
+    
+    if (magnitude > maxMagnitude) maxMagnitude = magnitude;
   }
   
-  lastAccelMagnitude = accelMagnitude;
+  // Peak magnitude over the window, reported to HA
+  currentBio.acceleration = maxMagnitude;
 }
 
-String detectActivity() {
-  unsigned long timeSinceMovement = millis() - currentBio.lastMovement;
-  
-  if (timeSinceMovement < 1000) {
-    if (currentBio.acceleration > 1.5) {
-      return "Running";
-    } else if (currentBio.acceleration > 1.2) {
-      return "Walking";
-    } else {
-      return "Moving";
-    }
-  } else if (timeSinceMovement < 30000) { // 30 seconds
-    return "Still";
-  } else {
-    return "Sitting";
+// Sources report out of order (FIFO samples lag the ISR), keep the newest
+static void noteMovement(unsigned long when) {
+  if ((long)(when - currentBio.lastMovement) > 0) {
+    currentBio.lastMovement = when;
   }
 }
 
-// // Couldn't get this to detect steps correctly, the approach is changed to just add average steps
-// // count based on the activity (walking / running)
-// void detectSteps() {
-//   unsigned long currentTime = millis();
-//   static float smoothedAccel = 1.0;
-//   static bool aboveThreshold = false;
+// Latest windowed decision - processMotionSamples() reclassifies every 1.28 s
+ActivityClass detectActivity() {
+  return activityClassifier.current;
+}
+
+// Picks up interrupt movement stamps and feeds every new FIFO sample through
+// the step detector and the activity classifier - called from loop() so no
+// sample is missed between the slower activity reads
+void processMotionSamples() {
+  static unsigned long cursor = 0;
   
-//   // Simple moving average for smoothing
-//   float alpha = 0.1; // Lower alpha for smoother averaging
-//   smoothedAccel = alpha * smoothedAccel + (1 - alpha) * currentBio.acceleration;
+  unsigned long movedAt;
+  if (motionTakeMovement(movedAt)) {
+    noteMovement(movedAt);
+  }
   
-//   // Improved step detection
-//   float diff = currentBio.acceleration - smoothedAccel;
+  if (motionWriteIndex - cursor > MOTION_RING_SIZE) {
+    cursor = motionWriteIndex - MOTION_RING_SIZE;
+  }
   
-//   // Step up detected
-//   if (!aboveThreshold && diff > 0.03 && (currentTime - lastStepTime > 200)) { // Lower threshold and time gap
-//     aboveThreshold = true;
-//   }
-//   // Step down detected - count the step
-//   else if (aboveThreshold && diff < -0.015) { // Lower threshold for step down
-//     stepCount++;
-//     lastStepTime = currentTime;
-//     currentBio.lastMovement = currentTime;
-//     aboveThreshold = false;
+  for (; cursor < motionWriteIndex; cursor++) {
+    const AccelSample& s = motionRing[cursor % MOTION_RING_SIZE];
+    int added = stepDetectorAddSample(stepDetector, s.x, s.y, s.z);
+    if (added > 0) {
+      stepCount += added;
+      boutTrackerAddSteps(added);
+      noteMovement(motionSampleTime(cursor));
+      LOG_DEBUG(LOG_SENSOR, "Step +%d, total %d", added, stepCount);
+    }
     
-//     Serial.printf("STEP #%d! Diff: %.3f, Accel: %.3f, Smooth: %.3f\n", 
-//                   stepCount, diff, currentBio.acceleration, smoothedAccel);
-//   }
-  
-// }
-
-void estimateStepCount(){
-  if (currentBio.activity == "Walking") {
-    stepCount += 2; // Average walking pace
-  } else if (currentBio.activity == "Running") {
-    stepCount += 3; // Average running pace
+    if (activityClassifierAddSample(activityClassifier, s.x, s.y, s.z)) {
+      unsigned long sampleTime = motionSampleTime(cursor);
+      unsigned long idle = sampleTime > currentBio.lastMovement ? (sampleTime - currentBio.lastMovement) / 1000 : 0;
+      ActivityClass previous = activityClassifier.current;
+      ActivityClass activity = activityClassify(activityClassifier, idle);
+      
+      // A window classified as motion counts as movement for the idle timer
+      if (activity >= ACTIVITY_MOVING) noteMovement(sampleTime);
+      boutTrackerUpdate(activity, millis());
+      if (activity != previous) {
+        LOG_DEBUG(LOG_SENSOR, "Activity %s (sma %ld mg, %ld.%ld Hz, tilt %ld)",
+                  activityName(activity), (long)activityClassifier.features[FEATURE_SMA],
+                  (long)activityClassifier.features[FEATURE_FREQUENCY] / 10,
+                  (long)activityClassifier.features[FEATURE_FREQUENCY] % 10,
+                  (long)activityClassifier.features[FEATURE_TILT]);
+      }
+    }
   }
 }
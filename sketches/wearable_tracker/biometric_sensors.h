@@ -2,21 +2,17 @@
 #define BIOMETRIC_SENSORS_H
 
 #include "biometric_data.h"
+#include "step_detector.h"
+#include "activity_classifier.h"
 
 void readBiometrics();
 void readActivityData();
-String detectActivity();
-// void detectSteps();
-void estimateStepCount();
+ActivityClass detectActivity();
+void processMotionSamples();
 
 extern BiometricData currentBio;
-extern float lastAccelMagnitude;
 extern int stepCount;
-extern unsigned long lastStepTime;
-extern bool stepDetected;
-
-// Step detection constants
-#define ACCEL_THRESHOLD 0.1
-#define STEP_DELAY 100
+extern StepDetector stepDetector;
+extern ActivityClassifier activityClassifier;
 
 #endif
@@ -0,0 +1,206 @@
+#include "bout_tracker.h"
+#include "logger.h"
+
+#define BOUT_MAGIC    0xB0D7E501UL
+#define DAY_MS        86400000UL
+
+const uint8_t boutHistogramEdges[BOUT_HIST_BINS - 1] = { 1, 5, 10, 20, 30, 60 };
+
+// Times are on the tracker clock: wear time in ms, advanced by millis()
+// deltas and carried across resets (time switched off is not counted)
+struct BoutState {
+  uint32_t magic;
+  uint32_t clock;
+  uint32_t dayStart;
+  uint32_t boutStart;
+  uint32_t switchStart;       // When the opposite state began, if pending
+  uint8_t sedentary;          // Kind of the current bout
+  uint8_t pending;            // Opposite state seen, not yet confirmed
+  uint8_t inSession;
+  uint8_t reserved;
+  BoutTotals today;
+  BoutTotals yesterday;
+  BoutTotals session;
+  uint32_t sessionStart;
+  uint16_t sitHist[BOUT_HIST_BINS];
+  uint16_t activeHist[BOUT_HIST_BINS];
+  uint32_t crc;
+};
+
+static_assert(sizeof(BoutState) % 4 == 0, "RTC memory is written in 4-byte blocks");
+static_assert(RTC_BOUT_BLOCK * 4 + sizeof(BoutState) <= 512, "bout state does not fit in RTC user memory");
+
+static BoutState state;
+static unsigned long lastMillis = 0;
+static unsigned long lastSave = 0;
+
+static uint32_t crc32(const uint8_t* data, size_t length) {
+  uint32_t crc = 0xFFFFFFFF;
+  while (length--) {
+    crc ^= *data++;
+    for (int k = 0; k < 8; k++) crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+  }
+  return ~crc;
+}
+
+static void saveState() {
+  state.crc = crc32((const uint8_t*)&state, offsetof(BoutState, crc));
+  ESP.rtcUserMemoryWrite(RTC_BOUT_BLOCK, (uint32_t*)&state, sizeof(state));
+  lastSave = millis();
+}
+
+void boutTrackerInit() {
+  lastMillis = millis();
+  if (ESP.rtcUserMemoryRead(RTC_BOUT_BLOCK, (uint32_t*)&state, sizeof(state)) &&
+      state.magic == BOUT_MAGIC &&
+      state.crc == crc32((const uint8_t*)&state, offsetof(BoutState, crc))) {
+    LOG_INFO(LOG_HEALTH, "Bout tracker restored: %lu min tracked today",
+             (unsigned long)((state.clock - state.dayStart) / 60000));
+    return;
+  }
+
+  memset(&state, 0, sizeof(state));
+  state.magic = BOUT_MAGIC;
+  state.sedentary = 1;
+  saveState();
+  LOG_INFO(LOG_HEALTH, "Bout tracker started fresh");
+}
+
+static int histogramBin(uint32_t ms) {
+  uint32_t minutes = ms / 60000;
+  int bin = 0;
+  while (bin < BOUT_HIST_BINS - 1 && minutes >= boutHistogramEdges[bin]) bin++;
+  return bin;
+}
+
+static void addBout(BoutTotals& totals, bool sedentary, uint32_t length) {
+  if (sedentary) {
+    totals.sedentaryMs += length;
+    totals.sitBouts++;
+    if (length > totals.longestSitMs) totals.longestSitMs = length;
+  } else {
+    totals.activeMs += length;
+    totals.activeBouts++;
+  }
+}
+
+static void closeBout(uint32_t end) {
+  uint32_t length = end - state.boutStart;
+  bool sedentary = state.sedentary;
+
+  addBout(state.today, sedentary, length);
+  if (state.inSession) {
+    // Only the part inside the session counts towards it
+    uint32_t from = (int32_t)(state.sessionStart - state.boutStart) > 0 ? state.sessionStart : state.boutStart;
+    addBout(state.session, sedentary, end - from);
+  }
+  (sedentary ? state.sitHist : state.activeHist)[histogramBin(length)]++;
+
+  LOG_DEBUG(LOG_HEALTH, "%s bout ended after %lu s", sedentary ? "Sitting" : "Active",
+            (unsigned long)(length / 1000));
+
+  state.sedentary = !sedentary;
+  state.boutStart = end;
+  state.pending = 0;
+}
+
+static void rollDay() {
+  state.yesterday = state.today;
+  memset(&state.today, 0, sizeof(state.today));
+  memset(state.sitHist, 0, sizeof(state.sitHist));
+  memset(state.activeHist, 0, sizeof(state.activeHist));
+  state.dayStart = state.clock;
+  LOG_INFO(LOG_HEALTH, "Bout tracker day rolled over");
+}
+
+// Called on every classifier decision
+void boutTrackerUpdate(ActivityClass activity, unsigned long now) {
+  state.clock += now - lastMillis;
+  lastMillis = now;
+
+  bool sedentary = activity <= ACTIVITY_STILL;
+  if (sedentary == (bool)state.sedentary) {
+    state.pending = 0;
+  } else if (!state.pending) {
+    state.pending = 1;
+    state.switchStart = state.clock;
+  } else if (state.clock - state.switchStart >= BOUT_SWITCH_MS) {
+    closeBout(state.switchStart);
+    saveState();
+  }
+
+  if (state.clock - state.dayStart >= DAY_MS) {
+    rollDay();
+    saveState();
+  }
+
+  if (millis() - lastSave >= BOUT_SAVE_INTERVAL_MS) {
+    saveState();
+  }
+}
+
+void boutTrackerAddSteps(int steps) {
+  state.today.steps += steps;
+  if (state.inSession) state.session.steps += steps;
+}
+
+// A retained session/state after a reset resumes the restored session
+void boutTrackerSessionStart() {
+  if (state.inSession) return;
+  memset(&state.session, 0, sizeof(state.session));
+  state.sessionStart = state.clock;
+  state.inSession = 1;
+  saveState();
+}
+
+// Session totals including the bout still in progress
+void boutTrackerSessionEnd(BoutTotals& session, unsigned long& sessionMs) {
+  session = state.session;
+  sessionMs = state.inSession ? state.clock - state.sessionStart : 0;
+
+  if (state.inSession) {
+    uint32_t from = (int32_t)(state.sessionStart - state.boutStart) > 0 ? state.sessionStart : state.boutStart;
+    uint32_t open = state.clock - from;
+    if (state.sedentary) {
+      session.sedentaryMs += open;
+      if (open > session.longestSitMs) session.longestSitMs = open;
+    } else {
+      session.activeMs += open;
+    }
+  }
+
+  state.inSession = 0;
+  saveState();
+}
+
+void boutTrackerToday(BoutTotals& today) {
+  today = state.today;
+  uint32_t open = state.clock - state.boutStart;
+  if (state.sedentary) {
+    today.sedentaryMs += open;
+    if (open > today.longestSitMs) today.longestSitMs = open;
+  } else {
+    today.activeMs += open;
+  }
+}
+
+void boutTrackerYesterday(BoutTotals& yesterday) {
+  yesterday = state.yesterday;
+}
+
+const uint16_t* boutSitHistogram() {
+  return state.sitHist;
+}
+
+const uint16_t* boutActiveHistogram() {
+  return state.activeHist;
+}
+
+// Length of the sitting bout in progress, 0 while active
+unsigned long boutCurrentSitMs() {
+  return state.sedentary ? state.clock - state.boutStart : 0;
+}
+
+unsigned long boutHoursTracked() {
+  return (state.clock - state.dayStart) / 3600000UL;
+}
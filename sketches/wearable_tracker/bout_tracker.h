@@ -0,0 +1,41 @@
+#ifndef BOUT_TRACKER_H
+#define BOUT_TRACKER_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "activity_classifier.h"
+
+// Incremental sitting/active bout tracking from the classifier decisions.
+// Sitting and Still are sedentary, everything else is active. A bout only
+// ends once the other state has lasted BOUT_SWITCH_MS, so a short fidget
+// does not break a sitting bout; the bout is closed where the switch began.
+//
+// All state lives in one fixed-size struct kept in RTC user memory (CRC
+// checked), so a reset or crash keeps today's totals. RTC memory does not
+// survive power loss.
+
+#define BOUT_HIST_BINS 7   // Edges: 1, 5, 10, 20, 30, 60 min
+
+struct BoutTotals {
+  uint32_t sedentaryMs;
+  uint32_t activeMs;
+  uint32_t steps;
+  uint16_t sitBouts;
+  uint16_t activeBouts;
+  uint32_t longestSitMs;
+};
+
+void boutTrackerInit();
+void boutTrackerUpdate(ActivityClass activity, unsigned long now);
+void boutTrackerAddSteps(int steps);
+void boutTrackerSessionStart();
+void boutTrackerSessionEnd(BoutTotals& session, unsigned long& sessionMs);
+void boutTrackerToday(BoutTotals& today);
+void boutTrackerYesterday(BoutTotals& yesterday);
+const uint16_t* boutSitHistogram();
+const uint16_t* boutActiveHistogram();
+unsigned long boutCurrentSitMs();
+unsigned long boutHoursTracked();
+extern const uint8_t boutHistogramEdges[BOUT_HIST_BINS - 1];
+
+#endif
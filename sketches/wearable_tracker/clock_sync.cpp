@@ -0,0 +1,98 @@
+#include "clock_sync.h"
+#include "logger.h"
+#include <PubSubClient.h>
+
+extern PubSubClient client;
+extern PomodoroInfo pomodoroInfo;
+
+struct ClockSample {
+  long offset;          // brain millis() - our millis()
+  unsigned long rtt;
+};
+
+static ClockSample samples[CLOCK_SYNC_SAMPLES];
+static int sampleCount = 0;
+static int nextSlot = 0;
+
+static long offset = 0;
+static unsigned long bestRtt = 0;
+static bool synced = false;
+static bool seeded = false;
+
+static unsigned long pingId = 0;
+static unsigned long lastPing = 0;
+static unsigned long lastBrainTime = 0;
+
+void clockSyncPing() {
+  char payload[48];
+  lastPing = millis();
+  snprintf(payload, sizeof(payload), "{\"id\":%lu,\"t0\":%lu}", ++pingId, lastPing);
+  client.publish("bille/time/ping", payload);
+}
+
+// Periodic ping while connected - low-power mode also pings on every connect
+void clockSyncUpdate() {
+  if (client.connected() && millis() - lastPing >= CLOCK_SYNC_INTERVAL_MS) {
+    clockSyncPing();
+  }
+}
+
+void clockSyncOnPong(unsigned long id, unsigned long t0, unsigned long brainTime) {
+  unsigned long t3 = millis();
+  unsigned long rtt = t3 - t0;
+  if (id != pingId || rtt > CLOCK_SYNC_MAX_RTT_MS) return;   // Stale or queued too long
+
+  // Main brain rebooted - its old samples no longer apply
+  if (synced && (long)(brainTime - lastBrainTime) < 0) {
+    LOG_INFO(LOG_MQTT, "Main brain clock restarted, resyncing");
+    sampleCount = 0;
+    nextSlot = 0;
+  }
+  lastBrainTime = brainTime;
+
+  // Reply assumed to be stamped halfway through the round trip
+  samples[nextSlot].offset = (long)(brainTime + rtt / 2 - t3);
+  samples[nextSlot].rtt = rtt;
+  nextSlot = (nextSlot + 1) % CLOCK_SYNC_SAMPLES;
+  if (sampleCount < CLOCK_SYNC_SAMPLES) sampleCount++;
+
+  int best = 0;
+  for (int i = 1; i < sampleCount; i++) {
+    if (samples[i].rtt < samples[best].rtt) best = i;
+  }
+  offset = samples[best].offset;
+  bestRtt = samples[best].rtt;
+  synced = true;
+
+  LOG_DEBUG(LOG_MQTT, "Clock offset %ld ms (rtt %lu, best %lu)", offset, rtt, bestRtt);
+}
+
+// Rough offset from a message timestamp, used only until the first pong.
+// Ignores network delay, so it can be off by a round trip or more.
+void clockSyncSeed(unsigned long brainTime) {
+  if (synced || seeded) return;
+  offset = (long)(brainTime - millis());
+  seeded = true;
+}
+
+bool clockSynced() {
+  return synced;
+}
+
+unsigned long brainMillis() {
+  return millis() + offset;
+}
+
+long clockOffset() {
+  return offset;
+}
+
+unsigned long clockRtt() {
+  return bestRtt;
+}
+
+unsigned long pomodoroRemainingSeconds() {
+  if (!pomodoroInfo.dataAvailable || pomodoroInfo.deadline == 0) return 0;
+  long remaining = (long)(pomodoroInfo.deadline - brainMillis());
+  return remaining > 0 ? remaining / 1000 : 0;
+}
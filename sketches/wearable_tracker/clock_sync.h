@@ -0,0 +1,24 @@
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "biometric_data.h"
+
+// Estimate of the main brain's millis() clock, which Pomodoro deadlines use.
+// Ping/pong over MQTT; the lowest round-trip of the recent samples wins
+// because its reply time is closest to the midpoint.
+
+void clockSyncPing();
+void clockSyncUpdate();
+void clockSyncOnPong(unsigned long id, unsigned long t0, unsigned long brainTime);
+void clockSyncSeed(unsigned long brainTime);
+bool clockSynced();
+unsigned long brainMillis();
+long clockOffset();
+unsigned long clockRtt();
+
+// Seconds left until the current Pomodoro deadline, on the brain clock
+unsigned long pomodoroRemainingSeconds();
+
+#endif
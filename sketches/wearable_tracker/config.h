@@ -8,10 +8,61 @@
 #define MQTT_PORT       1883
 #define MQTT_USER       "bille_mqtt"
 #define MQTT_PASSWORD   "BillE2025_Secure!" 
+#define MQTT_BUFFER_SIZE 768                // PubSubClient packet buffer; bille/status/wearable_system with its boot object is ~600
 
 // Pin definitions
 #define OLED_SDA        D2
 #define OLED_SCL        D1
 #define BUTTON_PIN      D3
+#define MOTION_INT_PIN  D5      // MPU6050 INT, active high
+
+// MPU6050 FIFO acquisition
+#define MOTION_SAMPLE_RATE_HZ     50        // FIFO sample rate
+#define MOTION_RING_SIZE          256       // Samples kept in RAM (~5 s at 50 Hz)
+#define MOTION_DRAIN_INTERVAL_MS  250       // Bulk FIFO read 4 times per second
+#define MOTION_LSB_PER_G          8192.0    // ±4 g full scale
+
+// MPU6050 motion interrupt - timestamps movement without polling
+#define MOTION_INT_THRESHOLD      50        // 2 mg per LSB, any axis after the high-pass (0.10 g)
+#define MOTION_INT_DURATION_MS    5         // Samples over threshold before INT fires
+#define IDLE_SLEEP_MAX_MS         50        // Longest CPU idle between loop passes (button stays responsive)
+
+// Low-power radio duty cycling
+#define LOW_POWER_MODE              1         // 0 = WiFi always on, publish every read
+#define SAMPLE_INTERVAL_MS          5000      // Sensor read into RAM
+#define SAMPLE_BUFFER_SIZE          32        // Samples held between uploads (forces a window when full)
+#define BATCH_INTERVAL_IDLE_MS      120000UL  // Upload every 2 min with no session
+#define BATCH_INTERVAL_SESSION_MS   60000UL   // Upload every minute during work
+#define BATCH_INTERVAL_BREAK_MS     15000UL   // Upload every 15 s during breaks
+#define RADIO_WINDOW_MS             1500      // Stay connected after upload for inbound messages
+#define RADIO_CONNECT_TIMEOUT_MS    10000     // Give up and keep buffering after this
+#define SUMMARY_INTERVAL_MS         60000UL   // JSON state for HA, at most once a minute
+#define STATUS_INTERVAL_MS          600000UL  // Wearable status every 10 min
+
+// Clock sync with the main brain (Pomodoro deadlines are in its millis())
+#define CLOCK_SYNC_INTERVAL_MS  60000     // Ping period while connected
+#define CLOCK_SYNC_SAMPLES      4         // Recent pongs; lowest round trip is used
+#define CLOCK_SYNC_MAX_RTT_MS   1000      // Replies slower than this are ignored
+
+// Sitting/active bout tracking
+#define BOUT_SWITCH_MS          60000UL   // Opposite state must last this long to end a bout
+#define BOUT_SAVE_INTERVAL_MS   60000UL   // RTC memory refresh (also saved on every bout change)
+#define RTC_BOUT_BLOCK          32        // RTC user memory block; 0-31 are left to OTA (eboot)
+
+// Fast WiFi connect (fast_connect.h)
+#define RTC_WIFI_BLOCK        96        // Cached AP and lease in RTC user memory; after the bout state
+#define WIFI_FAST_TIMEOUT_MS  1500      // Direct association allowed this long before a full scan
+
+// Notification overlay
+#define TOAST_QUEUE_SIZE    4         // Pending toasts; lowest priority is evicted when full
+#define TOAST_SESSION_MS    2000      // Session started/ended
+#define TOAST_ALERT_MS      6000      // Movement reminders
+
+// Logging
+#define LOG_NODE_NAME       "wearable"
+#define LOG_COMPILE_LEVEL   LOG_LEVEL_DEBUG  // Lower to LOG_LEVEL_WARN to strip the rest
+#define LOG_DEFAULT_LEVEL   LOG_LEVEL_INFO   // Runtime level per module, changeable over MQTT
+#define LOG_BUFFER_SIZE     2048             // In-RAM ring buffer, dumped on bille/commands/log
+#define LOG_SERIAL_ENABLED  1                // 0 for production: ring buffer + MQTT only
 
 #endif
\ No newline at end of file
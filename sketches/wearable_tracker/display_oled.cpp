@@ -1,6 +1,9 @@
 #include "display_oled.h"
 #include "biometric_data.h"
 #include "config.h"
+#include "logger.h"
+#include "notification_overlay.h"
+#include "clock_sync.h"
 #include <U8g2lib.h>
 #include <ESP8266WiFi.h>
 #include <PubSubClient.h>
@@ -10,13 +13,85 @@ extern BiometricData currentBio;
 extern PomodoroInfo pomodoroInfo;
 extern PubSubClient client;
 
+// SSD1306 full buffer: 8 tile rows (pages) of 16 tiles, each tile 8 bytes
+#define DISPLAY_TILE_COLS  16
+#define DISPLAY_TILE_ROWS  8
+#define DISPLAY_BUFFER_SIZE (DISPLAY_TILE_COLS * DISPLAY_TILE_ROWS * 8)
+
+// Copy of what the panel currently shows
+static uint8_t shadowBuffer[DISPLAY_BUFFER_SIZE];
+static bool shadowValid = false;
+
+static unsigned long framesFlushed = 0;
+static unsigned long tileBytesSent = 0;
+static unsigned long flushMicros = 0;
+static unsigned long fullFrameMicros = 0;   // Measured on the first (full) push
+
+static bool tileDirty(const uint8_t* buffer, uint8_t tx, uint8_t ty) {
+  int offset = (ty * DISPLAY_TILE_COLS + tx) * 8;
+  return memcmp(buffer + offset, shadowBuffer + offset, 8) != 0;
+}
+
+// Composites any active toast, then sends only the 8x8 tiles that differ from
+// the panel, merged into runs per tile row. Every screen must go through here
+// so the shadow stays in sync.
+void flushDisplay() {
+  toastComposite();
+  
+  uint8_t* buffer = display.getBufferPtr();
+  unsigned long start = micros();
+  int tilesSent = 0;
+
+  if (!shadowValid) {
+    display.sendBuffer();
+    fullFrameMicros = micros() - start;
+    tilesSent = DISPLAY_TILE_COLS * DISPLAY_TILE_ROWS;
+    shadowValid = true;
+  } else {
+    for (uint8_t ty = 0; ty < DISPLAY_TILE_ROWS; ty++) {
+      uint8_t tx = 0;
+      while (tx < DISPLAY_TILE_COLS) {
+        if (!tileDirty(buffer, tx, ty)) {
+          tx++;
+          continue;
+        }
+        uint8_t run = 1;
+        while (tx + run < DISPLAY_TILE_COLS && tileDirty(buffer, tx + run, ty)) run++;
+        display.updateDisplayArea(tx, ty, run, 1);
+        tilesSent += run;
+        tx += run;
+      }
+    }
+  }
+
+  memcpy(shadowBuffer, buffer, DISPLAY_BUFFER_SIZE);
+  framesFlushed++;
+  tileBytesSent += tilesSent * 8;
+  flushMicros += micros() - start;
+}
+
+unsigned long displayFrames() {
+  return framesFlushed;
+}
+
+// Average framebuffer bytes sent over I2C per frame (a full push is 1024)
+unsigned long displayBytesPerFrame() {
+  return framesFlushed ? tileBytesSent / framesFlushed : 0;
+}
+
+// Average time saved per frame against the measured full push, in microseconds
+long displayMicrosSavedPerFrame() {
+  if (framesFlushed == 0) return 0;
+  return (long)fullFrameMicros - (long)(flushMicros / framesFlushed);
+}
+
 void updateDisplay() {
   static int currentMode = 0;
   static unsigned long lastUpdate = 0;
   
   // Handle button press
   if (readButton()) {
-    Serial.println("Button detected in updateDisplay()");
+    LOG_DEBUG(LOG_DISPLAY, "Button detected in updateDisplay()");
     
     // Determine max modes based on session state
     int maxModes;
@@ -28,14 +103,26 @@ void updateDisplay() {
     
     // Cycle to next mode
     currentMode = (currentMode + 1) % maxModes;
-    Serial.println("Switched to mode: " + String(currentMode));
+    LOG_DEBUG(LOG_DISPLAY, "Switched to mode: %d", currentMode);
     
     // Force immediate update
     lastUpdate = 0;
   }
   
-  // Update display every 2 seconds OR immediately after mode change
-  if (millis() - lastUpdate > 2000) {
+  // Redraw right away when a toast appears or expires
+  if (toastUpdate()) {
+    lastUpdate = 0;
+  }
+  
+  // Pomodoro screens tick every second for the countdown - only the digit
+  // tiles change, so the flush stays small. Others refresh every 2 s, and so
+  // does the countdown while a toast covers its digits.
+  bool countdown = !toastActive() &&
+                   (currentMode == 2 || (currentMode == 3 && pomodoroInfo.currentState == WORK_SESSION));
+  unsigned long interval = countdown ? 1000 : 2000;
+  
+  // Update display on the interval OR immediately after mode change
+  if (millis() - lastUpdate > interval) {
     switch (currentMode) {
       case 0:
         showBiometricData();
@@ -74,7 +161,7 @@ void showBiometricData() {
   display.printf("Steps: %d", currentBio.stepCount);
   
   display.setCursor(0, 45);
-  display.printf("Activity: %s", currentBio.activity.c_str());
+  display.printf("Activity: %s", activityName(currentBio.activity));
   
   // Add Pomodoro context if available
   if (sessionActive && pomodoroInfo.dataAvailable) {
@@ -88,7 +175,7 @@ void showBiometricData() {
     }
   }
   
-  display.sendBuffer();
+  flushDisplay();
 }
 
 void showWelcomeScreen() {
@@ -100,7 +187,7 @@ void showWelcomeScreen() {
   display.print("Wearable");
   display.setCursor(0, 60);
   display.print("MQTT Ready!");
-  display.sendBuffer();
+  flushDisplay();
 }
 
 void showActivityStatus() {
@@ -111,12 +198,12 @@ void showActivityStatus() {
   display.print("Activity:");
   display.setCursor(0, 35);
   display.setFont(u8g2_font_8x13_tf);
-  display.print(currentBio.activity);
+  display.print(activityName(currentBio.activity));
   display.setFont(u8g2_font_6x10_tf);
   display.setCursor(0, 55);
   display.printf("Accel: %.2f g", currentBio.acceleration);
   
-  display.sendBuffer();
+  flushDisplay();
 }
 
 void showBreakCompliance() {
@@ -145,7 +232,7 @@ void showBreakCompliance() {
     
   }
   
-  display.sendBuffer();
+  flushDisplay();
 }
 
 bool readButton() {
@@ -201,7 +288,7 @@ void nextDisplayMode() {
 
 void handleButtonPress() {
   if (readButton()) {
-    Serial.println("Button pressed - changing display mode");
+    LOG_DEBUG(LOG_DISPLAY, "Button pressed - changing display mode");
     nextDisplayMode();
   }
 }
@@ -210,32 +297,19 @@ void showPomodoroProgress() {
   display.clearBuffer();
   display.setFont(u8g2_font_6x10_tf);
   
-  // Calculate progress
-  int totalDuration;
+  // Duration comes from the main brain, so snoozes and per-user lengths show
   String stateText;
   switch (pomodoroInfo.currentState) {
-    case WORK_SESSION: 
-      totalDuration = 25 * 60; 
-      stateText = "FOCUS TIME";
-      break;
-    case SHORT_BREAK: 
-      totalDuration = 5 * 60; 
-      stateText = "SHORT BREAK";
-      break;
-    case LONG_BREAK: 
-      totalDuration = 15 * 60; 
-      stateText = "LONG BREAK";
-      break;
-    default: 
-      totalDuration = 1;
-      stateText = "IDLE";
-      break;
+    case WORK_SESSION: stateText = "FOCUS TIME"; break;
+    case SHORT_BREAK: stateText = "SHORT BREAK"; break;
+    case LONG_BREAK: stateText = "LONG BREAK"; break;
+    default: stateText = "IDLE"; break;
   }
+  int totalDuration = pomodoroInfo.stateDuration > 0 ? pomodoroInfo.stateDuration : 1;
   
-  // Calculate real-time remaining
-  unsigned long realTimeElapsed = (millis() - pomodoroInfo.lastUpdate) / 1000;
-  unsigned long currentRemaining = (pomodoroInfo.timeRemaining > realTimeElapsed) ? 
-                                   (pomodoroInfo.timeRemaining - realTimeElapsed) : 0;
+  // Count down to the deadline on the estimated main brain clock
+  unsigned long currentRemaining = pomodoroRemainingSeconds();
+  if (currentRemaining > (unsigned long)totalDuration) currentRemaining = totalDuration;
   
   int elapsed = totalDuration - currentRemaining;
   int progressPercent = (elapsed * 100) / totalDuration;
@@ -248,14 +322,15 @@ void showPomodoroProgress() {
   display.setCursor(0, 25);
   display.printf("Cycle: %d", pomodoroInfo.completedCycles);
   
-  // Time remaining
+  // Time remaining - baseline 39 keeps the digits inside tile row 4, so the
+  // per-second tick only dirties that row
   int minutes = currentRemaining / 60;
   int seconds = currentRemaining % 60;
-  display.setCursor(0, 38);
+  display.setCursor(0, 39);
   display.printf("Time: %d:%02d", minutes, seconds);
   
   // Progress percentage
-  display.setCursor(80, 38);
+  display.setCursor(80, 39);
   display.printf("%d%%", progressPercent);
   
   // Progress bar frame
@@ -269,5 +344,5 @@ void showPomodoroProgress() {
     display.drawBox(6, 46, progressPixels, 10);
   }
   
-  display.sendBuffer();
+  flushDisplay();
 }
@@ -15,6 +15,12 @@ void handleButtonPress();
 bool readButton();
 void nextDisplayMode();
 
+// Dirty-tile flush - use instead of display.sendBuffer()
+void flushDisplay();
+unsigned long displayFrames();
+unsigned long displayBytesPerFrame();
+long displayMicrosSavedPerFrame();
+
 extern bool sessionActive;
 
 #endif
\ No newline at end of file
@@ -1,5 +1,7 @@
 #include "health_monitor.h"
 #include "biometric_data.h"
+#include "logger.h"
+#include "bout_tracker.h"
 #include <PubSubClient.h>
 #include <ArduinoJson.h>
 #include <Arduino.h>
@@ -23,7 +25,8 @@ void publishHealthAlerts() {
   // Check for extended sitting during work sessions
   unsigned long timeSinceMovement = millis() - currentBio.lastMovement;
   
-  if (pomodoroInfo.currentState == WORK_SESSION && timeSinceMovement > 20 * 60 * 1000) { // 20 minutes
+  // Sitting bout length ignores short fidgets that would reset lastMovement
+  if (pomodoroInfo.currentState == WORK_SESSION && boutCurrentSitMs() > 20 * 60 * 1000UL) { // 20 minutes
     alertMessage = "Consider taking a short movement break";
     alertLevel = "warning";
     hasAlert = true;
@@ -41,12 +44,13 @@ void publishHealthAlerts() {
     alertDoc["alert"] = alertMessage;
     alertDoc["level"] = alertLevel;
     alertDoc["timeSinceMovement"] = timeSinceMovement / 60000; // minutes
+    alertDoc["sittingBoutMinutes"] = boutCurrentSitMs() / 60000;
     alertDoc["pomodoroState"] = pomodoroInfo.currentState;
     
     String alertString;
     serializeJson(alertDoc, alertString);
     client.publish("bille/alerts/health", alertString.c_str());
     
-    Serial.println("Health alert: " + alertMessage);
+    LOG_INFO(LOG_HEALTH, "Health alert: %s", alertMessage.c_str());
   }
 }
@@ -0,0 +1,119 @@
+#include "logger.h"
+#include <stdarg.h>
+
+static const char* const moduleNames[LOG_MODULE_COUNT] = {
+  "system", "sensor", "display", "mqtt", "health"
+};
+static const char* const levelNames[] = { "NONE", "ERROR", "WARN", "INFO", "DEBUG" };
+
+uint8_t logLevels[LOG_MODULE_COUNT];
+
+// Ring buffer - positions are running byte counts, the index is pos % size
+static char logBuffer[LOG_BUFFER_SIZE];
+static unsigned long logHead = 0;       // Total bytes written
+static unsigned long serialTail = 0;    // Bytes already sent to Serial
+static unsigned long droppedBytes = 0;  // Bytes overwritten before reaching Serial
+
+void logInit() {
+  for (int i = 0; i < LOG_MODULE_COUNT; i++) {
+    logLevels[i] = LOG_DEFAULT_LEVEL;
+  }
+}
+
+static void logAppend(const char* data, size_t len) {
+  size_t offset = logHead % LOG_BUFFER_SIZE;
+  size_t first = (len < LOG_BUFFER_SIZE - offset) ? len : LOG_BUFFER_SIZE - offset;
+  memcpy(logBuffer + offset, data, first);
+  memcpy(logBuffer, data + first, len - first);
+  logHead += len;
+
+  // Serial fell a whole buffer behind - skip the oldest unsent bytes
+  if (logHead - serialTail > LOG_BUFFER_SIZE) {
+    droppedBytes += logHead - serialTail - LOG_BUFFER_SIZE;
+    serialTail = logHead - LOG_BUFFER_SIZE;
+  }
+}
+
+void logWrite(uint8_t module, uint8_t level, PGM_P format, ...) {
+  char line[160];
+  int len = snprintf(line, sizeof(line), "[%lu][%s][%s] ",
+                     millis(), levelNames[level], moduleNames[module]);
+
+  // Leave room for the trailing newline
+  int room = sizeof(line) - len - 1;
+  va_list args;
+  va_start(args, format);
+  int msgLen = vsnprintf_P(line + len, room, format, args);
+  va_end(args);
+
+  if (msgLen > 0) len += (msgLen < room) ? msgLen : room - 1;
+  line[len++] = '\n';
+
+  logAppend(line, len);
+}
+
+// Called from loop(): hands Serial only what its TX FIFO can take right now
+void logDrain() {
+#if LOG_SERIAL_ENABLED
+  while (serialTail != logHead) {
+    int room = Serial.availableForWrite();
+    if (room <= 0) return;
+
+    size_t offset = serialTail % LOG_BUFFER_SIZE;
+    unsigned long chunk = LOG_BUFFER_SIZE - offset;
+    if (chunk > logHead - serialTail) chunk = logHead - serialTail;
+    if (chunk > (unsigned long)room) chunk = room;
+
+    Serial.write((const uint8_t*)logBuffer + offset, chunk);
+    serialTail += chunk;
+  }
+#else
+  serialTail = logHead;
+#endif
+}
+
+static int findName(const char* const* names, int count, const char* name) {
+  for (int i = 0; i < count; i++) {
+    if (strcasecmp(names[i], name) == 0) return i;
+  }
+  return -1;
+}
+
+bool logSetLevel(const char* moduleName, const char* levelName) {
+  int level = findName(levelNames, LOG_LEVEL_DEBUG + 1, levelName);
+  if (level < 0) return false;
+
+  if (strcasecmp(moduleName, "all") == 0) {
+    for (int i = 0; i < LOG_MODULE_COUNT; i++) logLevels[i] = level;
+  } else {
+    int module = findName(moduleNames, LOG_MODULE_COUNT, moduleName);
+    if (module < 0) return false;
+    logLevels[module] = level;
+  }
+  return true;
+}
+
+// Streams the buffered history straight from the ring, no copy needed
+void logPublish(PubSubClient& mqtt, const char* topic) {
+  unsigned long start = 0;
+  if (logHead > LOG_BUFFER_SIZE) {
+    // Oldest line was partly overwritten - start at the next full line
+    start = logHead - LOG_BUFFER_SIZE;
+    while (start < logHead && logBuffer[start % LOG_BUFFER_SIZE] != '\n') start++;
+    if (start < logHead) start++;
+  }
+
+  mqtt.beginPublish(topic, logHead - start, false);
+  while (start < logHead) {
+    size_t offset = start % LOG_BUFFER_SIZE;
+    unsigned long chunk = LOG_BUFFER_SIZE - offset;
+    if (chunk > logHead - start) chunk = logHead - start;
+    mqtt.write((const uint8_t*)logBuffer + offset, chunk);
+    start += chunk;
+  }
+  mqtt.endPublish();
+}
+
+unsigned long logDroppedBytes() {
+  return droppedBytes;
+}
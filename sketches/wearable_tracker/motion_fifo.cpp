@@ -0,0 +1,126 @@
+#include "motion_fifo.h"
+#include "logger.h"
+#include <MPU6050.h>
+
+extern MPU6050 mpu;
+
+#define MPU_FIFO_SIZE      1024
+#define BYTES_PER_SAMPLE   6
+#define SAMPLES_PER_READ   20      // 120 bytes per I2C burst
+
+static unsigned long lastDrainTime = 0;
+
+// Written by the ISR only
+static volatile unsigned long irqLastTime = 0;
+static volatile unsigned long irqCount = 0;
+static unsigned long irqSeen = 0;
+
+void motionInit() {
+  // 1 kHz internal rate with the 20 Hz low-pass, divided down to the sample rate
+  mpu.setDLPFMode(MPU6050_DLPF_BW_20);
+  mpu.setRate(1000 / MOTION_SAMPLE_RATE_HZ - 1);
+  mpu.setFullScaleAccelRange(MPU6050_ACCEL_FS_4);
+
+  // Accelerometer only: 6 bytes per sample, ~3.4 s of headroom at 50 Hz
+  mpu.setAccelFIFOEnabled(true);
+  mpu.setFIFOEnabled(true);
+  mpu.resetFIFO();
+
+  lastDrainTime = millis();
+  LOG_INFO(LOG_SENSOR, "MPU6050 FIFO at %d Hz, drain every %d ms",
+           MOTION_SAMPLE_RATE_HZ, MOTION_DRAIN_INTERVAL_MS);
+}
+
+void motionUpdate() {
+  if (millis() - lastDrainTime >= MOTION_DRAIN_INTERVAL_MS) {
+    motionDrainFifo();
+  }
+}
+
+// Bulk-reads everything in the FIFO into the ring, returns samples read
+int motionDrainFifo() {
+  lastDrainTime = millis();
+
+  uint16_t count = mpu.getFIFOCount();
+  if (count >= MPU_FIFO_SIZE || mpu.getIntFIFOBufferOverflowStatus()) {
+    // Data is no longer sample-aligned after an overflow - start clean
+    mpu.resetFIFO();
+    motionFifoOverflows++;
+    LOG_WARN(LOG_SENSOR, "MPU6050 FIFO overflow, reset");
+    return 0;
+  }
+
+  int available = count / BYTES_PER_SAMPLE;
+  int read = 0;
+  uint8_t buffer[SAMPLES_PER_READ * BYTES_PER_SAMPLE];
+
+  while (read < available) {
+    int chunk = available - read;
+    if (chunk > SAMPLES_PER_READ) chunk = SAMPLES_PER_READ;
+    mpu.getFIFOBytes(buffer, chunk * BYTES_PER_SAMPLE);
+
+    for (int i = 0; i < chunk; i++) {
+      const uint8_t* p = buffer + i * BYTES_PER_SAMPLE;
+      AccelSample& s = motionRing[motionWriteIndex % MOTION_RING_SIZE];
+      s.x = (int16_t)((p[0] << 8) | p[1]);
+      s.y = (int16_t)((p[2] << 8) | p[3]);
+      s.z = (int16_t)((p[4] << 8) | p[5]);
+      motionWriteIndex++;
+    }
+    read += chunk;
+  }
+
+  return read;
+}
+
+// Newest sample was taken at the last drain; older ones are one period apart
+unsigned long motionSampleTime(unsigned long index) {
+  unsigned long age = motionWriteIndex - 1 - index;
+  return lastDrainTime - age * (1000 / MOTION_SAMPLE_RATE_HZ);
+}
+
+unsigned long motionMsUntilDrain() {
+  unsigned long elapsed = millis() - lastDrainTime;
+  return elapsed >= MOTION_DRAIN_INTERVAL_MS ? 0 : MOTION_DRAIN_INTERVAL_MS - elapsed;
+}
+
+// INT pulses once per over-threshold sample while the wearer moves
+static void IRAM_ATTR onMotionInterrupt() {
+  irqLastTime = millis();
+  irqCount++;
+}
+
+void motionInterruptInit() {
+  // The high-pass only feeds the motion detector, FIFO data stays unfiltered
+  mpu.setDHPFMode(MPU6050_DHPF_5);
+  mpu.setMotionDetectionThreshold(MOTION_INT_THRESHOLD);
+  mpu.setMotionDetectionDuration(MOTION_INT_DURATION_MS);
+
+  // Active-high 50 us pulses: nothing to clear over I2C after each event
+  mpu.setInterruptMode(false);
+  mpu.setInterruptDrive(false);
+  mpu.setInterruptLatch(false);
+  mpu.setIntEnabled(0);
+  mpu.setIntMotionEnabled(true);
+
+  pinMode(MOTION_INT_PIN, INPUT);
+  attachInterrupt(digitalPinToInterrupt(MOTION_INT_PIN), onMotionInterrupt, RISING);
+  LOG_INFO(LOG_SENSOR, "Motion interrupt on GPIO %d, threshold %d mg",
+           MOTION_INT_PIN, MOTION_INT_THRESHOLD * 2);
+}
+
+// True if the ISR saw movement since the last call; when is its millis() stamp
+bool motionTakeMovement(unsigned long& when) {
+  noInterrupts();
+  unsigned long count = irqCount;
+  when = irqLastTime;
+  interrupts();
+
+  if (count == irqSeen) return false;
+  irqSeen = count;
+  return true;
+}
+
+unsigned long motionInterruptCount() {
+  return irqCount;
+}
@@ -0,0 +1,31 @@
+#ifndef MOTION_FIFO_H
+#define MOTION_FIFO_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Raw accelerometer sample as stored in the MPU6050 FIFO
+struct AccelSample {
+  int16_t x;
+  int16_t y;
+  int16_t z;
+};
+
+void motionInit();
+void motionUpdate();
+int motionDrainFifo();
+unsigned long motionSampleTime(unsigned long index);
+unsigned long motionMsUntilDrain();
+
+// Motion-detection interrupt on MOTION_INT_PIN
+void motionInterruptInit();
+bool motionTakeMovement(unsigned long& when);
+unsigned long motionInterruptCount();
+
+// Sample ring - positions are running sample counts, the slot is index % size.
+// Consumers keep their own cursor and catch up to motionWriteIndex.
+extern AccelSample motionRing[MOTION_RING_SIZE];
+extern unsigned long motionWriteIndex;
+extern unsigned long motionFifoOverflows;
+
+#endif
@@ -1,150 +1,174 @@
 #include "mqtt_communication.h"
 #include "config.h"
 #include "biometric_data.h"
+#include "logger.h"
+#include "power_manager.h"
+#include "motion_fifo.h"
+#include "display_oled.h"
+#include "notification_overlay.h"
+#include "clock_sync.h"
+#include "biometric_batch.h"
+#include "bout_tracker.h"
+#include "fast_connect.h"
 #include <ESP8266WiFi.h>
 #include <PubSubClient.h>
 #include <ArduinoJson.h>
-#include <U8g2lib.h>
 
 extern PubSubClient client;
 extern BiometricData currentBio;
 extern PomodoroInfo pomodoroInfo;
-extern U8G2_SSD1306_128X64_NONAME_F_HW_I2C display;
 
 void setup_wifi() {
-  delay(10);
-  Serial.println();
-  Serial.print("Connecting to ");
-  Serial.println(WIFI_SSID);
+  bootMark(BOOT_SETUP);
+  LOG_INFO(LOG_SYSTEM, "Connecting to %s", WIFI_SSID);
 
-  WiFi.mode(WIFI_STA);
-  WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
-
-  while (WiFi.status() != WL_CONNECTED) {
-    delay(500);
-    Serial.print(".");
+  // Cached AP and lease first, full scan as the fallback (fast_connect.h)
+  wifiStart();
+  while (!wifiPoll()) {
+    delay(10);
+    logDrain();
   }
 
   randomSeed(micros());
-  Serial.println("");
-  Serial.println("WiFi connected");
-  Serial.print("IP address: ");
-  Serial.println(WiFi.localIP());
+  LOG_INFO(LOG_SYSTEM, "WiFi connected in %lu ms%s, IP address: %s", wifiConnectMs(),
+           wifiConnectedFast() ? " (cached AP)" : "", WiFi.localIP().toString().c_str());
+}
+
+// Single connection attempt - used directly by the low-power radio windows
+bool connect_mqtt() {
+  LOG_INFO(LOG_MQTT, "Attempting MQTT connection...");
+  
+  // Create a random client ID
+  String clientId = "BillE-Wearable-";
+  clientId += String(random(0xffff), HEX);
+  
+  // The will clears our retained summary if we vanish without a DISCONNECT.
+  // Low-power windows end with one, so the summary outlives them.
+  if (!client.connect(clientId.c_str(), MQTT_USER, MQTT_PASSWORD, "bille/data/biometric", 0, true, "")) {
+    LOG_WARN(LOG_MQTT, "MQTT connect failed, rc=%d", client.state());
+    return false;
+  }
+  
+  LOG_INFO(LOG_MQTT, "MQTT connected");
+  bootMark(BOOT_MQTT);
+  
+  // Subscribe to control topics
+  client.subscribe("bille/session/state");
+  client.subscribe("bille/pomodoro/state");
+  client.subscribe("bille/wearable/request");
+  client.subscribe("bille/alerts/movement");
+  client.subscribe("bille/commands/log");
+  client.subscribe("bille/time/pong");
+  
+  // Announce presence
+  client.publish("bille/status/wearable", "online", true);
+  
+  // Offset sample on every connect - a low-power window may be the only chance
+  clockSyncPing();
+  return true;
 }
 
 void reconnect_mqtt() {
   while (!client.connected()) {
-    Serial.print("Attempting MQTT connection...");
-    
-    // Create a random client ID
-    String clientId = "BillE-Wearable-";
-    clientId += String(random(0xffff), HEX);
-    
-    if (client.connect(clientId.c_str(), MQTT_USER, MQTT_PASSWORD)) {
-      Serial.println("connected");
-      
-      // Subscribe to control topics
-      client.subscribe("bille/session/state");
-      client.subscribe("bille/pomodoro/state");
-      client.subscribe("bille/wearable/request");
-      client.subscribe("bille/alerts/movement");
-      
-      // Announce presence
-      client.publish("bille/status/wearable", "online", true);
-      
-    } else {
-      Serial.print("failed, rc=");
-      Serial.print(client.state());
-      Serial.println(" try again in 5 seconds");
+    if (!connect_mqtt()) {
+      LOG_WARN(LOG_MQTT, "Trying again in 5 seconds");
+      logDrain();
       delay(5000);
     }
   }
 }
 
 void mqtt_callback(char* topic, byte* payload, unsigned int length) {
-  Serial.print("Message arrived [");
-  Serial.print(topic);
-  Serial.print("] ");
-  
   String message;
   for (int i = 0; i < length; i++) {
     message += (char)payload[i];
   }
-  Serial.println(message);
+  LOG_DEBUG(LOG_MQTT, "Message arrived [%s] %s", topic, message.c_str());
   
   StaticJsonDocument<300> doc;
   deserializeJson(doc, message);
   
   // Handle session state updates
   if (String(topic) == "bille/session/state") {
-    sessionActive = doc["active"];
+    bool active = doc["active"];
+    
+    // Retained state is redelivered on every radio window - only react to changes
+    if (active == sessionActive) return;
+    
+    sessionActive = active;
     currentUser = doc["userId"].as<String>();
     
     if (sessionActive) {
       // Reset step counter for new session
       extern int stepCount;
       stepCount = 0;
+      currentBio.stepCount = 0;
+      boutTrackerSessionStart();
       
-      // Show session start notification
-      display.clearBuffer();
-      display.setFont(u8g2_font_8x13_tf);
-      display.setCursor(0, 30);
-      display.print("Session");
-      display.setCursor(0, 50);
-      display.print("Started!");
-      display.sendBuffer();
-      delay(2000);
+      toastPush("Session", "Started!", TOAST_SESSION, TOAST_SESSION_MS);
       
-      Serial.println("Session started for: " + currentUser);
+      LOG_INFO(LOG_MQTT, "Session started for: %s", currentUser.c_str());
     } else {
+      publishActivitySummary();
       currentUser = "";
       
-      // Show session end notification
-      display.clearBuffer();
-      display.setFont(u8g2_font_8x13_tf);
-      display.setCursor(0, 30);
-      display.print("Session");
-      display.setCursor(0, 50);
-      display.print("Ended");
-      display.sendBuffer();
-      delay(2000);
+      toastPush("Session", "Ended", TOAST_SESSION, TOAST_SESSION_MS);
       
-      Serial.println("Session ended");
+      LOG_INFO(LOG_MQTT, "Session ended");
     }
   }
   
   // Handle Pomodoro state updates
   else if (String(topic) == "bille/pomodoro/state") {
     pomodoroInfo.currentState = (PomodoroState)doc["state"].as<int>();
-    pomodoroInfo.timeRemaining = doc["timeRemaining"];
+    pomodoroInfo.stateDuration = doc["stateDuration"];
+    pomodoroInfo.deadline = doc["deadline"];
     pomodoroInfo.completedCycles = doc["completedCycles"];
     pomodoroInfo.snoozed = doc["snoozed"];
     pomodoroInfo.snoozeCount = doc["snoozeCount"];
     pomodoroInfo.stateText = doc["stateText"].as<String>();
     pomodoroInfo.dataAvailable = true;
     pomodoroInfo.lastUpdate = millis();
+    clockSyncSeed(doc["timestamp"]);
     
-    Serial.println("Pomodoro state updated: " + pomodoroInfo.stateText);
+    LOG_DEBUG(LOG_MQTT, "Pomodoro state updated: %s", pomodoroInfo.stateText.c_str());
   }
   
   // Handle movement reminders
   else if (String(topic) == "bille/alerts/movement") {
     String reminderMsg = doc["message"].as<String>();
     
-    display.clearBuffer();
-    display.setFont(u8g2_font_8x13_tf);
-    display.setCursor(0, 30);
-    display.print(reminderMsg);
-    display.sendBuffer();
+    toastPush("Move!", reminderMsg.c_str(), TOAST_ALERT, TOAST_ALERT_MS);
     
-    Serial.println("Movement reminder: " + reminderMsg);
+    LOG_INFO(LOG_HEALTH, "Movement reminder: %s", reminderMsg.c_str());
     
   }
   
+  // Clock offset replies from the main brain
+  else if (String(topic) == "bille/time/pong") {
+    clockSyncOnPong(doc["id"], doc["t0"], doc["brain"]);
+  }
+  
   // Handle data requests
   else if (String(topic) == "bille/wearable/request") {
     publishBiometricData();
   }
+  
+  // Handle log commands (dump ring buffer / change module level)
+  else if (String(topic) == "bille/commands/log") {
+    const char* node = doc["node"] | "all";
+    if (strcmp(node, "all") == 0 || strcmp(node, LOG_NODE_NAME) == 0) {
+      String command = doc["command"].as<String>();
+      
+      if (command == "dump") {
+        logPublish(client, "bille/logs/" LOG_NODE_NAME);
+      } else if (command == "level") {
+        if (!logSetLevel(doc["module"] | "all", doc["level"] | "info")) {
+          LOG_WARN(LOG_SYSTEM, "Unknown log module or level");
+        }
+      }
+    }
+  }
 }
 
 void publishBiometricData() {
@@ -154,34 +178,153 @@ void publishBiometricData() {
   
   // Publish individual sensor values to HA
   client.publish("bille/sensors/steps", String(currentBio.stepCount).c_str());
-  client.publish("bille/sensors/activity", currentBio.activity.c_str());
+  client.publish("bille/sensors/activity", activityName(currentBio.activity));
 
   unsigned long minutesSinceMovement = (millis() - currentBio.lastMovement) / 60000 ;
   client.publish("bille/sensors/last_movement_minutes", String(minutesSinceMovement).c_str());
   
-  
-  // Publish combined biometric data
+  publishBiometricSummary();
+}
+
+// Combined JSON state - HA reads steps and activity from here too
+void publishBiometricSummary() {
   StaticJsonDocument<400> doc;
   doc["nodeType"] = "WEARABLE";
   doc["timestamp"] = currentBio.timestamp;
-  doc["activity"] = currentBio.activity;
+  doc["activity"] = activityName(currentBio.activity);
   doc["stepCount"] = currentBio.stepCount;
   doc["acceleration"] = currentBio.acceleration;
   doc["lastMovement"] = currentBio.lastMovement;
+  doc["idleSeconds"] = (millis() - currentBio.lastMovement) / 1000;   // Clock-free, for the main brain
   doc["sessionActive"] = sessionActive;
   doc["currentUser"] = currentUser;
   
   // Add Pomodoro context
   if (pomodoroInfo.dataAvailable) {
     doc["pomodoroState"] = pomodoroInfo.currentState;
-    doc["pomodoroTimeRemaining"] = pomodoroInfo.timeRemaining;
+    doc["pomodoroTimeRemaining"] = pomodoroRemainingSeconds();
     doc["breakCompliant"] = (millis() - currentBio.lastMovement) < 30000;
   }
   
   String jsonString;
   serializeJson(doc, jsonString);
-  client.publish("bille/data/biometric", jsonString.c_str());
+  // Retained: a (re)connecting main brain gets it on subscribe
+  client.publish("bille/data/biometric", jsonString.c_str(), true);
+  bootMark(BOOT_FIRST_PUBLISH);
+  
+  LOG_DEBUG(LOG_MQTT, "Biometric data published, last movement %lu ms ago",
+            millis() - currentBio.lastMovement);
+}
+
+// Buffered samples as one binary record (format in biometric_batch.h).
+// The buffer is only cleared once the broker has taken the whole batch.
+// batchSeq restarts with every boot; bootId lets the main brain tell that
+// from lost batches.
+void publishBiometricBatch() {
+  static const uint16_t bootId = (uint16_t)ESP.random();
+  static uint16_t batchSeq = 0;
+  static uint8_t payload[BATCH_HEADER_SIZE + SAMPLE_BUFFER_SIZE * BATCH_MAX_SAMPLE_SIZE];
+  if (sampleCount == 0) return;
+  
+  BatchWriter writer;
+  batchBegin(writer, payload, sizeof(payload), bootId, batchSeq,
+             sampleBuffer[0].timestamp, sampleBuffer[0].stepCount);
+  
+  for (int i = 0; i < sampleCount; i++) {
+    const BiometricSample& s = sampleBuffer[i];
+    BatchRecord record;
+    record.timestamp = s.timestamp;
+    record.idleSeconds = s.timestamp > s.lastMovement ? (s.timestamp - s.lastMovement) / 1000 : 0;
+    record.accelMg = (uint16_t)(s.acceleration * 1000);
+    record.steps = s.stepCount;
+    record.activity = s.activity;
+    batchAdd(writer, record);  // Sized for a full buffer, cannot fail
+  }
+  size_t length = batchFinish(writer);
+  
+  // Streamed so a full buffer does not need PubSubClient's packet buffer
+  if (client.beginPublish("bille/data/biometric_batch", length, false)) {
+    client.write(payload, length);
+    if (client.endPublish()) {
+      LOG_DEBUG(LOG_MQTT, "Published batch %u: %d samples, %u bytes", batchSeq, sampleCount, (unsigned)length);
+      bootMark(BOOT_FIRST_PUBLISH);
+      batchSeq++;
+      sampleCount = 0;
+    }
+  }
+}
+
+static void addTotals(JsonObject obj, const BoutTotals& totals) {
+  obj["sedentaryMinutes"] = totals.sedentaryMs / 60000;
+  obj["activeMinutes"] = totals.activeMs / 60000;
+  obj["steps"] = totals.steps;
+  obj["sitBouts"] = totals.sitBouts;
+  obj["activeBouts"] = totals.activeBouts;
+  obj["longestSitMinutes"] = totals.longestSitMs / 60000;
+}
+
+// One summary per session, built from the bout tracker - no raw samples needed
+void publishActivitySummary() {
+  BoutTotals session, today, yesterday;
+  unsigned long sessionMs;
+  boutTrackerSessionEnd(session, sessionMs);
+  boutTrackerToday(today);
+  boutTrackerYesterday(yesterday);
   
-  Serial.println("Biometric data published to MQTT");
-  Serial.printf("Last movement: %lu m ago\n", millis() - currentBio.lastMovement);
+  DynamicJsonDocument doc(1024);
+  doc["nodeType"] = "WEARABLE";
+  doc["userId"] = currentUser;
+  doc["sessionMinutes"] = sessionMs / 60000;
+  addTotals(doc.createNestedObject("session"), session);
+  
+  JsonObject day = doc.createNestedObject("today");
+  addTotals(day, today);
+  day["hoursTracked"] = boutHoursTracked();
+  addTotals(doc.createNestedObject("yesterday"), yesterday);
+  
+  JsonArray edges = doc.createNestedArray("histogramEdgesMinutes");
+  JsonArray sitHist = doc.createNestedArray("sitHistogram");
+  JsonArray activeHist = doc.createNestedArray("activeHistogram");
+  for (int i = 0; i < BOUT_HIST_BINS; i++) {
+    if (i < BOUT_HIST_BINS - 1) edges.add(boutHistogramEdges[i]);
+    sitHist.add(boutSitHistogram()[i]);
+    activeHist.add(boutActiveHistogram()[i]);
+  }
+  
+  if (client.beginPublish("bille/data/activity_summary", measureJson(doc), false)) {
+    serializeJson(doc, client);
+    client.endPublish();
+  }
+  LOG_INFO(LOG_HEALTH, "Session summary: %lu min sitting in %u bouts, longest %lu min",
+           (unsigned long)(session.sedentaryMs / 60000), session.sitBouts,
+           (unsigned long)(session.longestSitMs / 60000));
+}
+
+void publishWearableStatus() {
+  StaticJsonDocument<640> doc;
+  doc["nodeType"] = "WEARABLE";
+  doc["timestamp"] = millis();
+  doc["lowPowerMode"] = LOW_POWER_MODE != 0;
+  doc["batchInterval"] = currentBatchInterval() / 1000;
+  doc["batchUploads"] = batchUploads;
+  doc["droppedSamples"] = droppedSamples;
+  doc["radioOnSeconds"] = radioOnTime() / 1000;
+  doc["radioOnSecondsPerHour"] = radioOnSecondsPerHour();
+  doc["logDroppedBytes"] = logDroppedBytes();
+  doc["motionInterrupts"] = motionInterruptCount();
+  doc["displayFrames"] = displayFrames();
+  doc["displayBytesPerFrame"] = displayBytesPerFrame();
+  doc["displayMsSavedPerFrame"] = displayMicrosSavedPerFrame() / 1000.0;
+  doc["toastsDropped"] = toastDropped();
+  doc["clockSynced"] = clockSynced();
+  doc["clockOffset"] = clockOffset();
+  doc["clockRtt"] = clockRtt();
+  doc["wakeToMqttMs"] = radioWakeToMqttMs();
+  bootReport(doc.createNestedObject("boot"));
+  
+  String jsonString;
+  serializeJson(doc, jsonString);
+  if (!client.publish("bille/status/wearable_system", jsonString.c_str())) {
+    LOG_WARN(LOG_MQTT, "Status not published (%u bytes, buffer %d)", jsonString.length(), MQTT_BUFFER_SIZE);
+  }
 }
@@ -5,8 +5,13 @@
 
 void setup_wifi();
 void reconnect_mqtt();
+bool connect_mqtt();
 void mqtt_callback(char* topic, byte* payload, unsigned int length);
 void publishBiometricData();
+void publishBiometricSummary();
+void publishBiometricBatch();
+void publishWearableStatus();
+void publishActivitySummary();
 
 extern bool sessionActive;
 extern String currentUser;
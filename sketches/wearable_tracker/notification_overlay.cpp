@@ -0,0 +1,130 @@
+#include "notification_overlay.h"
+#include "logger.h"
+#include <U8g2lib.h>
+
+extern U8G2_SSD1306_128X64_NONAME_F_HW_I2C display;
+
+struct Toast {
+  char title[TOAST_TITLE_LEN];
+  char message[TOAST_MESSAGE_LEN];
+  uint8_t priority;
+  unsigned long duration;
+  unsigned long seq;      // Arrival order within a priority
+};
+
+static Toast queue[TOAST_QUEUE_SIZE];
+static int queued = 0;
+static unsigned long nextSeq = 0;
+static unsigned long dropped = 0;
+
+// Toast on screen, if any - its clock starts when it is first shown
+static Toast current;
+static bool showing = false;
+static unsigned long shownAt = 0;
+
+void toastPush(const char* title, const char* message, ToastPriority priority, unsigned long durationMs) {
+  if (queued == TOAST_QUEUE_SIZE) {
+    // Full: evict the least important, newest toast if this one outranks it
+    int victim = 0;
+    for (int i = 1; i < queued; i++) {
+      if (queue[i].priority < queue[victim].priority ||
+          (queue[i].priority == queue[victim].priority && queue[i].seq > queue[victim].seq)) {
+        victim = i;
+      }
+    }
+    dropped++;
+    if (queue[victim].priority >= priority) {
+      LOG_WARN(LOG_DISPLAY, "Toast queue full, dropped \"%s\"", title);
+      return;
+    }
+    LOG_WARN(LOG_DISPLAY, "Toast queue full, evicted \"%s\"", queue[victim].title);
+    queue[victim] = queue[--queued];
+  }
+
+  Toast& t = queue[queued++];
+  strncpy(t.title, title, TOAST_TITLE_LEN - 1);
+  t.title[TOAST_TITLE_LEN - 1] = '\0';
+  strncpy(t.message, message ? message : "", TOAST_MESSAGE_LEN - 1);
+  t.message[TOAST_MESSAGE_LEN - 1] = '\0';
+  t.priority = priority;
+  t.duration = durationMs;
+  t.seq = nextSeq++;
+}
+
+// Expires the current toast and promotes the next one.
+// Returns true when the visible toast changed and the screen needs a redraw.
+bool toastUpdate() {
+  bool changed = false;
+
+  if (showing && millis() - shownAt >= current.duration) {
+    showing = false;
+    changed = true;
+  }
+
+  if (!showing && queued > 0) {
+    int next = 0;
+    for (int i = 1; i < queued; i++) {
+      if (queue[i].priority > queue[next].priority ||
+          (queue[i].priority == queue[next].priority && queue[i].seq < queue[next].seq)) {
+        next = i;
+      }
+    }
+    current = queue[next];
+    queue[next] = queue[--queued];
+    showing = true;
+    shownAt = millis();
+    changed = true;
+    LOG_DEBUG(LOG_DISPLAY, "Toast \"%s\" for %lu ms, %d queued", current.title, current.duration, queued);
+  }
+
+  return changed;
+}
+
+// Wraps at the last space that fits, hard-breaks long words
+static int wrapLine(const char* text, int width) {
+  int len = strlen(text);
+  if (len <= width) return len;
+  for (int i = width; i > 0; i--) {
+    if (text[i] == ' ') return i;
+  }
+  return width;
+}
+
+// Draws the current toast over the screen in the framebuffer. The box covers
+// tile rows 1-6 so the dirty-tile flush only sends that band.
+void toastComposite() {
+  if (!showing) return;
+
+  display.setDrawColor(0);
+  display.drawBox(2, 8, 124, 48);
+  display.setDrawColor(1);
+  display.drawFrame(2, 8, 124, 48);
+  if (current.priority == TOAST_ALERT) {
+    display.drawFrame(4, 10, 120, 44);
+  }
+
+  display.setFont(u8g2_font_8x13_tf);
+  display.setCursor(8, 24);
+  display.print(current.title);
+
+  display.setFont(u8g2_font_6x10_tf);
+  const char* text = current.message;
+  char line[21];
+  for (int row = 0; row < 2 && *text; row++) {
+    int n = wrapLine(text, 20);
+    memcpy(line, text, n);
+    line[n] = '\0';
+    display.setCursor(8, 38 + row * 11);
+    display.print(line);
+    text += n;
+    while (*text == ' ') text++;
+  }
+}
+
+bool toastActive() {
+  return showing;
+}
+
+unsigned long toastDropped() {
+  return dropped;
+}
@@ -0,0 +1,24 @@
+#ifndef NOTIFICATION_OVERLAY_H
+#define NOTIFICATION_OVERLAY_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Toasts are composited over whatever screen is showing, one at a time.
+// Higher priority goes first, equal priority in arrival order.
+enum ToastPriority : uint8_t {
+  TOAST_INFO    = 0,
+  TOAST_SESSION = 1,
+  TOAST_ALERT   = 2
+};
+
+#define TOAST_TITLE_LEN    16
+#define TOAST_MESSAGE_LEN  42   // Two wrapped lines of 20 characters
+
+void toastPush(const char* title, const char* message, ToastPriority priority, unsigned long durationMs);
+bool toastUpdate();
+void toastComposite();
+bool toastActive();
+unsigned long toastDropped();
+
+#endif
@@ -0,0 +1,177 @@
+#include "power_manager.h"
+#include "biometric_sensors.h"
+#include "mqtt_communication.h"
+#include "health_monitor.h"
+#include "logger.h"
+#include "fast_connect.h"
+#include <ESP8266WiFi.h>
+#include <PubSubClient.h>
+
+extern PubSubClient client;
+extern BiometricData currentBio;
+extern PomodoroInfo pomodoroInfo;
+
+enum RadioState {
+  RADIO_ASLEEP,
+  RADIO_CONNECTING,
+  RADIO_WINDOW
+};
+
+static RadioState radioState = RADIO_WINDOW;   // setup() leaves WiFi connected
+static unsigned long stateSince = 0;
+static unsigned long lastUpload = 0;
+static unsigned long lastMqttAttempt = 0;
+static unsigned long radioOnSince = 0;
+static unsigned long radioOnTotal = 0;         // ms, completed awake periods only
+static unsigned long lastSummary = 0;
+static unsigned long lastStatus = 0;
+static unsigned long wakeToMqtt = 0;           // ms, last radio window
+
+void powerInit() {
+  unsigned long now = millis();
+  radioState = RADIO_WINDOW;
+  stateSince = now;
+  lastUpload = now;
+  radioOnSince = 0;  // Radio has been on since boot
+  radioOnTotal = 0;
+}
+
+void powerRecordSample() {
+  if (sampleCount >= SAMPLE_BUFFER_SIZE) {
+    // Radio could not get out in time - drop the oldest sample
+    memmove(sampleBuffer, sampleBuffer + 1, (SAMPLE_BUFFER_SIZE - 1) * sizeof(BiometricSample));
+    sampleCount--;
+    droppedSamples++;
+  }
+
+  BiometricSample& sample = sampleBuffer[sampleCount++];
+  sample.timestamp = currentBio.timestamp;
+  sample.lastMovement = currentBio.lastMovement;
+  sample.acceleration = currentBio.acceleration;
+  sample.stepCount = currentBio.stepCount;
+  sample.activity = currentBio.activity;
+}
+
+// Batch interval tightens while a session or break needs fresher data
+unsigned long currentBatchInterval() {
+  if (!sessionActive) return BATCH_INTERVAL_IDLE_MS;
+  if (pomodoroInfo.currentState == SHORT_BREAK || pomodoroInfo.currentState == LONG_BREAK) {
+    return BATCH_INTERVAL_BREAK_MS;
+  }
+  return BATCH_INTERVAL_SESSION_MS;
+}
+
+static void radioWake() {
+  LOG_DEBUG(LOG_SYSTEM, "Radio wake (%d samples buffered)", sampleCount);
+  WiFi.forceSleepWake();
+  delay(1);
+  wifiStart();   // Straight back to the cached AP, no scan or DHCP
+
+  radioOnSince = millis();
+  radioState = RADIO_CONNECTING;
+  stateSince = radioOnSince;
+  lastMqttAttempt = 0;
+}
+
+static void radioSleep() {
+  client.disconnect();
+  WiFi.disconnect(true);
+  WiFi.mode(WIFI_OFF);
+  WiFi.forceSleepBegin();  // Modem sleep until the next window
+  delay(1);
+
+  unsigned long now = millis();
+  radioOnTotal += now - radioOnSince;
+  radioState = RADIO_ASLEEP;
+  stateSince = now;
+  LOG_DEBUG(LOG_SYSTEM, "Radio sleep, on-time %lu ms total", radioOnTotal);
+}
+
+// The binary batch carries every sample; the HA summary and the status only
+// go out on their own, slower intervals
+static void uploadBatch() {
+  unsigned long now = millis();
+  publishBiometricBatch();
+  if (batchUploads == 0 || now - lastSummary >= SUMMARY_INTERVAL_MS) {
+    publishBiometricSummary();
+    lastSummary = now;
+  }
+  publishHealthAlerts();
+  if (batchUploads == 0 || now - lastStatus >= STATUS_INTERVAL_MS) {
+    publishWearableStatus();
+    lastStatus = now;
+  }
+  batchUploads++;
+}
+
+// One non-blocking MQTT attempt per second while the radio is up
+static void ensureMqtt(unsigned long now) {
+  if (WiFi.status() == WL_CONNECTED && !client.connected() && now - lastMqttAttempt > 1000) {
+    lastMqttAttempt = now;
+    connect_mqtt();
+  }
+}
+
+void powerUpdate() {
+  unsigned long now = millis();
+
+  switch (radioState) {
+    case RADIO_ASLEEP:
+      if (now - lastUpload >= currentBatchInterval() || sampleCount >= SAMPLE_BUFFER_SIZE) {
+        radioWake();
+      }
+      break;
+
+    case RADIO_CONNECTING:
+      wifiPoll();
+      ensureMqtt(now);
+      if (client.connected()) {
+        wakeToMqtt = now - radioOnSince;
+        client.loop();  // Pick up retained session/Pomodoro state first
+        uploadBatch();
+        lastUpload = now;
+        radioState = RADIO_WINDOW;
+        stateSince = now;
+      } else if (now - stateSince > RADIO_CONNECT_TIMEOUT_MS) {
+        LOG_WARN(LOG_MQTT, "Radio window timed out, keeping %d samples", sampleCount);
+        lastUpload = now;
+        radioSleep();
+      }
+      break;
+
+    case RADIO_WINDOW:
+      // Boot window stays open until the first sample has gone out
+      if (batchUploads == 0) {
+        ensureMqtt(now);
+        if (sampleCount > 0 && client.connected()) {
+          uploadBatch();
+          lastUpload = now;
+          stateSince = now;
+        }
+        break;
+      }
+      if (now - stateSince > RADIO_WINDOW_MS) {
+        radioSleep();
+      }
+      break;
+  }
+}
+
+unsigned long radioWakeToMqttMs() {
+  return wakeToMqtt;
+}
+
+bool radioAwake() {
+  return radioState != RADIO_ASLEEP;
+}
+
+unsigned long radioOnTime() {
+  return radioOnTotal + (radioAwake() ? millis() - radioOnSince : 0);
+}
+
+// Measured radio duty cycle scaled to one hour
+unsigned long radioOnSecondsPerHour() {
+  unsigned long uptime = millis();
+  if (uptime == 0) return 0;
+  return (unsigned long)((unsigned long long)radioOnTime() * 3600ULL / uptime);
+}
@@ -0,0 +1,22 @@
+#ifndef POWER_MANAGER_H
+#define POWER_MANAGER_H
+
+#include "biometric_data.h"
+#include "config.h"
+
+void powerInit();
+void powerRecordSample();
+void powerUpdate();
+bool radioAwake();
+unsigned long currentBatchInterval();
+unsigned long radioOnTime();
+unsigned long radioOnSecondsPerHour();
+unsigned long radioWakeToMqttMs();   // Last window: wake until MQTT connected
+
+// Samples waiting for the next radio window
+extern BiometricSample sampleBuffer[SAMPLE_BUFFER_SIZE];
+extern int sampleCount;
+extern unsigned long droppedSamples;
+extern unsigned long batchUploads;
+
+#endif
@@ -0,0 +1,110 @@
+#include "step_detector.h"
+
+void stepDetectorInit(StepDetector& sd, int sampleRateHz, int lsbPerG) {
+  sd.lsbPerG = lsbPerG;
+  sd.dc = (int32_t)lsbPerG << 8;
+  sd.lp1 = 0;
+  sd.lp2 = 0;
+  sd.previous = 0;
+  sd.rising = false;
+  sd.peakValue = 0;
+  sd.minThreshold = lsbPerG * STEP_MIN_THRESHOLD_MG / 1000;
+  sd.peakAverage = sd.minThreshold * 2 << 4;
+  sd.sampleIndex = 0;
+  sd.lastPeakIndex = 0;
+  sd.minInterval = STEP_MIN_INTERVAL_MS * sampleRateHz / 1000;
+  sd.maxInterval = STEP_MAX_INTERVAL_MS * sampleRateHz / 1000;
+  sd.pendingSteps = 0;
+  sd.totalSteps = 0;
+}
+
+// Bitwise integer square root (16 iterations for a 32-bit input)
+static uint32_t isqrt32(uint32_t value) {
+  uint32_t result = 0;
+  uint32_t bit = 1UL << 30;
+  while (bit > value) bit >>= 2;
+  while (bit != 0) {
+    if (value >= result + bit) {
+      value -= result + bit;
+      result = (result >> 1) + bit;
+    } else {
+      result >>= 1;
+    }
+    bit >>= 2;
+  }
+  return result;
+}
+
+static int acceptPeak(StepDetector& sd, int32_t peak) {
+  uint32_t interval = sd.sampleIndex - sd.lastPeakIndex;
+
+  // Bounces within one step (heel strike ringing) are ignored outright
+  if (sd.lastPeakIndex != 0 && interval < sd.minInterval) return 0;
+
+  // Peak height feeds the adaptive threshold: avg += (peak - avg) / 4
+  sd.peakAverage += ((peak << 4) - sd.peakAverage) >> 2;
+
+  bool continues = sd.lastPeakIndex != 0 && interval <= sd.maxInterval;
+  sd.lastPeakIndex = sd.sampleIndex;
+
+  if (!continues) {
+    sd.pendingSteps = 1;  // Start of a possible walking bout
+    return 0;
+  }
+
+  if (sd.pendingSteps < STEP_CONFIRM_COUNT) {
+    sd.pendingSteps++;
+    if (sd.pendingSteps == STEP_CONFIRM_COUNT) {
+      sd.totalSteps += STEP_CONFIRM_COUNT;
+      return STEP_CONFIRM_COUNT;  // Credit the confirming run
+    }
+    return 0;
+  }
+
+  sd.totalSteps++;
+  return 1;
+}
+
+int stepDetectorAddSample(StepDetector& sd, int16_t x, int16_t y, int16_t z) {
+  sd.sampleIndex++;
+
+  // Orientation-independent magnitude in LSB
+  uint32_t sumSquares = (uint32_t)((int32_t)x * x) + (uint32_t)((int32_t)y * y) +
+                        (uint32_t)((int32_t)z * z);
+  int32_t magnitude = (int32_t)isqrt32(sumSquares);
+
+  // High-pass: remove gravity with a slow one-pole tracker (~0.1 Hz at 50 Hz)
+  sd.dc += ((magnitude << 8) - sd.dc) >> 6;
+  int32_t highPassed = magnitude - (sd.dc >> 8);
+
+  // Low-pass: two one-pole stages (~3 Hz at 50 Hz) smooth impact spikes
+  sd.lp1 += ((highPassed << 8) - sd.lp1) >> 2;
+  sd.lp2 += (sd.lp1 - sd.lp2) >> 2;
+  int32_t filtered = sd.lp2 >> 8;
+
+  // Adaptive threshold: half the running peak height, never below the floor
+  int32_t threshold = sd.peakAverage >> 5;
+  if (threshold < sd.minThreshold) threshold = sd.minThreshold;
+
+  int added = 0;
+  if (filtered > sd.previous) {
+    sd.rising = true;
+    if (filtered > sd.peakValue) sd.peakValue = filtered;
+  } else if (sd.rising && filtered < sd.previous) {
+    // Local maximum just passed
+    sd.rising = false;
+    if (sd.peakValue > threshold) {
+      added = acceptPeak(sd, sd.peakValue);
+    }
+    sd.peakValue = 0;
+  }
+
+  // Bout timed out - let the threshold relax back towards the floor
+  if (sd.sampleIndex - sd.lastPeakIndex > sd.maxInterval) {
+    sd.pendingSteps = 0;
+    sd.peakAverage -= sd.peakAverage >> 6;
+  }
+
+  sd.previous = filtered;
+  return added;
+}
@@ -0,0 +1,42 @@
+#ifndef STEP_DETECTOR_H
+#define STEP_DETECTOR_H
+
+#include <stdint.h>
+
+// Streaming fixed-point step detector for raw accelerometer samples.
+// Plain C++ with no Arduino dependencies so it can be validated on the host.
+//
+// Pipeline per sample:
+//   |a| (integer sqrt) -> high-pass (gravity removal) -> low-pass (~3 Hz)
+//   -> peak picking against an adaptive threshold -> step-interval gating
+//
+// Steps are only counted once STEP_CONFIRM_COUNT peaks in a row have a
+// plausible spacing; the confirming run is then credited retroactively.
+
+#define STEP_CONFIRM_COUNT     4
+#define STEP_MIN_THRESHOLD_MG  60     // Floor for the adaptive peak threshold
+#define STEP_MIN_INTERVAL_MS   250    // Faster than 4 steps/s is not a step
+#define STEP_MAX_INTERVAL_MS   2000   // Longer gap ends the walking bout
+
+struct StepDetector {
+  int32_t lsbPerG;
+  int32_t dc;             // Gravity estimate, Q8
+  int32_t lp1;            // Low-pass stages, Q8
+  int32_t lp2;
+  int32_t previous;       // Last filtered value, LSB
+  bool rising;
+  int32_t peakValue;      // Max of the current rising edge, LSB
+  int32_t peakAverage;    // Running average of accepted peaks, Q4
+  int32_t minThreshold;   // LSB
+  uint32_t sampleIndex;
+  uint32_t lastPeakIndex;
+  uint16_t minInterval;   // Samples
+  uint16_t maxInterval;
+  uint8_t pendingSteps;   // Peaks waiting for confirmation
+  uint32_t totalSteps;
+};
+
+void stepDetectorInit(StepDetector& sd, int sampleRateHz, int lsbPerG);
+int stepDetectorAddSample(StepDetector& sd, int16_t x, int16_t y, int16_t z);
+
+#endif
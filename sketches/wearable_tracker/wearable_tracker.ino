@@ -18,6 +18,7 @@ PIN CONNECTIONS:
 - BUTTON_PIN:  D3  (Push button for display mode switching)
 - MPU6050_SDA: D2  (I2C SDA for accelerometer, shared with OLED)
 - MPU6050_SCL: D1  (I2C SCL for accelerometer, shared with OLED)
+- MPU6050_INT: D5  (Motion-detection interrupt)
 
 HARDWARE COMPONENTS:
 - ESP8266 NodeMCU v1.0
@@ -25,8 +26,14 @@ HARDWARE COMPONENTS:
 - 0.96" I2C OLED Display (128x64, SSD1306)
 - Push Button for UI navigation
 
+MOTION ACQUISITION:
+- MPU6050 FIFO at 50 Hz (±4 g), bulk-read 4 times per second
+- 256-sample ring buffer; analysis runs over the samples since the last read
+- Motion interrupt (0.10 g, high-passed) stamps lastMovement from an ISR;
+  the CPU idles between FIFO drains while the radio sleeps
+
 BIOMETRIC FEATURES:
-- Step Detection: Threshold-based algorithm with smoothing
+- Step Detection: Streaming band-pass + adaptive peak detector on 50 Hz data
 - Activity Classification: Sitting, Still, Moving, Walking, Running
 - Movement Tracking: Last movement timestamp for health alerts
 - Acceleration Monitoring: Real-time g-force measurement
@@ -36,6 +43,15 @@ DISPLAY MODES:
 - Mode 1: Detailed activity status (acceleration, movement time)
 - Mode 2: Pomodoro progress (timer, cycles, percentage complete)
 - Mode 3: Break compliance (movement encouragement during breaks)
+- Toasts: session start/end and movement reminders overlay any mode for a
+  few seconds, queued by priority, without blocking the loop
+
+LOW-POWER MODE:
+- Samples every 5 s into RAM, WiFi in forced modem sleep between uploads
+- Upload window every 2 min idle, 1 min in a work session, 15 s in a break
+- Health alerts are evaluated in each upload window
+- Each window sends one binary batch (delta timestamps, 1/64 g acceleration,
+  ~11 bytes per sample); the JSON state for HA goes out at most once a minute
 
 HEALTH MONITORING:
 - Work Session Alerts: Movement reminders after 20+ minutes sitting
@@ -43,23 +59,36 @@ HEALTH MONITORING:
 - Activity Thresholds: Configurable detection parameters
 
 MQTT TOPICS (Published):
-- bille/data/biometric          - Complete biometric data package
+- bille/data/biometric          - Complete biometric data package (retained, cleared by the will)
+- bille/data/biometric_batch    - Binary sample batch per radio window (biometric_batch.h)
+- bille/status/wearable_system  - Power status incl. measured radio-on seconds per hour
 - bille/sensors/steps           - Individual step count
 - bille/sensors/activity        - Current activity classification
 - bille/sensors/last_movement_minutes - Time since last movement
 - bille/alerts/health           - Health and movement alerts
+- bille/data/activity_summary  - Sitting/active bouts for the session and today (on session end)
+- bille/logs/wearable           - Log ring buffer dump (on request)
+- bille/time/ping               - Clock offset request to the main brain
 
 MQTT TOPICS (Subscribed):
 - bille/session/state           - Session start/stop notifications
-- bille/pomodoro/state          - Timer updates and context
+- bille/pomodoro/state          - State changes with duration and deadline (brain clock)
+- bille/time/pong               - Clock ping replies
 - bille/wearable/request        - Data requests from main brain
 - bille/alerts/movement         - Movement reminders from system
+- bille/commands/log            - Log dump / per-module level commands
+
+STEP DETECTION ALGORITHM (step_detector.cpp, fixed-point, every 50 Hz sample):
+- Magnitude: integer square root, orientation independent
+- Band-pass: one-pole gravity high-pass + two one-pole low-pass stages (~3 Hz)
+- Peaks: adaptive threshold at half the running peak height (60 mg floor)
+- Gating: 250-2000 ms between steps, counted after 4 regular steps in a row
 
-STEP DETECTION ALGORITHM:
-- Smoothing: Exponential moving average (α = 0.2)
-- Threshold: 0.05g step-up, -0.02g step-down detection
-- Debounce: 300ms minimum interval between steps
-- Validation: Acceleration magnitude analysis
+ACTIVITY CLASSIFICATION (activity_classifier.cpp, 2.56 s window every 1.28 s):
+- Features: vertical variance, signal magnitude area, dominant frequency
+  (mean crossings along gravity), wrist tilt, seconds since last movement
+- Decision tree held in a constexpr node table, fixed cost per window
+- Classes: Sitting, Still, Moving, Walking, Running
 
 DEPENDENCIES:
 - U8g2lib Library (OLED display)
@@ -90,6 +119,11 @@ NETWORK CONFIGURATION:
 #include "display_oled.h"
 #include "mqtt_communication.h"
 #include "health_monitor.h"
+#include "logger.h"
+#include "power_manager.h"
+#include "motion_fifo.h"
+#include "clock_sync.h"
+#include "bout_tracker.h"
 
 // Objects
 U8G2_SSD1306_128X64_NONAME_F_HW_I2C display(U8G2_R0, /* reset=*/ U8X8_PIN_NONE);
@@ -101,11 +135,21 @@ PubSubClient client(espClient);
 BiometricData currentBio;
 PomodoroInfo pomodoroInfo;
 
-// Activity detection variables - defined here, declared as extern in biometric_sensors.h
-float lastAccelMagnitude = 0;
+// Step counting - defined here, declared as extern in biometric_sensors.h
 int stepCount = 0;
-unsigned long lastStepTime = 0;
-bool stepDetected = false;
+StepDetector stepDetector;
+ActivityClassifier activityClassifier;
+
+// Accelerometer sample ring - defined here, declared as extern in motion_fifo.h
+AccelSample motionRing[MOTION_RING_SIZE];
+unsigned long motionWriteIndex = 0;
+unsigned long motionFifoOverflows = 0;
+
+// Low-power sample buffer - defined here, declared as extern in power_manager.h
+BiometricSample sampleBuffer[SAMPLE_BUFFER_SIZE];
+int sampleCount = 0;
+unsigned long droppedSamples = 0;
+unsigned long batchUploads = 0;
 
 // Session state
 bool sessionActive = false;
@@ -113,11 +157,13 @@ String currentUser = "";
 
 void setup() {
   Serial.begin(115200);
+  logInit();
   delay(1000);
-  Serial.println("Bill-E Wearable Tracker with MQTT Starting...");
+  LOG_INFO(LOG_SYSTEM, "Bill-E Wearable Tracker with MQTT Starting...");
   
   // Initialize biometric data
   currentBio.lastMovement = millis();
+  boutTrackerInit();  // Restores today's bouts from RTC memory after a reset
 
   // Initialize I2C
   Wire.begin(OLED_SDA, OLED_SCL);
@@ -127,7 +173,7 @@ void setup() {
   display.enableUTF8Print();
   
   // Initialize MPU6050
-  Serial.println("Initializing MPU6050...");
+  LOG_INFO(LOG_SENSOR, "Initializing MPU6050...");
   mpu.initialize();
 
   // Initialize the button pin
@@ -135,45 +181,71 @@ void setup() {
   
   // Test gyro connection
   if (mpu.testConnection()) {
-    Serial.println("MPU6050 connection successful");
+    LOG_INFO(LOG_SENSOR, "MPU6050 connection successful");
   } else {
-    Serial.println("MPU6050 connection failed");
+    LOG_ERROR(LOG_SENSOR, "MPU6050 connection failed");
+    logDrain();
     display.clearBuffer();
     display.setFont(u8g2_font_6x10_tf);
     display.setCursor(0, 20);
     display.print("ERROR:");
     display.setCursor(0, 40);
     display.print("MPU6050 Error");
-    display.sendBuffer();
+    flushDisplay();
     while (1) delay(10);
   }
+  motionInit();
+  motionInterruptInit();
+  stepDetectorInit(stepDetector, MOTION_SAMPLE_RATE_HZ, (int)MOTION_LSB_PER_G);
+  activityClassifierInit(activityClassifier, MOTION_SAMPLE_RATE_HZ, (int)MOTION_LSB_PER_G);
   
   // Setup WiFi and MQTT
   setup_wifi();
   client.setServer(MQTT_SERVER, MQTT_PORT);
   client.setCallback(mqtt_callback);
+  client.setBufferSize(MQTT_BUFFER_SIZE);
+  powerInit();
   
   // Welcome screen
   showWelcomeScreen();
   
-  Serial.println("Wearable Tracker with MQTT Ready!");
-  Serial.print("IP Address: ");
-  Serial.println(WiFi.localIP());
-  Serial.println("Improved step counter algorithm enabled");
-  Serial.printf("Step detection: threshold=%.1f, delay=%dms\n", ACCEL_THRESHOLD, STEP_DELAY);
+  LOG_INFO(LOG_SYSTEM, "Wearable Tracker with MQTT Ready!");
+  LOG_INFO(LOG_SYSTEM, "IP Address: %s", WiFi.localIP().toString().c_str());
+  LOG_INFO(LOG_SENSOR, "Step detection: %d-step confirmation, %d-%d ms step interval",
+           STEP_CONFIRM_COUNT, STEP_MIN_INTERVAL_MS, STEP_MAX_INTERVAL_MS);
+  logDrain();
   delay(2000);
 }
 
 void loop() {
   
+  // Drain the accelerometer FIFO in bursts and count steps on every sample
+  motionUpdate();
+  processMotionSamples();
+  
+#if LOW_POWER_MODE
+  // Radio duty cycling: samples go to RAM, uploads happen in short windows
+  powerUpdate();
+  if (radioAwake() && client.connected()) {
+    client.loop();
+  }
+  
+  static unsigned long lastRead = 0;
+  if (millis() - lastRead > SAMPLE_INTERVAL_MS) {
+    readBiometrics();
+    powerRecordSample();
+    lastRead = millis();
+  }
+#else
  if (!client.connected()) {
    reconnect_mqtt();
  }
  client.loop();
+ clockSyncUpdate();
  
  // Read sensors every 5 seconds
  static unsigned long lastRead = 0;
- if (millis() - lastRead > 5000) {
+ if (millis() - lastRead > SAMPLE_INTERVAL_MS) {
    readBiometrics();
    publishBiometricData();
    lastRead = millis();
@@ -185,7 +257,20 @@ void loop() {
    publishHealthAlerts();
    lastHealthCheck = millis();
  }
+#endif
  
   // Update display
   updateDisplay();
+  
+  // Flush buffered log output without blocking on the UART
+  logDrain();
+  
+#if LOW_POWER_MODE
+  // Nothing due until the next FIFO drain: let the CPU idle. The motion
+  // interrupt still stamps movement while we wait.
+  if (!radioAwake()) {
+    unsigned long idle = motionMsUntilDrain();
+    delay(idle < IDLE_SLEEP_MAX_MS ? idle : IDLE_SLEEP_MAX_MS);
+  }
+#endif
 }
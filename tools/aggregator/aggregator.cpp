@@ -0,0 +1,827 @@
+/*
+===============================================================
+Bill-E Time-Series Aggregator
+Long-term history for every desk, outside Home Assistant's recorder
+===============================================================
+
+Subscribes to bille/# on the local broker, decodes the node payloads
+(tools/common/bille_decode.h) and appends every value to a per-metric
+columnar store (tools/common/column_store.h):
+
+  <root>/desk-<n>/<metric>/seg-<id>.col   times and values, mmap'd
+  <root>/desk-<n>/<metric>/segments.idx   time range of each sealed segment
+
+Memory stays bounded: a mapped series keeps only a few resident pages
+(filled column pages are released as it writes), and beyond --max-open
+series the least recently used are unmapped until their next point. Segments are
+written through the mapping, so --query (or any reader using
+column_store.h) sees points as soon as they are appended.
+
+Publishes its own counters to bille/status/aggregator every --status-s.
+
+DURABILITY:
+Every message is first appended to a write-ahead log (tools/common/wal.h,
+<root>/wal by default) and only then decoded into the store. The log is
+group-committed every --wal-sync-ms; session/state and pomodoro/state are
+synced before the handler returns, and the subscription is QoS 1, so our
+PUBACK to the broker only goes out once they are on disk (the publisher's
+own PUBACK comes from the broker on receipt). The session is persistent
+(fixed client ID, cleanSession off): the broker queues messages while we
+are away and resends any we had not acknowledged with DUP set; a DUP copy
+of a recently logged message is dropped. Every --checkpoint-s the
+store is synced and checkpointed and the log segments before it deleted.
+After a crash the store is cut back to the checkpoint and the log replayed
+from there, so no point is lost or stored twice. What a node publishes at
+QoS 0 and the broker drops never reaches us; that part is out of our hands.
+
+BUILD (from the repository root):
+  g++ -O2 -std=c++17 -Itools/common -Isketches/main_brain \
+      -o bille-aggregator tools/aggregator/aggregator.cpp tools/common/mqtt_client.cpp \
+      tools/common/column_store.cpp tools/common/bille_decode.cpp tools/common/wal.cpp \
+      sketches/main_brain/biometric_batch.cpp
+
+USAGE:
+  ./bille-aggregator --host 127.0.0.1 --root /var/lib/bille
+  ./bille-aggregator --root /var/lib/bille --query desk-0/environment.temperature --from 0
+  ./bille-aggregator --bench 200000      # log + decode + append throughput, no broker
+  ./bille-aggregator --bench-recovery 4096   # recovery/replay time for a 4 GB log
+  ./bille-aggregator --verify            # store/decoder self-check
+===============================================================
+*/
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "mqtt_client.h"
+#include "desk_topics.h"
+#include "bille_decode.h"
+#include "column_store.h"
+#include "wal.h"
+#include "biometric_batch.h"
+#include "verify.h"
+
+#define RECONNECT_DELAY_MS   2000
+#define STATUS_TOPIC         "bille/status/aggregator"
+#define CLIENT_ID            "bille_aggregator"   // Fixed: the broker keys our session on it
+#define RECENT_MESSAGES      256                  // Checked against redelivered (DUP) messages
+
+struct Options {
+  std::string host = "127.0.0.1";
+  int port = MQTT_DEFAULT_PORT;
+  std::string user;
+  std::string password;
+  std::string root = "bille-data";
+  size_t maxOpen = COLUMN_STORE_MAX_OPEN;
+  int flushMs = 1000;
+  int statusS = 60;
+  bool useWal = true;
+  std::string walDir;            // Default <root>/wal
+  int walSyncMs = WAL_DEFAULT_SYNC_MS;
+  size_t walSegmentMb = WAL_DEFAULT_SEGMENT >> 20;
+  int checkpointS = 30;
+  std::string query;
+  int64_t from = INT64_MIN;
+  int64_t to = INT64_MAX;
+  long bench = 0;
+  int benchDesks = 50;
+  long benchRecoveryMb = 0;
+  bool verify = false;
+};
+
+struct AggregatorStats {
+  uint64_t messages;
+  uint64_t ignored;      // Topics we do not store
+  uint64_t points;
+  uint64_t walErrors;     // Messages the log could not take (stored anyway)
+  uint64_t replayed;      // Log records re-applied at startup
+  uint64_t redelivered;   // DUP copies of messages already logged, dropped
+  uint64_t checkpoints;
+  uint64_t checkpointLsn;
+};
+
+static Options opts;
+static ColumnStore store;
+static AggregatorStats stats;
+static Wal wal;
+static uint64_t currentLsn;   // Log record being decoded, tagged onto its points
+static uint32_t recentKeys[RECENT_MESSAGES];   // Ring of message checksums, 0 = empty
+static size_t recentNext;
+static volatile sig_atomic_t running = 1;
+
+static void onSignal(int) {
+  running = 0;
+}
+
+static int64_t wallMillis() {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void storePoint(void* context, int desk, const char* metric, int64_t timeMs, double value) {
+  ColumnStore& s = *(ColumnStore*)context;
+  columnStoreAppend(s, columnSeriesName(desk, metric), timeMs, value, currentLsn);
+  stats.points++;
+}
+
+static uint32_t messageKey(const char* topic, size_t topicLength, const uint8_t* payload, size_t length) {
+  uint32_t key = crc32c(crc32c(0, topic, topicLength), payload, length);
+  return key ? key : 1;
+}
+
+static bool seenRecently(uint32_t key) {
+  for (uint32_t k : recentKeys) {
+    if (k == key) return true;
+  }
+  return false;
+}
+
+static void rememberMessage(uint32_t key) {
+  recentKeys[recentNext] = key;
+  recentNext = (recentNext + 1) % RECENT_MESSAGES;
+}
+
+static void onMessage(void* context, const char* topic, size_t topicLength, const uint8_t* payload,
+                      size_t length) {
+  if (topicLength == strlen(STATUS_TOPIC) && memcmp(topic, STATUS_TOPIC, topicLength) == 0) return;
+  // The broker resends whatever we had not acknowledged when the connection
+  // dropped. Only DUP messages are checked: identical payloads do recur.
+  const MqttClient* client = (const MqttClient*)context;
+  uint32_t key = messageKey(topic, topicLength, payload, length);
+  if (client && client->dup && seenRecently(key)) {
+    stats.redelivered++;
+    return;
+  }
+  rememberMessage(key);
+  stats.messages++;
+  int64_t now = wallMillis();
+  currentLsn = 0;
+  if (opts.useWal) {
+    // Logged before it is decoded; transitions are on disk before the PUBACK
+    currentLsn = walAppend(wal, topic, topicLength, payload, length, now,
+                           billeIsCriticalTopic(topic, topicLength));
+    if (!currentLsn) stats.walErrors++;
+  }
+  if (billeDecode(topic, topicLength, payload, length, now, storePoint, &store) < 0) {
+    stats.ignored++;
+  }
+}
+
+static bool replayRecord(void*, const WalRecord& record) {
+  currentLsn = record.lsn;
+  // Logged but maybe never acknowledged: the broker may send it again
+  rememberMessage(messageKey(record.topic, record.topicLength, record.payload, record.length));
+  billeDecode(record.topic, record.topicLength, record.payload, record.length, record.receivedMs,
+              storePoint, &store);
+  stats.replayed++;
+  return true;
+}
+
+// Everything logged so far is in the store; make it durable and drop the
+// log before it
+static void checkpoint() {
+  if (!walSync(wal)) {
+    stats.walErrors++;
+    return;
+  }
+  uint64_t lsn = wal.nextLsn - 1;
+  if (!columnStoreCheckpoint(store, lsn)) return;
+  walTruncateBefore(wal, lsn + 1);
+  stats.checkpoints++;
+  stats.checkpointLsn = lsn;
+}
+
+// Cuts the store back to its last checkpoint and replays the log after it
+static bool recover() {
+  uint64_t checkpointLsn;
+  if (!columnStoreRecover(store, checkpointLsn)) {
+    fprintf(stderr, "aggregator: unreadable checkpoint under %s\n", opts.root.c_str());
+    return false;
+  }
+  if (!walOpen(wal, opts.walDir.c_str(), opts.walSegmentMb << 20, opts.walSyncMs, checkpointLsn + 1)) {
+    fprintf(stderr, "aggregator: cannot open log %s\n", opts.walDir.c_str());
+    return false;
+  }
+  if (wal.nextLsn <= checkpointLsn) {
+    fprintf(stderr, "aggregator: log %s ends before the checkpoint (lsn %" PRIu64 ")\n", opts.walDir.c_str(),
+            checkpointLsn);
+    return false;
+  }
+  uint64_t start = mqttNowMicros();
+  walReplay(opts.walDir.c_str(), checkpointLsn + 1, replayRecord, nullptr);
+  stats.checkpointLsn = checkpointLsn;
+  fprintf(stderr, "aggregator: checkpoint lsn %" PRIu64 ", %" PRIu64 " points rolled back, %" PRIu64
+          " records replayed in %.1f ms (%" PRIu64 " torn bytes dropped)\n",
+          checkpointLsn, store.stats.rolledBack, stats.replayed, (mqttNowMicros() - start) / 1000.0,
+          wal.stats.tornBytes);
+  checkpoint();
+  return true;
+}
+
+static void publishStatus(MqttClient& client) {
+  char json[768];
+  snprintf(json, sizeof(json),
+           "{\"nodeType\":\"AGGREGATOR\",\"messages\":%" PRIu64 ",\"ignored\":%" PRIu64 ",\"points\":%" PRIu64
+           ",\"reordered\":%" PRIu64 ",\"series\":%zu,\"openSegments\":%zu,\"segmentsSealed\":%" PRIu64
+           ",\"evictions\":%" PRIu64 ",\"errors\":%" PRIu64 ",\"walRecords\":%" PRIu64 ",\"walSyncs\":%" PRIu64
+           ",\"walDurableSyncs\":%" PRIu64 ",\"walMaxGroup\":%" PRIu64 ",\"walErrors\":%" PRIu64
+           ",\"checkpoints\":%" PRIu64 ",\"checkpointLsn\":%" PRIu64 ",\"replayed\":%" PRIu64
+           ",\"redelivered\":%" PRIu64 "}",
+           stats.messages, stats.ignored, stats.points, store.stats.reordered, store.series.size(),
+           store.openCount, store.stats.segmentsSealed, store.stats.evictions, store.stats.errors,
+           wal.stats.records, wal.stats.syncs, wal.stats.durableSyncs, wal.stats.maxGroup, stats.walErrors,
+           stats.checkpoints, stats.checkpointLsn, stats.replayed, stats.redelivered);
+  mqttPublish(client, STATUS_TOPIC, json);
+}
+
+static int runDaemon() {
+  if (!columnStoreOpen(store, opts.root.c_str(), opts.maxOpen)) {
+    fprintf(stderr, "aggregator: cannot create %s\n", opts.root.c_str());
+    return 1;
+  }
+  if (opts.useWal && !recover()) return 1;
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+
+  const char* user = opts.user.empty() ? nullptr : opts.user.c_str();
+  const char* password = opts.password.empty() ? nullptr : opts.password.c_str();
+  MqttClient client;
+  mqttInit(client);
+  uint64_t lastFlush = mqttNowMicros();
+  uint64_t lastStatus = lastFlush;
+  uint64_t lastCheckpoint = lastFlush;
+  int pollMs = opts.useWal && opts.walSyncMs < 100 ? opts.walSyncMs : 100;
+
+  while (running) {
+    if (!client.connected) {
+      if (!mqttConnect(client, opts.host.c_str(), opts.port, CLIENT_ID, user, password, 30, false)) {
+        fprintf(stderr, "aggregator: broker %s:%d unavailable, retrying\n", opts.host.c_str(), opts.port);
+        usleep(RECONNECT_DELAY_MS * 1000);
+        continue;
+      }
+      // QoS 1: the PUBACK goes out after the handler has logged the message
+      mqttSubscribe(client, "bille/#", 1);
+      fprintf(stderr, "aggregator: connected (%s session), storing under %s\n",
+              client.sessionPresent ? "resumed" : "new", opts.root.c_str());
+    }
+
+    mqttPoll(client, pollMs, onMessage, &client);
+    if (opts.useWal) walMaybeSync(wal);
+
+    uint64_t now = mqttNowMicros();
+    if (now - lastFlush > opts.flushMs * 1000ULL) {
+      columnStoreFlush(store);
+      lastFlush = now;
+    }
+    if (opts.useWal && now - lastCheckpoint > opts.checkpointS * 1000000ULL) {
+      checkpoint();
+      lastCheckpoint = now;
+    }
+    if (opts.statusS > 0 && now - lastStatus > opts.statusS * 1000000ULL) {
+      publishStatus(client);
+      lastStatus = now;
+    }
+  }
+
+  mqttDisconnect(client);
+  if (opts.useWal) {
+    checkpoint();
+    walClose(wal);
+  }
+  columnStoreClose(store);
+  fprintf(stderr, "aggregator: %" PRIu64 " messages, %" PRIu64 " points stored\n", stats.messages, stats.points);
+  return 0;
+}
+
+// ---- Query -------------------------------------------------------------
+
+static bool printSlice(void*, const int64_t* times, const double* values, size_t count) {
+  for (size_t i = 0; i < count; i++) printf("%" PRId64 ",%.6g\n", times[i], values[i]);
+  return true;
+}
+
+static int runQuery() {
+  printf("timeMs,value\n");
+  if (!columnStoreScan(opts.root.c_str(), opts.query, opts.from, opts.to, printSlice, nullptr)) {
+    fprintf(stderr, "aggregator: no series %s under %s\n", opts.query.c_str(), opts.root.c_str());
+    return 1;
+  }
+  return 0;
+}
+
+// ---- Bench and self-check ----------------------------------------------
+
+static std::string tempRoot(const char* tag) {
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/bille-%s-XXXXXX", tag);
+  return mkdtemp(path) ? path : "";
+}
+
+static void removeTree(const std::string& path) {
+  std::string cmd = "rm -rf '" + path + "'";
+  if (system(cmd.c_str()) != 0) fprintf(stderr, "aggregator: could not remove %s\n", path.c_str());
+}
+
+struct BenchMessage {
+  std::string topic;
+  std::vector<uint8_t> payload;
+};
+
+static std::vector<BenchMessage> benchMessages(int desks) {
+  std::vector<BenchMessage> out;
+  char json[400];
+  for (int desk = 0; desk < desks; desk++) {
+    BenchMessage env = {deskTopic(desk, "data/environment"), {}};
+    snprintf(json, sizeof(json), "{\"nodeType\":\"ENVIRONMENT\",\"timestamp\":%d,\"temperature\":%.2f,"
+             "\"humidity\":48.50,\"lightLevel\":412,\"noiseLevel\":38,\"soundDetected\":false}",
+             100000 + desk, 21.5 + desk % 7);
+    env.payload.assign(json, json + strlen(json));
+    out.push_back(env);
+
+    BenchMessage bio = {deskTopic(desk, "data/biometric"), {}};
+    snprintf(json, sizeof(json), "{\"nodeType\":\"WEARABLE\",\"timestamp\":%d,\"activity\":\"Walking\","
+             "\"stepCount\":%d,\"acceleration\":1.12,\"lastMovement\":%d,\"sessionActive\":true,"
+             "\"currentUser\":\"A1B2C3D4\",\"pomodoroState\":1,\"pomodoroTimeRemaining\":840}",
+             200000, 1200 + desk, 195000);
+    bio.payload.assign(json, json + strlen(json));
+    out.push_back(bio);
+
+    uint8_t batch[BATCH_HEADER_SIZE + 12 * BATCH_MAX_SAMPLE_SIZE];
+    BatchWriter writer;
+    batchBegin(writer, batch, sizeof(batch), 1, (uint16_t)desk, 100000, 1000);
+    for (int i = 0; i < 12; i++) {
+      BatchRecord r = {100000u + i * 5000u, (uint32_t)i * 5, (uint16_t)(1000 + i * 20), 1000u + i * 7,
+                       (uint8_t)(i % 5)};
+      batchAdd(writer, r);
+    }
+    size_t length = batchFinish(writer);
+    out.push_back({deskTopic(desk, "data/biometric_batch"), std::vector<uint8_t>(batch, batch + length)});
+  }
+  const char* pomodoro = "{\"state\":1,\"timeRemaining\":840,\"stateDuration\":1500,\"deadline\":1900000,"
+                         "\"completedCycles\":2,\"snoozed\":false,\"snoozeCount\":0,\"timestamp\":1000000,"
+                         "\"awaitingConfirmation\":false,\"stateText\":\"WORK\"}";
+  out.push_back({"bille/pomodoro/state", std::vector<uint8_t>(pomodoro, pomodoro + strlen(pomodoro))});
+  return out;
+}
+
+static int runBench() {
+  std::string root = tempRoot("aggbench");
+  if (root.empty() || !columnStoreOpen(store, root.c_str(), opts.maxOpen)) return 1;
+  if (opts.useWal && !walOpen(wal, (root + "/wal").c_str(), opts.walSegmentMb << 20, opts.walSyncMs)) return 1;
+  std::vector<BenchMessage> messages = benchMessages(opts.benchDesks);
+
+  struct timespec cpu0, cpu1;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu0);
+  uint64_t start = mqttNowMicros();
+  int64_t t = wallMillis();
+  for (long i = 0; i < opts.bench; i++) {
+    const BenchMessage& m = messages[i % messages.size()];
+    stats.messages++;
+    if (opts.useWal) {
+      currentLsn = walAppend(wal, m.topic.c_str(), m.topic.size(), m.payload.data(), m.payload.size(), t + i,
+                             billeIsCriticalTopic(m.topic.c_str(), m.topic.size()));
+      walMaybeSync(wal);
+    }
+    billeDecode(m.topic.c_str(), m.topic.size(), m.payload.data(), m.payload.size(), t + i, storePoint, &store);
+  }
+  uint64_t checkpointStart = mqttNowMicros();
+  if (opts.useWal) checkpoint();
+  else columnStoreFlush(store);
+  double checkpointMs = (mqttNowMicros() - checkpointStart) / 1000.0;
+  double elapsed = (mqttNowMicros() - start) / 1e6;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu1);
+  double cpu = (cpu1.tv_sec - cpu0.tv_sec) + (cpu1.tv_nsec - cpu0.tv_nsec) / 1e9;
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  printf("{\"messages\": %" PRIu64 ", \"points\": %" PRIu64 ", \"series\": %zu, \"seconds\": %.3f, "
+         "\"messagesPerCpuS\": %.0f, \"pointsPerCpuS\": %.0f, \"segmentOpens\": %" PRIu64 ", "
+         "\"evictions\": %" PRIu64 ", \"maxRssKb\": %ld, \"messagesPerS\": %.0f, \"walMb\": %.1f, "
+         "\"walSyncs\": %" PRIu64 ", \"walDurableSyncs\": %" PRIu64 ", \"walMaxGroup\": %" PRIu64 ", "
+         "\"checkpointMs\": %.1f}\n",
+         stats.messages, stats.points, store.series.size(), elapsed, stats.messages / cpu, stats.points / cpu,
+         store.stats.segmentOpens, store.stats.evictions, usage.ru_maxrss, stats.messages / elapsed,
+         wal.stats.bytes / 1048576.0, wal.stats.syncs, wal.stats.durableSyncs, wal.stats.maxGroup, checkpointMs);
+  if (opts.useWal) walClose(wal);
+  columnStoreClose(store);
+  removeTree(root);
+  return 0;
+}
+
+static bool countRecord(void* context, const WalRecord&) {
+  (*(uint64_t*)context)++;
+  return true;
+}
+
+// Fills a log of the given size with no checkpoint, tears its tail, then
+// times what a restart costs: reopening, a raw scan, and a full replay
+// into an empty store (the worst case - checkpoints normally bound it)
+static int runRecoveryBench() {
+  std::string root = tempRoot("aggrecovery");
+  std::string dir = root + "/wal";
+  if (root.empty() || !walOpen(wal, dir.c_str(), opts.walSegmentMb << 20, opts.walSyncMs)) return 1;
+  std::vector<BenchMessage> messages = benchMessages(opts.benchDesks);
+  uint64_t target = (uint64_t)opts.benchRecoveryMb << 20;
+  uint64_t start = mqttNowMicros();
+  int64_t t = wallMillis();
+  for (long i = 0; wal.stats.bytes < target; i++) {
+    const BenchMessage& m = messages[i % messages.size()];
+    if (!walAppend(wal, m.topic.c_str(), m.topic.size(), m.payload.data(), m.payload.size(), t + i, false)) {
+      fprintf(stderr, "aggregator: log append failed (disk full?)\n");
+      walClose(wal);
+      removeTree(root);
+      return 1;
+    }
+    walMaybeSync(wal);
+  }
+  double writeS = (mqttNowMicros() - start) / 1e6;
+  uint64_t written = wal.stats.records, writeSyncs = wal.stats.syncs;
+  // A record cut off mid-write: half a header of garbage past the tail
+  memset(wal.map + wal.writePos, 0xA5, WAL_RECORD_HEADER / 2);
+  walClose(wal);
+
+  // Start cold, as after a reboot
+  if (system("sync") != 0) fprintf(stderr, "aggregator: sync failed\n");
+  int dropCaches = open("/proc/sys/vm/drop_caches", O_WRONLY);
+  bool cold = dropCaches >= 0 && write(dropCaches, "1", 1) == 1;
+  if (dropCaches >= 0) close(dropCaches);
+
+  if (!walOpen(wal, dir.c_str(), opts.walSegmentMb << 20, opts.walSyncMs)) return 1;
+  double openMs = wal.stats.recoveryMicros / 1000.0;
+  uint64_t tornBytes = wal.stats.tornBytes, nextLsn = wal.nextLsn;
+  walClose(wal);
+
+  uint64_t scanned = 0;
+  start = mqttNowMicros();
+  walReplay(dir.c_str(), 1, countRecord, &scanned);
+  double scanS = (mqttNowMicros() - start) / 1e6;
+
+  if (!columnStoreOpen(store, (root + "/store").c_str(), opts.maxOpen)) return 1;
+  uint64_t checkpointLsn;
+  columnStoreRecover(store, checkpointLsn);
+  start = mqttNowMicros();
+  walReplay(dir.c_str(), 1, replayRecord, nullptr);
+  columnStoreCheckpoint(store, nextLsn - 1);
+  double replayS = (mqttNowMicros() - start) / 1e6;
+  columnStoreClose(store);
+
+  double mb = opts.benchRecoveryMb;
+  printf("{\"logMb\": %.0f, \"records\": %" PRIu64 ", \"writeMbPerS\": %.0f, \"walSyncs\": %" PRIu64 ", "
+         "\"coldCache\": %s, \"openMs\": %.2f, \"tornBytes\": %" PRIu64 ", \"scanned\": %" PRIu64 ", "
+         "\"scanMbPerS\": %.0f, \"replayed\": %" PRIu64 ", \"points\": %" PRIu64 ", \"replayS\": %.2f, "
+         "\"replayMbPerS\": %.0f}\n",
+         mb, written, mb / writeS, writeSyncs, cold ? "true" : "false", openMs, tornBytes, scanned,
+         mb / scanS, stats.replayed, stats.points, replayS, mb / replayS);
+  removeTree(root);
+  return scanned == written && nextLsn == written + 1 ? 0 : 1;
+}
+
+struct Collected {
+  std::vector<int64_t> times;
+  std::vector<double> values;
+};
+
+static bool collect(void* context, const int64_t* times, const double* values, size_t count) {
+  Collected& c = *(Collected*)context;
+  c.times.insert(c.times.end(), times, times + count);
+  c.values.insert(c.values.end(), values, values + count);
+  return true;
+}
+
+struct PointLog {
+  std::vector<std::string> metrics;
+  std::vector<double> values;
+  std::vector<int64_t> times;
+};
+
+static void logPoint(void* context, int desk, const char* metric, int64_t timeMs, double value) {
+  PointLog& log = *(PointLog*)context;
+  log.metrics.push_back(columnSeriesName(desk, metric));
+  log.values.push_back(value);
+  log.times.push_back(timeMs);
+}
+
+static double pointValue(const PointLog& log, const char* series) {
+  for (size_t i = 0; i < log.metrics.size(); i++) {
+    if (log.metrics[i] == series) return log.values[i];
+  }
+  return -12345;
+}
+
+struct ReplayCheck {
+  uint64_t first;
+  uint64_t next;
+  uint64_t count;
+  bool continuous;
+  bool payloadsMatch;
+};
+
+static bool checkRecord(void* context, const WalRecord& record) {
+  ReplayCheck& c = *(ReplayCheck*)context;
+  if (c.count == 0) c.first = record.lsn;
+  else if (record.lsn != c.next) c.continuous = false;
+  c.next = record.lsn + 1;
+  c.count++;
+  char expected[32];
+  int n = snprintf(expected, sizeof(expected), "{\"i\":%" PRIu64 "}", record.lsn);
+  if (record.receivedMs != (int64_t)record.lsn || record.length != (size_t)n ||
+      memcmp(record.payload, expected, n) != 0) {
+    c.payloadsMatch = false;
+  }
+  return true;
+}
+
+static void ingest(const std::string& topic, const char* payload, int64_t timeMs) {
+  currentLsn = walAppend(wal, topic.c_str(), topic.size(), (const uint8_t*)payload, strlen(payload), timeMs,
+                         billeIsCriticalTopic(topic.c_str(), topic.size()));
+  billeDecode(topic.c_str(), topic.size(), (const uint8_t*)payload, strlen(payload), timeMs, storePoint, &store);
+}
+
+static void verifyWal() {
+  // Rollover, durable appends, a corrupted last record and a torn tail
+  std::string root = tempRoot("walverify");
+  std::string dir = root + "/wal";
+  check(walOpen(wal, dir.c_str(), 64 * 1024, 1000), "wal open");
+  char payload[32];
+  bool lsnsInOrder = true;
+  size_t lastPos = 0;
+  for (uint64_t i = 1; i <= 5000; i++) {
+    int n = snprintf(payload, sizeof(payload), "{\"i\":%" PRIu64 "}", i);
+    lastPos = wal.writePos;
+    lsnsInOrder = lsnsInOrder && walAppend(wal, "bille/data/x", 12, (const uint8_t*)payload, n, (int64_t)i,
+                                           i % 500 == 0) == i;
+  }
+  check(lsnsInOrder, "wal lsns consecutive");
+  check(wal.stats.segmentsCreated > 3 && wal.stats.durableSyncs == 10, "wal rollover and durable syncs");
+  wal.map[lastPos + WAL_RECORD_HEADER] ^= 0xFF;  // Last record fails its CRC
+  memset(wal.map + wal.writePos, 0xA5, 40);      // Half-written record after it
+  walClose(wal);
+
+  check(walOpen(wal, dir.c_str(), 64 * 1024, 1000), "wal reopen");
+  check(wal.nextLsn == 5000 && wal.stats.tornBytes > 0, "wal torn tail dropped");
+  check(wal.stats.recoveredRecords > 0 && wal.stats.recoveredRecords < 5000, "wal scans only the newest segment");
+  int n = snprintf(payload, sizeof(payload), "{\"i\":5000}");
+  check(walAppend(wal, "bille/data/x", 12, (const uint8_t*)payload, n, 5000, false) == 5000, "wal appends after tail");
+
+  ReplayCheck replay = {0, 0, 0, true, true};
+  walReplay(dir.c_str(), 1, checkRecord, &replay);
+  check(replay.count == 5000 && replay.continuous && replay.payloadsMatch, "wal replay complete");
+
+  walTruncateBefore(wal, 3000);
+  replay = {0, 0, 0, true, true};
+  walReplay(dir.c_str(), 1, checkRecord, &replay);
+  check(wal.stats.segmentsRemoved > 0 && replay.first > 1 && replay.first <= 3000 && replay.next == 5001 &&
+        replay.continuous, "wal truncated before lsn");
+  replay = {0, 0, 0, true, true};
+  walReplay(dir.c_str(), 4000, checkRecord, &replay);
+  check(replay.first == 4000 && replay.count == 1001, "wal replay from lsn");
+  walClose(wal);
+
+  // A segment created but never given its header (power cut) is discarded
+  char name[64];
+  snprintf(name, sizeof(name), "/wal-%016" PRIx64 ".log", (uint64_t)5001);
+  int fd = open((dir + name).c_str(), O_RDWR | O_CREAT, 0644);
+  check(fd >= 0 && ftruncate(fd, 64 * 1024) == 0, "empty segment created");
+  if (fd >= 0) close(fd);
+  check(walOpen(wal, dir.c_str(), 64 * 1024, 1000) && wal.nextLsn == 5001, "headerless segment discarded");
+  walClose(wal);
+
+  // A newest segment that cannot be opened fails the open and nothing is
+  // deleted (a dangling link stands in for EACCES/EMFILE/ENOMEM)
+  snprintf(name, sizeof(name), "/wal-%016" PRIx64 ".log", (uint64_t)6001);
+  std::string unreadable = dir + name;
+  check(symlink((root + "/missing").c_str(), unreadable.c_str()) == 0, "unopenable segment created");
+  check(!walOpen(wal, dir.c_str(), 64 * 1024, 1000), "unopenable segment fails the open");
+  struct stat st;
+  replay = {0, 0, 0, true, true};
+  walReplay(dir.c_str(), 4000, checkRecord, &replay);
+  check(lstat(unreadable.c_str(), &st) == 0 && replay.first == 4000 && replay.count == 1001,
+        "nothing deleted on an I/O error");
+  unlink(unreadable.c_str());
+  check(walOpen(wal, dir.c_str(), 64 * 1024, 1000) && wal.nextLsn == 5001, "log intact after the failed open");
+  walClose(wal);
+  removeTree(root);
+
+  // Crash after a checkpoint: the store goes back to it, the log replays
+  // the rest, and every point is there exactly once
+  root = tempRoot("crashverify");
+  dir = root + "/wal";
+  stats = AggregatorStats();
+  uint64_t checkpointLsn = 99;
+  check(columnStoreOpen(store, root.c_str(), 8) && columnStoreRecover(store, checkpointLsn) && checkpointLsn == 0,
+        "fresh store recovers");
+  check(walOpen(wal, dir.c_str(), 1 << 20, 1000), "crash log open");
+  std::string envTopic = deskTopic(1, "data/environment");
+  std::string sessionTopic = deskTopic(2, "session/state");
+  char json[160];
+  const long before = 60000, total = SEGMENT_CAPACITY + 10000;
+  for (long i = 1; i <= total; i++) {
+    if (i == before + 1) checkpoint();
+    snprintf(json, sizeof(json), "{\"timestamp\":%ld,\"temperature\":%ld}", i, i);
+    ingest(envTopic, json, 1000 + i);
+    if (i > before && i % 1000 == 0) {
+      snprintf(json, sizeof(json), "{\"active\":true,\"userId\":\"A1B2C3D4\",\"timestamp\":%ld,"
+               "\"sessionDuration\":%ld}", i, i / 1000);
+      ingest(sessionTopic, json, 1000 + i);
+    }
+  }
+  check(wal.stats.durableSyncs == (total - before) / 1000, "session transitions synced on append");
+  columnStoreClose(store);  // Crash: no checkpoint for the tail
+  walClose(wal);
+
+  stats = AggregatorStats();
+  columnStoreOpen(store, root.c_str(), 8);
+  check(columnStoreRecover(store, checkpointLsn) && checkpointLsn == (uint64_t)before, "checkpoint lsn read");
+  check(store.stats.rolledBack == total - before && store.stats.droppedSeries == 3,
+        "store cut back to checkpoint");
+  check(walOpen(wal, dir.c_str(), 1 << 20, 1000, checkpointLsn + 1), "crash log reopen");
+  walReplay(dir.c_str(), checkpointLsn + 1, replayRecord, nullptr);
+  check(stats.replayed == (uint64_t)(total - before + (total - before) / 1000), "log replayed after checkpoint");
+
+  // On reconnect the broker resends what was never acknowledged: a DUP copy
+  // of a logged message is dropped, one we never got is stored
+  MqttClient redelivery;
+  mqttInit(redelivery);
+  redelivery.dup = true;
+  for (long i = total; i <= total + 1; i++) {
+    snprintf(json, sizeof(json), "{\"timestamp\":%ld,\"temperature\":%ld}", i, i);
+    onMessage(&redelivery, envTopic.c_str(), envTopic.size(), (const uint8_t*)json, strlen(json));
+  }
+  check(stats.redelivered == 1 && stats.messages == 1, "redelivered copy of a logged message dropped");
+  checkpoint();
+  walClose(wal);
+  columnStoreClose(store);
+
+  Collected temperature;
+  columnStoreScan(root.c_str(), "desk-1/environment.temperature", INT64_MIN, INT64_MAX, collect, &temperature);
+  bool exact = (long)temperature.values.size() == total + 1;
+  for (size_t i = 0; exact && i < temperature.values.size(); i++) exact = temperature.values[i] == (double)(i + 1);
+  check(exact, "every point once, in order");
+  Collected session;
+  columnStoreScan(root.c_str(), "desk-2/session.durationSeconds", INT64_MIN, INT64_MAX, collect, &session);
+  check((long)session.values.size() == (total - before) / 1000 && session.values.back() == total / 1000,
+        "session transitions recovered");
+  removeTree(root);
+}
+
+static int runVerify() {
+  // Store: two segments' worth of points, forced evictions, a late point
+  std::string root = tempRoot("aggverify");
+  check(!root.empty() && columnStoreOpen(store, root.c_str(), 2), "store open");
+  const long total = SEGMENT_CAPACITY + SEGMENT_CAPACITY / 2;
+  for (long i = 0; i < total; i++) {
+    columnStoreAppend(store, "desk-1/a", 1000 + i * 10, (double)i);
+    if (i % 1000 == 0) {
+      columnStoreAppend(store, "desk-2/b", 1000 + i, 1);
+      columnStoreAppend(store, "desk-3/c", 1000 + i, 2);
+    }
+  }
+  columnStoreAppend(store, "desk-1/a", 5, -1);  // Late: clamped to the last time
+  check(store.stats.segmentsSealed == 1, "one segment sealed");
+  check(store.stats.evictions > 0 && store.openCount <= 2, "open segments bounded");
+  check(store.stats.reordered == 1, "late point clamped");
+
+  // Readers see appended points without a close (shared mapping)
+  Collected all;
+  check(columnStoreScan(root.c_str(), "desk-1/a", INT64_MIN, INT64_MAX, collect, &all), "scan live");
+  check((long)all.times.size() == total + 1, "live point count");
+  bool ordered = true;
+  for (size_t i = 1; i < all.times.size(); i++) ordered = ordered && all.times[i] >= all.times[i - 1];
+  check(ordered, "times non-decreasing");
+  columnStoreClose(store);
+
+  // Range across the segment boundary
+  Collected range;
+  int64_t from = 1000 + (SEGMENT_CAPACITY - 5) * 10LL, to = 1000 + (SEGMENT_CAPACITY + 4) * 10LL;
+  columnStoreScan(root.c_str(), "desk-1/a", from, to, collect, &range);
+  check(range.times.size() == 10 && range.values.front() == SEGMENT_CAPACITY - 5, "range across segments");
+
+  // Reopen appends to the active segment
+  columnStoreOpen(store, root.c_str(), 2);
+  columnStoreAppend(store, "desk-1/a", 1, 7);
+  columnStoreClose(store);
+  Collected tail;
+  columnStoreScan(root.c_str(), "desk-1/a", INT64_MIN, INT64_MAX, collect, &tail);
+  check((long)tail.times.size() == total + 2 && tail.values.back() == 7, "append after reopen");
+  removeTree(root);
+
+  verifyWal();
+
+  // Decoder
+  PointLog log;
+  const char* env = "{\"nodeType\":\"ENVIRONMENT\",\"timestamp\":123,\"temperature\":22.50,"
+                    "\"humidity\":41,\"lightLevel\":300,\"noiseLevel\":40,\"soundDetected\":true}";
+  std::string topic = deskTopic(4, "data/environment");
+  check(billeDecode(topic.c_str(), topic.size(), (const uint8_t*)env, strlen(env), 1000, logPoint, &log) == 5,
+        "environment points");
+  check(pointValue(log, "desk-4/environment.temperature") == 22.5, "temperature");
+  check(pointValue(log, "desk-4/environment.soundDetected") == 1, "soundDetected");
+
+  const char* bio = "{\"timestamp\":70000,\"activity\":\"Running\",\"stepCount\":10,\"lastMovement\":40000,"
+                    "\"nested\":{\"a\":[1,{\"b\":\"}\"}]},\"sessionActive\":false}";
+  check(billeDecode("bille/data/biometric", 20, (const uint8_t*)bio, strlen(bio), 1000, logPoint, &log) == 4,
+        "biometric points");
+  check(pointValue(log, "desk-0/biometric.activity") == 4, "activity code");
+  check(pointValue(log, "desk-0/biometric.idleSeconds") == 30, "idle seconds");
+  check(billeDecode("bille/status/aggregator", 23, (const uint8_t*)"{}", 2, 0, logPoint, &log) == -1,
+        "unknown topic ignored");
+
+  std::vector<BenchMessage> messages = benchMessages(1);
+  const BenchMessage& batch = messages[2];
+  log = PointLog();
+  check(billeDecode(batch.topic.c_str(), batch.topic.size(), batch.payload.data(), batch.payload.size(),
+                    100000, logPoint, &log) == 48, "batch points");
+  check(log.times.front() == 100000 - 11 * 5000 && log.times.back() == 100000, "batch sample times");
+
+  if (verifyFailures) {
+    fprintf(stderr, "verify: %d check(s) failed\n", verifyFailures);
+    return 1;
+  }
+  printf("verify: ok\n");
+  return 0;
+}
+
+// ---- Main --------------------------------------------------------------
+
+static void usage() {
+  fprintf(stderr,
+          "usage: bille-aggregator [options]\n"
+          "  --host H / --port P         broker (default 127.0.0.1:1883)\n"
+          "  --user U / --password P     broker credentials\n"
+          "  --root DIR                  store directory (default bille-data)\n"
+          "  --max-open N                mapped segments kept open (default %d)\n"
+          "  --flush-ms MS               msync period (default 1000)\n"
+          "  --status-s S                status publish period, 0 = off (default 60)\n"
+          "  --wal-dir DIR               write-ahead log (default <root>/wal)\n"
+          "  --wal-sync-ms MS            group commit interval (default %d)\n"
+          "  --wal-segment-mb MB         log segment size (default %u)\n"
+          "  --checkpoint-s S            store checkpoint period (default 30)\n"
+          "  --no-wal                    store only, no log (points since the last msync can be lost)\n"
+          "  --query SERIES              print desk-<n>/<metric> as CSV and exit\n"
+          "  --from MS / --to MS         query range, wall-clock ms\n"
+          "  --bench N [--desks D]       log + decode + append N synthetic messages\n"
+          "  --bench-recovery MB         write an MB-sized log, then time its recovery and replay\n"
+          "  --verify                    store/log/decoder self-check\n",
+          COLUMN_STORE_MAX_OPEN, WAL_DEFAULT_SYNC_MS, WAL_DEFAULT_SEGMENT >> 20);
+}
+
+static bool parseArgs(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    if (a == "--verify") {
+      opts.verify = true;
+      continue;
+    }
+    if (a == "--no-wal") {
+      opts.useWal = false;
+      continue;
+    }
+    if (i + 1 >= argc) return false;
+    const char* v = argv[++i];
+    if (a == "--host") opts.host = v;
+    else if (a == "--port") opts.port = atoi(v);
+    else if (a == "--user") opts.user = v;
+    else if (a == "--password") opts.password = v;
+    else if (a == "--root") opts.root = v;
+    else if (a == "--max-open") opts.maxOpen = atol(v);
+    else if (a == "--flush-ms") opts.flushMs = atoi(v);
+    else if (a == "--status-s") opts.statusS = atoi(v);
+    else if (a == "--wal-dir") opts.walDir = v;
+    else if (a == "--wal-sync-ms") opts.walSyncMs = atoi(v);
+    else if (a == "--wal-segment-mb") opts.walSegmentMb = atol(v);
+    else if (a == "--checkpoint-s") opts.checkpointS = atoi(v);
+    else if (a == "--bench-recovery") opts.benchRecoveryMb = atol(v);
+    else if (a == "--query") opts.query = v;
+    else if (a == "--from") opts.from = atoll(v);
+    else if (a == "--to") opts.to = atoll(v);
+    else if (a == "--bench") opts.bench = atol(v);
+    else if (a == "--desks") opts.benchDesks = atoi(v);
+    else return false;
+  }
+  if (opts.walDir.empty()) opts.walDir = opts.root + "/wal";
+  return opts.maxOpen > 0 && opts.benchDesks > 0 && opts.walSyncMs >= 0 && opts.walSegmentMb > 0 &&
+         opts.checkpointS > 0;
+}
+
+int main(int argc, char** argv) {
+  if (!parseArgs(argc, argv)) {
+    usage();
+    return 2;
+  }
+  if (opts.verify) return runVerify();
+  if (opts.bench > 0) return runBench();
+  if (opts.benchRecoveryMb > 0) return runRecoveryBench();
+  if (!opts.query.empty()) return runQuery();
+  return runDaemon();
+}
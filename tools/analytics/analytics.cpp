@@ -0,0 +1,649 @@
+/*
+===============================================================
+Bill-E Desk Analytics Service
+Firmware analysis logic for many desks on a worker pool
+===============================================================
+
+Runs the environment, Pomodoro and biometric analysis of the sketches
+(environmental_analysis.cpp with the predictive fan controller,
+data_analysis.cpp, health_monitor.cpp) on the host for every desk under
+bille/#, so one service can watch a whole room of desks.
+
+Pipeline (pipeline.h): per-desk state shards with lock-free MPSC message
+queues, drained by a work-stealing pool of worker threads. A desk is only
+ever processed by one worker at a time, in arrival order, so its alerts
+are the same whatever the thread count.
+
+Alerts are published to bille/desk/<n>/analytics/alerts (desk 0:
+bille/analytics/alerts); counters go to bille/status/analytics.
+
+--bench replays generated traffic through 1..N workers and reports
+throughput, speedup over one worker and a check that every run's per-desk
+results match a single-threaded replay. --verify tests the queues, the
+deque, the ported rules and run-to-run determinism.
+
+BUILD (from the repository root):
+  g++ -O2 -std=c++17 -pthread -Itools/common -Itools/analytics -Isketches/main_brain \
+      -Isketches/environment_monitor -o bille-analytics tools/analytics/analytics.cpp \
+      tools/analytics/pipeline.cpp tools/analytics/desk_analytics.cpp tools/common/mqtt_client.cpp \
+      tools/common/bille_decode.cpp sketches/environment_monitor/fan_controller.cpp \
+      sketches/main_brain/biometric_batch.cpp
+
+USAGE:
+  ./bille-analytics --host 127.0.0.1 --workers 8
+  ./bille-analytics --bench [--desks 256] [--steps 720] [--workers 8] [--producers 2]
+  ./bille-analytics --verify
+===============================================================
+*/
+
+#include <inttypes.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mqtt_client.h"
+#include "desk_topics.h"
+#include "lockfree_queue.h"
+#include "pipeline.h"
+#include "desk_analytics.h"
+#include "verify.h"
+
+#define RECONNECT_DELAY_MS   2000
+#define STATUS_TOPIC         "bille/status/analytics"
+#define ALERT_QUEUE_DEPTH    4096
+#define STEP_MS              10000    // Environment and biometric publish interval in the generated traffic
+
+struct Options {
+  std::string host = "127.0.0.1";
+  int port = MQTT_DEFAULT_PORT;
+  std::string user;
+  std::string password;
+  int workers = 0;               // 0: one per core
+  int producers = 2;
+  size_t queueDepth = PIPELINE_QUEUE_DEPTH;
+  int maxDesks = PIPELINE_MAX_DESKS;
+  int statusS = 60;
+  bool bench = false;
+  bool verify = false;
+  int desks = 256;
+  int steps = 720;
+};
+
+struct AlertOut {
+  int desk;
+  uint8_t type;
+  int64_t timeMs;
+};
+
+static Options opts;
+static Pipeline pipeline;
+static BoundedQueue<AlertOut> alertQueue;
+static std::atomic<uint64_t> alertsDropped(0);
+static volatile sig_atomic_t running = 1;
+
+static void onSignal(int) {
+  running = 0;
+}
+
+static int64_t wallMillis() {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int defaultWorkers() {
+  unsigned n = std::thread::hardware_concurrency();
+  return n ? (int)n : 1;
+}
+
+// ---- Service -----------------------------------------------------------
+
+// Worker threads: hand alerts to the MQTT thread
+static void queueAlert(void*, const DeskState& desk, DeskAlertType type, int64_t timeMs) {
+  AlertOut a = {desk.desk, (uint8_t)type, timeMs};
+  if (!boundedPush(alertQueue, a)) alertsDropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+static void onMessage(void*, const char* topic, size_t topicLength, const uint8_t* payload, size_t length) {
+  pipelineSubmit(pipeline, topic, topicLength, payload, length, wallMillis());
+}
+
+static void publishAlerts(MqttClient& client) {
+  AlertOut a;
+  char json[256];
+  while (boundedPopSingle(alertQueue, a)) {
+    DeskAlertType type = (DeskAlertType)a.type;
+    snprintf(json, sizeof(json),
+             "{\"nodeType\":\"ANALYTICS\",\"alert\":\"%s\",\"type\":\"%s\",\"level\":\"%s\",\"timestamp\":%" PRId64 "}",
+             deskAlertMessage(type), deskAlertName(type), deskAlertLevel(type), a.timeMs);
+    mqttPublish(client, deskTopic(a.desk, "analytics/alerts").c_str(), json);
+  }
+}
+
+static void publishStatus(MqttClient& client) {
+  PipelineStats s = pipelineStats(pipeline);
+  char json[512];
+  snprintf(json, sizeof(json),
+           "{\"nodeType\":\"ANALYTICS\",\"workers\":%d,\"desks\":%zu,\"submitted\":%" PRIu64 ",\"processed\":%" PRIu64
+           ",\"ignored\":%" PRIu64 ",\"oversize\":%" PRIu64 ",\"fullWaits\":%" PRIu64 ",\"steals\":%" PRIu64
+           ",\"alertsDropped\":%" PRIu64 "}",
+           pipeline.workerCount, s.desks, s.submitted, s.processed, s.ignored, s.oversize, s.fullWaits, s.steals,
+           alertsDropped.load());
+  mqttPublish(client, STATUS_TOPIC, json);
+}
+
+static int runService() {
+  boundedInit(alertQueue, ALERT_QUEUE_DEPTH);
+  int workers = opts.workers > 0 ? opts.workers : defaultWorkers();
+  if (!pipelineStart(pipeline, workers, opts.queueDepth, opts.maxDesks, queueAlert, nullptr)) {
+    fprintf(stderr, "analytics: bad pipeline settings\n");
+    return 2;
+  }
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+
+  const char* user = opts.user.empty() ? nullptr : opts.user.c_str();
+  const char* password = opts.password.empty() ? nullptr : opts.password.c_str();
+  MqttClient client;
+  mqttInit(client);
+  uint64_t lastStatus = mqttNowMicros();
+
+  while (running) {
+    if (!client.connected) {
+      if (!mqttConnect(client, opts.host.c_str(), opts.port, "bille_analytics", user, password, 30)) {
+        fprintf(stderr, "analytics: broker %s:%d unavailable, retrying\n", opts.host.c_str(), opts.port);
+        usleep(RECONNECT_DELAY_MS * 1000);
+        continue;
+      }
+      mqttSubscribe(client, "bille/#");
+      fprintf(stderr, "analytics: connected, %d workers\n", workers);
+    }
+
+    mqttPoll(client, 20, onMessage, nullptr);
+    publishAlerts(client);
+
+    uint64_t now = mqttNowMicros();
+    if (opts.statusS > 0 && now - lastStatus > opts.statusS * 1000000ULL) {
+      publishStatus(client);
+      lastStatus = now;
+    }
+  }
+
+  pipelineStop(pipeline);
+  publishAlerts(client);
+  mqttDisconnect(client);
+  PipelineStats s = pipelineStats(pipeline);
+  fprintf(stderr, "analytics: %" PRIu64 " messages from %zu desks\n", s.processed, s.desks);
+  return 0;
+}
+
+// ---- Generated traffic -------------------------------------------------
+
+struct Traffic {
+  std::vector<std::string> topics;   // Per desk and kind
+  std::vector<char> payloads;
+  struct Message {
+    uint32_t topic;
+    uint32_t offset;
+    uint16_t length;
+    int desk;
+    int64_t receivedMs;
+  };
+  std::vector<Message> messages;     // Arrival order across all desks
+};
+
+static uint32_t randomState = 12345;
+static double uniform() {
+  randomState ^= randomState << 13;
+  randomState ^= randomState >> 17;
+  randomState ^= randomState << 5;
+  return (randomState & 0xFFFFFF) / (double)0x1000000;
+}
+
+static void addMessage(Traffic& t, int desk, int kind, int64_t receivedMs, const char* json) {
+  size_t length = strlen(json);
+  Traffic::Message m = {(uint32_t)(desk * 4 + kind), (uint32_t)t.payloads.size(), (uint16_t)length, desk, receivedMs};
+  t.payloads.insert(t.payloads.end(), json, json + length);
+  t.messages.push_back(m);
+}
+
+// Each desk: a session of 25/5 minute Pomodoros, a room that warms past the
+// fan thresholds and cools again, a wearer who sits through work blocks and
+// moves in most breaks. Desks are phase-shifted so alerts are spread out.
+static void generateTraffic(Traffic& t, int desks, int steps) {
+  static const char* kindSuffix[4] = {"data/environment", "data/biometric", "pomodoro/state", "session/state"};
+  static const char* activities[] = {"Sitting", "Still", "Moving", "Walking", "Running"};
+  t.topics.clear();
+  t.payloads.clear();
+  t.messages.clear();
+  for (int d = 0; d < desks; d++)
+    for (int k = 0; k < 4; k++) t.topics.push_back(deskTopic(d, kindSuffix[k]));
+
+  std::vector<unsigned long> lastMovement(desks, 0);
+  std::vector<int> pomodoro(desks, -1);
+  char json[400];
+  const int64_t base = INT64_C(1760000000000);
+  for (int step = 0; step < steps; step++) {
+    for (int d = 0; d < desks; d++) {
+      int64_t received = base + (int64_t)step * STEP_MS + d * 7;
+      unsigned long millis = 60000UL + (unsigned long)step * STEP_MS;
+      if (step == 0) {
+        addMessage(t, d, 3, received, "{\"active\":true,\"user\":\"A1B2C3D4\",\"sessionDuration\":0}");
+      }
+      // 30-minute cycles: 25 min work (1), 5 min short break (2), every 4th a long break (3)
+      int minute = (step * STEP_MS / 60000 + d) % 30;
+      int cycle = (step * STEP_MS / 60000 + d) / 30;
+      int state = minute < 25 ? 1 : cycle % 4 == 3 ? 3 : 2;
+      if (state != pomodoro[d]) {
+        pomodoro[d] = state;
+        snprintf(json, sizeof(json), "{\"state\":%d,\"timeRemaining\":%d,\"completedCycles\":%d,\"snoozeCount\":0,"
+                 "\"timestamp\":%lu}", state, state == 1 ? 1500 : 300, cycle, millis);
+        addMessage(t, d, 2, received, json);
+      }
+
+      double phase = (step + d * 13) * 2 * M_PI / 360.0;   // One hour per room cycle
+      double temperature = 23.0 + 2.2 * sin(phase) + (uniform() - 0.5) * 0.2;
+      if (uniform() < 0.002) temperature = -999;           // DHT failure
+      snprintf(json, sizeof(json), "{\"nodeType\":\"ENVIRONMENT\",\"timestamp\":%lu,\"temperature\":%.2f,"
+               "\"humidity\":48.50,\"lightLevel\":%d,\"noiseLevel\":%d,\"soundDetected\":false}",
+               millis, temperature, 250 + (int)(uniform() * 200), (int)(uniform() * 6));
+      addMessage(t, d, 0, received, json);
+
+      // Sits through work, moves in three breaks out of four, fidgets now and then
+      bool moving = state != 1 ? (cycle + d) % 4 != 0 && minute >= 26 : uniform() < 0.03;
+      int activity = moving ? 2 + (int)(uniform() * 3) : (int)(uniform() * 2);
+      if (moving) lastMovement[d] = millis;
+      snprintf(json, sizeof(json), "{\"nodeType\":\"WEARABLE\",\"timestamp\":%lu,\"activity\":\"%s\","
+               "\"stepCount\":%d,\"acceleration\":1.02,\"lastMovement\":%lu,\"sessionActive\":true}",
+               millis, activities[activity], step * 3, lastMovement[d]);
+      addMessage(t, d, 1, received + 3, json);
+    }
+  }
+}
+
+struct DeskResult {
+  uint64_t digest;
+  uint64_t messages;
+  uint64_t alerts[ALERT_TYPES];
+};
+
+static void collectResult(void* context, const DeskState& state) {
+  std::vector<DeskResult>& results = *(std::vector<DeskResult>*)context;
+  if ((size_t)state.desk >= results.size()) results.resize(state.desk + 1);
+  DeskResult& r = results[state.desk];
+  r.digest = state.digest;
+  r.messages = state.messages;
+  memcpy(r.alerts, state.alerts, sizeof(r.alerts));
+}
+
+// Single-threaded reference: the same code path without the pipeline
+static double replaySequential(const Traffic& t, int desks, std::vector<DeskResult>& results) {
+  std::vector<DeskState> states(desks);
+  for (int d = 0; d < desks; d++) deskInit(states[d], d);
+  uint64_t start = mqttNowMicros();
+  for (const Traffic::Message& m : t.messages) {
+    const std::string& topic = t.topics[m.topic];
+    const char* suffix = nullptr;
+    size_t suffixLength = 0;
+    if (deskFromTopic(topic.c_str(), topic.size(), &suffix, &suffixLength) < 0) continue;
+    deskProcess(states[m.desk], deskMessageKind(suffix, suffixLength), t.payloads.data() + m.offset, m.length,
+                m.receivedMs, nullptr, nullptr);
+  }
+  double seconds = (mqttNowMicros() - start) / 1e6;
+  results.clear();
+  for (const DeskState& s : states) collectResult(&results, s);
+  return seconds;
+}
+
+struct RunResult {
+  double seconds;
+  PipelineStats stats;
+};
+
+// Producers split the desks between them (desk % producers), as separate
+// broker connections would, so each desk's order is fixed
+static RunResult replayPipeline(const Traffic& t, int workers, int producers, std::vector<DeskResult>& results) {
+  Pipeline p;
+  pipelineStart(p, workers, opts.queueDepth, opts.maxDesks);
+  uint64_t start = mqttNowMicros();
+  std::vector<std::thread> threads;
+  for (int id = 0; id < producers; id++) {
+    threads.emplace_back([&t, &p, id, producers]() {
+      for (const Traffic::Message& m : t.messages) {
+        if (m.desk % producers != id) continue;
+        const std::string& topic = t.topics[m.topic];
+        pipelineSubmit(p, topic.c_str(), topic.size(), (const uint8_t*)t.payloads.data() + m.offset, m.length,
+                       m.receivedMs);
+      }
+    });
+  }
+  for (std::thread& th : threads) th.join();
+  pipelineDrain(p);
+  RunResult run;
+  run.seconds = (mqttNowMicros() - start) / 1e6;
+  run.stats = pipelineStats(p);
+  results.clear();
+  pipelineForEachDesk(p, collectResult, &results);
+  pipelineStop(p);
+  return run;
+}
+
+static bool sameResults(const std::vector<DeskResult>& a, const std::vector<DeskResult>& b) {
+  if (a.size() != b.size()) return false;
+  for (size_t i = 0; i < a.size(); i++)
+    if (a[i].digest != b[i].digest || a[i].messages != b[i].messages ||
+        memcmp(a[i].alerts, b[i].alerts, sizeof(a[i].alerts)) != 0)
+      return false;
+  return true;
+}
+
+// ---- Bench -------------------------------------------------------------
+
+static int runBench() {
+  Traffic traffic;
+  generateTraffic(traffic, opts.desks, opts.steps);
+  const double messages = (double)traffic.messages.size();
+  int maxWorkers = opts.workers > 0 ? opts.workers : defaultWorkers();
+
+  std::vector<DeskResult> reference, results;
+  double sequential = replaySequential(traffic, opts.desks, reference);
+  uint64_t alerts = 0;
+  for (const DeskResult& r : reference)
+    for (uint64_t a : r.alerts) alerts += a;
+
+  printf("{\"desks\": %d, \"messages\": %.0f, \"alerts\": %" PRIu64 ", \"cores\": %d, \"producers\": %d, "
+         "\"sequentialMsgsPerSec\": %.0f, \"runs\": [",
+         opts.desks, messages, alerts, defaultWorkers(), opts.producers, messages / sequential);
+  std::vector<int> counts;
+  for (int n = 1; n < maxWorkers; n *= 2) counts.push_back(n);
+  counts.push_back(maxWorkers);
+  double single = 0;
+  bool allMatch = true;
+  for (size_t i = 0; i < counts.size(); i++) {
+    // Best of three, to keep scheduler noise out of the scaling curve
+    RunResult best = {};
+    bool match = true;
+    for (int rep = 0; rep < 3; rep++) {
+      RunResult run = replayPipeline(traffic, counts[i], opts.producers, results);
+      match = match && sameResults(results, reference);
+      if (rep == 0 || run.seconds < best.seconds) best = run;
+    }
+    allMatch = allMatch && match;
+    double rate = messages / best.seconds;
+    if (i == 0) single = rate;
+    printf("%s{\"workers\": %d, \"msgsPerSec\": %.0f, \"speedup\": %.2f, \"steals\": %" PRIu64
+           ", \"fullWaits\": %" PRIu64 ", \"matchesSequential\": %s}",
+           i ? ", " : "", counts[i], rate, rate / single, best.stats.steals, best.stats.fullWaits,
+           match ? "true" : "false");
+  }
+  printf("]}\n");
+  return allMatch ? 0 : 1;
+}
+
+// ---- Self-check --------------------------------------------------------
+
+struct Tagged {
+  uint32_t producer;
+  uint32_t sequence;
+};
+
+static void verifyQueues() {
+  // MPSC: four producers through a small queue, per-producer order kept
+  const int producers = 4, perProducer = 200000;
+  BoundedQueue<Tagged> q;
+  boundedInit(q, 64);
+  std::vector<std::thread> threads;
+  for (int id = 0; id < producers; id++) {
+    threads.emplace_back([&q, id]() {
+      for (uint32_t s = 0; s < (uint32_t)perProducer; s++) {
+        Tagged item = {(uint32_t)id, s};
+        while (!boundedPush(q, item)) std::this_thread::yield();
+      }
+    });
+  }
+  std::vector<uint32_t> next(producers, 0);
+  bool ordered = true;
+  for (int received = 0; received < producers * perProducer;) {
+    Tagged item;
+    if (!boundedPopSingle(q, item)) {
+      std::this_thread::yield();
+      continue;
+    }
+    ordered = ordered && item.producer < (uint32_t)producers && item.sequence == next[item.producer];
+    if (item.producer < (uint32_t)producers) next[item.producer] = item.sequence + 1;
+    received++;
+  }
+  for (std::thread& th : threads) th.join();
+  Tagged extra;
+  check(ordered && !boundedPopSingle(q, extra), "MPSC queue keeps per-producer order");
+
+  BoundedQueue<int> small;
+  boundedInit(small, 3);   // Rounds up to 4
+  int pushed = 0;
+  while (boundedPush(small, pushed)) pushed++;
+  check(pushed == 4, "bounded queue capacity");
+
+  // Deque: owner pushes and pops while three thieves steal; each item taken once
+  const int items = 300000;
+  StealDeque<int> d;
+  stealInit(d, 1024);
+  std::vector<int> values(items);
+  std::vector<std::atomic<int>> taken(items);
+  for (int i = 0; i < items; i++) {
+    values[i] = i;
+    taken[i].store(0);
+  }
+  std::atomic<bool> done(false);
+  std::vector<std::thread> thieves;
+  for (int k = 0; k < 3; k++) {
+    thieves.emplace_back([&]() {
+      while (!done.load()) {
+        int* v = stealTake(d);
+        if (v) taken[*v].fetch_add(1);
+        else std::this_thread::yield();
+      }
+    });
+  }
+  for (int i = 0; i < items; i++) {
+    while (!stealPush(d, &values[i])) {
+      int* v = stealPop(d);
+      if (v) taken[*v].fetch_add(1);
+    }
+    if (i % 3 == 0) {
+      int* v = stealPop(d);
+      if (v) taken[*v].fetch_add(1);
+    }
+  }
+  for (int* v; (v = stealPop(d));) taken[*v].fetch_add(1);
+  done.store(true);
+  for (std::thread& th : thieves) th.join();
+  bool once = true;
+  for (int i = 0; i < items; i++) once = once && taken[i].load() == 1;
+  check(once, "steal deque hands out every item once");
+}
+
+static uint64_t lastAlerts[ALERT_TYPES];
+static void countAlert(void*, const DeskState&, DeskAlertType type, int64_t) {
+  lastAlerts[type]++;
+}
+
+static bool feed(DeskState& d, DeskMessageKind kind, const char* json, int64_t t) {
+  return deskProcess(d, kind, json, strlen(json), t, countAlert, nullptr);
+}
+
+static void verifyRules() {
+  DeskState d;
+  char json[256];
+  deskInit(d, 3);
+  memset(lastAlerts, 0, sizeof(lastAlerts));
+
+  // Environment: the last matching rule wins, one alert per reading
+  feed(d, DESK_ENVIRONMENT, "{\"temperature\":19.0,\"lightLevel\":400,\"noiseLevel\":1}", 1000);
+  feed(d, DESK_ENVIRONMENT, "{\"temperature\":27.0,\"lightLevel\":400,\"noiseLevel\":9}", 2000);
+  feed(d, DESK_ENVIRONMENT, "{\"temperature\":22.0,\"lightLevel\":100,\"noiseLevel\":9}", 3000);
+  feed(d, DESK_ENVIRONMENT, "{\"temperature\":22.0,\"lightLevel\":400,\"noiseLevel\":1}", 4000);
+  check(lastAlerts[ALERT_TOO_COLD] == 1 && lastAlerts[ALERT_TOO_HOT] == 0 && lastAlerts[ALERT_NOISY] == 1 &&
+        lastAlerts[ALERT_DIM] == 1, "environment alert precedence");
+  // The firmware alerts on the DHT failure value too; the fan model skips it
+  feed(d, DESK_ENVIRONMENT, "{\"temperature\":-999,\"lightLevel\":400,\"noiseLevel\":1}", 5000);
+  check(lastAlerts[ALERT_TOO_COLD] == 2 && d.fan.count == 4, "-999 reaches alerts, not the fan model");
+
+  // Fan: rising room switches on, then holds for the minimum on time
+  deskInit(d, 4);
+  memset(lastAlerts, 0, sizeof(lastAlerts));
+  int64_t t = 0;
+  for (int i = 0; i < 30; i++, t += 10000) {
+    snprintf(json, sizeof(json), "{\"temperature\":%.2f,\"lightLevel\":400,\"noiseLevel\":1}", 22.0 + i * 0.12);
+    feed(d, DESK_ENVIRONMENT, json, t);
+  }
+  check(lastAlerts[ALERT_FAN_ON] == 1 && d.fanOn, "fan switches on as the room warms");
+  feed(d, DESK_ENVIRONMENT, "{\"temperature\":20.0,\"lightLevel\":400,\"noiseLevel\":1}", t);
+  check(d.fanOn && lastAlerts[ALERT_FAN_OFF] == 0, "fan dwell holds the relay");
+  feed(d, DESK_FAN_COMMAND, "{\"command\":\"manual_off\"}", t + 1);
+  check(!d.fanOn && lastAlerts[ALERT_FAN_OFF] == 1, "manual command bypasses dwell");
+
+  // Bouts: a fidget shorter than the switch time keeps the sitting bout
+  deskInit(d, 5);
+  memset(lastAlerts, 0, sizeof(lastAlerts));
+  feed(d, DESK_SESSION, "{\"active\":true}", 0);
+  feed(d, DESK_POMODORO, "{\"state\":1}", 0);
+  t = 0;
+  for (int i = 0; i <= 130; i++, t += 10000) {
+    bool fidget = i == 60 || i == 61;   // 20 s of movement
+    snprintf(json, sizeof(json), "{\"timestamp\":%" PRId64 ",\"lastMovement\":%" PRId64 ",\"activity\":\"%s\"}", t,
+             fidget ? t : 0, fidget ? "Walking" : "Sitting");
+    feed(d, DESK_BIOMETRIC, json, t);
+  }
+  check(deskCurrentSitMs(d, t - 10000) == 1300000, "short fidget keeps the sitting bout");
+  check(lastAlerts[ALERT_MOVEMENT_BREAK] == 10, "sitting alert after 20 minutes in a work session");
+  check(lastAlerts[ALERT_MOVEMENT_REMINDER] == 0, "no reminder while the wearable saw movement");
+
+  // Walking for the switch time ends the bout where walking began
+  for (int i = 0; i < 7; i++, t += 10000) {
+    snprintf(json, sizeof(json), "{\"timestamp\":%" PRId64 ",\"lastMovement\":%" PRId64 ",\"activity\":\"Walking\"}",
+             t, t);
+    feed(d, DESK_BIOMETRIC, json, t);
+  }
+  check(!d.sedentary && deskCurrentSitMs(d, t) == 0, "a minute of walking ends the bout");
+
+  // Break: still two minutes in; main brain reminder after 25 idle minutes
+  feed(d, DESK_POMODORO, "{\"state\":2}", t);
+  snprintf(json, sizeof(json), "{\"timestamp\":%" PRId64 ",\"lastMovement\":%" PRId64 ",\"activity\":\"Still\"}",
+           t + 26 * 60000, t);
+  feed(d, DESK_BIOMETRIC, json, t + 26 * 60000);
+  check(lastAlerts[ALERT_BREAK_MOVE] == 1 && lastAlerts[ALERT_MOVEMENT_REMINDER] == 1, "break and idle alerts");
+  feed(d, DESK_SESSION, "{\"active\":false}", t + 27 * 60000);
+  feed(d, DESK_BIOMETRIC, json, t + 27 * 60000);
+  check(lastAlerts[ALERT_BREAK_MOVE] == 1 && lastAlerts[ALERT_MOVEMENT_REMINDER] == 1, "no alerts outside a session");
+
+  check(!feed(d, DESK_ENVIRONMENT, "{\"temperature\":", 0) && d.malformed == 1, "malformed payload");
+  check(deskMessageKind("data/biometric_batch", 20) == DESK_IGNORED &&
+        deskMessageKind("commands/fan", 12) == DESK_FAN_COMMAND, "topic kinds");
+}
+
+static void verifyPipeline() {
+  Traffic traffic;
+  generateTraffic(traffic, 40, 400);
+  std::vector<DeskResult> reference, results;
+  replaySequential(traffic, 40, reference);
+  uint64_t alerts = 0;
+  for (const DeskResult& r : reference)
+    for (uint64_t a : r.alerts) alerts += a;
+  check(alerts > 1000, "generated traffic raises alerts");
+
+  const int workerCounts[] = {1, 3, 8};
+  size_t depth = opts.queueDepth;
+  opts.queueDepth = 4;   // Small queues exercise the full-queue path
+  for (int workers : workerCounts) {
+    RunResult run = replayPipeline(traffic, workers, 4, results);
+    check(sameResults(results, reference), "pipeline matches the sequential replay");
+    check(run.stats.processed == traffic.messages.size() && run.stats.submitted == run.stats.processed,
+          "every message processed once");
+  }
+  opts.queueDepth = depth;
+
+  Pipeline p;
+  pipelineStart(p, 2, 8, 16);
+  std::string big(PIPELINE_PAYLOAD_MAX + 1, ' ');
+  check(pipelineSubmit(p, "bille/data/environment", 22, (const uint8_t*)big.data(), big.size(), 0) ==
+        PIPELINE_OVERSIZE, "oversize rejected");
+  check(pipelineSubmit(p, "bille/desk/16/data/environment", 30, (const uint8_t*)"{}", 2, 0) == PIPELINE_IGNORED,
+        "desk past maxDesks ignored");
+  check(pipelineSubmit(p, "bille/analytics/alerts", 22, (const uint8_t*)"{}", 2, 0) == PIPELINE_IGNORED,
+        "own alerts ignored");
+  check(pipelineSubmit(p, "bille/desk/15/session/state", 27, (const uint8_t*)"{\"active\":true}", 15, 0) ==
+        PIPELINE_QUEUED, "desk message queued");
+  pipelineStop(p);
+}
+
+static int runVerify() {
+  verifyQueues();
+  verifyRules();
+  verifyPipeline();
+  printf("{\"verify\": \"%s\", \"failures\": %d}\n", verifyFailures ? "failed" : "ok", verifyFailures);
+  return verifyFailures ? 1 : 0;
+}
+
+static void usage() {
+  fprintf(stderr,
+          "usage: bille-analytics [options]\n"
+          "  --host HOST / --port N      broker (default 127.0.0.1:%d)\n"
+          "  --user U / --password P\n"
+          "  --workers N                 worker threads (default: one per core)\n"
+          "  --queue-depth N             messages per desk queue (default %d)\n"
+          "  --max-desks N               highest desk number + 1 (default %d)\n"
+          "  --status-s S                status interval (default 60, 0 = off)\n"
+          "  --bench                     1..N worker scaling on generated traffic\n"
+          "    --desks N / --steps N     traffic size (default 256 desks x 720 steps of 10 s)\n"
+          "    --producers N             ingest threads (default 2)\n"
+          "  --verify                    queue, rule and determinism self-check\n",
+          MQTT_DEFAULT_PORT, PIPELINE_QUEUE_DEPTH, PIPELINE_MAX_DESKS);
+}
+
+static bool parseArgs(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    if (a == "--bench") {
+      opts.bench = true;
+      continue;
+    }
+    if (a == "--verify") {
+      opts.verify = true;
+      continue;
+    }
+    if (i + 1 >= argc) return false;
+    const char* v = argv[++i];
+    if (a == "--host") opts.host = v;
+    else if (a == "--port") opts.port = atoi(v);
+    else if (a == "--user") opts.user = v;
+    else if (a == "--password") opts.password = v;
+    else if (a == "--workers") opts.workers = atoi(v);
+    else if (a == "--producers") opts.producers = atoi(v);
+    else if (a == "--queue-depth") opts.queueDepth = strtoul(v, nullptr, 10);
+    else if (a == "--max-desks") opts.maxDesks = atoi(v);
+    else if (a == "--status-s") opts.statusS = atoi(v);
+    else if (a == "--desks") opts.desks = atoi(v);
+    else if (a == "--steps") opts.steps = atoi(v);
+    else return false;
+  }
+  return opts.workers >= 0 && opts.producers > 0 && opts.queueDepth >= 2 && opts.maxDesks > 0 && opts.desks > 0 &&
+         opts.desks <= opts.maxDesks && opts.steps > 0;
+}
+
+int main(int argc, char** argv) {
+  if (!parseArgs(argc, argv)) {
+    usage();
+    return 2;
+  }
+  if (opts.verify) return runVerify();
+  if (opts.bench) return runBench();
+  return runService();
+}
@@ -0,0 +1,262 @@
+#include "desk_analytics.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bille_decode.h"
+
+// Thresholds as in the sketches
+#define ENV_COLD_C              20.0f     // environmental_analysis.cpp
+#define ENV_HOT_C               26.0f
+#define ENV_NOISY_LEVEL         4
+#define ENV_DIM_LUX             270
+#define BRAIN_REMINDER_IDLE_MS  (25 * 60 * 1000LL)  // data_analysis.cpp
+#define WEAR_SIT_ALERT_MS       (20 * 60 * 1000LL)  // health_monitor.cpp
+#define WEAR_BREAK_IDLE_MS      (2 * 60 * 1000LL)
+#define BOUT_SWITCH_MS          60000LL             // wearable_tracker/config.h
+
+#define POMODORO_WORK_SESSION   1
+#define POMODORO_SHORT_BREAK    2
+#define POMODORO_LONG_BREAK     3
+#define ACTIVITY_STILL          1                   // Sitting and Still are sedentary
+
+#define FNV_PRIME 1099511628211ULL
+
+static const struct {
+  const char* suffix;
+  DeskMessageKind kind;
+} kinds[] = {
+  {"data/environment", DESK_ENVIRONMENT},
+  {"data/biometric", DESK_BIOMETRIC},
+  {"pomodoro/state", DESK_POMODORO},
+  {"session/state", DESK_SESSION},
+  {"commands/fan", DESK_FAN_COMMAND},
+};
+
+static const struct {
+  const char* name;
+  const char* level;
+  const char* message;
+} alertInfo[ALERT_TYPES] = {
+  {"too_cold", "warning", "Temperature too low for productivity"},
+  {"too_hot", "warning", "Temperature too high for focus"},
+  {"noisy", "warning", "Environment too noisy for concentration"},
+  {"dim", "info", "Lighting may be too dim for productivity"},
+  {"fan_on", "info", "Fan state changed to: ON"},
+  {"fan_off", "info", "Fan state changed to: OFF"},
+  {"movement_reminder", "info", "Time to move around!"},
+  {"movement_break", "warning", "Consider taking a short movement break"},
+  {"break_move", "info", "Break time - time to move around!"},
+};
+
+static bool keyIs(const char* key, size_t keyLength, const char* name) {
+  return strlen(name) == keyLength && memcmp(key, name, keyLength) == 0;
+}
+
+static bool parseNumber(const char* text, size_t length, double& out) {
+  char buf[32];
+  if (length == 0 || length >= sizeof(buf)) return false;
+  memcpy(buf, text, length);
+  buf[length] = 0;
+  char* end;
+  out = strtod(buf, &end);
+  return end == buf + length;
+}
+
+static void mix(DeskState& d, uint64_t value) {
+  d.digest = (d.digest ^ value) * FNV_PRIME;
+}
+
+DeskMessageKind deskMessageKind(const char* suffix, size_t length) {
+  for (const auto& k : kinds)
+    if (keyIs(suffix, length, k.suffix)) return k.kind;
+  return DESK_IGNORED;
+}
+
+void deskInit(DeskState& d, int desk) {
+  memset(&d, 0, sizeof(d));
+  d.desk = desk;
+  d.digest = 14695981039346656037ULL;
+  d.temperature = -999;
+}
+
+const char* deskAlertName(DeskAlertType type) {
+  return alertInfo[type].name;
+}
+
+const char* deskAlertLevel(DeskAlertType type) {
+  return alertInfo[type].level;
+}
+
+const char* deskAlertMessage(DeskAlertType type) {
+  return alertInfo[type].message;
+}
+
+int64_t deskCurrentSitMs(const DeskState& d, int64_t now) {
+  return d.boutStarted && d.sedentary ? now - d.boutStart : 0;
+}
+
+static void raise(DeskState& d, DeskAlertType type, int64_t now, DeskAlertSink sink, void* context) {
+  d.alerts[type]++;
+  mix(d, ((uint64_t)type << 56) ^ (uint64_t)now);
+  if (sink) sink(context, d, type, now);
+}
+
+// ---- Payload fields ----------------------------------------------------
+
+struct Fields {
+  double temperature, lightLevel, noiseLevel, timestamp, lastMovement, state;
+  int activity;
+  bool hasTemperature, hasLight, hasNoise, hasTimestamp, hasLastMovement, hasState, hasActivity;
+  int active;                   // -1 unknown
+  int command;                  // 0 none, 1 manual_on, 2 manual_off, 3 auto
+};
+
+static void onField(void* context, const char* key, size_t keyLength, const char* value, size_t valueLength,
+                    bool isString) {
+  Fields& f = *(Fields*)context;
+  if (isString) {
+    if (keyIs(key, keyLength, "activity")) {
+      f.activity = billeActivityCode(value, valueLength);
+      f.hasActivity = f.activity != BILLE_ACTIVITY_UNKNOWN;
+    } else if (keyIs(key, keyLength, "command")) {
+      f.command = keyIs(value, valueLength, "manual_on") ? 1 : keyIs(value, valueLength, "manual_off") ? 2
+                : keyIs(value, valueLength, "auto") ? 3 : 0;
+    }
+    return;
+  }
+  if (keyIs(key, keyLength, "active")) {
+    f.active = keyIs(value, valueLength, "true") ? 1 : keyIs(value, valueLength, "false") ? 0 : f.active;
+  } else if (keyIs(key, keyLength, "temperature")) {
+    f.hasTemperature = parseNumber(value, valueLength, f.temperature);
+  } else if (keyIs(key, keyLength, "lightLevel")) {
+    f.hasLight = parseNumber(value, valueLength, f.lightLevel);
+  } else if (keyIs(key, keyLength, "noiseLevel")) {
+    f.hasNoise = parseNumber(value, valueLength, f.noiseLevel);
+  } else if (keyIs(key, keyLength, "timestamp")) {
+    f.hasTimestamp = parseNumber(value, valueLength, f.timestamp);
+  } else if (keyIs(key, keyLength, "lastMovement")) {
+    f.hasLastMovement = parseNumber(value, valueLength, f.lastMovement);
+  } else if (keyIs(key, keyLength, "state")) {
+    f.hasState = parseNumber(value, valueLength, f.state);
+  }
+}
+
+// ---- Environment monitor -----------------------------------------------
+
+// controlFan(): manual commands bypass the model, otherwise the predictive
+// controller with its dwell times decides
+static void controlFan(DeskState& d, int64_t now, DeskAlertSink sink, void* context) {
+  if (!d.fanStarted) {
+    fanControllerInit(d.fan, (unsigned long)now);
+    d.fanStarted = true;
+  }
+  fanControllerAddSample(d.fan, d.temperature, (unsigned long)now);
+  bool want = d.manualOverride ? d.manualFanState : fanControllerDesiredState(d.fan, (unsigned long)now);
+  if (want != d.fanOn) {
+    d.fanOn = want;
+    fanControllerSetRelay(d.fan, want, (unsigned long)now);
+    raise(d, want ? ALERT_FAN_ON : ALERT_FAN_OFF, now, sink, context);
+  }
+}
+
+// checkEnvironmentalAlerts(): one alert per reading, the last rule that
+// matches wins
+static void analyzeEnvironment(DeskState& d, const Fields& f, int64_t now, DeskAlertSink sink, void* context) {
+  if (f.hasTemperature) d.temperature = (float)f.temperature;
+  int alert = -1;
+  if (f.hasTemperature && d.temperature < ENV_COLD_C) alert = ALERT_TOO_COLD;
+  else if (f.hasTemperature && d.temperature > ENV_HOT_C) alert = ALERT_TOO_HOT;
+  if (f.hasNoise && f.noiseLevel > ENV_NOISY_LEVEL) alert = ALERT_NOISY;
+  if (f.hasLight && f.lightLevel < ENV_DIM_LUX) alert = ALERT_DIM;
+  if (alert >= 0) raise(d, (DeskAlertType)alert, now, sink, context);
+  controlFan(d, now, sink, context);
+}
+
+// ---- Wearable and main brain -------------------------------------------
+
+// boutTrackerUpdate(): a bout ends only once the opposite state has lasted
+// BOUT_SWITCH_MS, and is closed where the switch began
+static void updateBout(DeskState& d, int activity, int64_t now) {
+  bool sedentary = activity <= ACTIVITY_STILL;
+  if (!d.boutStarted) {
+    d.boutStarted = true;
+    d.sedentary = sedentary;
+    d.boutStart = now;
+    return;
+  }
+  if (sedentary == d.sedentary) {
+    d.switchPending = false;
+  } else if (!d.switchPending) {
+    d.switchPending = true;
+    d.switchStart = now;
+  } else if (now - d.switchStart >= BOUT_SWITCH_MS) {
+    d.sedentary = sedentary;
+    d.boutStart = d.switchStart;
+    d.switchPending = false;
+  }
+}
+
+static void analyzeBiometrics(DeskState& d, const Fields& f, int64_t now, DeskAlertSink sink, void* context) {
+  if (f.hasTimestamp && f.hasLastMovement && f.timestamp >= f.lastMovement)
+    d.idleMs = (int64_t)(f.timestamp - f.lastMovement);
+  if (f.hasActivity) updateBout(d, f.activity, now);
+
+  // Main brain, analyzeBiometrics()
+  if (d.idleMs > BRAIN_REMINDER_IDLE_MS && d.sessionActive) raise(d, ALERT_MOVEMENT_REMINDER, now, sink, context);
+
+  // Wearable, publishHealthAlerts()
+  if (!d.sessionActive) return;
+  int alert = -1;
+  if (d.pomodoroState == POMODORO_WORK_SESSION && deskCurrentSitMs(d, now) > WEAR_SIT_ALERT_MS)
+    alert = ALERT_MOVEMENT_BREAK;
+  if ((d.pomodoroState == POMODORO_SHORT_BREAK || d.pomodoroState == POMODORO_LONG_BREAK) &&
+      d.idleMs > WEAR_BREAK_IDLE_MS)
+    alert = ALERT_BREAK_MOVE;
+  if (alert >= 0) raise(d, (DeskAlertType)alert, now, sink, context);
+}
+
+bool deskProcess(DeskState& d, DeskMessageKind kind, const char* payload, size_t length, int64_t receivedMs,
+                 DeskAlertSink sink, void* context) {
+  if (kind == DESK_IGNORED) return true;
+  d.messages++;
+  mix(d, ((uint64_t)kind << 56) ^ (uint64_t)receivedMs ^ ((uint64_t)length << 40));
+
+  Fields f;
+  memset(&f, 0, sizeof(f));
+  f.active = -1;
+  if (!jsonWalk(payload, length, onField, &f)) {
+    d.malformed++;
+    return false;
+  }
+
+  switch (kind) {
+    case DESK_ENVIRONMENT:
+      analyzeEnvironment(d, f, receivedMs, sink, context);
+      break;
+    case DESK_BIOMETRIC:
+      analyzeBiometrics(d, f, receivedMs, sink, context);
+      break;
+    case DESK_POMODORO:
+      if (f.hasState) d.pomodoroState = (int)f.state;
+      break;
+    case DESK_SESSION:
+      if (f.active >= 0) d.sessionActive = f.active == 1;
+      break;
+    case DESK_FAN_COMMAND:
+      // setFanManualOverride() re-runs the control logic straight away
+      if (f.command == 1 || f.command == 2) {
+        d.manualOverride = true;
+        d.manualFanState = f.command == 1;
+      } else if (f.command == 3) {
+        d.manualOverride = false;
+      } else {
+        break;
+      }
+      controlFan(d, receivedMs, sink, context);
+      break;
+    default:
+      break;
+  }
+  return true;
+}
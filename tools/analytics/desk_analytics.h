@@ -0,0 +1,82 @@
+#ifndef DESK_ANALYTICS_H
+#define DESK_ANALYTICS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "fan_controller.h"
+
+// One desk's analysis state, replaying the firmware logic on the host:
+//   environmental_analysis.cpp  environment alerts and the predictive fan
+//                               (fan_controller.cpp, compiled in place)
+//   data_analysis.cpp           main brain movement reminders
+//   health_monitor.cpp          wearable sitting-bout and break alerts,
+//                               with bout_tracker.cpp's bout rule
+// Times are the receive time of each message, so a desk's state only ever
+// depends on the order of its own messages. Not thread-safe: the pipeline
+// gives each desk to one worker at a time.
+
+enum DeskMessageKind {
+  DESK_ENVIRONMENT,     // data/environment
+  DESK_BIOMETRIC,       // data/biometric
+  DESK_POMODORO,        // pomodoro/state
+  DESK_SESSION,         // session/state
+  DESK_FAN_COMMAND,     // commands/fan
+  DESK_IGNORED
+};
+
+enum DeskAlertType {
+  ALERT_TOO_COLD,
+  ALERT_TOO_HOT,
+  ALERT_NOISY,
+  ALERT_DIM,
+  ALERT_FAN_ON,
+  ALERT_FAN_OFF,
+  ALERT_MOVEMENT_REMINDER,   // Main brain: no movement for 25 min in a session
+  ALERT_MOVEMENT_BREAK,      // Wearable: 20 min sitting bout in a work session
+  ALERT_BREAK_MOVE,          // Wearable: still 2 min into a break
+  ALERT_TYPES
+};
+
+struct DeskState {
+  int desk;
+  uint64_t messages;
+  uint64_t malformed;
+  uint64_t alerts[ALERT_TYPES];
+  uint64_t digest;              // Hash over every alert in order, for order checks
+
+  // Environment monitor
+  FanController fan;
+  bool fanStarted;
+  bool fanOn;
+  bool manualOverride;
+  bool manualFanState;
+  float temperature;
+
+  // Main brain
+  int pomodoroState;            // PomodoroState order: IDLE, WORK_SESSION, SHORT_BREAK, LONG_BREAK
+  bool sessionActive;
+
+  // Wearable
+  int64_t idleMs;               // timestamp - lastMovement of the last biometric message
+  bool sedentary;               // Current bout
+  int64_t boutStart;
+  bool switchPending;           // Opposite state seen, bout not ended yet
+  int64_t switchStart;
+  bool boutStarted;
+};
+
+typedef void (*DeskAlertSink)(void* context, const DeskState& desk, DeskAlertType type, int64_t timeMs);
+
+DeskMessageKind deskMessageKind(const char* suffix, size_t length);
+void deskInit(DeskState& d, int desk);
+// Applies one message; false if the payload could not be parsed
+bool deskProcess(DeskState& d, DeskMessageKind kind, const char* payload, size_t length, int64_t receivedMs,
+                 DeskAlertSink sink, void* context);
+
+const char* deskAlertName(DeskAlertType type);
+const char* deskAlertLevel(DeskAlertType type);
+const char* deskAlertMessage(DeskAlertType type);   // The firmware's alert text
+int64_t deskCurrentSitMs(const DeskState& d, int64_t now);
+
+#endif
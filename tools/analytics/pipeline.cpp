@@ -0,0 +1,225 @@
+#include "pipeline.h"
+
+#include <string.h>
+#include <unistd.h>
+
+#include "desk_topics.h"
+
+#define IDLE_SPINS      64
+#define IDLE_WAIT_MS    1        // Bounds a wake-up lost between the idle check and the wait
+
+static void schedule(Pipeline& p, DeskShard* shard) {
+  // Never full: a shard is queued at most once and the queue holds maxDesks
+  boundedPush(p.inject, shard);
+  if (p.idle.load(std::memory_order_seq_cst) > 0) p.idleWake.notify_one();
+}
+
+static DeskShard* shardFor(Pipeline& p, int desk) {
+  DeskShard* shard = p.shards[desk].load(std::memory_order_acquire);
+  if (shard) return shard;
+  DeskShard* created = new DeskShard;
+  created->scheduled.store(false, std::memory_order_relaxed);
+  boundedInit(created->queue, p.queueDepth);
+  deskInit(created->state, desk);
+  if (p.shards[desk].compare_exchange_strong(shard, created, std::memory_order_acq_rel)) {
+    p.deskCount.fetch_add(1, std::memory_order_relaxed);
+    return created;
+  }
+  delete created;   // Another producer created it first
+  return shard;
+}
+
+PipelineSubmit pipelineSubmit(Pipeline& p, const char* topic, size_t topicLength, const uint8_t* payload,
+                              size_t length, int64_t receivedMs) {
+  const char* suffix;
+  size_t suffixLength;
+  int desk = deskFromTopic(topic, topicLength, &suffix, &suffixLength);
+  DeskMessageKind kind = desk < 0 ? DESK_IGNORED : deskMessageKind(suffix, suffixLength);
+  if (kind == DESK_IGNORED || desk >= p.maxDesks) {
+    p.ignored.fetch_add(1, std::memory_order_relaxed);
+    return PIPELINE_IGNORED;
+  }
+  if (length > PIPELINE_PAYLOAD_MAX) {
+    p.oversize.fetch_add(1, std::memory_order_relaxed);
+    return PIPELINE_OVERSIZE;
+  }
+
+  DeskShard* shard = shardFor(p, desk);
+  PipelineMessage m;
+  m.receivedMs = receivedMs;
+  m.kind = (uint16_t)kind;
+  m.length = (uint16_t)length;
+  memcpy(m.payload, payload, length);
+  while (!boundedPush(shard->queue, m)) {
+    p.fullWaits.fetch_add(1, std::memory_order_relaxed);
+    std::this_thread::yield();
+  }
+  p.submitted.fetch_add(1, std::memory_order_relaxed);
+
+  // Pairs with the fence in runShard: either the worker sees this message
+  // after clearing the flag, or we see the flag clear and schedule it
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (!shard->scheduled.exchange(true, std::memory_order_acq_rel)) schedule(p, shard);
+  return PIPELINE_QUEUED;
+}
+
+static void runShard(Pipeline& p, PipelineWorker& w, DeskShard* shard) {
+  PipelineMessage m;
+  int n = 0;
+  while (n < PIPELINE_BATCH && boundedPopSingle(shard->queue, m)) {
+    deskProcess(shard->state, (DeskMessageKind)m.kind, m.payload, m.length, m.receivedMs, p.sink, p.sinkContext);
+    n++;
+  }
+  w.processed.store(w.processed.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  w.turns.store(w.turns.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+  if (n == PIPELINE_BATCH) {
+    // Still scheduled; to the back of the line
+    schedule(p, shard);
+    return;
+  }
+  shard->scheduled.store(false, std::memory_order_release);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (boundedHasItem(shard->queue) && !shard->scheduled.exchange(true, std::memory_order_acq_rel))
+    schedule(p, shard);
+}
+
+static DeskShard* findWork(Pipeline& p, PipelineWorker& w) {
+  DeskShard* shard = stealPop(w.deque);
+  if (shard) return shard;
+
+  if (boundedPopShared(p.inject, shard)) {
+    // Take a few more so idle workers have something to steal
+    DeskShard* extra;
+    for (int i = 1; i < PIPELINE_INJECT_BATCH && boundedPopShared(p.inject, extra); i++) stealPush(w.deque, extra);
+    return shard;
+  }
+
+  int n = p.workerCount;
+  if (n > 1) {
+    w.random ^= w.random << 13;
+    w.random ^= w.random >> 17;
+    w.random ^= w.random << 5;
+    int start = (int)(w.random % n);
+    for (int i = 0; i < n; i++) {
+      PipelineWorker& victim = *p.workers[(start + i) % n];
+      if (&victim == &w) continue;
+      shard = stealTake(victim.deque);
+      if (shard) {
+        w.steals.store(w.steals.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return shard;
+      }
+    }
+  }
+  return nullptr;
+}
+
+static void workerLoop(Pipeline& p, PipelineWorker& w) {
+  int spins = 0;
+  while (p.running.load(std::memory_order_acquire)) {
+    DeskShard* shard = findWork(p, w);
+    if (shard) {
+      runShard(p, w, shard);
+      spins = 0;
+      continue;
+    }
+    if (++spins < IDLE_SPINS) {
+      std::this_thread::yield();
+      continue;
+    }
+    spins = 0;
+    w.sleeps.store(w.sleeps.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::unique_lock<std::mutex> lock(p.idleLock);
+    p.idle.fetch_add(1, std::memory_order_seq_cst);
+    p.idleWake.wait_for(lock, std::chrono::milliseconds(IDLE_WAIT_MS));
+    p.idle.fetch_sub(1, std::memory_order_seq_cst);
+  }
+}
+
+bool pipelineStart(Pipeline& p, int workers, size_t queueDepth, int maxDesks, DeskAlertSink sink,
+                   void* sinkContext) {
+  if (workers < 1 || maxDesks < 1 || queueDepth < 2) return false;
+  p.workerCount = workers;
+  p.queueDepth = queueDepth;
+  p.maxDesks = maxDesks;
+  p.sink = sink;
+  p.sinkContext = sinkContext;
+  p.shards.reset(new std::atomic<DeskShard*>[maxDesks]);
+  for (int i = 0; i < maxDesks; i++) p.shards[i].store(nullptr, std::memory_order_relaxed);
+  boundedInit(p.inject, maxDesks);
+  p.running.store(true);
+  p.idle.store(0);
+  p.submitted.store(0);
+  p.ignored.store(0);
+  p.oversize.store(0);
+  p.fullWaits.store(0);
+  p.deskCount.store(0);
+
+  p.workers.clear();
+  for (int i = 0; i < workers; i++) {
+    std::unique_ptr<PipelineWorker> w(new PipelineWorker);
+    stealInit(w->deque, maxDesks);
+    w->random = 0x9E3779B9u * (i + 1);
+    w->processed.store(0);
+    w->steals.store(0);
+    w->turns.store(0);
+    w->sleeps.store(0);
+    p.workers.push_back(std::move(w));
+  }
+  // Started after every deque exists, since workers steal from each other
+  for (auto& w : p.workers) {
+    PipelineWorker* worker = w.get();
+    worker->thread = std::thread([&p, worker]() { workerLoop(p, *worker); });
+  }
+  return true;
+}
+
+void pipelineDrain(Pipeline& p) {
+  for (;;) {
+    uint64_t processed = 0;
+    for (auto& w : p.workers) processed += w->processed.load(std::memory_order_acquire);
+    if (processed >= p.submitted.load(std::memory_order_acquire)) break;
+    usleep(100);
+  }
+  // The last runs may still be clearing their flags
+  for (int i = 0; i < p.maxDesks; i++) {
+    DeskShard* shard = p.shards[i].load(std::memory_order_acquire);
+    while (shard && shard->scheduled.load(std::memory_order_acquire)) usleep(50);
+  }
+}
+
+void pipelineStop(Pipeline& p) {
+  pipelineDrain(p);
+  p.running.store(false, std::memory_order_release);
+  p.idleWake.notify_all();
+  for (auto& w : p.workers)
+    if (w->thread.joinable()) w->thread.join();
+  for (int i = 0; i < p.maxDesks; i++) {
+    delete p.shards[i].load(std::memory_order_relaxed);
+    p.shards[i].store(nullptr, std::memory_order_relaxed);
+  }
+}
+
+PipelineStats pipelineStats(Pipeline& p) {
+  PipelineStats s;
+  memset(&s, 0, sizeof(s));
+  s.submitted = p.submitted.load(std::memory_order_relaxed);
+  s.ignored = p.ignored.load(std::memory_order_relaxed);
+  s.oversize = p.oversize.load(std::memory_order_relaxed);
+  s.fullWaits = p.fullWaits.load(std::memory_order_relaxed);
+  s.desks = p.deskCount.load(std::memory_order_relaxed);
+  for (auto& w : p.workers) {
+    s.processed += w->processed.load(std::memory_order_relaxed);
+    s.steals += w->steals.load(std::memory_order_relaxed);
+    s.turns += w->turns.load(std::memory_order_relaxed);
+    s.sleeps += w->sleeps.load(std::memory_order_relaxed);
+  }
+  return s;
+}
+
+void pipelineForEachDesk(Pipeline& p, DeskVisitor visit, void* context) {
+  for (int i = 0; i < p.maxDesks; i++) {
+    DeskShard* shard = p.shards[i].load(std::memory_order_acquire);
+    if (shard) visit(context, shard->state);
+  }
+}
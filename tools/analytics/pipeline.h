@@ -0,0 +1,115 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "lockfree_queue.h"
+#include "desk_analytics.h"
+
+// Multi-threaded desk analytics. Each desk is a shard: its DeskState plus a
+// bounded MPSC queue of raw messages. Any number of ingest threads submit
+// messages; a pool of workers decodes and analyses them.
+//
+// Per-desk order: a shard is "scheduled" (in the inject queue, a worker's
+// deque, or running) at most once, guarded by an atomic flag, so only one
+// worker ever drains a desk's queue at a time and it does so in FIFO order.
+//
+// Scheduling: a submit that finds its shard idle pushes it onto the shared
+// inject queue. A worker takes shards from the inject queue in small
+// batches, runs the first and parks the rest in its own Chase-Lev deque;
+// idle workers steal from the other deques. A shard that used its whole
+// batch of messages goes back on the inject queue so busy desks cannot
+// starve the others.
+
+#define PIPELINE_PAYLOAD_MAX    464      // Larger messages are not analysed (batches, history blocks)
+#define PIPELINE_QUEUE_DEPTH    64       // Messages per desk before submit waits
+#define PIPELINE_BATCH          32       // Messages a worker takes from a desk per turn
+#define PIPELINE_INJECT_BATCH   4        // Shards a worker takes from the inject queue at once
+#define PIPELINE_MAX_DESKS      4096
+
+struct PipelineMessage {
+  int64_t receivedMs;
+  uint16_t kind;                 // DeskMessageKind
+  uint16_t length;
+  char payload[PIPELINE_PAYLOAD_MAX];
+};
+
+struct DeskShard {
+  alignas(LOCKFREE_CACHE_LINE) std::atomic<bool> scheduled;
+  BoundedQueue<PipelineMessage> queue;
+  DeskState state;
+};
+
+struct PipelineWorker {
+  StealDeque<DeskShard> deque;
+  std::thread thread;
+  uint32_t random;
+  // Written by this worker only; read for stats
+  alignas(LOCKFREE_CACHE_LINE) std::atomic<uint64_t> processed;
+  std::atomic<uint64_t> steals;
+  std::atomic<uint64_t> turns;
+  std::atomic<uint64_t> sleeps;
+};
+
+struct PipelineStats {
+  uint64_t submitted;
+  uint64_t processed;
+  uint64_t ignored;              // Topics outside the analysed set, or desks past maxDesks
+  uint64_t oversize;
+  uint64_t fullWaits;            // Submits that found the desk queue full and yielded
+  uint64_t steals;
+  uint64_t turns;                // Shard runs
+  uint64_t sleeps;               // Worker idle waits
+  size_t desks;
+};
+
+struct Pipeline {
+  int workerCount;
+  size_t queueDepth;
+  int maxDesks;
+  DeskAlertSink sink;            // Called from worker threads
+  void* sinkContext;
+
+  std::unique_ptr<std::atomic<DeskShard*>[]> shards;
+  BoundedQueue<DeskShard*> inject;
+  std::vector<std::unique_ptr<PipelineWorker>> workers;
+  std::atomic<bool> running;
+  std::atomic<int> idle;
+  std::mutex idleLock;
+  std::condition_variable idleWake;
+
+  std::atomic<uint64_t> submitted;
+  std::atomic<uint64_t> ignored;
+  std::atomic<uint64_t> oversize;
+  std::atomic<uint64_t> fullWaits;
+  std::atomic<size_t> deskCount;
+};
+
+enum PipelineSubmit {
+  PIPELINE_QUEUED,
+  PIPELINE_IGNORED,
+  PIPELINE_OVERSIZE
+};
+
+bool pipelineStart(Pipeline& p, int workers, size_t queueDepth = PIPELINE_QUEUE_DEPTH,
+                   int maxDesks = PIPELINE_MAX_DESKS, DeskAlertSink sink = nullptr, void* sinkContext = nullptr);
+// Any thread. Waits (yielding) while the desk's queue is full, so a fast
+// producer is held back rather than dropping messages.
+PipelineSubmit pipelineSubmit(Pipeline& p, const char* topic, size_t topicLength, const uint8_t* payload,
+                              size_t length, int64_t receivedMs);
+// Returns once every message submitted so far has been processed
+void pipelineDrain(Pipeline& p);
+void pipelineStop(Pipeline& p);   // Drains, then joins the workers
+PipelineStats pipelineStats(Pipeline& p);
+// Only while no worker is running a desk (after pipelineDrain with producers stopped)
+typedef void (*DeskVisitor)(void* context, const DeskState& state);
+void pipelineForEachDesk(Pipeline& p, DeskVisitor visit, void* context);
+
+#endif
@@ -0,0 +1,605 @@
+/*
+===============================================================
+Bill-E Anomaly Detector
+Per-room baselines in place of fixed environment thresholds
+===============================================================
+
+The sketches flag a room with fixed thresholds (20-26 C, noise > 4,
+light < 270 lux in environmental_analysis.cpp; the main brain's
+analyzeEnvironment() and hasEnvironmentalAlert() use their own). Rooms
+differ, so this service learns each desk's normal instead: a robust
+median/MAD baseline per hour of the week for temperature, humidity,
+light, noise and the wearable's acceleration, updated one reading at a
+time in fixed memory per desk (anomaly_detector.h).
+
+Readings far from their hour's baseline for a few readings in a row are
+published as anomaly start/end events on bille/desk/<n>/analytics/anomalies
+(desk 0: bille/analytics/anomalies). Suggested per-room thresholds, in the
+firmware's terms, are published retained on .../analytics/thresholds once
+enough hours are learned. Counters go to bille/status/anomaly.
+
+Everything runs on the MQTT thread. --bench replays generated traffic of
+many desks over weeks and reports throughput on one core against the
+firmware publish rate; --verify checks the estimators, hour-of-week
+handling, detection and suggestions.
+
+BUILD (from the repository root):
+  g++ -O2 -std=c++17 -Itools/common -Itools/anomaly -Isketches/main_brain \
+      -o bille-anomaly tools/anomaly/anomaly.cpp tools/anomaly/anomaly_detector.cpp \
+      tools/common/mqtt_client.cpp tools/common/bille_decode.cpp sketches/main_brain/biometric_batch.cpp
+
+USAGE:
+  ./bille-anomaly --host 127.0.0.1 [--thresholds-s 3600]
+  ./bille-anomaly --bench [--desks 100] [--days 21]
+  ./bille-anomaly --verify
+  Hours of the week follow the local time zone; set TZ for the rooms' one.
+===============================================================
+*/
+
+#include <inttypes.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "mqtt_client.h"
+#include "desk_topics.h"
+#include "bille_decode.h"
+#include "biometric_batch.h"
+#include "anomaly_detector.h"
+#include "verify.h"
+
+#define RECONNECT_DELAY_MS   2000
+#define STATUS_TOPIC         "bille/status/anomaly"
+#define DAY_MS               (24 * 3600 * 1000LL)
+#define ENV_INTERVAL_MS      10000    // environment_monitor.ino read/publish period
+#define WEAR_INTERVAL_MS     60000    // Wearable JSON summary and session batch upload
+#define BATCH_SAMPLES        12       // 5 s samples per minute batch
+#define BENCH_START_MS       1736121600000LL   // Monday 2025-01-06 00:00 UTC
+
+struct Options {
+  std::string host = "127.0.0.1";
+  int port = MQTT_DEFAULT_PORT;
+  std::string user;
+  std::string password;
+  int maxDesks = ANOMALY_MAX_DESKS;
+  int statusS = 60;
+  int thresholdsS = 3600;
+  bool bench = false;
+  bool verify = false;
+  int desks = 100;
+  int days = 21;
+};
+
+static Options opts;
+static AnomalyDetector detector;
+static std::vector<AnomalyEvent> pendingEvents;
+static volatile sig_atomic_t running = 1;
+
+static void onSignal(int) {
+  running = 0;
+}
+
+static int64_t wallMillis() {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// ---- Service -----------------------------------------------------------
+
+// Published after the poll rather than from inside the receive callback
+static void queueEvent(void*, const AnomalyEvent& e) {
+  pendingEvents.push_back(e);
+}
+
+static void onMessage(void*, const char* topic, size_t topicLength, const uint8_t* payload, size_t length) {
+  billeDecode(topic, topicLength, payload, length, wallMillis(), anomalyOnMetric, &detector);
+}
+
+static void publishEvents(MqttClient& client) {
+  char json[384];
+  for (const AnomalyEvent& e : pendingEvents) {
+    int n = snprintf(json, sizeof(json),
+                     "{\"nodeType\":\"ANALYTICS\",\"event\":\"%s\",\"metric\":\"%s\",\"value\":%.2f,\"median\":%.2f,"
+                     "\"mad\":%.2f,\"score\":%.1f,\"hourOfWeek\":%d,\"timestamp\":%" PRId64,
+                     e.type == ANOMALY_START ? "start" : "end", anomalyChannelName(e.channel), e.value, e.median,
+                     e.mad, e.score, e.hourOfWeek, e.timeMs);
+    if (e.type == ANOMALY_END)
+      n += snprintf(json + n, sizeof(json) - n, ",\"durationS\":%" PRId64 ",\"peakScore\":%.1f", e.durationMs / 1000,
+                    e.peakScore);
+    snprintf(json + n, sizeof(json) - n, "}");
+    mqttPublish(client, deskTopic(e.desk, "analytics/anomalies").c_str(), json);
+  }
+  pendingEvents.clear();
+}
+
+static bool movedEnough(const AnomalyThresholds& a, const AnomalyThresholds& b) {
+  return !b.valid || fabsf(a.tempMin - b.tempMin) >= 0.1f || fabsf(a.tempMax - b.tempMax) >= 0.1f ||
+         fabsf(a.noiseMax - b.noiseMax) >= 0.5f || fabsf(a.lightMin - b.lightMin) >= 2.0f;
+}
+
+// Retained, so a node or dashboard that connects later gets the latest
+static void publishThresholds(MqttClient& client, std::vector<AnomalyThresholds>& published) {
+  char json[256];
+  published.resize(detector.maxDesks);
+  for (int desk = 0; desk < detector.maxDesks; desk++) {
+    const DeskBaselines* b = anomalyDesk(detector, desk);
+    if (!b) continue;
+    AnomalyThresholds t = anomalySuggest(*b);
+    if (!t.valid || !movedEnough(t, published[desk])) continue;
+    snprintf(json, sizeof(json),
+             "{\"nodeType\":\"ANALYTICS\",\"tempMin\":%.1f,\"tempMax\":%.1f,\"noiseMax\":%.0f,\"lightMin\":%.0f,"
+             "\"hours\":%d,\"timestamp\":%" PRId64 "}",
+             t.tempMin, t.tempMax, t.noiseMax, t.lightMin, t.slots, wallMillis());
+    if (mqttPublish(client, deskTopic(desk, "analytics/thresholds").c_str(), json, 0, true)) published[desk] = t;
+  }
+}
+
+static void publishStatus(MqttClient& client) {
+  const AnomalyStats& s = detector.stats;
+  char json[384];
+  snprintf(json, sizeof(json),
+           "{\"nodeType\":\"ANALYTICS\",\"desks\":%zu,\"points\":%" PRIu64 ",\"invalid\":%" PRIu64
+           ",\"ignored\":%" PRIu64 ",\"anomalies\":%" PRIu64 ",\"active\":%" PRIu64 ",\"bytesPerDesk\":%zu}",
+           detector.deskCount, s.points, s.invalid, s.ignored, s.started, s.started - s.ended,
+           sizeof(DeskBaselines));
+  mqttPublish(client, STATUS_TOPIC, json);
+}
+
+static int runService() {
+  anomalyInit(detector, opts.maxDesks, queueEvent, nullptr);
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+
+  const char* user = opts.user.empty() ? nullptr : opts.user.c_str();
+  const char* password = opts.password.empty() ? nullptr : opts.password.c_str();
+  MqttClient client;
+  mqttInit(client);
+  std::vector<AnomalyThresholds> published;
+  uint64_t lastStatus = mqttNowMicros();
+  uint64_t lastThresholds = lastStatus;
+
+  while (running) {
+    if (!client.connected) {
+      if (!mqttConnect(client, opts.host.c_str(), opts.port, "bille_anomaly", user, password, 30)) {
+        fprintf(stderr, "anomaly: broker %s:%d unavailable, retrying\n", opts.host.c_str(), opts.port);
+        usleep(RECONNECT_DELAY_MS * 1000);
+        continue;
+      }
+      mqttSubscribe(client, "bille/#");
+      published.clear();   // Republish after a reconnect
+      fprintf(stderr, "anomaly: connected\n");
+    }
+
+    mqttPoll(client, 20, onMessage, nullptr);
+    publishEvents(client);
+
+    uint64_t now = mqttNowMicros();
+    if (opts.thresholdsS > 0 && now - lastThresholds > opts.thresholdsS * 1000000ULL) {
+      publishThresholds(client, published);
+      lastThresholds = now;
+    }
+    if (opts.statusS > 0 && now - lastStatus > opts.statusS * 1000000ULL) {
+      publishStatus(client);
+      lastStatus = now;
+    }
+  }
+
+  publishEvents(client);
+  mqttDisconnect(client);
+  fprintf(stderr, "anomaly: %" PRIu64 " points from %zu desks, %" PRIu64 " anomalies\n", detector.stats.points,
+          detector.deskCount, detector.stats.started);
+  return 0;
+}
+
+// ---- Generated traffic -------------------------------------------------
+
+struct Traffic {
+  std::vector<std::string> topics;   // Per desk and kind
+  std::vector<uint8_t> payloads;
+  struct Message {
+    uint32_t topic;
+    uint32_t offset;
+    uint16_t length;
+    int64_t dayMs;                   // Receive time within the day
+  };
+  std::vector<Message> messages;     // Arrival order across all desks
+};
+
+static uint32_t randomState = 12345;
+static double uniform() {
+  randomState ^= randomState << 13;
+  randomState ^= randomState >> 17;
+  randomState ^= randomState << 5;
+  return (randomState & 0xFFFFFF) / (double)0x1000000;
+}
+
+static double gaussian() {
+  double u = uniform() + 1e-9, v = uniform();
+  return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+static void addMessage(Traffic& t, uint32_t topic, int64_t dayMs, const uint8_t* payload, size_t length) {
+  Traffic::Message m = {topic, (uint32_t)t.payloads.size(), (uint16_t)length, dayMs};
+  t.payloads.insert(t.payloads.end(), payload, payload + length);
+  t.messages.push_back(m);
+}
+
+// One day per desk at the firmware rates: an environment reading every
+// 10 s, a wearable summary and a 12-sample batch every minute. Rooms differ
+// in warmth, light and noise; the day follows office hours.
+static void generateDay(Traffic& t, int desks) {
+  static const char* kindSuffix[3] = {"data/environment", "data/biometric", "data/biometric_batch"};
+  t.topics.clear();
+  t.payloads.clear();
+  t.messages.clear();
+  for (int d = 0; d < desks; d++)
+    for (int k = 0; k < 3; k++) t.topics.push_back(deskTopic(d, kindSuffix[k]));
+
+  char json[400];
+  uint8_t batch[BATCH_HEADER_SIZE + BATCH_SAMPLES * BATCH_MAX_SAMPLE_SIZE];
+  for (int64_t ms = 0; ms < DAY_MS; ms += ENV_INTERVAL_MS) {
+    double hour = ms / 3600000.0;
+    bool office = hour >= 8.5 && hour < 17.5;
+    for (int d = 0; d < desks; d++) {
+      int64_t received = ms + d * 7;
+      unsigned long millis = (unsigned long)(ms + 60000);
+      double warmth = 20 + (d % 7) * 0.8;
+      double temperature = warmth + 1.5 * sin((hour - 9) * M_PI / 12) + gaussian() * 0.3;
+      if (uniform() < 0.002) temperature = -999;
+      int light = office ? 250 + (d % 5) * 60 + (int)(gaussian() * 20) : 5 + (int)(uniform() * 10);
+      int noise = (int)fmax(0, (office ? 6 + d % 4 : 2) + gaussian() * (office ? 2 : 0.7));
+      snprintf(json, sizeof(json), "{\"nodeType\":\"ENVIRONMENT\",\"timestamp\":%lu,\"temperature\":%.2f,"
+               "\"humidity\":%.2f,\"lightLevel\":%d,\"noiseLevel\":%d,\"soundDetected\":%s}",
+               millis, temperature, 45 + gaussian() * 2, light, noise, noise > 8 ? "true" : "false");
+      addMessage(t, d * 3, received, (const uint8_t*)json, strlen(json));
+
+      if (ms % WEAR_INTERVAL_MS != 0) continue;
+      double g = office ? 1.0 + fabs(gaussian()) * 0.08 : 1.0 + fabs(gaussian()) * 0.01;
+      snprintf(json, sizeof(json), "{\"nodeType\":\"WEARABLE\",\"timestamp\":%lu,\"activity\":\"Sitting\","
+               "\"stepCount\":%d,\"acceleration\":%.3f,\"lastMovement\":%lu,\"sessionActive\":%s}",
+               millis, (int)(ms / 6000), g, millis, office ? "true" : "false");
+      addMessage(t, d * 3 + 1, received + 3, (const uint8_t*)json, strlen(json));
+
+      BatchRecord records[BATCH_SAMPLES];
+      for (int i = 0; i < BATCH_SAMPLES; i++) {
+        records[i].timestamp = (uint32_t)(millis - (BATCH_SAMPLES - 1 - i) * 5000);
+        records[i].idleSeconds = 0;
+        records[i].accelMg = (uint16_t)((office ? 1.0 + fabs(gaussian()) * 0.08 : 1.0) * 1000);
+        records[i].steps = (uint32_t)(ms / 6000);
+        records[i].activity = 0;
+      }
+      BatchWriter writer;
+      batchBegin(writer, batch, sizeof(batch), (uint16_t)d, (uint16_t)(ms / WEAR_INTERVAL_MS),
+                 records[0].timestamp, records[0].steps);
+      for (const BatchRecord& r : records) batchAdd(writer, r);
+      addMessage(t, d * 3 + 2, received + 5, batch, batchFinish(writer));
+    }
+  }
+}
+
+static void countPoint(void* context, int, const char*, int64_t, double) {
+  (*(uint64_t*)context)++;
+}
+
+static uint64_t startedAfter = 0;   // Anomalies once the first week is learned
+static int64_t learnedAt = 0;
+static void countEvent(void*, const AnomalyEvent& e) {
+  if (e.type == ANOMALY_START && e.timeMs >= learnedAt) startedAfter++;
+}
+
+static int runBench() {
+  setenv("TZ", "UTC", 1);
+  tzset();
+  Traffic t;
+  generateDay(t, opts.desks);
+  const size_t perDay = t.messages.size();
+
+  // Decoding alone, for the detector's share of the cost
+  uint64_t decoded = 0;
+  uint64_t start = mqttNowMicros();
+  for (const Traffic::Message& m : t.messages) {
+    const std::string& topic = t.topics[m.topic];
+    billeDecode(topic.c_str(), topic.size(), t.payloads.data() + m.offset, m.length, BENCH_START_MS + m.dayMs,
+                countPoint, &decoded);
+  }
+  double decodeS = (mqttNowMicros() - start) / 1e6;
+
+  learnedAt = BENCH_START_MS + 7 * DAY_MS;
+  anomalyInit(detector, opts.maxDesks, countEvent, nullptr);
+  start = mqttNowMicros();
+  for (int day = 0; day < opts.days; day++) {
+    int64_t base = BENCH_START_MS + day * DAY_MS;
+    for (const Traffic::Message& m : t.messages) {
+      const std::string& topic = t.topics[m.topic];
+      billeDecode(topic.c_str(), topic.size(), t.payloads.data() + m.offset, m.length, base + m.dayMs,
+                  anomalyOnMetric, &detector);
+    }
+  }
+  double seconds = (mqttNowMicros() - start) / 1e6;
+  uint64_t messages = (uint64_t)perDay * opts.days;
+  double rate = messages / seconds;
+  double decodeRate = perDay / decodeS;
+  // Per desk: environment every 10 s, wearable summary and batch every minute
+  double deskRate = 1000.0 / ENV_INTERVAL_MS + 2 * 1000.0 / WEAR_INTERVAL_MS;
+  int learnedDays = opts.days > 7 ? opts.days - 7 : 0;
+
+  const DeskBaselines* first = anomalyDesk(detector, 0);
+  AnomalyThresholds th = first ? anomalySuggest(*first) : AnomalyThresholds();
+  size_t valid = 0;
+  for (int d = 0; d < opts.desks; d++) {
+    const DeskBaselines* b = anomalyDesk(detector, d);
+    if (b && anomalySuggest(*b).valid) valid++;
+  }
+  printf("{\"desks\": %d, \"days\": %d, \"messages\": %" PRIu64 ", \"points\": %" PRIu64 ", \"seconds\": %.2f, "
+         "\"messagesPerS\": %.0f, \"pointsPerS\": %.0f, \"decodeOnlyMessagesPerS\": %.0f, "
+         "\"detectorNsPerPoint\": %.1f, \"deskMessagesPerS\": %.3f, \"desksPerCore\": %.0f, \"bytesPerDesk\": %zu, "
+         "\"hourLookups\": %" PRIu64 ", \"anomaliesPerDeskDay\": %.3f, \"desksWithThresholds\": %zu, "
+         "\"desk0Thresholds\": {\"tempMin\": %.1f, \"tempMax\": %.1f, \"noiseMax\": %.0f, \"lightMin\": %.0f, "
+         "\"hours\": %d}}\n",
+         opts.desks, opts.days, messages, detector.stats.points + detector.stats.invalid, seconds, rate,
+         (detector.stats.points + detector.stats.invalid) / seconds, decodeRate,
+         seconds > 0 ? (seconds - messages / decodeRate) * 1e9 / (detector.stats.points + detector.stats.invalid) : 0,
+         deskRate, rate / deskRate, sizeof(DeskBaselines), detector.stats.hourLookups,
+         learnedDays ? startedAfter / (double)(opts.desks * learnedDays) : 0, valid, th.tempMin, th.tempMax,
+         th.noiseMax, th.lightMin, th.slots);
+  return 0;
+}
+
+// ---- Self-check --------------------------------------------------------
+
+static std::vector<AnomalyEvent> events;
+static void collectEvent(void*, const AnomalyEvent& e) {
+  events.push_back(e);
+}
+
+static float trueMedian(std::vector<float> v) {
+  std::sort(v.begin(), v.end());
+  size_t n = v.size();
+  return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+// Estimates of one hour slot after weeks of a known distribution
+static void verifyEstimators() {
+  struct Case {
+    const char* name;
+    AnomalyChannel channel;
+    int kind;                 // 0 normal, 1 contaminated, 2 integer levels
+    double centre, spread;
+  } cases[] = {
+    {"normal temperature", CHANNEL_TEMPERATURE, 0, 22.5, 0.6},
+    {"10% outliers", CHANNEL_HUMIDITY, 1, 45, 3},
+    {"integer noise levels", CHANNEL_NOISE, 2, 6, 2},
+  };
+  for (const Case& c : cases) {
+    AnomalyDetector d;
+    anomalyInit(d, 4);
+    std::vector<float> seen;
+    // Three weeks of 10 s readings, all in Monday 10:00
+    for (int week = 0; week < 3; week++) {
+      int64_t hourStart = BENCH_START_MS + week * 7 * DAY_MS + 10 * 3600000LL;
+      for (int i = 0; i < 360; i++) {
+        double x = c.centre + gaussian() * c.spread;
+        if (c.kind == 1 && uniform() < 0.1) x = c.centre + 40 + uniform() * 100;
+        if (c.kind == 2) x = fmax(0, round(x));
+        seen.push_back((float)x);
+        anomalyAdd(d, 1, c.channel, hourStart + i * ENV_INTERVAL_MS, x);
+      }
+    }
+    const Baseline* b = anomalyReference(*anomalyDesk(d, 1), c.channel, 10);
+    float median = trueMedian(seen);
+    std::vector<float> deviations;
+    for (float x : seen) deviations.push_back(fabsf(x - median));
+    float mad = trueMedian(deviations);
+    bool ok = b && b->count >= ANOMALY_MIN_SAMPLES && fabsf(b->median - median) <= 0.15f * mad + 0.1f &&
+              fabsf(b->mad - mad) <= 0.25f * mad + 0.1f;
+    if (!ok)
+      fprintf(stderr, "verify: %s: median %.3f/%.3f mad %.3f/%.3f\n", c.name, b ? b->median : NAN, median,
+              b ? b->mad : NAN, mad);
+    check(ok, c.name);
+  }
+}
+
+static void verifyHours() {
+  AnomalyDetector d;
+  anomalyInit(d, 1);
+  check(anomalyHourOfWeek(d, BENCH_START_MS) == 0, "Monday 00:00 is hour 0");
+  check(anomalyHourOfWeek(d, BENCH_START_MS + 3600000LL - 1) == 0, "hour ends exclusive");
+  check(anomalyHourOfWeek(d, BENCH_START_MS + 3600000LL) == 1, "next hour");
+  check(anomalyHourOfWeek(d, BENCH_START_MS + 6 * DAY_MS + 23 * 3600000LL + 59999) == 167, "Sunday 23:00 is 167");
+  check(anomalyHourOfWeek(d, BENCH_START_MS + 7 * DAY_MS) == 0, "week wraps");
+  check(anomalyHourOfWeek(d, BENCH_START_MS - 1) == 167, "backwards across the week");
+  check(anomalyHourOfWeek(d, -1) == ((3 + 6) % 7) * 24 + 23, "before the epoch");   // 1969-12-31 was a Wednesday
+  uint64_t lookups = d.stats.hourLookups;
+  for (int i = 0; i < 360; i++) anomalyHourOfWeek(d, BENCH_START_MS + 5 * 3600000LL + i * 10000LL);
+  check(d.stats.hourLookups == lookups + 1, "one lookup per hour");
+
+  setenv("TZ", "UTC-2", 1);   // POSIX: two hours ahead of UTC
+  tzset();
+  AnomalyDetector local;
+  anomalyInit(local, 1);
+  check(anomalyHourOfWeek(local, BENCH_START_MS) == 2, "local time zone");
+  setenv("TZ", "UTC", 1);
+  tzset();
+}
+
+// A desk with a daily pattern learns its hours: daytime noise is normal at
+// 10:00 and an anomaly at 03:00; arriving at 08:30 rather than on the hour
+// and one-off spikes never start one
+static void verifyDetection() {
+  AnomalyDetector d;
+  anomalyInit(d, 8, collectEvent, nullptr);
+  events.clear();
+  const int desk = 5;
+  for (int day = 0; day < 21; day++) {
+    for (int64_t ms = 0; ms < DAY_MS; ms += ENV_INTERVAL_MS) {
+      int64_t t = BENCH_START_MS + day * DAY_MS + ms;
+      bool office = ms >= 8 * 3600000LL + 1800000 && ms < 17 * 3600000LL;
+      double noise = fmax(0, round((office ? 12 : 2) + gaussian() * (office ? 2 : 0.6)));
+      if (day == 20 && ms == 10 * 3600000LL) noise = 60;   // Single spike
+      anomalyAdd(d, desk, CHANNEL_NOISE, t, noise);
+      anomalyAdd(d, desk, CHANNEL_TEMPERATURE, t, uniform() < 0.01 ? -999 : 22 + gaussian() * 0.3);
+    }
+  }
+  size_t learnedEvents = 0;
+  for (const AnomalyEvent& e : events)
+    if (e.timeMs >= BENCH_START_MS + 7 * DAY_MS) learnedEvents++;
+  check(learnedEvents <= 2, "few false alarms once learned");
+  check(anomalyDesk(d, desk)->invalid > 0 && d.stats.invalid == anomalyDesk(d, desk)->invalid, "-999 skipped");
+
+  const Baseline* night = anomalyReference(*anomalyDesk(d, desk), CHANNEL_NOISE, 3);
+  const Baseline* day = anomalyReference(*anomalyDesk(d, desk), CHANNEL_NOISE, 10);
+  check(night && day && fabsf(night->median - 2) < 1 && fabsf(day->median - 12) < 1.5f, "per-hour baselines");
+
+  // Office-level noise at 03:00 for two minutes, then quiet
+  events.clear();
+  int64_t t0 = BENCH_START_MS + 21 * DAY_MS + 3 * 3600000LL;
+  for (int i = 0; i < 30; i++) anomalyAdd(d, desk, CHANNEL_NOISE, t0 + i * ENV_INTERVAL_MS, i < 12 ? 12 : 2);
+  check(events.size() == 2 && events[0].type == ANOMALY_START && events[1].type == ANOMALY_END,
+        "night noise starts and ends one anomaly");
+  if (events.size() == 2) {
+    check(events[0].timeMs == t0 + 2 * ENV_INTERVAL_MS && events[0].hourOfWeek == 3 && events[0].score > 0,
+          "start after the confirming readings");
+    check(events[1].durationMs == 10 * ENV_INTERVAL_MS && events[1].peakScore >= events[0].score, "end and peak");
+  }
+  // The same level at 10:00 is the room's normal
+  events.clear();
+  int64_t t1 = BENCH_START_MS + 21 * DAY_MS + 10 * 3600000LL;
+  for (int i = 0; i < 30; i++) anomalyAdd(d, desk, CHANNEL_NOISE, t1 + i * ENV_INTERVAL_MS, 12);
+  check(events.empty(), "daytime level is normal");
+  // Too few readings to confirm
+  for (int i = 0; i < 20; i++) anomalyAdd(d, desk, CHANNEL_NOISE, t1 + (40 + i) * ENV_INTERVAL_MS, i % 2 ? 12 : 60);
+  check(events.empty(), "isolated spikes ignored");
+
+  // A room that gets permanently warmer is adopted, not alarmed forever
+  events.clear();
+  for (int64_t ms = 0; ms < 14 * DAY_MS; ms += ENV_INTERVAL_MS)
+    anomalyAdd(d, desk, CHANNEL_TEMPERATURE, BENCH_START_MS + 22 * DAY_MS + ms, 25 + gaussian() * 0.3);
+  check(!anomalyDesk(d, desk)->channels[CHANNEL_TEMPERATURE].anomalous, "level shift adopted");
+}
+
+static void verifySuggestions() {
+  AnomalyDetector d;
+  anomalyInit(d, 4);
+  for (int64_t ms = 0; ms < 14 * DAY_MS; ms += ENV_INTERVAL_MS) {
+    int64_t t = BENCH_START_MS + ms;
+    anomalyAdd(d, 2, CHANNEL_TEMPERATURE, t, 23 + gaussian() * 0.5);
+    anomalyAdd(d, 2, CHANNEL_NOISE, t, fmax(0, round(3 + gaussian())));
+    anomalyAdd(d, 2, CHANNEL_LIGHT, t, 400 + gaussian() * 20);
+    if (ms == DAY_MS / 2) check(!anomalySuggest(*anomalyDesk(d, 2)).valid, "no suggestion before enough hours");
+  }
+  AnomalyThresholds t = anomalySuggest(*anomalyDesk(d, 2));
+  check(t.valid && t.slots == ANOMALY_SLOTS, "suggestion after two weeks");
+  check(fabsf(t.tempMin - 21.5f) < 0.3f && fabsf(t.tempMax - 24.5f) < 0.3f, "temperature band at 3 sigma");
+  check(t.noiseMax >= 5 && t.noiseMax <= 8, "noise ceiling");
+  check(fabsf(t.lightMin - 340) < 10, "light floor");
+
+  // Lit only while studied: the floor comes from the session hours
+  for (int64_t ms = 0; ms < 14 * DAY_MS; ms += ENV_INTERVAL_MS) {
+    int64_t t = BENCH_START_MS + ms;
+    bool studied = ms % DAY_MS >= 9 * 3600000LL && ms % DAY_MS < 17 * 3600000LL;
+    anomalyAdd(d, 3, CHANNEL_TEMPERATURE, t, 23 + gaussian() * 0.5);
+    anomalyAdd(d, 3, CHANNEL_NOISE, t, fmax(0, round(3 + gaussian())));
+    anomalyAdd(d, 3, CHANNEL_LIGHT, t, studied ? 400 + gaussian() * 20 : 5);
+    if (ms % 60000 == 0) anomalySession(d, 3, t, studied ? 1 : 0);
+  }
+  AnomalyThresholds lit = anomalySuggest(*anomalyDesk(d, 3));
+  check(lit.valid && lit.slots == 8 * 7 && fabsf(lit.lightMin - 340) < 10, "study hours only");
+
+  AnomalyDetector none;
+  anomalyInit(none, 2);
+  anomalyAdd(none, 5, CHANNEL_NOISE, BENCH_START_MS, 1);
+  anomalyAdd(none, -1, CHANNEL_NOISE, BENCH_START_MS, 1);
+  check(none.stats.ignored == 2 && none.deskCount == 0, "desks outside the table ignored");
+}
+
+static void verifyDecodePath() {
+  AnomalyDetector d;
+  anomalyInit(d, 8);
+  const char* topic = "bille/desk/3/data/environment";
+  const char* json = "{\"temperature\":22.5,\"humidity\":-999,\"lightLevel\":300,\"noiseLevel\":3,\"soundDetected\":false}";
+  billeDecode(topic, strlen(topic), (const uint8_t*)json, strlen(json), BENCH_START_MS, anomalyOnMetric, &d);
+  const DeskBaselines* b = anomalyDesk(d, 3);
+  check(b && b->points == 3 && b->invalid == 1 && d.stats.ignored == 1, "environment payload feeds three channels");
+  check(b && b->channels[CHANNEL_TEMPERATURE].warmupCount == 1 && b->channels[CHANNEL_HUMIDITY].warmupCount == 0,
+        "points reach their channels");
+  check(anomalyChannel("wearable.accel") == CHANNEL_ACCELERATION && anomalyChannel("pomodoro.state") < 0,
+        "channel mapping");
+  const char* wearTopic = "bille/desk/3/data/biometric";
+  const char* wear = "{\"nodeType\":\"WEARABLE\",\"acceleration\":1.02,\"sessionActive\":true}";
+  billeDecode(wearTopic, strlen(wearTopic), (const uint8_t*)wear, strlen(wear), BENCH_START_MS, anomalyOnMetric, &d);
+  check(b && b->sessions && b->occupied[0] == 1 && d.stats.sessionReadings == 1, "session readings mark study hours");
+}
+
+static int runVerify() {
+  setenv("TZ", "UTC", 1);
+  tzset();
+  verifyEstimators();
+  verifyHours();
+  verifyDetection();
+  verifySuggestions();
+  verifyDecodePath();
+  check(sizeof(DeskBaselines) < 16 * 1024, "bounded memory per desk");
+  printf("{\"verify\": \"%s\", \"bytesPerDesk\": %zu, \"failures\": %d}\n", verifyFailures ? "failed" : "ok",
+         sizeof(DeskBaselines), verifyFailures);
+  return verifyFailures ? 1 : 0;
+}
+
+static void usage() {
+  fprintf(stderr,
+          "usage: bille-anomaly [options]\n"
+          "  --host H --port P          broker (default 127.0.0.1:%d)\n"
+          "  --user U --password P\n"
+          "  --max-desks N              desk numbers tracked (default %d)\n"
+          "  --status-s S               status period, 0 = off (default 60)\n"
+          "  --thresholds-s S           suggested threshold period (default 3600)\n"
+          "  --bench                    generated traffic through decode + detector on one core\n"
+          "    --desks N --days N       (default 100 desks, 21 days)\n"
+          "  --verify                   estimator, hour and detection self-check\n",
+          MQTT_DEFAULT_PORT, ANOMALY_MAX_DESKS);
+}
+
+static bool parseArgs(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    if (a == "--bench") {
+      opts.bench = true;
+      continue;
+    }
+    if (a == "--verify") {
+      opts.verify = true;
+      continue;
+    }
+    if (i + 1 >= argc) return false;
+    const char* v = argv[++i];
+    if (a == "--host") opts.host = v;
+    else if (a == "--port") opts.port = atoi(v);
+    else if (a == "--user") opts.user = v;
+    else if (a == "--password") opts.password = v;
+    else if (a == "--max-desks") opts.maxDesks = atoi(v);
+    else if (a == "--status-s") opts.statusS = atoi(v);
+    else if (a == "--thresholds-s") opts.thresholdsS = atoi(v);
+    else if (a == "--desks") opts.desks = atoi(v);
+    else if (a == "--days") opts.days = atoi(v);
+    else return false;
+  }
+  return opts.maxDesks > 0 && opts.desks > 0 && opts.desks <= opts.maxDesks && opts.days > 0;
+}
+
+int main(int argc, char** argv) {
+  if (!parseArgs(argc, argv)) {
+    usage();
+    return 2;
+  }
+  if (opts.verify) return runVerify();
+  if (opts.bench) return runBench();
+  return runService();
+}
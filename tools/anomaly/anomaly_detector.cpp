@@ -0,0 +1,268 @@
+#include "anomaly_detector.h"
+
+#include <math.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+
+// Robbins-Monro gains: 1 / density at the median (and at the MAD of the
+// absolute deviations) of a normal, in MADs
+#define MEDIAN_GAIN   3.72f
+#define MAD_GAIN      2.33f
+#define MAD_TO_SIGMA  1.4826f
+#define HOUR_MS       3600000LL
+#define OCCUPIED_WINDOW  256
+
+static const struct {
+  const char* name;
+  const char* metrics[2];
+  float resolution;          // Smallest step the sensor reports; floors the MAD
+} channelInfo[CHANNEL_COUNT] = {
+  {"temperature", {"environment.temperature", nullptr}, 0.1f},
+  {"humidity", {"environment.humidity", nullptr}, 1.0f},
+  {"lightLevel", {"environment.lightLevel", nullptr}, 2.0f},
+  {"noiseLevel", {"environment.noiseLevel", nullptr}, 1.0f},
+  {"acceleration", {"biometric.acceleration", "wearable.accel"}, 0.01f},
+};
+
+void anomalyInit(AnomalyDetector& d, int maxDesks, AnomalySink sink, void* sinkContext) {
+  d.maxDesks = maxDesks > 0 ? maxDesks : 1;
+  d.desks.clear();
+  d.desks.resize(d.maxDesks);
+  d.deskCount = 0;
+  d.hourStart = 0;
+  d.hourEnd = 0;
+  d.hourOfWeek = 0;
+  d.sink = sink;
+  d.sinkContext = sinkContext;
+  memset(&d.stats, 0, sizeof(d.stats));
+}
+
+int anomalyChannel(const char* metric) {
+  for (int c = 0; c < CHANNEL_COUNT; c++)
+    for (const char* name : channelInfo[c].metrics)
+      if (name && strcmp(metric, name) == 0) return c;
+  return -1;
+}
+
+const char* anomalyChannelName(AnomalyChannel channel) {
+  return channelInfo[channel].name;
+}
+
+int anomalyHourOfWeek(AnomalyDetector& d, int64_t timeMs) {
+  if (timeMs >= d.hourStart && timeMs < d.hourEnd) return d.hourOfWeek;
+  int64_t ms = timeMs % 1000;
+  if (ms < 0) ms += 1000;
+  time_t seconds = (time_t)((timeMs - ms) / 1000);
+  struct tm tm;
+  localtime_r(&seconds, &tm);
+  d.hourOfWeek = ((tm.tm_wday + 6) % 7) * 24 + tm.tm_hour;
+  d.hourStart = timeMs - ((tm.tm_min * 60 + tm.tm_sec) * 1000LL + ms);
+  d.hourEnd = d.hourStart + HOUR_MS;
+  d.stats.hourLookups++;
+  return d.hourOfWeek;
+}
+
+const DeskBaselines* anomalyDesk(const AnomalyDetector& d, int desk) {
+  return desk >= 0 && desk < d.maxDesks ? d.desks[desk].get() : nullptr;
+}
+
+static DeskBaselines& deskFor(AnomalyDetector& d, int desk) {
+  std::unique_ptr<DeskBaselines>& slot = d.desks[desk];
+  if (!slot) {
+    slot.reset(new DeskBaselines);
+    memset(slot.get(), 0, sizeof(DeskBaselines));
+    slot->desk = desk;
+    d.deskCount++;
+  }
+  return *slot;
+}
+
+// ---- Baselines -----------------------------------------------------------
+
+static float middle(float* values, int n) {
+  std::sort(values, values + n);
+  return n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+}
+
+static void seedOverall(ChannelState& c) {
+  float values[ANOMALY_WARMUP];
+  memcpy(values, c.warmup, sizeof(values));
+  c.overall.median = middle(values, ANOMALY_WARMUP);
+  for (int i = 0; i < ANOMALY_WARMUP; i++) values[i] = fabsf(c.warmup[i] - c.overall.median);
+  c.overall.mad = middle(values, ANOMALY_WARMUP);
+  c.overall.count = ANOMALY_WARMUP;
+}
+
+// One sign step of each estimate; the step is in MADs (floored at the
+// sensor resolution) over the readings so far, capped at the window
+static void updateBaseline(Baseline& b, float x, float resolution) {
+  uint32_t n = b.count < ANOMALY_WINDOW ? b.count + 1 : ANOMALY_WINDOW;
+  float step = 0.5f * std::max(b.mad, resolution) / n;
+  float deviation = fabsf(x - b.median);
+  if (x > b.median) b.median += MEDIAN_GAIN * step;
+  else if (x < b.median) b.median -= MEDIAN_GAIN * step;
+  if (deviation > b.mad) b.mad += MAD_GAIN * step;
+  else if (deviation < b.mad) b.mad = std::max(0.0f, b.mad - MAD_GAIN * step);
+  if (b.count < UINT32_MAX) b.count++;
+}
+
+static float robustScore(float x, const Baseline& b, float resolution) {
+  return (x - b.median) / (MAD_TO_SIGMA * std::max(b.mad, resolution));
+}
+
+const Baseline* anomalyReference(const DeskBaselines& desk, AnomalyChannel channel, int hourOfWeek) {
+  const ChannelState& c = desk.channels[channel];
+  if (c.overall.count == 0) return nullptr;
+  const Baseline& slot = c.slots[hourOfWeek];
+  return slot.count >= ANOMALY_MIN_SAMPLES ? &slot : &c.overall;
+}
+
+// ---- Detection -----------------------------------------------------------
+
+static void emit(AnomalyDetector& d, AnomalyEventType type, const DeskBaselines& desk, AnomalyChannel channel,
+                 int64_t timeMs, int hour, float value, const Baseline& reference, float score) {
+  if (!d.sink) return;
+  const ChannelState& c = desk.channels[channel];
+  AnomalyEvent e;
+  e.type = type;
+  e.desk = desk.desk;
+  e.channel = channel;
+  e.timeMs = timeMs;
+  e.hourOfWeek = hour;
+  e.value = value;
+  e.median = reference.median;
+  e.mad = reference.mad;
+  e.score = score;
+  e.peakScore = c.peakScore;
+  e.durationMs = type == ANOMALY_END ? timeMs - c.since : 0;
+  d.sink(d.sinkContext, e);
+}
+
+void anomalyAdd(AnomalyDetector& d, int desk, AnomalyChannel channel, int64_t timeMs, double value) {
+  if (desk < 0 || desk >= d.maxDesks || channel < 0 || channel >= CHANNEL_COUNT) {
+    d.stats.ignored++;
+    return;
+  }
+  DeskBaselines& b = deskFor(d, desk);
+  if (value != value || value == -999.0) {
+    d.stats.invalid++;
+    b.invalid++;
+    return;
+  }
+  d.stats.points++;
+  b.points++;
+  ChannelState& c = b.channels[channel];
+  float x = (float)value;
+  if (c.warmupCount < ANOMALY_WARMUP) {
+    c.warmup[c.warmupCount++] = x;
+    if (c.warmupCount == ANOMALY_WARMUP) seedOverall(c);
+    return;
+  }
+
+  int hour = anomalyHourOfWeek(d, timeMs);
+  Baseline& slot = c.slots[hour];
+  if (slot.count == 0) {
+    const Baseline& before = c.slots[(hour + ANOMALY_SLOTS - 1) % ANOMALY_SLOTS];
+    slot = before.count >= ANOMALY_MIN_SAMPLES ? before : c.overall;
+    slot.count = ANOMALY_SEED_WEIGHT;
+  }
+  const Baseline* reference = slot.count >= ANOMALY_MIN_SAMPLES ? &slot : &c.overall;
+  float resolution = channelInfo[channel].resolution;
+  float score = robustScore(x, *reference, resolution);
+  if (fabsf(score) >= ANOMALY_CLEAR_SCORE) {
+    for (int side : {ANOMALY_SLOTS - 1, 1}) {
+      const Baseline& next = c.slots[(hour + side) % ANOMALY_SLOTS];
+      if (next.count < ANOMALY_MIN_SAMPLES) continue;
+      float nextScore = robustScore(x, next, resolution);
+      if (fabsf(nextScore) < fabsf(score)) {
+        score = nextScore;
+        reference = &next;
+      }
+    }
+  }
+  float magnitude = fabsf(score);
+
+  if (!c.anomalous) {
+    if (magnitude <= ANOMALY_SCORE) {
+      c.streak = 0;
+    } else if (++c.streak >= ANOMALY_CONFIRM) {
+      c.anomalous = true;
+      c.since = timeMs;
+      c.peakScore = magnitude;
+      b.anomalies++;
+      d.stats.started++;
+      emit(d, ANOMALY_START, b, channel, timeMs, hour, x, *reference, score);
+    }
+  } else {
+    c.peakScore = std::max(c.peakScore, magnitude);
+    if (magnitude < ANOMALY_CLEAR_SCORE) {
+      c.anomalous = false;
+      c.streak = 0;
+      d.stats.ended++;
+      emit(d, ANOMALY_END, b, channel, timeMs, hour, x, *reference, score);
+    }
+  }
+
+  // Scored first, so a reading never vouches for itself
+  updateBaseline(c.overall, x, resolution);
+  updateBaseline(slot, x, resolution);
+}
+
+void anomalySession(AnomalyDetector& d, int desk, int64_t timeMs, double active) {
+  if (desk < 0 || desk >= d.maxDesks || active != active) {
+    d.stats.ignored++;
+    return;
+  }
+  DeskBaselines& b = deskFor(d, desk);
+  int hour = anomalyHourOfWeek(d, timeMs);
+  uint16_t& count = b.occupiedCount[hour];
+  if (count < OCCUPIED_WINDOW) count++;
+  b.occupied[hour] += ((active != 0 ? 1.0f : 0.0f) - b.occupied[hour]) / count;
+  b.sessions = true;
+  d.stats.sessionReadings++;
+}
+
+void anomalyOnMetric(void* context, int desk, const char* metric, int64_t timeMs, double value) {
+  AnomalyDetector& d = *(AnomalyDetector*)context;
+  int channel = anomalyChannel(metric);
+  if (channel < 0 && (strcmp(metric, "session.active") == 0 || strcmp(metric, "biometric.sessionActive") == 0)) {
+    anomalySession(d, desk, timeMs, value);
+    return;
+  }
+  if (channel < 0) {
+    d.stats.ignored++;
+    return;
+  }
+  anomalyAdd(d, desk, (AnomalyChannel)channel, timeMs, value);
+}
+
+// ---- Suggested thresholds ------------------------------------------------
+
+// Median over the trusted study-hour slots of median + sign * k sigma
+static float typicalBound(const DeskBaselines& desk, AnomalyChannel channel, float sign, int& slots) {
+  float bounds[ANOMALY_SLOTS];
+  float resolution = channelInfo[channel].resolution;
+  slots = 0;
+  for (int hour = 0; hour < ANOMALY_SLOTS; hour++) {
+    const Baseline& s = desk.channels[channel].slots[hour];
+    if (s.count < ANOMALY_MIN_SAMPLES) continue;
+    if (desk.sessions && desk.occupied[hour] < ANOMALY_OCCUPIED) continue;
+    bounds[slots++] = s.median + sign * ANOMALY_SUGGEST_SCORE * MAD_TO_SIGMA * std::max(s.mad, resolution);
+  }
+  return slots ? middle(bounds, slots) : NAN;
+}
+
+AnomalyThresholds anomalySuggest(const DeskBaselines& desk) {
+  AnomalyThresholds t;
+  int temperature, noise, light;
+  t.tempMin = typicalBound(desk, CHANNEL_TEMPERATURE, -1, temperature);
+  t.tempMax = typicalBound(desk, CHANNEL_TEMPERATURE, 1, temperature);
+  t.noiseMax = typicalBound(desk, CHANNEL_NOISE, 1, noise);
+  float lightMin = typicalBound(desk, CHANNEL_LIGHT, -1, light);
+  t.lightMin = lightMin < 0 ? 0 : lightMin;
+  t.slots = std::min(temperature, std::min(noise, light));
+  t.valid = t.slots >= ANOMALY_SUGGEST_SLOTS;
+  return t;
+}
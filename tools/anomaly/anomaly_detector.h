@@ -0,0 +1,159 @@
+#ifndef ANOMALY_DETECTOR_H
+#define ANOMALY_DETECTOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <memory>
+#include <vector>
+
+// Streaming anomaly detection against each room's own baseline, in place of
+// the sketches' fixed thresholds (20-26 C, noise > 4, light < 270 lux).
+//
+// Each desk keeps, per channel, a robust baseline (median and MAD) for
+// every hour of the week plus one over all hours. They are updated one
+// reading at a time by stochastic approximation, nudging the median towards
+// each reading and the MAD towards each absolute deviation by a step that
+// shrinks with the sample count, so memory is fixed per desk (no sample
+// buffers) and old weeks fade once a slot has ANOMALY_WINDOW readings.
+//
+// The desk-wide baseline starts from the exact median/MAD of its first
+// ANOMALY_WARMUP readings. An hour slot starts from the hour before it when
+// that one is trusted (days change gradually; a lit study hour seeded from a
+// night-dominated desk-wide baseline takes weeks to settle), otherwise from
+// the desk-wide one, and is used on its own once it has ANOMALY_MIN_SAMPLES
+// readings; until then the desk-wide baseline scores its readings. A reading is
+// scored against its hour and, when that looks unusual, the trusted hours
+// either side, keeping the closest: a desk taken at 08:30 has a half quiet,
+// half busy 08:00 slot. A robust z-score |x - median| / (1.4826 * MAD) past
+// ANOMALY_SCORE for ANOMALY_CONFIRM readings in a row starts an anomaly; it
+// ends below ANOMALY_CLEAR_SCORE. NaN and -999 (DHT failures) are skipped.
+//
+// session.active and the wearable's sessionActive mark which hours a desk
+// is studied at; suggested thresholds come from those hours only.
+//
+// Hour of the week follows the host's local time (TZ), Monday 00:00 = 0.
+// Not thread-safe; the service runs it on one thread.
+
+#define ANOMALY_SLOTS           168      // Hours in a week
+#define ANOMALY_WINDOW          512      // Readings after which a baseline's step stops shrinking
+#define ANOMALY_MIN_SAMPLES     120      // Hour slot readings before it is trusted (20 min of environment data)
+#define ANOMALY_WARMUP          32       // Readings for the exact desk-wide seed
+#define ANOMALY_SCORE           4.0f
+#define ANOMALY_CLEAR_SCORE     2.5f
+#define ANOMALY_CONFIRM         3
+#define ANOMALY_SEED_WEIGHT     8        // Readings a seeded hour slot counts as
+#define ANOMALY_SUGGEST_SCORE   3.0f     // Width of the suggested thresholds, in robust sigmas
+#define ANOMALY_SUGGEST_SLOTS   16       // Trusted hour slots before thresholds are suggested
+#define ANOMALY_OCCUPIED        0.5f     // Session share that makes an hour a study hour
+#define ANOMALY_MAX_DESKS       4096
+
+enum AnomalyChannel {
+  CHANNEL_TEMPERATURE,
+  CHANNEL_HUMIDITY,
+  CHANNEL_LIGHT,
+  CHANNEL_NOISE,
+  CHANNEL_ACCELERATION,     // biometric.acceleration and batched wearable.accel
+  CHANNEL_COUNT
+};
+
+struct Baseline {
+  float median;
+  float mad;
+  uint32_t count;
+};
+
+struct ChannelState {
+  Baseline overall;
+  Baseline slots[ANOMALY_SLOTS];
+  float warmup[ANOMALY_WARMUP];
+  uint8_t warmupCount;
+  uint8_t streak;            // Consecutive readings past ANOMALY_SCORE
+  bool anomalous;
+  float peakScore;
+  int64_t since;
+};
+
+struct DeskBaselines {
+  int desk;
+  uint64_t points;
+  uint64_t invalid;
+  uint64_t anomalies;
+  ChannelState channels[CHANNEL_COUNT];
+  float occupied[ANOMALY_SLOTS];          // Share of session readings that were active
+  uint16_t occupiedCount[ANOMALY_SLOTS];
+  bool sessions;                          // Any session readings at all
+};
+
+enum AnomalyEventType {
+  ANOMALY_START,
+  ANOMALY_END
+};
+
+struct AnomalyEvent {
+  AnomalyEventType type;
+  int desk;
+  AnomalyChannel channel;
+  int64_t timeMs;
+  int hourOfWeek;
+  float value;
+  float median;              // Baseline the reading was scored against
+  float mad;
+  float score;               // Signed: negative below the median
+  float peakScore;           // End: largest |score| during the anomaly
+  int64_t durationMs;        // End only
+};
+
+typedef void (*AnomalySink)(void* context, const AnomalyEvent& event);
+
+struct AnomalyStats {
+  uint64_t points;
+  uint64_t invalid;
+  uint64_t ignored;          // Metrics without a channel, or desks past maxDesks
+  uint64_t sessionReadings;
+  uint64_t started;
+  uint64_t ended;
+  uint64_t hourLookups;      // localtime calls, once per hour crossed
+};
+
+struct AnomalyDetector {
+  int maxDesks;
+  std::vector<std::unique_ptr<DeskBaselines>> desks;   // By desk number, created on first reading
+  size_t deskCount;
+  int64_t hourStart;         // Cached local hour [hourStart, hourEnd)
+  int64_t hourEnd;
+  int hourOfWeek;
+  AnomalySink sink;
+  void* sinkContext;
+  AnomalyStats stats;
+};
+
+// Room thresholds in the firmware's terms, from the trusted hour slots the
+// desk is studied at (every trusted slot for desks without session data):
+// the median across hours of median -/+ ANOMALY_SUGGEST_SCORE robust sigmas
+struct AnomalyThresholds {
+  bool valid;                // Enough slots on every channel below
+  int slots;                 // Fewest slots used of the three channels
+  float tempMin;
+  float tempMax;
+  float noiseMax;
+  float lightMin;
+};
+
+void anomalyInit(AnomalyDetector& d, int maxDesks = ANOMALY_MAX_DESKS, AnomalySink sink = nullptr,
+                 void* sinkContext = nullptr);
+// -1 for metrics that are not watched
+int anomalyChannel(const char* metric);
+const char* anomalyChannelName(AnomalyChannel channel);
+void anomalyAdd(AnomalyDetector& d, int desk, AnomalyChannel channel, int64_t timeMs, double value);
+// A session reading: non-zero while the desk is in a study session
+void anomalySession(AnomalyDetector& d, int desk, int64_t timeMs, double active);
+// MetricSink (bille_decode.h) adapter; context is the detector
+void anomalyOnMetric(void* context, int desk, const char* metric, int64_t timeMs, double value);
+
+int anomalyHourOfWeek(AnomalyDetector& d, int64_t timeMs);
+const DeskBaselines* anomalyDesk(const AnomalyDetector& d, int desk);
+// Baseline a reading at hourOfWeek would be scored against; null before warm-up
+const Baseline* anomalyReference(const DeskBaselines& desk, AnomalyChannel channel, int hourOfWeek);
+AnomalyThresholds anomalySuggest(const DeskBaselines& desk);
+
+#endif
@@ -0,0 +1,1026 @@
+#include "mqtt_broker.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#define LISTEN_SLOT          UINT32_MAX
+#define SWEEP_INTERVAL_US    1000000ULL
+#define CONNECT_TIMEOUT_US   10000000ULL   // To send CONNECT after the TCP connect
+
+// CONNACK return codes
+#define CONNACK_ACCEPTED         0
+#define CONNACK_BAD_PROTOCOL     1
+#define CONNACK_BAD_CLIENT_ID    2
+#define CONNACK_BAD_CREDENTIALS  4
+
+static const std::string LEVEL_PLUS = "+";
+static const std::string LEVEL_HASH = "#";
+
+// ---- Messages --------------------------------------------------------------
+
+static BrokerMessage* messageNew(const char* topic, size_t topicLength, const uint8_t* payload, size_t length,
+                                 uint8_t qos) {
+  BrokerMessage* m = (BrokerMessage*)malloc(sizeof(BrokerMessage) + 2 + topicLength + length);
+  m->refs = 1;
+  m->topicLength = (uint16_t)topicLength;
+  m->qos = qos > 1 ? 1 : qos;
+  m->payloadLength = (uint32_t)length;
+  uint8_t* p = m->bytes();
+  p[0] = topicLength >> 8;
+  p[1] = topicLength & 0xFF;
+  memcpy(p + 2, topic, topicLength);
+  if (length) memcpy(p + 2 + topicLength, payload, length);
+  return m;
+}
+
+static BrokerMessage* messageRef(BrokerMessage* m) {
+  m->refs++;
+  return m;
+}
+
+static void messageRelease(BrokerMessage* m) {
+  if (m && --m->refs == 0) free(m);
+}
+
+static const char* messageTopic(BrokerMessage* m) {
+  return (const char*)m->bytes() + 2;
+}
+
+// ---- Topic trie --------------------------------------------------------------
+
+struct Level {
+  const char* text;
+  size_t length;
+};
+
+static void splitLevels(const char* s, size_t length, std::vector<Level>& out) {
+  out.clear();
+  size_t start = 0;
+  for (size_t i = 0; i <= length; i++) {
+    if (i == length || s[i] == '/') {
+      out.push_back({s + start, i - start});
+      start = i + 1;
+    }
+  }
+}
+
+static bool levelIs(const Level& l, char c) {
+  return l.length == 1 && l.text[0] == c;
+}
+
+static TrieNode* childFor(TrieNode* node, const char* level, size_t length, bool create) {
+  std::string key(level, length);
+  auto it = node->children.find(key);
+  if (it != node->children.end()) return it->second.get();
+  if (!create) return nullptr;
+  TrieNode* child = new TrieNode();
+  child->level = key;
+  child->parent = node;
+  child->retained = nullptr;
+  memset(&child->counters, 0, sizeof(child->counters));
+  node->children.emplace(key, std::unique_ptr<TrieNode>(child));
+  return child;
+}
+
+static TrieNode* nodeFor(Broker& b, const char* path, size_t length, bool create) {
+  std::vector<Level> levels;
+  splitLevels(path, length, levels);
+  TrieNode* node = &b.root;
+  for (const Level& l : levels) {
+    node = childFor(node, l.text, l.length, create);
+    if (!node) return nullptr;
+  }
+  return node;
+}
+
+// Drops nodes left with nothing to match, retain or report
+static void prune(TrieNode* node) {
+  while (node->parent && node->children.empty() && node->subscribers.empty() && !node->retained &&
+         node->counters.messages == 0) {
+    TrieNode* parent = node->parent;
+    parent->children.erase(node->level);
+    node = parent;
+  }
+}
+
+static void trieSubscribe(Broker& b, BrokerSession* s, const std::string& filter, uint8_t qos) {
+  TrieNode* node = nodeFor(b, filter.data(), filter.size(), true);
+  b.generation++;
+  for (TrieSubscriber& t : node->subscribers) {
+    if (t.session == s) {
+      t.qos = qos;
+      return;
+    }
+  }
+  node->subscribers.push_back({s, qos});
+}
+
+static void trieUnsubscribe(Broker& b, BrokerSession* s, const std::string& filter) {
+  TrieNode* node = nodeFor(b, filter.data(), filter.size(), false);
+  if (!node) return;
+  std::vector<TrieSubscriber>& v = node->subscribers;
+  v.erase(std::remove_if(v.begin(), v.end(), [s](const TrieSubscriber& t) { return t.session == s; }), v.end());
+  b.generation++;
+  prune(node);
+}
+
+// One entry per session, at the highest QoS of its matching filters
+static void addTarget(Broker& b, const TrieSubscriber& t, std::vector<TrieSubscriber>& out) {
+  BrokerSession* s = t.session;
+  if (s->matchEpoch != b.publishEpoch) {
+    s->matchEpoch = b.publishEpoch;
+    s->matchQos = t.qos;
+    out.push_back(t);
+    return;
+  }
+  if (t.qos <= s->matchQos) return;
+  s->matchQos = t.qos;
+  for (TrieSubscriber& o : out)
+    if (o.session == s) o.qos = t.qos;
+}
+
+static void matchWalk(Broker& b, TrieNode* node, const std::vector<Level>& levels, size_t i,
+                      std::vector<TrieSubscriber>& out) {
+  // Filters starting with a wildcard do not match $-topics
+  bool wildcards = !(i == 0 && levels[0].length > 0 && levels[0].text[0] == '$');
+  if (wildcards) {
+    auto hash = node->children.find(LEVEL_HASH);
+    if (hash != node->children.end())
+      for (const TrieSubscriber& t : hash->second->subscribers) addTarget(b, t, out);
+  }
+  if (i == levels.size()) {
+    for (const TrieSubscriber& t : node->subscribers) addTarget(b, t, out);
+    return;
+  }
+  TrieNode* child = childFor(node, levels[i].text, levels[i].length, false);
+  if (child) matchWalk(b, child, levels, i + 1, out);
+  if (wildcards) {
+    auto plus = node->children.find(LEVEL_PLUS);
+    if (plus != node->children.end()) matchWalk(b, plus->second.get(), levels, i + 1, out);
+  }
+}
+
+void brokerMatch(Broker& b, const char* topic, std::vector<TrieSubscriber>& out) {
+  std::vector<Level> levels;
+  splitLevels(topic, strlen(topic), levels);
+  out.clear();
+  b.publishEpoch++;
+  matchWalk(b, &b.root, levels, 0, out);
+}
+
+static BrokerRoute& routeFor(Broker& b, const char* topic, size_t length) {
+  b.topicScratch.assign(topic, length);
+  auto it = b.routes.find(b.topicScratch);
+  if (it != b.routes.end() && it->second.generation == b.generation) {
+    b.stats.routeHits++;
+    return it->second;
+  }
+  b.stats.routeMisses++;
+  if (it == b.routes.end()) {
+    if (b.routes.size() >= BROKER_ROUTE_CACHE) b.routes.clear();
+    it = b.routes.emplace(b.topicScratch, BrokerRoute()).first;
+  }
+  BrokerRoute& r = it->second;
+  r.generation = b.generation;
+  r.node = nodeFor(b, topic, length, true);
+  r.targets.clear();
+  std::vector<Level> levels;
+  splitLevels(topic, length, levels);
+  b.publishEpoch++;
+  matchWalk(b, &b.root, levels, 0, r.targets);
+  return r;
+}
+
+static void retainedSubtree(TrieNode* node, bool top, std::vector<BrokerMessage*>& out) {
+  if (node->retained) out.push_back(node->retained);
+  for (auto& entry : node->children) {
+    const std::string& level = entry.first;
+    if (level == LEVEL_PLUS || level == LEVEL_HASH) continue;
+    if (top && !level.empty() && level[0] == '$') continue;
+    retainedSubtree(entry.second.get(), false, out);
+  }
+}
+
+static void retainedWalk(TrieNode* node, const std::vector<Level>& filter, size_t i, std::vector<BrokerMessage*>& out) {
+  if (i == filter.size()) {
+    if (node->retained) out.push_back(node->retained);
+    return;
+  }
+  if (levelIs(filter[i], '#')) {
+    retainedSubtree(node, i == 0, out);   // "a/#" includes "a" itself
+    return;
+  }
+  if (levelIs(filter[i], '+')) {
+    for (auto& entry : node->children) {
+      const std::string& level = entry.first;
+      if (level == LEVEL_PLUS || level == LEVEL_HASH) continue;
+      if (i == 0 && !level.empty() && level[0] == '$') continue;
+      retainedWalk(entry.second.get(), filter, i + 1, out);
+    }
+    return;
+  }
+  TrieNode* child = childFor(node, filter[i].text, filter[i].length, false);
+  if (child) retainedWalk(child, filter, i + 1, out);
+}
+
+bool brokerValidTopic(const char* topic, size_t length) {
+  if (length == 0 || length > UINT16_MAX) return false;
+  for (size_t i = 0; i < length; i++)
+    if (topic[i] == '+' || topic[i] == '#' || topic[i] == 0) return false;
+  return true;
+}
+
+bool brokerValidFilter(const char* filter, size_t length) {
+  if (length == 0 || length > UINT16_MAX) return false;
+  for (size_t i = 0; i < length; i++) {
+    char c = filter[i];
+    if (c == 0) return false;
+    bool levelStart = i == 0 || filter[i - 1] == '/';
+    bool levelEnd = i + 1 == length || filter[i + 1] == '/';
+    if (c == '+' && !(levelStart && levelEnd)) return false;
+    if (c == '#' && !(levelStart && i + 1 == length)) return false;
+  }
+  return true;
+}
+
+// ---- Output --------------------------------------------------------------
+
+static size_t deliveryLength(const BrokerDelivery& d) {
+  if (d.raw) return d.message->payloadLength;
+  size_t n = d.headLength;
+  if (d.message) n += 2 + d.message->topicLength + (d.hasPacketId ? 2 : 0) + d.message->payloadLength;
+  return n;
+}
+
+static void markDirty(Broker& b, BrokerClient* c) {
+  if (!c->dirty) {
+    c->dirty = true;
+    b.dirty.push_back(c);
+  }
+}
+
+static void queueDelivery(Broker& b, BrokerClient* c, const BrokerDelivery& d) {
+  c->tx.push_back(d);
+  c->queuedBytes += deliveryLength(d);
+  markDirty(b, c);
+  if (c->queuedBytes > 4 * b.config.queueLimit && !c->closing) {
+    c->closing = true;
+    b.stats.slowDisconnects++;
+  }
+}
+
+static void sendControl(Broker& b, BrokerClient* c, const uint8_t* packet, size_t length) {
+  BrokerDelivery d;
+  memset(&d, 0, sizeof(d));
+  if (length <= sizeof(d.head)) {
+    memcpy(d.head, packet, length);
+    d.headLength = (uint8_t)length;
+  } else {
+    d.raw = true;
+    d.message = messageNew("", 0, packet, length, 0);
+    memmove(d.message->bytes(), packet, length);   // The whole packet, no topic prefix
+  }
+  queueDelivery(b, c, d);
+}
+
+static void sendAck(Broker& b, BrokerClient* c, uint8_t type, uint16_t packetId) {
+  uint8_t ack[4] = {(uint8_t)(type << 4), 2, (uint8_t)(packetId >> 8), (uint8_t)(packetId & 0xFF)};
+  sendControl(b, c, ack, sizeof(ack));
+}
+
+static uint16_t takePacketId(BrokerSession* s) {
+  for (;;) {
+    uint16_t id = s->nextPacketId++;
+    if (s->nextPacketId == 0) s->nextPacketId = 1;
+    if (!s->inflight.count(id)) return id;
+  }
+}
+
+static void queuePublish(Broker& b, BrokerClient* c, BrokerMessage* m, uint8_t qos, bool retain, bool dup,
+                         uint16_t packetId) {
+  BrokerDelivery d;
+  memset(&d, 0, sizeof(d));
+  d.message = messageRef(m);
+  size_t remaining = 2 + m->topicLength + (qos ? 2 : 0) + m->payloadLength;
+  d.head[0] = (MQTT_PUBLISH << 4) | (dup ? 0x08 : 0) | (qos << 1) | (retain ? 1 : 0);
+  d.headLength = 1 + mqttEncodeLength(d.head + 1, remaining);
+  if (qos) {
+    d.hasPacketId = true;
+    d.packetId[0] = packetId >> 8;
+    d.packetId[1] = packetId & 0xFF;
+  }
+  queueDelivery(b, c, d);
+}
+
+// Held for a persistent session until its client is back
+static bool queueOffline(Broker& b, BrokerSession* s, BrokerMessage* m) {
+  if (s->offline.size() >= BROKER_OFFLINE_LIMIT) {
+    messageRelease(s->offline.front());
+    s->offline.pop_front();
+    b.stats.dropped++;
+  }
+  s->offline.push_back(messageRef(m));
+  b.stats.queuedOffline++;
+  return true;
+}
+
+// Queues one copy of m; false if it was dropped
+static bool deliver(Broker& b, BrokerSession* s, BrokerMessage* m, uint8_t qos, bool retain) {
+  BrokerClient* c = s->client;
+  if (!c || c->closing) return qos > 0 && s->persistent && queueOffline(b, s, m);
+  if ((qos == 0 && c->queuedBytes > b.config.queueLimit) || (qos > 0 && s->inflight.size() >= UINT16_MAX)) {
+    c->dropped++;
+    b.stats.dropped++;
+    return false;
+  }
+  uint16_t id = 0;
+  if (qos) {
+    id = takePacketId(s);
+    s->inflight[id] = messageRef(m);
+  }
+  queuePublish(b, c, m, qos, retain, false, id);
+  c->deliveries++;
+  b.stats.deliveries++;
+  return true;
+}
+
+static void addPiece(struct iovec* iov, int& n, const uint8_t* data, size_t length, size_t& skip) {
+  if (skip >= length) {
+    skip -= length;
+    return;
+  }
+  iov[n].iov_base = (void*)(data + skip);
+  iov[n].iov_len = length - skip;
+  n++;
+  skip = 0;
+}
+
+static void setWriteInterest(Broker& b, BrokerClient* c, bool wantWrite) {
+  struct epoll_event ev;
+  ev.events = wantWrite ? EPOLLIN | EPOLLOUT : EPOLLIN;
+  ev.data.u32 = c->slot;
+  epoll_ctl(b.epollFd, EPOLL_CTL_MOD, c->fd, &ev);
+}
+
+static void flushClient(Broker& b, BrokerClient* c) {
+  while (!c->tx.empty() && c->writable) {
+    struct iovec iov[BROKER_IOV_BATCH * 4];
+    int n = 0;
+    for (auto it = c->tx.begin(); it != c->tx.end() && n + 4 <= BROKER_IOV_BATCH * 4; ++it) {
+      BrokerDelivery& d = *it;
+      size_t skip = d.sent;
+      if (d.raw) {
+        addPiece(iov, n, d.message->bytes(), d.message->payloadLength, skip);
+        continue;
+      }
+      addPiece(iov, n, d.head, d.headLength, skip);
+      if (!d.message) continue;
+      BrokerMessage* m = d.message;
+      addPiece(iov, n, m->bytes(), 2 + m->topicLength, skip);
+      if (d.hasPacketId) addPiece(iov, n, d.packetId, 2, skip);
+      addPiece(iov, n, m->bytes() + 2 + m->topicLength, m->payloadLength, skip);
+    }
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = n;
+    ssize_t written = sendmsg(c->fd, &msg, MSG_NOSIGNAL);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        c->writable = false;
+        setWriteInterest(b, c, true);
+      } else {
+        c->closing = true;
+      }
+      return;
+    }
+    b.stats.writeCalls++;
+    b.stats.bytesOut += written;
+    size_t left = (size_t)written;
+    while (left > 0) {
+      BrokerDelivery& d = c->tx.front();
+      size_t length = deliveryLength(d);
+      size_t rest = length - d.sent;
+      if (left < rest) {
+        d.sent += (uint32_t)left;
+        break;
+      }
+      left -= rest;
+      c->queuedBytes -= length;
+      messageRelease(d.message);
+      c->tx.pop_front();
+    }
+  }
+}
+
+// ---- Routing ---------------------------------------------------------------
+
+static void route(Broker& b, BrokerMessage* m, bool retain) {
+  BrokerRoute& r = routeFor(b, messageTopic(m), m->topicLength);
+  TrieNode* node = r.node;
+  node->counters.messages++;
+  node->counters.bytes += m->payloadLength;
+  b.stats.messagesIn++;
+  b.stats.bytesIn += m->payloadLength;
+  if (retain) {
+    if (node->retained) {
+      messageRelease(node->retained);
+      node->retained = nullptr;
+      b.retainedCount--;
+    }
+    if (m->payloadLength) {   // An empty retained publish only clears
+      node->retained = messageRef(m);
+      b.retainedCount++;
+    }
+  }
+  for (const TrieSubscriber& t : r.targets) {
+    if (deliver(b, t.session, m, std::min(m->qos, t.qos), false)) node->counters.deliveries++;
+    else node->counters.dropped++;
+  }
+}
+
+void brokerPublish(Broker& b, const char* topic, const uint8_t* payload, size_t length, uint8_t qos, bool retain) {
+  size_t topicLength = strlen(topic);
+  if (!brokerValidTopic(topic, topicLength)) return;
+  BrokerMessage* m = messageNew(topic, topicLength, payload, length, qos);
+  route(b, m, retain);
+  messageRelease(m);
+}
+
+// ---- Sessions and clients --------------------------------------------------
+
+static void destroySession(Broker& b, BrokerSession* s) {
+  for (const BrokerSubscription& sub : s->subscriptions) trieUnsubscribe(b, s, sub.filter);
+  for (auto& entry : s->inflight) messageRelease(entry.second);
+  for (BrokerMessage* m : s->offline) messageRelease(m);
+  b.sessions.erase(s->clientId);
+}
+
+// After the CONNACK of a resumed session: unacknowledged messages again,
+// oldest packet ID first with DUP set, then what arrived while it was away
+static void resumeSession(Broker& b, BrokerSession* s) {
+  BrokerClient* c = s->client;
+  std::vector<uint16_t> ids;
+  for (const auto& entry : s->inflight) ids.push_back(entry.first);
+  std::sort(ids.begin(), ids.end(),
+            [s](uint16_t x, uint16_t y) { return (uint16_t)(x - s->nextPacketId) < (uint16_t)(y - s->nextPacketId); });
+  for (uint16_t id : ids) {
+    queuePublish(b, c, s->inflight[id], 1, false, true, id);
+    b.stats.resent++;
+  }
+  while (!s->offline.empty()) {
+    BrokerMessage* m = s->offline.front();
+    s->offline.pop_front();
+    deliver(b, s, m, 1, false);
+    messageRelease(m);
+  }
+}
+
+static void closeClient(Broker& b, BrokerClient* c, bool publishWill) {
+  if (c->fd >= 0) {
+    epoll_ctl(b.epollFd, EPOLL_CTL_DEL, c->fd, nullptr);
+    close(c->fd);
+    c->fd = -1;
+  }
+  if (c->dirty) b.dirty.erase(std::find(b.dirty.begin(), b.dirty.end(), c));
+  for (BrokerDelivery& d : c->tx) messageRelease(d.message);
+  c->tx.clear();
+  if (c->session) {
+    c->session->client = nullptr;
+    if (!c->session->persistent) destroySession(b, c->session);
+    c->session = nullptr;
+  }
+  if (c->will) {
+    if (publishWill) {
+      b.stats.wills++;
+      route(b, c->will, c->willRetain);
+    }
+    messageRelease(c->will);
+    c->will = nullptr;
+  }
+  if (c->connected) b.stats.disconnects++;
+  uint32_t slot = c->slot;
+  b.clients[slot].reset();
+  b.releasedSlots.push_back(slot);
+}
+
+static void acceptClients(Broker& b) {
+  for (;;) {
+    int fd = accept4(b.listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      return;   // EAGAIN, or out of descriptors until a client leaves
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    uint32_t slot;
+    if (!b.freeSlots.empty()) {
+      slot = b.freeSlots.back();
+      b.freeSlots.pop_back();
+    } else {
+      slot = (uint32_t)b.clients.size();
+      b.clients.emplace_back();
+    }
+    BrokerClient* c = new BrokerClient();
+    c->fd = fd;
+    c->slot = slot;
+    c->writable = true;
+    c->lastRxMicros = mqttNowMicros();
+    b.clients[slot].reset(c);
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u32 = slot;
+    epoll_ctl(b.epollFd, EPOLL_CTL_ADD, fd, &ev);
+  }
+}
+
+// ---- Packets ---------------------------------------------------------------
+
+struct Reader {
+  const uint8_t* data;
+  size_t length;
+  size_t pos;
+  bool ok;
+};
+
+static uint16_t readU16(Reader& r) {
+  if (r.pos + 2 > r.length) {
+    r.ok = false;
+    return 0;
+  }
+  uint16_t v = ((uint16_t)r.data[r.pos] << 8) | r.data[r.pos + 1];
+  r.pos += 2;
+  return v;
+}
+
+static uint8_t readByte(Reader& r) {
+  if (r.pos >= r.length) {
+    r.ok = false;
+    return 0;
+  }
+  return r.data[r.pos++];
+}
+
+// Length-prefixed string or binary field
+static const char* readField(Reader& r, size_t& length) {
+  length = readU16(r);
+  if (!r.ok || r.pos + length > r.length) {
+    r.ok = false;
+    length = 0;
+    return "";
+  }
+  const char* s = (const char*)r.data + r.pos;
+  r.pos += length;
+  return s;
+}
+
+static void rejectConnect(Broker& b, BrokerClient* c, uint8_t code) {
+  uint8_t ack[4] = {MQTT_CONNACK << 4, 2, 0, code};
+  sendControl(b, c, ack, sizeof(ack));
+  c->closing = true;
+  b.stats.rejected++;
+}
+
+static void handleConnect(Broker& b, BrokerClient* c, const uint8_t* body, size_t length) {
+  if (c->connected) {   // A second CONNECT is a protocol violation
+    c->closing = true;
+    return;
+  }
+  Reader r = {body, length, 0, true};
+  size_t nameLength;
+  const char* name = readField(r, nameLength);
+  uint8_t level = readByte(r);
+  uint8_t flags = readByte(r);
+  uint16_t keepAlive = readU16(r);
+  size_t idLength;
+  const char* id = readField(r, idLength);
+  if (!r.ok || (flags & 0x01)) {
+    c->closing = true;
+    return;
+  }
+  bool v311 = nameLength == 4 && memcmp(name, "MQTT", 4) == 0 && level == 4;
+  bool v31 = nameLength == 6 && memcmp(name, "MQIsdp", 6) == 0 && level == 3;
+  if (!v311 && !v31) {
+    rejectConnect(b, c, CONNACK_BAD_PROTOCOL);
+    return;
+  }
+
+  BrokerMessage* will = nullptr;
+  if (flags & 0x04) {
+    size_t topicLength, messageLength;
+    const char* topic = readField(r, topicLength);
+    const char* message = readField(r, messageLength);
+    if (r.ok && brokerValidTopic(topic, topicLength))
+      will = messageNew(topic, topicLength, (const uint8_t*)message, messageLength, (flags >> 3) & 0x03);
+  }
+  size_t userLength = 0, passwordLength = 0;
+  const char* user = (flags & 0x80) ? readField(r, userLength) : "";
+  const char* password = (flags & 0x40) ? readField(r, passwordLength) : "";
+  if (!r.ok || ((flags & 0x04) && !will)) {
+    messageRelease(will);
+    c->closing = true;
+    return;
+  }
+
+  bool cleanSession = flags & 0x02;
+  std::string clientId(id, idLength);
+  if (clientId.empty()) {
+    if (!cleanSession) {
+      messageRelease(will);
+      rejectConnect(b, c, CONNACK_BAD_CLIENT_ID);
+      return;
+    }
+    char generated[32];
+    snprintf(generated, sizeof(generated), "bille-broker-%u", ++b.anonymousIds);
+    clientId = generated;
+  }
+  if (!b.config.user.empty() &&
+      (std::string(user, userLength) != b.config.user || std::string(password, passwordLength) != b.config.password)) {
+    messageRelease(will);
+    rejectConnect(b, c, CONNACK_BAD_CREDENTIALS);
+    return;
+  }
+
+  // A second connection with the same client ID takes over the session;
+  // closing the old one ends the session unless it is persistent. The old
+  // one never sent DISCONNECT (typically a half-open TCP connection), so its
+  // will is published, as mosquitto does.
+  auto existing = b.sessions.find(clientId);
+  if (existing != b.sessions.end() && existing->second->client) {
+    closeClient(b, existing->second->client, true);
+    existing = b.sessions.find(clientId);
+  }
+  BrokerSession* s = nullptr;
+  if (existing != b.sessions.end()) {
+    if (cleanSession) destroySession(b, existing->second.get());
+    else s = existing->second.get();
+  }
+  bool sessionPresent = s != nullptr;
+  if (sessionPresent) {
+    b.stats.resumed++;
+  } else {
+    s = new BrokerSession();
+    s->clientId = clientId;
+    s->nextPacketId = 1;
+    b.sessions[clientId].reset(s);
+  }
+  s->persistent = !cleanSession;
+
+  s->client = c;
+  c->session = s;
+  c->connected = true;
+  c->keepAliveSeconds = keepAlive;
+  c->will = will;
+  c->willRetain = flags & 0x20;
+  b.stats.connects++;
+  uint8_t ack[4] = {MQTT_CONNACK << 4, 2, (uint8_t)(sessionPresent ? 1 : 0), CONNACK_ACCEPTED};
+  sendControl(b, c, ack, sizeof(ack));
+  if (sessionPresent) resumeSession(b, s);
+}
+
+static void handlePublish(Broker& b, BrokerClient* c, uint8_t header, const uint8_t* body, size_t length) {
+  uint8_t qos = (header >> 1) & 0x03;
+  if (qos == 3) {
+    c->closing = true;
+    return;
+  }
+  Reader r = {body, length, 0, true};
+  size_t topicLength;
+  const char* topic = readField(r, topicLength);
+  uint16_t packetId = qos ? readU16(r) : 0;
+  if (!r.ok || !brokerValidTopic(topic, topicLength)) {
+    c->closing = true;
+    return;
+  }
+  BrokerMessage* m = messageNew(topic, topicLength, body + r.pos, length - r.pos, qos);
+  route(b, m, header & 0x01);
+  messageRelease(m);
+  c->messagesIn++;
+  if (qos == 1) sendAck(b, c, MQTT_PUBACK, packetId);
+  else if (qos == 2) sendAck(b, c, MQTT_PUBREC, packetId);
+}
+
+static void handleSubscribe(Broker& b, BrokerClient* c, uint8_t header, const uint8_t* body, size_t length) {
+  BrokerSession* s = c->session;
+  Reader r = {body, length, 0, true};
+  uint16_t packetId = readU16(r);
+  std::vector<uint8_t> ack = {MQTT_SUBACK << 4, 0, (uint8_t)(packetId >> 8), (uint8_t)(packetId & 0xFF)};
+  std::vector<std::pair<std::string, uint8_t>> accepted;
+  while (r.ok && r.pos < r.length) {
+    size_t filterLength;
+    const char* filter = readField(r, filterLength);
+    uint8_t requested = readByte(r);
+    if (!r.ok || requested > 2) break;
+    if (!brokerValidFilter(filter, filterLength)) {
+      ack.push_back(0x80);
+      continue;
+    }
+    uint8_t granted = requested > 1 ? 1 : requested;
+    std::string f(filter, filterLength);
+    bool found = false;
+    for (BrokerSubscription& sub : s->subscriptions) {
+      if (sub.filter == f) {
+        sub.qos = granted;
+        found = true;
+      }
+    }
+    if (!found) s->subscriptions.push_back({f, granted});
+    trieSubscribe(b, s, f, granted);
+    accepted.push_back({f, granted});
+    ack.push_back(granted);
+  }
+  if ((header & 0x0F) != 0x02 || !r.ok || ack.size() == 4 || ack.size() - 2 > 127) {
+    c->closing = true;
+    return;
+  }
+  ack[1] = (uint8_t)(ack.size() - 2);
+  sendControl(b, c, ack.data(), ack.size());
+
+  // Retained messages for the new filters, after the SUBACK
+  std::vector<Level> levels;
+  std::vector<BrokerMessage*> retained;
+  for (const auto& sub : accepted) {
+    splitLevels(sub.first.data(), sub.first.size(), levels);
+    retained.clear();
+    retainedWalk(&b.root, levels, 0, retained);
+    for (BrokerMessage* m : retained) deliver(b, s, m, std::min(m->qos, sub.second), true);
+  }
+}
+
+static void handleUnsubscribe(Broker& b, BrokerClient* c, uint8_t header, const uint8_t* body, size_t length) {
+  BrokerSession* s = c->session;
+  Reader r = {body, length, 0, true};
+  uint16_t packetId = readU16(r);
+  while (r.ok && r.pos < r.length) {
+    size_t filterLength;
+    const char* filter = readField(r, filterLength);
+    if (!r.ok) break;
+    std::string f(filter, filterLength);
+    auto it = std::find_if(s->subscriptions.begin(), s->subscriptions.end(),
+                           [&f](const BrokerSubscription& sub) { return sub.filter == f; });
+    if (it == s->subscriptions.end()) continue;
+    s->subscriptions.erase(it);
+    trieUnsubscribe(b, s, f);
+  }
+  if ((header & 0x0F) != 0x02 || !r.ok) {
+    c->closing = true;
+    return;
+  }
+  sendAck(b, c, MQTT_UNSUBACK, packetId);
+}
+
+static void handlePacket(Broker& b, BrokerClient* c, uint8_t header, const uint8_t* body, size_t length) {
+  uint8_t type = header >> 4;
+  if (!c->connected && type != MQTT_CONNECT) {
+    c->closing = true;
+    return;
+  }
+  switch (type) {
+    case MQTT_CONNECT:
+      handleConnect(b, c, body, length);
+      break;
+    case MQTT_PUBLISH:
+      handlePublish(b, c, header, body, length);
+      break;
+    case MQTT_PUBACK: {
+      if (length < 2) break;
+      auto it = c->session->inflight.find(((uint16_t)body[0] << 8) | body[1]);
+      if (it != c->session->inflight.end()) {
+        messageRelease(it->second);
+        c->session->inflight.erase(it);
+      }
+      break;
+    }
+    case MQTT_PUBREL:
+      if (length >= 2) sendAck(b, c, MQTT_PUBCOMP, ((uint16_t)body[0] << 8) | body[1]);
+      break;
+    case MQTT_SUBSCRIBE:
+      handleSubscribe(b, c, header, body, length);
+      break;
+    case MQTT_UNSUBSCRIBE:
+      handleUnsubscribe(b, c, header, body, length);
+      break;
+    case MQTT_PINGREQ: {
+      uint8_t pong[2] = {MQTT_PINGRESP << 4, 0};
+      sendControl(b, c, pong, sizeof(pong));
+      break;
+    }
+    case MQTT_DISCONNECT:
+      messageRelease(c->will);   // A clean disconnect never publishes the will
+      c->will = nullptr;
+      c->closing = true;
+      break;
+    case MQTT_PUBREC:
+    case MQTT_PUBCOMP:
+      break;   // Never sent QoS 2
+    default:
+      c->closing = true;
+      break;
+  }
+}
+
+// Handles every complete packet in data; returns the bytes consumed
+static size_t parsePackets(Broker& b, BrokerClient* c, const uint8_t* data, size_t available) {
+  size_t pos = 0;
+  while (!c->closing && available - pos >= 2) {
+    size_t length;
+    int used = mqttDecodeLength(data + pos + 1, available - pos - 1, length);
+    if (used < 0 || length > MQTT_MAX_PACKET_SIZE) {
+      c->closing = true;
+      break;
+    }
+    if (used == 0 || available - pos < 1 + used + length) break;
+    handlePacket(b, c, data[pos], data + pos + 1 + used, length);
+    pos += 1 + used + length;
+  }
+  return pos;
+}
+
+// A client that hung up or broke the protocol is closed by flushAll, after
+// whatever was queued for it (such as a refused CONNACK) is written
+static void readClient(Broker& b, BrokerClient* c) {
+  size_t budget = BROKER_READ_BUDGET;
+  while (!c->closing) {
+    ssize_t n = recv(c->fd, b.readBuffer.data(), b.readBuffer.size(), 0);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) {
+      if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) c->closing = true;
+      break;
+    }
+    c->lastRxMicros = mqttNowMicros();
+    // Packets are parsed straight from the read buffer unless one is split
+    if (c->rx.empty()) {
+      size_t used = parsePackets(b, c, b.readBuffer.data(), n);
+      c->rx.assign(b.readBuffer.data() + used, b.readBuffer.data() + n);
+    } else {
+      c->rx.insert(c->rx.end(), b.readBuffer.data(), b.readBuffer.data() + n);
+      size_t used = parsePackets(b, c, c->rx.data(), c->rx.size());
+      c->rx.erase(c->rx.begin(), c->rx.begin() + used);
+    }
+    if ((size_t)n < b.readBuffer.size() || budget <= (size_t)n) break;
+    budget -= n;
+  }
+  if (c->closing) markDirty(b, c);
+}
+
+static void flushAll(Broker& b) {
+  std::vector<BrokerClient*> pending;
+  while (!b.dirty.empty()) {
+    pending.swap(b.dirty);
+    for (BrokerClient* c : pending) {
+      c->dirty = false;
+      flushClient(b, c);
+      if (c->closing) closeClient(b, c, true);   // DISCONNECT has already dropped the will
+    }
+    pending.clear();
+  }
+}
+
+// Keep-alive (1.5 times the client's interval) and CONNECT timeouts
+static void sweep(Broker& b, uint64_t now) {
+  for (size_t slot = 0; slot < b.clients.size(); slot++) {
+    BrokerClient* c = b.clients[slot].get();
+    if (!c || c->closing) continue;
+    uint64_t limit = c->connected ? c->keepAliveSeconds * 1500000ULL : CONNECT_TIMEOUT_US;
+    if (limit && now - c->lastRxMicros > limit) closeClient(b, c, true);
+  }
+}
+
+// ---- Broker ----------------------------------------------------------------
+
+bool brokerOpen(Broker& b, const BrokerConfig& config) {
+  b.config = config;
+  b.listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (b.listenFd < 0) return false;
+  int one = 1;
+  setsockopt(b.listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(config.port);
+  if (inet_pton(AF_INET, config.bindAddress.c_str(), &addr.sin_addr) != 1 ||
+      bind(b.listenFd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(b.listenFd, 1024) != 0) {
+    close(b.listenFd);
+    b.listenFd = -1;
+    return false;
+  }
+  socklen_t addrLength = sizeof(addr);
+  getsockname(b.listenFd, (struct sockaddr*)&addr, &addrLength);
+  b.port = ntohs(addr.sin_port);
+
+  b.epollFd = epoll_create1(EPOLL_CLOEXEC);
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.u32 = LISTEN_SLOT;
+  epoll_ctl(b.epollFd, EPOLL_CTL_ADD, b.listenFd, &ev);
+
+  b.clients.clear();
+  b.freeSlots.clear();
+  b.dirty.clear();
+  b.releasedSlots.clear();
+  b.readBuffer.assign(BROKER_READ_CHUNK, 0);
+  b.sessions.clear();
+  b.root.children.clear();
+  b.root.subscribers.clear();
+  b.root.parent = nullptr;
+  b.root.retained = nullptr;
+  memset(&b.root.counters, 0, sizeof(b.root.counters));
+  b.generation = 1;
+  b.publishEpoch = 0;
+  b.routes.clear();
+  b.retainedCount = 0;
+  b.lastSweepMicros = mqttNowMicros();
+  b.anonymousIds = 0;
+  memset(&b.stats, 0, sizeof(b.stats));
+  return true;
+}
+
+void brokerPoll(Broker& b, int timeoutMs) {
+  struct epoll_event events[BROKER_MAX_EVENTS];
+  int n = epoll_wait(b.epollFd, events, BROKER_MAX_EVENTS, timeoutMs);
+  for (int i = 0; i < n; i++) {
+    uint32_t slot = events[i].data.u32;
+    if (slot == LISTEN_SLOT) {
+      acceptClients(b);
+      continue;
+    }
+    BrokerClient* c = slot < b.clients.size() ? b.clients[slot].get() : nullptr;
+    if (!c) continue;   // Closed earlier in this batch
+    if (events[i].events & EPOLLOUT) {
+      c->writable = true;
+      setWriteInterest(b, c, false);
+      markDirty(b, c);
+    }
+    if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) readClient(b, c);
+  }
+  flushAll(b);
+
+  uint64_t now = mqttNowMicros();
+  if (now - b.lastSweepMicros > SWEEP_INTERVAL_US) {
+    sweep(b, now);
+    flushAll(b);
+    b.lastSweepMicros = now;
+  }
+  b.freeSlots.insert(b.freeSlots.end(), b.releasedSlots.begin(), b.releasedSlots.end());
+  b.releasedSlots.clear();
+}
+
+static void releaseRetained(TrieNode* node) {
+  messageRelease(node->retained);
+  node->retained = nullptr;
+  for (auto& entry : node->children) releaseRetained(entry.second.get());
+}
+
+void brokerClose(Broker& b) {
+  for (size_t slot = 0; slot < b.clients.size(); slot++) {
+    BrokerClient* c = b.clients[slot].get();
+    if (c) {
+      flushClient(b, c);
+      closeClient(b, c, false);
+    }
+  }
+  while (!b.sessions.empty()) destroySession(b, b.sessions.begin()->second.get());   // Persistent ones
+  b.routes.clear();
+  releaseRetained(&b.root);
+  b.root.children.clear();
+  b.retainedCount = 0;
+  if (b.listenFd >= 0) close(b.listenFd);
+  if (b.epollFd >= 0) close(b.epollFd);
+  b.listenFd = -1;
+  b.epollFd = -1;
+}
+
+// ---- Reporting ---------------------------------------------------------------
+
+static void topicsUnder(const TrieNode* node, const std::string& path, std::vector<BrokerTopicReport>& out) {
+  for (const auto& entry : node->children) {
+    const TrieNode* child = entry.second.get();
+    std::string topic = node->parent || !path.empty() ? path + "/" + child->level : child->level;
+    if (child->counters.messages || child->retained) out.push_back({topic, child->counters, child->retained != nullptr});
+    topicsUnder(child, topic, out);
+  }
+}
+
+void brokerTopics(const Broker& b, std::vector<BrokerTopicReport>& out) {
+  out.clear();
+  topicsUnder(&b.root, "", out);
+  std::sort(out.begin(), out.end(),
+            [](const BrokerTopicReport& x, const BrokerTopicReport& y) { return x.topic < y.topic; });
+}
+
+size_t brokerSubscriptionCount(const Broker& b) {
+  size_t n = 0;
+  for (const auto& entry : b.sessions) n += entry.second->subscriptions.size();
+  return n;
+}
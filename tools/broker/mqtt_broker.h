@@ -0,0 +1,206 @@
+#ifndef MQTT_BROKER_H
+#define MQTT_BROKER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mqtt_client.h"
+
+// Single-threaded MQTT 3.1.1 broker for tests and small deployments: one
+// epoll loop, no TLS, nothing kept across broker restarts. Enough protocol
+// for the Bill-E nodes and host tools: CONNECT (with will, user/password),
+// PUBLISH QoS 0/1 (QoS 2 publishes are accepted and forwarded at QoS 1),
+// SUBSCRIBE/UNSUBSCRIBE with '+' and '#', retained messages, PINGREQ and
+// DISCONNECT.
+//
+// A client connecting with cleanSession=0 keeps its session while away:
+// its subscriptions stay in the trie, QoS 1 messages queue for it (up to
+// BROKER_OFFLINE_LIMIT) and on reconnect CONNACK reports the session as
+// present, unacknowledged messages are resent with DUP set and the queue
+// is delivered.
+//
+// Subscriptions and retained messages live in one topic trie, one node per
+// topic level. A publish resolves its topic to a route (the topic's node
+// plus every matching session, de-duplicated at the highest QoS) which is
+// cached per topic until the subscriptions change, so the steady bille/...
+// traffic costs one hash lookup per message instead of a trie walk.
+//
+// Fan-out is zero-copy: a PUBLISH is copied once out of the receive buffer
+// into a reference-counted BrokerMessage, and every delivery is a small
+// fixed header plus iovecs into that one buffer, and each client's queued
+// deliveries go out in one sendmsg. A client more than BROKER_QUEUE_LIMIT
+// bytes behind drops QoS 0 deliveries and is disconnected at four times that.
+
+#define BROKER_MAX_EVENTS     256
+#define BROKER_READ_CHUNK     65536
+#define BROKER_READ_BUDGET    (256 * 1024)     // Bytes read from one client per wakeup
+#define BROKER_QUEUE_LIMIT    (4 * 1024 * 1024)
+#define BROKER_IOV_BATCH      64
+#define BROKER_ROUTE_CACHE    65536            // Cached topics before the cache is reset
+#define BROKER_OFFLINE_LIMIT  1000             // QoS 1 messages kept for an away session; oldest dropped
+
+// One PUBLISH: [topic length][topic][payload] in a single allocation after
+// the struct, shared by the retained store, queued deliveries and QoS 1
+// messages awaiting a PUBACK
+struct BrokerMessage {
+  uint32_t refs;
+  uint16_t topicLength;
+  uint8_t qos;               // As published, capped at 1
+  uint32_t payloadLength;
+  uint8_t* bytes() { return (uint8_t*)(this + 1); }
+};
+
+struct BrokerDelivery {
+  BrokerMessage* message;    // Null for a control packet held in head
+  bool raw;                  // message holds a whole control packet (a long SUBACK)
+  uint8_t head[8];           // PUBLISH fixed header, or a whole control packet
+  uint8_t headLength;
+  uint8_t packetId[2];
+  bool hasPacketId;
+  uint32_t sent;             // Bytes of this delivery already written
+};
+
+struct BrokerSession;
+
+struct BrokerClient {
+  int fd;
+  uint32_t slot;             // Index in Broker::clients, also the epoll data
+  bool connected;            // CONNECT accepted
+  bool writable;             // False while waiting for EPOLLOUT
+  bool dirty;                // In Broker::dirty
+  bool closing;              // Closed after the current event; slow or misbehaving
+  uint16_t keepAliveSeconds;
+  uint64_t lastRxMicros;
+  std::vector<uint8_t> rx;
+  std::deque<BrokerDelivery> tx;
+  size_t queuedBytes;
+  BrokerSession* session;
+  BrokerMessage* will;       // Published unless the client sends DISCONNECT
+  bool willRetain;
+  uint64_t messagesIn;
+  uint64_t deliveries;
+  uint64_t dropped;
+};
+
+struct BrokerSubscription {
+  std::string filter;
+  uint8_t qos;
+};
+
+struct BrokerSession {
+  std::string clientId;
+  BrokerClient* client;
+  std::vector<BrokerSubscription> subscriptions;
+  uint16_t nextPacketId;
+  bool persistent;           // cleanSession=0: kept while the client is away
+  std::unordered_map<uint16_t, BrokerMessage*> inflight;   // QoS 1 sent, awaiting PUBACK
+  std::deque<BrokerMessage*> offline;                      // QoS 1 arrived while away
+  uint64_t matchEpoch;       // Route building: last publish that matched
+  uint8_t matchQos;
+};
+
+struct BrokerTopicCounters {
+  uint64_t messages;         // Published to this topic
+  uint64_t bytes;            // Payload bytes in
+  uint64_t deliveries;       // Copies sent to subscribers (not counting retained replays)
+  uint64_t dropped;          // QoS 0 copies dropped for slow subscribers
+};
+
+struct TrieSubscriber {
+  BrokerSession* session;
+  uint8_t qos;
+};
+
+struct TrieNode {
+  std::string level;
+  TrieNode* parent;
+  std::unordered_map<std::string, std::unique_ptr<TrieNode>> children;   // '+' and '#' included
+  std::vector<TrieSubscriber> subscribers;
+  BrokerMessage* retained;
+  BrokerTopicCounters counters;
+};
+
+struct BrokerRoute {
+  uint64_t generation;       // Broker::generation it was built at
+  TrieNode* node;            // The topic's own node
+  std::vector<TrieSubscriber> targets;
+};
+
+struct BrokerStats {
+  uint64_t connects;
+  uint64_t disconnects;
+  uint64_t rejected;         // CONNACK with a non-zero code
+  uint64_t messagesIn;
+  uint64_t bytesIn;          // Payload bytes
+  uint64_t deliveries;
+  uint64_t bytesOut;         // Socket bytes, all packets
+  uint64_t dropped;
+  uint64_t slowDisconnects;
+  uint64_t wills;
+  uint64_t resumed;          // Reconnects that found their session
+  uint64_t queuedOffline;    // QoS 1 copies queued for away sessions
+  uint64_t resent;           // Unacknowledged QoS 1 copies sent again on reconnect
+  uint64_t writeCalls;
+  uint64_t routeHits;
+  uint64_t routeMisses;
+};
+
+struct BrokerConfig {
+  std::string bindAddress = "0.0.0.0";
+  int port = MQTT_DEFAULT_PORT;     // 0 picks a free port (see Broker::port)
+  std::string user;                 // Empty: any credentials are accepted
+  std::string password;
+  size_t queueLimit = BROKER_QUEUE_LIMIT;
+};
+
+struct Broker {
+  BrokerConfig config;
+  int port;
+  int listenFd;
+  int epollFd;
+  std::vector<std::unique_ptr<BrokerClient>> clients;      // By slot; null when free
+  std::vector<uint32_t> freeSlots;
+  std::vector<BrokerClient*> dirty;                        // Clients with output to flush
+  std::vector<uint32_t> releasedSlots;                     // Reused once the epoll batch is done
+  std::vector<uint8_t> readBuffer;
+  std::unordered_map<std::string, std::unique_ptr<BrokerSession>> sessions;
+  TrieNode root;
+  uint64_t generation;       // Bumped when any subscription changes
+  uint64_t publishEpoch;
+  std::unordered_map<std::string, BrokerRoute> routes;
+  std::string topicScratch;
+  size_t retainedCount;
+  uint64_t lastSweepMicros;
+  uint32_t anonymousIds;
+  BrokerStats stats;
+};
+
+// Binds and listens; false (with errno) if the port cannot be opened
+bool brokerOpen(Broker& b, const BrokerConfig& config);
+// Serves events for up to timeoutMs, then flushes output and checks keep-alives
+void brokerPoll(Broker& b, int timeoutMs);
+void brokerClose(Broker& b);
+
+// Publishes from the broker itself (status topics), as if from a client
+void brokerPublish(Broker& b, const char* topic, const uint8_t* payload, size_t length, uint8_t qos = 0,
+                   bool retain = false);
+
+// Sessions matching topic with their granted QoS, from the trie (no cache)
+void brokerMatch(Broker& b, const char* topic, std::vector<TrieSubscriber>& out);
+bool brokerValidTopic(const char* topic, size_t length);
+bool brokerValidFilter(const char* filter, size_t length);
+
+struct BrokerTopicReport {
+  std::string topic;
+  BrokerTopicCounters counters;
+  bool retained;
+};
+void brokerTopics(const Broker& b, std::vector<BrokerTopicReport>& out);
+size_t brokerSubscriptionCount(const Broker& b);
+
+#endif
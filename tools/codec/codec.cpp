@@ -0,0 +1,595 @@
+/*
+===============================================================
+Bill-E Series Codec Tool
+Archives, history extraction and benchmarks for series_codec.h
+===============================================================
+
+Host side of the Gorilla-style block codec the environment monitor uses
+for its on-flash history (sketches/environment_monitor/series_codec.h):
+delta-of-delta timestamps, XOR-encoded floats, zigzag varint integers.
+
+--bench decodes bille/data/... traffic into per-series points and measures
+the codec on them: encode/decode throughput, bits per point and the ratio
+against the column store (16 bytes per point) and the JSON on the wire.
+The traffic comes from a write-ahead log captured by the aggregator
+(--wal DIR, tools/common/wal.h) or, without one, is generated with the
+firmware's payload formats and sensor behaviour. It also packs the
+environment readings the way env_history.cpp does (1 KB firmware blocks).
+
+--archive compresses one column-store series into a block file; integral
+series are stored as INT columns, the rest as DOUBLE (lossless).
+--extract prints an archive as CSV. --history prints every
+data/environment_history upload found in a captured log.
+
+BUILD (from the repository root):
+  g++ -O2 -std=c++17 -Itools/common -Isketches/main_brain -Isketches/environment_monitor \
+      -o bille-codec tools/codec/codec.cpp sketches/environment_monitor/series_codec.cpp \
+      tools/common/bille_decode.cpp tools/common/column_store.cpp tools/common/wal.cpp \
+      sketches/main_brain/biometric_batch.cpp
+
+USAGE:
+  ./bille-codec --bench                      # generated traffic, 50 desks x 24 h
+  ./bille-codec --bench --wal /var/lib/bille/wal
+  ./bille-codec --archive desk-3/environment.temperature --root /var/lib/bille --out t.bca
+  ./bille-codec --extract t.bca
+  ./bille-codec --history /var/lib/bille/wal
+  ./bille-codec --verify
+===============================================================
+*/
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "desk_topics.h"
+#include "bille_decode.h"
+#include "column_store.h"
+#include "wal.h"
+#include "series_codec.h"
+#include "verify.h"
+
+#define ARCHIVE_MAGIC        "BCA1"
+#define DEFAULT_BLOCK_BYTES  4096
+
+// Environment monitor history (env_history.h, config.h)
+#define HISTORY_COLUMNS       5
+#define HISTORY_UPLOAD_HEADER 12
+#define FIRMWARE_BLOCK_BYTES  1024    // ENV_HISTORY_BLOCK_SIZE
+#define FIRMWARE_RECORD_SIZE  24      // sizeof(EnvironmentData) on the ESP8266
+#define COLUMN_POINT_SIZE    16       // int64 time + double value in the column store
+
+struct Options {
+  bool bench = false;
+  bool verify = false;
+  std::string wal;
+  std::string root = "bille-data";
+  std::string archive;
+  std::string out;
+  std::string extract;
+  std::string history;
+  int desks = 50;
+  double hours = 24;
+  size_t blockBytes = DEFAULT_BLOCK_BYTES;
+};
+
+struct Series {
+  std::vector<int64_t> times;
+  std::vector<double> values;
+};
+
+static Options opts;
+
+static uint64_t nowMicros() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static bool isIntegral(const std::vector<double>& values) {
+  for (double v : values) {
+    if (!(fabs(v) < 9.0e15) || v != floor(v)) return false;
+  }
+  return true;
+}
+
+// Encodes one series into blocks of at most blockBytes; returns encoded bytes
+static size_t encodeSeries(const Series& s, uint8_t type, size_t blockBytes, std::vector<uint8_t>& out) {
+  std::vector<uint8_t> block(blockBytes);
+  size_t total = 0;
+  size_t i = 0;
+  while (i < s.times.size()) {
+    CodecWriter w;
+    codecBegin(w, block.data(), block.size(), 1, &type);
+    while (i < s.times.size() && codecAdd(w, s.times[i], &s.values[i])) i++;
+    size_t length = codecFinish(w);
+    uint32_t length32 = (uint32_t)length;
+    out.insert(out.end(), (uint8_t*)&length32, (uint8_t*)&length32 + 4);
+    out.insert(out.end(), block.begin(), block.begin() + length);
+    total += length;
+    if (w.count == 0) break;  // blockBytes too small for one point
+  }
+  return total;
+}
+
+// Walks length-prefixed blocks; false on a malformed block
+static bool decodeBlocks(const uint8_t* data, size_t length, Series& out) {
+  size_t pos = 0;
+  while (pos + 4 <= length) {
+    uint32_t blockLength;
+    memcpy(&blockLength, data + pos, 4);
+    pos += 4;
+    if (blockLength > length - pos) return false;
+    CodecReader r;
+    if (!codecOpen(r, data + pos, blockLength) || r.columns != 1) return false;
+    int64_t t;
+    double v;
+    while (codecNext(r, t, &v)) {
+      out.times.push_back(t);
+      out.values.push_back(v);
+    }
+    if (r.index != r.count) return false;
+    pos += blockLength;
+  }
+  return pos == length;
+}
+
+// ---- Traffic -----------------------------------------------------------
+
+struct Traffic {
+  std::map<std::string, Series> series;
+  uint64_t messages;
+  uint64_t jsonBytes;           // Wire size of the JSON payloads
+  uint64_t jsonPoints;
+  std::vector<std::vector<double>> envRows;  // Desk 0 readings as the firmware holds them
+  std::vector<int64_t> envTimes;
+};
+
+static void addPoint(void* context, int desk, const char* metric, int64_t timeMs, double value) {
+  Traffic& t = *(Traffic*)context;
+  Series& s = t.series[columnSeriesName(desk, metric)];
+  s.times.push_back(timeMs);
+  s.values.push_back(value);
+}
+
+static void ingest(Traffic& t, const char* topic, size_t topicLength, const uint8_t* payload, size_t length,
+                   int64_t receivedMs) {
+  int points = billeDecode(topic, topicLength, payload, length, receivedMs, addPoint, &t);
+  if (points < 0) return;
+  t.messages++;
+  if (length && payload[0] == '{') {
+    t.jsonBytes += length;
+    t.jsonPoints += points;
+  }
+}
+
+static bool walRecord(void* context, const WalRecord& record) {
+  ingest(*(Traffic*)context, record.topic, record.topicLength, record.payload, record.length, record.receivedMs);
+  return true;
+}
+
+// Simple LCG so runs are reproducible
+static uint32_t randomState = 12345;
+static double uniform() {
+  randomState = randomState * 1664525u + 1013904223u;
+  return (randomState >> 8) / 16777216.0;
+}
+
+// Environment readings and wearable summaries as the firmware publishes
+// them: 10 s readings with loop jitter, DHT values at 0.1 C / 1 %, lux and
+// noise from the analog front end, a step count that only grows
+static void generateTraffic(Traffic& t, int desks, double hours) {
+  const int64_t start = 1760000000000LL;
+  const int64_t end = start + (int64_t)(hours * 3600000);
+  char json[400];
+  for (int desk = 0; desk < desks; desk++) {
+    std::string envTopic = deskTopic(desk, "data/environment");
+    std::string bioTopic = deskTopic(desk, "data/biometric");
+    double temperature = 21 + desk % 4, humidity = 45, lux = 300;
+    uint32_t millisNow = 5000 + desk * 137;
+    uint32_t steps = 0, nextBio = 60000;
+    for (int64_t now = start; now < end;) {
+      int step = 10001 + (int)(uniform() * 30);
+      now += step;
+      millisNow += step;
+      temperature += (uniform() - 0.5) * 0.06;
+      humidity += (uniform() - 0.5) * 0.2;
+      lux += (uniform() - 0.5) * 8;
+      if (lux < 5) lux = 5;
+      double shownTemp = round(temperature * 10) / 10, shownHumidity = round(humidity);
+      int noise = 30 + (int)(uniform() * 12);
+      bool sound = uniform() < 0.05;
+      snprintf(json, sizeof(json), "{\"nodeType\":\"ENVIRONMENT\",\"timestamp\":%u,\"temperature\":%g,"
+               "\"humidity\":%g,\"lightLevel\":%d,\"noiseLevel\":%d,\"soundDetected\":%s}",
+               millisNow, shownTemp, shownHumidity, (int)lux, noise, sound ? "true" : "false");
+      ingest(t, envTopic.c_str(), envTopic.size(), (const uint8_t*)json, strlen(json), now);
+      if (desk == 0) {
+        t.envRows.push_back({shownTemp, shownHumidity, (double)(int)lux, (double)noise, sound ? 1.0 : 0.0});
+        t.envTimes.push_back(millisNow);
+      }
+
+      if (millisNow >= nextBio) {
+        nextBio += 60000;
+        bool walking = uniform() < 0.15;
+        if (walking) steps += 40 + (int)(uniform() * 60);
+        snprintf(json, sizeof(json), "{\"nodeType\":\"WEARABLE\",\"timestamp\":%u,\"activity\":\"%s\","
+                 "\"stepCount\":%u,\"acceleration\":%.2f,\"lastMovement\":%u,\"sessionActive\":true,"
+                 "\"currentUser\":\"A1B2C3D4\",\"pomodoroState\":1,\"pomodoroTimeRemaining\":840}",
+                 millisNow, walking ? "Walking" : "Sitting", steps, walking ? 1.1 + uniform() * 0.3 : 1.0,
+                 walking ? millisNow : millisNow - 30000);
+        ingest(t, bioTopic.c_str(), bioTopic.size(), (const uint8_t*)json, strlen(json), now);
+      }
+    }
+  }
+}
+
+// ---- Bench -------------------------------------------------------------
+
+static std::string metricOf(const std::string& series) {
+  size_t slash = series.find('/');
+  return slash == std::string::npos ? series : series.substr(slash + 1);
+}
+
+struct MetricTotals {
+  uint64_t points;
+  uint64_t encoded;
+};
+
+static int runBench() {
+  Traffic traffic = {};
+  if (!opts.wal.empty()) {
+    if (walReplay(opts.wal.c_str(), 1, walRecord, &traffic) == 0) {
+      fprintf(stderr, "codec: no records in %s\n", opts.wal.c_str());
+      return 1;
+    }
+  } else {
+    generateTraffic(traffic, opts.desks, opts.hours);
+  }
+
+  uint64_t points = 0;
+  std::vector<uint8_t> types;
+  for (auto& entry : traffic.series) {
+    points += entry.second.times.size();
+    types.push_back(isIntegral(entry.second.values) ? CODEC_INT : CODEC_DOUBLE);
+  }
+
+  // Encode everything, then decode and compare
+  std::vector<std::vector<uint8_t>> encoded(traffic.series.size());
+  uint64_t encodedBytes = 0;
+  uint64_t start = nowMicros();
+  size_t n = 0;
+  for (auto& entry : traffic.series) {
+    encodedBytes += encodeSeries(entry.second, types[n], opts.blockBytes, encoded[n]);
+    n++;
+  }
+  double encodeS = (nowMicros() - start) / 1e6;
+
+  bool exact = true;
+  start = nowMicros();
+  n = 0;
+  for (auto& entry : traffic.series) {
+    Series back;
+    back.times.reserve(entry.second.times.size());
+    back.values.reserve(entry.second.values.size());
+    exact = decodeBlocks(encoded[n].data(), encoded[n].size(), back) && exact;
+    exact = exact && back.times == entry.second.times && back.values == entry.second.values;
+    n++;
+  }
+  double decodeS = (nowMicros() - start) / 1e6;
+
+  std::map<std::string, MetricTotals> metrics;
+  n = 0;
+  for (auto& entry : traffic.series) {
+    MetricTotals& m = metrics[metricOf(entry.first)];
+    m.points += entry.second.times.size();
+    m.encoded += encoded[n].size() - 4 * (encoded[n].size() ? 1 : 0);
+    n++;
+  }
+
+  // Firmware history: desk 0's readings in 1 KB blocks of five columns
+  static const uint8_t envTypes[HISTORY_COLUMNS] = {CODEC_FLOAT, CODEC_FLOAT, CODEC_INT, CODEC_INT, CODEC_INT};
+  uint8_t block[FIRMWARE_BLOCK_BYTES];
+  size_t envBlocks = 0, envBytes = 0;
+  for (size_t i = 0; i < traffic.envRows.size();) {
+    CodecWriter w;
+    codecBegin(w, block, sizeof(block), HISTORY_COLUMNS, envTypes);
+    while (i < traffic.envRows.size() && codecAdd(w, traffic.envTimes[i], traffic.envRows[i].data())) i++;
+    envBytes += codecFinish(w);
+    envBlocks++;
+  }
+
+  double rawMb = points * (double)COLUMN_POINT_SIZE / 1048576.0;
+  printf("{\"source\": \"%s\", \"messages\": %" PRIu64 ", \"series\": %zu, \"points\": %" PRIu64 ", "
+         "\"rawBytes\": %" PRIu64 ", \"encodedBytes\": %" PRIu64 ", \"ratio\": %.2f, \"bitsPerPoint\": %.2f, "
+         "\"jsonBytesPerPoint\": %.1f, \"ratioVsJson\": %.1f, \"encodeMPointsPerS\": %.1f, "
+         "\"encodeRawMBPerS\": %.0f, \"decodeMPointsPerS\": %.1f, \"lossless\": %s",
+         opts.wal.empty() ? "generated" : opts.wal.c_str(), traffic.messages, traffic.series.size(), points,
+         points * COLUMN_POINT_SIZE, encodedBytes, (double)points * COLUMN_POINT_SIZE / encodedBytes,
+         encodedBytes * 8.0 / points, traffic.jsonPoints ? (double)traffic.jsonBytes / traffic.jsonPoints : 0.0,
+         traffic.jsonPoints ? (double)traffic.jsonBytes / traffic.jsonPoints / (encodedBytes / (double)points) : 0.0,
+         points / encodeS / 1e6, rawMb / encodeS, points / decodeS / 1e6, exact ? "true" : "false");
+  if (envBlocks) {
+    printf(", \"firmwareHistory\": {\"readings\": %zu, \"blocks\": %zu, \"readingsPerBlock\": %.0f, "
+           "\"bytesPerReading\": %.2f, \"ratio\": %.1f}",
+           traffic.envRows.size(), envBlocks, (double)traffic.envRows.size() / envBlocks,
+           (double)envBytes / traffic.envRows.size(),
+           (double)traffic.envRows.size() * FIRMWARE_RECORD_SIZE / envBytes);
+  }
+  printf(", \"metrics\": {");
+  bool first = true;
+  for (auto& entry : metrics) {
+    printf("%s\"%s\": {\"points\": %" PRIu64 ", \"bitsPerPoint\": %.2f}", first ? "" : ", ", entry.first.c_str(),
+           entry.second.points, entry.second.encoded * 8.0 / entry.second.points);
+    first = false;
+  }
+  printf("}}\n");
+  return exact ? 0 : 1;
+}
+
+// ---- Archives ----------------------------------------------------------
+
+static bool collect(void* context, const int64_t* times, const double* values, size_t count) {
+  Series& s = *(Series*)context;
+  s.times.insert(s.times.end(), times, times + count);
+  s.values.insert(s.values.end(), values, values + count);
+  return true;
+}
+
+static int runArchive() {
+  Series s;
+  if (!columnStoreScan(opts.root.c_str(), opts.archive, INT64_MIN, INT64_MAX, collect, &s)) {
+    fprintf(stderr, "codec: no series %s under %s\n", opts.archive.c_str(), opts.root.c_str());
+    return 1;
+  }
+  std::vector<uint8_t> blocks;
+  uint8_t type = isIntegral(s.values) ? CODEC_INT : CODEC_DOUBLE;
+  size_t encoded = encodeSeries(s, type, opts.blockBytes, blocks);
+
+  FILE* f = fopen(opts.out.c_str(), "wb");
+  if (!f) {
+    fprintf(stderr, "codec: cannot write %s\n", opts.out.c_str());
+    return 1;
+  }
+  uint16_t nameLength = (uint16_t)opts.archive.size();
+  bool ok = fwrite(ARCHIVE_MAGIC, 4, 1, f) == 1 && fwrite(&nameLength, 2, 1, f) == 1 &&
+            fwrite(opts.archive.data(), nameLength, 1, f) == 1 &&
+            (blocks.empty() || fwrite(blocks.data(), blocks.size(), 1, f) == 1);
+  ok = fclose(f) == 0 && ok;
+  if (!ok) return 1;
+  fprintf(stderr, "codec: %zu points, %zu -> %zu bytes (%.1fx, %s)\n", s.times.size(),
+          s.times.size() * COLUMN_POINT_SIZE, encoded,
+          encoded ? (double)s.times.size() * COLUMN_POINT_SIZE / encoded : 0.0,
+          type == CODEC_INT ? "int" : "double");
+  return 0;
+}
+
+static int runExtract() {
+  FILE* f = fopen(opts.extract.c_str(), "rb");
+  if (!f) {
+    fprintf(stderr, "codec: cannot read %s\n", opts.extract.c_str());
+    return 1;
+  }
+  std::vector<uint8_t> data;
+  uint8_t chunk[65536];
+  size_t got;
+  while ((got = fread(chunk, 1, sizeof(chunk), f)) > 0) data.insert(data.end(), chunk, chunk + got);
+  fclose(f);
+
+  uint16_t nameLength = 0;
+  if (data.size() < 6 || memcmp(data.data(), ARCHIVE_MAGIC, 4) != 0) {
+    fprintf(stderr, "codec: %s is not an archive\n", opts.extract.c_str());
+    return 1;
+  }
+  memcpy(&nameLength, data.data() + 4, 2);
+  size_t offset = 6 + nameLength;
+  Series s;
+  if (offset > data.size() || !decodeBlocks(data.data() + offset, data.size() - offset, s)) {
+    fprintf(stderr, "codec: %s is damaged\n", opts.extract.c_str());
+    return 1;
+  }
+  printf("timeMs,value\n");
+  for (size_t i = 0; i < s.times.size(); i++) printf("%" PRId64 ",%.17g\n", s.times[i], s.values[i]);
+  return 0;
+}
+
+// Environment history uploads found in a captured log, as CSV
+static bool printHistory(void*, const WalRecord& record) {
+  const char* suffix;
+  size_t suffixLength;
+  int desk = deskFromTopic(record.topic, record.topicLength, &suffix, &suffixLength);
+  if (desk < 0 || suffixLength != strlen("data/environment_history") ||
+      memcmp(suffix, "data/environment_history", suffixLength) != 0 ||
+      record.length < HISTORY_UPLOAD_HEADER) {
+    return true;
+  }
+  uint32_t seq, uploadMillis;
+  uint16_t blockBoot, currentBoot;
+  memcpy(&seq, record.payload, 4);
+  memcpy(&blockBoot, record.payload + 4, 2);
+  memcpy(&currentBoot, record.payload + 6, 2);
+  memcpy(&uploadMillis, record.payload + 8, 4);
+
+  CodecReader r;
+  if (!codecOpen(r, record.payload + HISTORY_UPLOAD_HEADER, record.length - HISTORY_UPLOAD_HEADER) ||
+      r.columns != HISTORY_COLUMNS) {
+    fprintf(stderr, "codec: bad history block %u from desk %d\n", seq, desk);
+    return true;
+  }
+  int64_t t;
+  double v[HISTORY_COLUMNS];
+  bool sameBoot = blockBoot == currentBoot;
+  while (codecNext(r, t, v)) {
+    // Same boot: millis() maps to wall clock through the upload time
+    int64_t time = sameBoot ? record.receivedMs - (int64_t)(uint32_t)(uploadMillis - (uint32_t)t) : t;
+    printf("%d,%u,%u,%d,%" PRId64 ",%.1f,%.1f,%.0f,%.0f,%.0f\n", desk, blockBoot, seq, sameBoot ? 1 : 0, time,
+           v[0], v[1], v[2], v[3], v[4]);
+  }
+  return true;
+}
+
+static int runHistory() {
+  printf("desk,boot,block,wallClock,timeMs,temperature,humidity,lightLevel,noiseLevel,soundDetected\n");
+  walReplay(opts.history.c_str(), 1, printHistory, nullptr);
+  return 0;
+}
+
+// ---- Self-check --------------------------------------------------------
+
+static bool sameBits(double a, double b) {
+  return memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+static bool roundTrip(const Series& s, uint8_t type, size_t blockBytes) {
+  std::vector<uint8_t> blocks;
+  encodeSeries(s, type, blockBytes, blocks);
+  Series back;
+  if (!decodeBlocks(blocks.data(), blocks.size(), back) || back.times != s.times) return false;
+  for (size_t i = 0; i < s.values.size(); i++) {
+    double expected = type == CODEC_FLOAT ? (double)(float)s.values[i]
+                    : type == CODEC_INT ? (double)llround(s.values[i]) : s.values[i];
+    if (!sameBits(back.values[i], expected)) return false;
+  }
+  return true;
+}
+
+static int runVerify() {
+  // Edge values: signed zeros, NaN, infinities, denormals, extremes
+  Series edge;
+  const double specials[] = {0.0, -0.0, NAN, INFINITY, -INFINITY, 5e-324, 1.7976931348623157e308, -999, 22.5, 22.5};
+  int64_t t = -5000;
+  for (int i = 0; i < 200; i++) {
+    t += i % 7 == 0 ? 10000 : i % 11 == 0 ? -3 : i % 13 == 0 ? 5000000000LL : 10000 + i % 3;
+    edge.times.push_back(t);
+    edge.values.push_back(specials[i % 10]);
+  }
+  check(roundTrip(edge, CODEC_DOUBLE, 4096), "double round trip");
+  check(roundTrip(edge, CODEC_FLOAT, 4096), "float round trip");
+  check(roundTrip(edge, CODEC_DOUBLE, 64), "small blocks split cleanly");
+
+  // Times spanning every delta-of-delta bucket, including the 64-bit escape
+  Series times;
+  const int64_t dods[] = {0, 1, -63, 64, 65, -255, 256, 257, -2047, 2048, 2049, -2147483647LL, 2147483648LL,
+                          2147483649LL, INT64_C(-9000000000000000000)};
+  int64_t delta = 0;
+  t = INT64_C(4000000000000000000);
+  for (int64_t dod : dods) {
+    delta += dod;
+    t += delta;
+    times.times.push_back(t);
+    times.values.push_back(1);
+  }
+  check(roundTrip(times, CODEC_INT, 4096), "timestamp buckets");
+
+  // Integers: step counts, resets, large jumps
+  Series ints;
+  const double steps[] = {0, 5, 5, 120, 0, -7, 4294967295.0, 1e15, -1e15, 3};
+  for (int i = 0; i < 10; i++) {
+    ints.times.push_back(i * 60000);
+    ints.values.push_back(steps[i]);
+  }
+  check(roundTrip(ints, CODEC_INT, 4096), "int round trip");
+
+  // A full writer is left unchanged and still decodes
+  uint8_t block[64];
+  uint8_t type = CODEC_DOUBLE;
+  CodecWriter w;
+  check(codecBegin(w, block, sizeof(block), 1, &type), "begin");
+  double v = 1.25;
+  int added = 0;
+  while (codecAdd(w, added * 10000, &v)) {
+    v += 0.37;
+    added++;
+  }
+  size_t length = codecFinish(w);
+  CodecReader r;
+  check(codecOpen(r, block, length) && r.count == added, "full block header");
+  int64_t rt;
+  double rv;
+  int read = 0;
+  while (codecNext(r, rt, &rv)) read++;
+  check(read == added, "full block decodes");
+  check(!codecOpen(r, block, 5), "short header rejected");
+  check(codecOpen(r, block, length - 1), "truncated block opens");
+  read = 0;
+  while (codecNext(r, rt, &rv)) read++;
+  check(read < added, "truncated block stops early");
+
+  // Regular sensor data compresses
+  Traffic traffic = {};
+  generateTraffic(traffic, 1, 6);
+  const Series& temperature = traffic.series["desk-0/environment.temperature"];
+  std::vector<uint8_t> blocks;
+  size_t bytes = encodeSeries(temperature, CODEC_DOUBLE, 4096, blocks);
+  check(temperature.times.size() > 2000 && bytes * 8.0 / temperature.times.size() < 24, "temperature compresses");
+  check(roundTrip(temperature, CODEC_DOUBLE, 4096), "generated series round trip");
+
+  if (verifyFailures) {
+    fprintf(stderr, "verify: %d check(s) failed\n", verifyFailures);
+    return 1;
+  }
+  printf("verify: ok\n");
+  return 0;
+}
+
+// ---- Main --------------------------------------------------------------
+
+static void usage() {
+  fprintf(stderr,
+          "usage: bille-codec MODE [options]\n"
+          "  --bench                     codec throughput and ratio on bille/data/... traffic\n"
+          "    --wal DIR                 captured traffic (aggregator log), default: generated\n"
+          "    --desks N / --hours H     generated traffic size (default 50 x 24)\n"
+          "    --block BYTES             block size (default %d)\n"
+          "  --archive SERIES --out FILE compress a column-store series (--root DIR)\n"
+          "  --extract FILE              print an archive as CSV\n"
+          "  --history DIR               print environment history uploads in a captured log\n"
+          "  --verify                    codec self-check\n",
+          DEFAULT_BLOCK_BYTES);
+}
+
+static bool parseArgs(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    if (a == "--bench") {
+      opts.bench = true;
+      continue;
+    }
+    if (a == "--verify") {
+      opts.verify = true;
+      continue;
+    }
+    if (i + 1 >= argc) return false;
+    const char* v = argv[++i];
+    if (a == "--wal") opts.wal = v;
+    else if (a == "--root") opts.root = v;
+    else if (a == "--archive") opts.archive = v;
+    else if (a == "--out") opts.out = v;
+    else if (a == "--extract") opts.extract = v;
+    else if (a == "--history") opts.history = v;
+    else if (a == "--desks") opts.desks = atoi(v);
+    else if (a == "--hours") opts.hours = atof(v);
+    else if (a == "--block") opts.blockBytes = atol(v);
+    else return false;
+  }
+  if (!opts.archive.empty() && opts.out.empty()) return false;
+  return opts.desks > 0 && opts.hours > 0 && opts.blockBytes >= 64 &&
+         (opts.bench || opts.verify || !opts.archive.empty() || !opts.extract.empty() || !opts.history.empty());
+}
+
+int main(int argc, char** argv) {
+  if (!parseArgs(argc, argv)) {
+    usage();
+    return 2;
+  }
+  if (opts.verify) return runVerify();
+  if (opts.bench) return runBench();
+  if (!opts.archive.empty()) return runArchive();
+  if (!opts.extract.empty()) return runExtract();
+  return runHistory();
+}
@@ -0,0 +1,282 @@
+#include "bille_decode.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "desk_topics.h"
+#include "biometric_batch.h"
+
+struct FieldMap {
+  const char* key;
+  const char* metric;
+};
+
+struct TopicMap {
+  const char* suffix;
+  const FieldMap* fields;
+};
+
+static const FieldMap environmentFields[] = {
+  {"temperature", "environment.temperature"},
+  {"humidity", "environment.humidity"},
+  {"lightLevel", "environment.lightLevel"},
+  {"noiseLevel", "environment.noiseLevel"},
+  {"soundDetected", "environment.soundDetected"},
+  {nullptr, nullptr}
+};
+
+static const FieldMap biometricFields[] = {
+  {"stepCount", "biometric.stepCount"},
+  {"acceleration", "biometric.acceleration"},
+  {"activity", "biometric.activity"},
+  {"sessionActive", "biometric.sessionActive"},
+  {nullptr, nullptr}
+};
+
+static const FieldMap pomodoroFields[] = {
+  {"state", "pomodoro.state"},
+  {"timeRemaining", "pomodoro.timeRemaining"},
+  {"completedCycles", "pomodoro.completedCycles"},
+  {"snoozeCount", "pomodoro.snoozeCount"},
+  {nullptr, nullptr}
+};
+
+static const FieldMap sessionFields[] = {
+  {"active", "session.active"},
+  {"sessionDuration", "session.durationSeconds"},
+  {"userId", "session.user"},
+  {nullptr, nullptr}
+};
+
+static const FieldMap systemFields[] = {
+  {"environmentDataAge", "system.environmentDataAge"},
+  {"biometricDataAge", "system.biometricDataAge"},
+  {"logDroppedBytes", "system.logDroppedBytes"},
+  {"bioBatches", "system.bioBatches"},
+  {"bioBatchGaps", "system.bioBatchGaps"},
+  {"bioBatchRestarts", "system.bioBatchRestarts"},
+  {nullptr, nullptr}
+};
+
+static const TopicMap jsonTopics[] = {
+  {"data/environment", environmentFields},
+  {"data/biometric", biometricFields},
+  {"pomodoro/state", pomodoroFields},
+  {"session/state", sessionFields},
+  {"status/system", systemFields},
+};
+
+static const char* activityNames[] = {"Sitting", "Still", "Moving", "Walking", "Running"};
+
+int billeActivityCode(const char* name, size_t length) {
+  for (int i = 0; i < (int)(sizeof(activityNames) / sizeof(activityNames[0])); i++) {
+    if (strlen(activityNames[i]) == length && memcmp(activityNames[i], name, length) == 0) return i;
+  }
+  return BILLE_ACTIVITY_UNKNOWN;
+}
+
+// ---- Flat JSON walk ----------------------------------------------------
+
+uint32_t billeUserCode(const char* id, size_t length) {
+  if (length == 0) return 0;
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < length; i++) hash = (hash ^ (uint8_t)id[i]) * 16777619u;
+  return hash ? hash : 1;
+}
+
+static size_t skipSpace(const char* s, size_t pos, size_t length) {
+  while (pos < length && (s[pos] == ' ' || s[pos] == '\t' || s[pos] == '\n' || s[pos] == '\r')) pos++;
+  return pos;
+}
+
+// pos at the opening quote; returns the index after the closing quote, 0 if unterminated
+static size_t skipString(const char* s, size_t pos, size_t length) {
+  for (pos++; pos < length; pos++) {
+    if (s[pos] == '\\') pos++;
+    else if (s[pos] == '"') return pos + 1;
+  }
+  return 0;
+}
+
+static size_t skipNested(const char* s, size_t pos, size_t length) {
+  int depth = 0;
+  while (pos < length) {
+    char c = s[pos];
+    if (c == '"') {
+      pos = skipString(s, pos, length);
+      if (!pos) return 0;
+      continue;
+    }
+    if (c == '{' || c == '[') depth++;
+    if (c == '}' || c == ']') {
+      if (--depth == 0) return pos + 1;
+    }
+    pos++;
+  }
+  return 0;
+}
+
+bool jsonWalk(const char* json, size_t length, JsonVisitor visit, void* context) {
+  size_t pos = skipSpace(json, 0, length);
+  if (pos >= length || json[pos] != '{') return false;
+  pos = skipSpace(json, pos + 1, length);
+  if (pos < length && json[pos] == '}') return true;
+
+  while (pos < length) {
+    if (json[pos] != '"') return false;
+    size_t keyEnd = skipString(json, pos, length);
+    if (!keyEnd) return false;
+    const char* key = json + pos + 1;
+    size_t keyLength = keyEnd - pos - 2;
+
+    pos = skipSpace(json, keyEnd, length);
+    if (pos >= length || json[pos] != ':') return false;
+    pos = skipSpace(json, pos + 1, length);
+    if (pos >= length) return false;
+
+    size_t valueStart = pos;
+    if (json[pos] == '"') {
+      pos = skipString(json, pos, length);
+      if (!pos) return false;
+      visit(context, key, keyLength, json + valueStart + 1, pos - valueStart - 2, true);
+    } else if (json[pos] == '{' || json[pos] == '[') {
+      pos = skipNested(json, pos, length);
+      if (!pos) return false;
+    } else {
+      while (pos < length && json[pos] != ',' && json[pos] != '}' && json[pos] != ' ') pos++;
+      visit(context, key, keyLength, json + valueStart, pos - valueStart, false);
+    }
+
+    pos = skipSpace(json, pos, length);
+    if (pos >= length) return false;
+    if (json[pos] == '}') return true;
+    if (json[pos] != ',') return false;
+    pos = skipSpace(json, pos + 1, length);
+  }
+  return false;
+}
+
+// ---- Decoding ----------------------------------------------------------
+
+struct DecodeContext {
+  const FieldMap* fields;
+  int desk;
+  int64_t receivedMs;
+  MetricSink sink;
+  void* sinkContext;
+  int points;
+  double timestamp;       // Wearable JSON: derive idleSeconds
+  double lastMovement;
+  bool hasTimestamp;
+  bool hasLastMovement;
+};
+
+static bool parseNumber(const char* value, size_t length, double& out) {
+  if (length == 4 && memcmp(value, "true", 4) == 0) {
+    out = 1;
+    return true;
+  }
+  if (length == 5 && memcmp(value, "false", 5) == 0) {
+    out = 0;
+    return true;
+  }
+  char buf[32];
+  if (length == 0 || length >= sizeof(buf)) return false;
+  memcpy(buf, value, length);
+  buf[length] = '\0';
+  char* end;
+  out = strtod(buf, &end);
+  return end == buf + length;
+}
+
+static bool keyIs(const char* key, size_t keyLength, const char* name) {
+  return strlen(name) == keyLength && memcmp(key, name, keyLength) == 0;
+}
+
+static void onJsonField(void* context, const char* key, size_t keyLength,
+                        const char* value, size_t valueLength, bool isString) {
+  DecodeContext& ctx = *(DecodeContext*)context;
+  double number;
+
+  if (!isString && keyIs(key, keyLength, "timestamp")) {
+    ctx.hasTimestamp = parseNumber(value, valueLength, ctx.timestamp);
+  } else if (!isString && keyIs(key, keyLength, "lastMovement")) {
+    ctx.hasLastMovement = parseNumber(value, valueLength, ctx.lastMovement);
+  }
+
+  for (const FieldMap* f = ctx.fields; f->key; f++) {
+    if (!keyIs(key, keyLength, f->key)) continue;
+    if (isString && keyIs(key, keyLength, "userId")) {
+      number = billeUserCode(value, valueLength);
+    } else if (isString) {
+      int code = billeActivityCode(value, valueLength);
+      if (code == BILLE_ACTIVITY_UNKNOWN) return;
+      number = code;
+    } else if (!parseNumber(value, valueLength, number)) {
+      return;
+    }
+    ctx.sink(ctx.sinkContext, ctx.desk, f->metric, ctx.receivedMs, number);
+    ctx.points++;
+    return;
+  }
+}
+
+static int decodeBatch(int desk, const uint8_t* payload, size_t length, int64_t receivedMs,
+                       MetricSink sink, void* context) {
+  BatchReader reader;
+  if (!batchOpen(reader, payload, length)) return 0;
+  BatchRecord records[256];
+  int count = 0;
+  while (count < 256 && batchNext(reader, records[count])) count++;
+  if (count == 0) return 0;
+
+  // The last sample was taken just before the upload window opened
+  uint32_t newest = records[count - 1].timestamp;
+  for (int i = 0; i < count; i++) {
+    const BatchRecord& r = records[i];
+    int64_t t = receivedMs - (int64_t)(uint32_t)(newest - r.timestamp);
+    sink(context, desk, "wearable.accel", t, r.accelMg / 1000.0);
+    sink(context, desk, "wearable.steps", t, r.steps);
+    sink(context, desk, "wearable.activity", t, r.activity);
+    sink(context, desk, "wearable.idleSeconds", t, r.idleSeconds);
+  }
+  return count * 4;
+}
+
+bool billeIsCriticalTopic(const char* topic, size_t topicLength) {
+  const char* suffix;
+  size_t suffixLength;
+  if (deskFromTopic(topic, topicLength, &suffix, &suffixLength) < 0) return false;
+  return keyIs(suffix, suffixLength, "session/state") || keyIs(suffix, suffixLength, "pomodoro/state");
+}
+
+int billeDecode(const char* topic, size_t topicLength, const uint8_t* payload, size_t length,
+                int64_t receivedMs, MetricSink sink, void* context) {
+  const char* suffix;
+  size_t suffixLength;
+  int desk = deskFromTopic(topic, topicLength, &suffix, &suffixLength);
+  if (desk < 0) return -1;
+
+  if (keyIs(suffix, suffixLength, "data/biometric_batch")) {
+    return decodeBatch(desk, payload, length, receivedMs, sink, context);
+  }
+
+  for (const TopicMap& t : jsonTopics) {
+    if (!keyIs(suffix, suffixLength, t.suffix)) continue;
+    DecodeContext ctx = {};
+    ctx.fields = t.fields;
+    ctx.desk = desk;
+    ctx.receivedMs = receivedMs;
+    ctx.sink = sink;
+    ctx.sinkContext = context;
+    if (!jsonWalk((const char*)payload, length, onJsonField, &ctx)) return ctx.points;
+
+    if (t.fields == biometricFields && ctx.hasTimestamp && ctx.hasLastMovement &&
+        ctx.timestamp >= ctx.lastMovement) {
+      sink(context, desk, "biometric.idleSeconds", receivedMs, (ctx.timestamp - ctx.lastMovement) / 1000.0);
+      ctx.points++;
+    }
+    return ctx.points;
+  }
+  return -1;
+}
@@ -0,0 +1,44 @@
+#ifndef BILLE_DECODE_H
+#define BILLE_DECODE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Turns Bill-E node payloads into (desk, metric, time, value) points for the
+// host tools. Handled topics, per desk (desk_topics.h):
+//   data/environment      environment.temperature/humidity/lightLevel/noiseLevel/soundDetected
+//   data/biometric        biometric.stepCount/acceleration/activity/idleSeconds/sessionActive
+//   data/biometric_batch  wearable.accel/steps/activity/idleSeconds, one point per sample
+//   pomodoro/state        pomodoro.state/timeRemaining/completedCycles/snoozeCount
+//   session/state         session.active/durationSeconds/user
+//   status/system         system.environmentDataAge/biometricDataAge/logDroppedBytes/bioBatches/bioBatchGaps/bioBatchRestarts
+// Node timestamps are device millis(), so points are stamped with the
+// receive time; batch samples are placed behind it by their millis() spacing.
+
+#define BILLE_ACTIVITY_UNKNOWN -1
+
+typedef void (*MetricSink)(void* context, int desk, const char* metric, int64_t timeMs, double value);
+
+// Number of points emitted, or -1 if the topic is not one we keep
+int billeDecode(const char* topic, size_t topicLength, const uint8_t* payload, size_t length,
+                int64_t receivedMs, MetricSink sink, void* context);
+
+// Topics whose loss would corrupt session history (session start/stop and
+// Pomodoro transitions); collectors make these durable before acknowledging
+bool billeIsCriticalTopic(const char* topic, size_t topicLength);
+
+// Activity names as published by the wearable (activity_classifier.h order)
+int billeActivityCode(const char* name, size_t length);
+
+// RFID user ids (the card UID as hex) as a store value: FNV-1a, 0 for no user.
+// Exact in a double, so session.user points compare equal to the code.
+uint32_t billeUserCode(const char* id, size_t length);
+
+// Flat JSON object walk: calls visit for each key with the raw value text
+// (strings without quotes). Nested values are skipped. Returns false on
+// malformed input.
+typedef void (*JsonVisitor)(void* context, const char* key, size_t keyLength,
+                            const char* value, size_t valueLength, bool isString);
+bool jsonWalk(const char* json, size_t length, JsonVisitor visit, void* context);
+
+#endif
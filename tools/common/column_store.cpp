@@ -0,0 +1,633 @@
+#include "column_store.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <float.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#define SEGMENT_FILE_SIZE (SEGMENT_HEADER_SIZE + (size_t)SEGMENT_CAPACITY * (sizeof(int64_t) + sizeof(double)))
+#define INDEX_FILE "segments.idx"
+#define CHECKPOINT_FILE "checkpoint"
+#define BASELINE_FILE "baselines"
+#define SEGMENT_PAGE_SIZE 4096
+
+std::string columnSeriesName(int desk, const char* metric) {
+  char prefix[24];
+  snprintf(prefix, sizeof(prefix), "desk-%d/", desk);
+  return std::string(prefix) + metric;
+}
+
+static std::string segmentPath(const std::string& dir, uint32_t id) {
+  char name[32];
+  snprintf(name, sizeof(name), "/seg-%06u.col", id);
+  return dir + name;
+}
+
+static void syncDir(const std::string& dir) {
+  int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+  if (fd >= 0) {
+    fsync(fd);
+    close(fd);
+  }
+}
+
+static std::string parentDir(const std::string& path) {
+  size_t slash = path.find_last_of('/');
+  return slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+}
+
+// New directories are synced into their parent so they survive power loss
+static bool makeDirs(const std::string& path) {
+  for (size_t pos = 1; pos <= path.size(); pos++) {
+    if (pos < path.size() && path[pos] != '/') continue;
+    std::string part = path.substr(0, pos);
+    if (mkdir(part.c_str(), 0755) == 0) syncDir(parentDir(part));
+    else if (errno != EEXIST) return false;
+  }
+  return true;
+}
+
+static void bindColumns(uint8_t* map, const SegmentHeader*& header, const int64_t*& times,
+                        const double*& values) {
+  header = (const SegmentHeader*)map;
+  times = (const int64_t*)(map + SEGMENT_HEADER_SIZE);
+  values = (const double*)(map + SEGMENT_HEADER_SIZE + (size_t)header->capacity * sizeof(int64_t));
+}
+
+static bool readIndex(const std::string& dir, std::vector<SegmentIndexEntry>& entries) {
+  entries.clear();
+  int fd = open((dir + "/" INDEX_FILE).c_str(), O_RDONLY);
+  if (fd < 0) return errno == ENOENT;
+  struct stat st;
+  bool ok = fstat(fd, &st) == 0;
+  if (ok) {
+    // A torn final entry (crash mid-write) is ignored
+    entries.resize(st.st_size / sizeof(SegmentIndexEntry));
+    size_t bytes = entries.size() * sizeof(SegmentIndexEntry);
+    ok = bytes == 0 || pread(fd, entries.data(), bytes, 0) == (ssize_t)bytes;
+  }
+  close(fd);
+  return ok;
+}
+
+bool columnListSegments(const std::string& seriesDir, std::vector<SegmentIndexEntry>& sealed,
+                        uint32_t& activeId) {
+  struct stat st;
+  if (stat(seriesDir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) return false;
+  if (!readIndex(seriesDir, sealed)) return false;
+  activeId = sealed.empty() ? 1 : sealed.back().segmentId + 1;
+  return true;
+}
+
+// ---- Writer ------------------------------------------------------------
+
+bool columnStoreOpen(ColumnStore& store, const char* root, size_t maxOpen) {
+  store.root = root;
+  store.maxOpen = maxOpen ? maxOpen : 1;
+  store.openCount = 0;
+  store.useClock = 0;
+  store.series.clear();
+  store.unsynced.clear();
+  store.checkpointing = false;
+  store.marks.clear();
+  memset(&store.stats, 0, sizeof(store.stats));
+  return makeDirs(store.root);
+}
+
+static void unmapWriter(ColumnStore& store, SeriesWriter& w) {
+  if (!w.map) return;
+  if (w.dirty) {
+    msync(w.map, SEGMENT_FILE_SIZE, MS_ASYNC);
+    store.unsynced.push_back(segmentPath(w.dir, w.segmentId));
+    w.dirty = false;
+  }
+  munmap(w.map, SEGMENT_FILE_SIZE);
+  close(w.fd);
+  w.map = nullptr;
+  w.header = nullptr;
+  w.fd = -1;
+  store.openCount--;
+}
+
+// Unmaps the least recently used eighth of the open segments in one pass,
+// so a working set just above maxOpen does not rescan on every miss
+static void evictLeastRecent(ColumnStore& store) {
+  std::vector<SeriesWriter*> open;
+  for (auto& entry : store.series) {
+    if (entry.second.map) open.push_back(&entry.second);
+  }
+  if (open.empty()) return;
+  size_t n = open.size() / 8 + 1;
+  std::nth_element(open.begin(), open.begin() + (n - 1), open.end(),
+                   [](const SeriesWriter* a, const SeriesWriter* b) { return a->lastUse < b->lastUse; });
+  for (size_t i = 0; i < n; i++) {
+    unmapWriter(store, *open[i]);
+    store.stats.evictions++;
+  }
+}
+
+// Drops the pages just filled from this process; they stay in the file and
+// the page cache, so a mapped series costs about three resident pages
+static void releaseFilledPage(SeriesWriter& w, uint32_t n) {
+  const uint32_t perPage = SEGMENT_PAGE_SIZE / sizeof(int64_t);
+  if (n % perPage != 0) return;
+  uint8_t* times = (uint8_t*)(w.times + n - perPage);
+  uint8_t* values = (uint8_t*)(w.values + n - perPage);
+  madvise(times, SEGMENT_PAGE_SIZE, MADV_DONTNEED);
+  madvise(values, SEGMENT_PAGE_SIZE, MADV_DONTNEED);
+}
+
+static bool mapSegment(ColumnStore& store, SeriesWriter& w) {
+  if (store.openCount >= store.maxOpen) evictLeastRecent(store);
+
+  std::string path = segmentPath(w.dir, w.segmentId);
+  int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd < 0) return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return false;
+  }
+  if ((size_t)st.st_size < SEGMENT_FILE_SIZE) {
+    if (ftruncate(fd, SEGMENT_FILE_SIZE) != 0) {
+      close(fd);
+      return false;
+    }
+    fsync(fd);
+    syncDir(w.dir);
+  }
+  void* map = mmap(nullptr, SEGMENT_FILE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    close(fd);
+    return false;
+  }
+
+  SegmentHeader* h = (SegmentHeader*)map;
+  if (h->magic == 0) {
+    // Fresh sparse file: only the header page is touched until data arrives
+    h->version = SEGMENT_VERSION;
+    h->headerSize = SEGMENT_HEADER_SIZE;
+    h->capacity = SEGMENT_CAPACITY;
+    h->count = 0;
+    h->minValue = DBL_MAX;
+    h->maxValue = -DBL_MAX;
+    h->sum = 0;
+    h->segmentId = w.segmentId;
+    h->sealed = 0;
+    h->firstLsn = 0;
+    h->lastLsn = 0;
+    __atomic_store_n(&h->magic, SEGMENT_MAGIC, __ATOMIC_RELEASE);
+  } else if (h->magic != SEGMENT_MAGIC || h->version != SEGMENT_VERSION || h->capacity != SEGMENT_CAPACITY) {
+    munmap(map, SEGMENT_FILE_SIZE);
+    close(fd);
+    return false;
+  }
+
+  w.fd = fd;
+  w.map = (uint8_t*)map;
+  w.header = h;
+  w.times = (int64_t*)(w.map + SEGMENT_HEADER_SIZE);
+  w.values = (double*)(w.map + SEGMENT_HEADER_SIZE + (size_t)SEGMENT_CAPACITY * sizeof(int64_t));
+  if (h->count > 0 && w.times[h->count - 1] > w.lastTime) w.lastTime = w.times[h->count - 1];
+  if (h->lastLsn > w.lastLsn) w.lastLsn = h->lastLsn;
+  w.count = h->count;
+  store.openCount++;
+  store.stats.segmentOpens++;
+  return true;
+}
+
+static bool sealSegment(ColumnStore& store, SeriesWriter& w) {
+  SegmentHeader* h = w.header;
+  SegmentIndexEntry entry = {h->firstTime, h->lastTime, w.segmentId, h->count,
+                             h->minValue, h->maxValue, h->sum};
+  h->sealed = 1;
+  msync(w.map, SEGMENT_FILE_SIZE, MS_ASYNC);
+
+  int fd = open((w.dir + "/" INDEX_FILE).c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+  bool ok = fd >= 0 && write(fd, &entry, sizeof(entry)) == (ssize_t)sizeof(entry) && fdatasync(fd) == 0;
+  if (fd >= 0) close(fd);
+  if (!ok) return false;
+
+  unmapWriter(store, w);
+  w.segmentId++;
+  w.count = 0;
+  store.stats.segmentsSealed++;
+  return true;
+}
+
+static bool readHeader(const std::string& path, SegmentHeader& h) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+  bool ok = pread(fd, &h, sizeof(h), 0) == (ssize_t)sizeof(h) && h.magic == SEGMENT_MAGIC &&
+            h.capacity == SEGMENT_CAPACITY;
+  close(fd);
+  return ok;
+}
+
+static void formatMark(char* line, size_t size, const SeriesMark& m) {
+  snprintf(line, size, "%s %u %u %llu\n", m.series.c_str(), m.segmentId, m.count,
+           (unsigned long long)m.lastLsn);
+}
+
+static bool appendBaseline(ColumnStore& store, const SeriesMark& mark) {
+  char line[512];
+  formatMark(line, sizeof(line), mark);
+  int fd = open((store.root + "/" BASELINE_FILE).c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+  bool ok = fd >= 0 && write(fd, line, strlen(line)) == (ssize_t)strlen(line) && fdatasync(fd) == 0;
+  if (fd >= 0) close(fd);
+  return ok;
+}
+
+static SeriesWriter* findWriter(ColumnStore& store, const std::string& series) {
+  auto it = store.series.find(series);
+  if (it != store.series.end()) return &it->second;
+
+  SeriesWriter w;
+  w.dir = store.root + "/" + series;
+  w.fd = -1;
+  w.map = nullptr;
+  w.header = nullptr;
+  w.times = nullptr;
+  w.values = nullptr;
+  w.lastTime = INT64_MIN;
+  w.lastLsn = 0;
+  w.count = 0;
+  w.dirty = false;
+  w.lastUse = 0;
+  if (!makeDirs(w.dir)) return nullptr;
+
+  // Resume after the last sealed segment; its end time seeds the clamp
+  std::vector<SegmentIndexEntry> sealed;
+  if (!columnListSegments(w.dir, sealed, w.segmentId)) return nullptr;
+  if (!sealed.empty()) w.lastTime = sealed.back().lastTime;
+
+  // A series with data that the last checkpoint does not cover gets its
+  // starting point journaled before it changes, so recovery can cut back to it
+  if (store.checkpointing && !store.marks.count(series)) {
+    SeriesMark mark = {series, w.segmentId, 0, 0};
+    SegmentHeader h;
+    if (readHeader(segmentPath(w.dir, w.segmentId), h)) {
+      mark.count = h.count;
+      mark.lastLsn = h.lastLsn;
+    }
+    if ((mark.count > 0 || !sealed.empty()) && !appendBaseline(store, mark)) return nullptr;
+    store.marks[series] = mark;
+  }
+
+  return &store.series.emplace(series, w).first->second;
+}
+
+bool columnStoreAppend(ColumnStore& store, const std::string& series, int64_t timeMs, double value,
+                       uint64_t lsn) {
+  SeriesWriter* w = findWriter(store, series);
+  if (!w || (!w->map && !mapSegment(store, *w))) {
+    store.stats.errors++;
+    return false;
+  }
+  w->lastUse = ++store.useClock;
+
+  SegmentHeader* h = w->header;
+  if (h->count >= h->capacity) {
+    if (!sealSegment(store, *w) || !mapSegment(store, *w)) {
+      store.stats.errors++;
+      return false;
+    }
+    h = w->header;
+  }
+
+  if (timeMs < w->lastTime) {
+    timeMs = w->lastTime;
+    store.stats.reordered++;
+  }
+  uint32_t n = h->count;
+  w->times[n] = timeMs;
+  w->values[n] = value;
+  if (n == 0) {
+    h->firstTime = timeMs;
+    h->firstLsn = lsn;
+  }
+  h->lastTime = timeMs;
+  if (lsn) h->lastLsn = lsn;
+  if (value < h->minValue) h->minValue = value;
+  if (value > h->maxValue) h->maxValue = value;
+  h->sum += value;
+  __atomic_store_n(&h->count, n + 1, __ATOMIC_RELEASE);  // Publishes the point to readers
+  w->lastTime = timeMs;
+  if (lsn) w->lastLsn = lsn;
+  w->count = n + 1;
+  w->dirty = true;
+  releaseFilledPage(*w, n + 1);
+  store.stats.points++;
+  return true;
+}
+
+void columnStoreFlush(ColumnStore& store) {
+  for (auto& entry : store.series) {
+    if (entry.second.map) msync(entry.second.map, SEGMENT_FILE_SIZE, MS_ASYNC);
+  }
+}
+
+void columnStoreClose(ColumnStore& store) {
+  columnStoreFlush(store);
+  for (auto& entry : store.series) unmapWriter(store, entry.second);
+  store.series.clear();
+}
+
+// ---- Checkpoint and recovery -------------------------------------------
+
+static bool syncAll(ColumnStore& store) {
+  bool ok = true;
+  for (auto& entry : store.series) {
+    SeriesWriter& w = entry.second;
+    if (w.map && w.dirty) {
+      ok = msync(w.map, SEGMENT_FILE_SIZE, MS_SYNC) == 0 && ok;
+      w.dirty = false;
+    }
+  }
+  for (const std::string& path : store.unsynced) {
+    int fd = open(path.c_str(), O_RDWR);
+    ok = fd >= 0 && fdatasync(fd) == 0 && ok;
+    if (fd >= 0) close(fd);
+  }
+  store.unsynced.clear();
+  return ok;
+}
+
+bool columnStoreCheckpoint(ColumnStore& store, uint64_t lsn) {
+  if (!syncAll(store)) {
+    store.stats.errors++;
+    return false;
+  }
+  for (auto& entry : store.series) {
+    const SeriesWriter& w = entry.second;
+    store.marks[entry.first] = {entry.first, w.segmentId, w.count, w.lastLsn};
+  }
+
+  std::string path = store.root + "/" CHECKPOINT_FILE;
+  std::string tmp = path + ".tmp";
+  FILE* f = fopen(tmp.c_str(), "w");
+  if (!f) return false;
+  fprintf(f, "bille-checkpoint 1 %llu\n", (unsigned long long)lsn);
+  char line[512];
+  for (auto& entry : store.marks) {
+    formatMark(line, sizeof(line), entry.second);
+    fputs(line, f);
+  }
+  fputs("end\n", f);
+  bool ok = fflush(f) == 0 && fdatasync(fileno(f)) == 0;
+  ok = fclose(f) == 0 && ok;
+  if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+    store.stats.errors++;
+    return false;
+  }
+  syncDir(store.root);
+  // Every baseline is in the checkpoint now
+  unlink((store.root + "/" BASELINE_FILE).c_str());
+  return true;
+}
+
+// Reads "<series> <segment> <count> <lastLsn>" lines; a torn last line is ignored
+static bool readMarks(const std::string& path, bool checkpoint, uint64_t& lsn,
+                      std::unordered_map<std::string, SeriesMark>& marks) {
+  FILE* f = fopen(path.c_str(), "r");
+  if (!f) return false;
+  char line[512];
+  bool ok = !checkpoint;
+  std::unordered_map<std::string, SeriesMark> read;
+  unsigned long long value;
+  if (checkpoint) {
+    ok = fgets(line, sizeof(line), f) && sscanf(line, "bille-checkpoint 1 %llu", &value) == 1;
+    lsn = value;
+  }
+  while (ok && fgets(line, sizeof(line), f)) {
+    if (checkpoint && strcmp(line, "end\n") == 0) break;
+    char name[400];
+    SeriesMark m;
+    if (!strchr(line, '\n') || sscanf(line, "%399s %u %u %llu", name, &m.segmentId, &m.count, &value) != 4) {
+      ok = !checkpoint;
+      break;
+    }
+    m.series = name;
+    m.lastLsn = value;
+    read[m.series] = m;
+  }
+  fclose(f);
+  if (!ok) return false;
+  for (auto& entry : read) {
+    if (!marks.count(entry.first)) marks[entry.first] = entry.second;
+  }
+  return true;
+}
+
+// Returns the points the removed segments held
+static uint64_t removeSegmentsAfter(const std::string& dir, uint32_t keepId) {
+  DIR* d = opendir(dir.c_str());
+  if (!d) return 0;
+  uint64_t dropped = 0;
+  while (struct dirent* e = readdir(d)) {
+    unsigned id;
+    if (sscanf(e->d_name, "seg-%u.col", &id) != 1 || id <= keepId) continue;
+    std::string path = dir + "/" + e->d_name;
+    SegmentHeader h;
+    if (readHeader(path, h)) dropped += h.count;
+    unlink(path.c_str());
+  }
+  closedir(d);
+  return dropped;
+}
+
+// Cuts a series back to its mark: later segments go, the marked one is
+// truncated and its header statistics recomputed
+static uint64_t rollbackSeries(ColumnStore& store, const std::string& dir, const SeriesMark& mark) {
+  std::vector<SegmentIndexEntry> sealed;
+  readIndex(dir, sealed);
+  size_t keep = 0;
+  while (keep < sealed.size() && sealed[keep].segmentId < mark.segmentId) keep++;
+  if (keep < sealed.size()) {
+    std::string index = dir + "/" INDEX_FILE;
+    std::string tmp = index + ".tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    size_t bytes = keep * sizeof(SegmentIndexEntry);
+    bool ok = fd >= 0 && (bytes == 0 || write(fd, sealed.data(), bytes) == (ssize_t)bytes) && fdatasync(fd) == 0;
+    if (fd >= 0) close(fd);
+    if (!ok || rename(tmp.c_str(), index.c_str()) != 0) store.stats.errors++;
+  }
+  uint64_t dropped = removeSegmentsAfter(dir, mark.segmentId);
+
+  int fd = open(segmentPath(dir, mark.segmentId).c_str(), O_RDWR);
+  if (fd < 0) {
+    if (mark.count > 0) store.stats.errors++;  // Checkpointed data missing
+    return dropped;
+  }
+  void* map = mmap(nullptr, SEGMENT_FILE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) return dropped;
+  SegmentHeader* h = (SegmentHeader*)map;
+  if (h->magic == SEGMENT_MAGIC && h->capacity == SEGMENT_CAPACITY) {
+    if (h->count < mark.count) store.stats.errors++;
+    if (h->count > mark.count) dropped += h->count - mark.count;
+    uint32_t n = mark.count < h->count ? mark.count : h->count;
+    const int64_t* times = (const int64_t*)((uint8_t*)map + SEGMENT_HEADER_SIZE);
+    const double* values = (const double*)((uint8_t*)map + SEGMENT_HEADER_SIZE + (size_t)SEGMENT_CAPACITY * 8);
+    h->minValue = DBL_MAX;
+    h->maxValue = -DBL_MAX;
+    h->sum = 0;
+    for (uint32_t i = 0; i < n; i++) {
+      if (values[i] < h->minValue) h->minValue = values[i];
+      if (values[i] > h->maxValue) h->maxValue = values[i];
+      h->sum += values[i];
+    }
+    h->firstTime = n ? times[0] : 0;
+    h->lastTime = n ? times[n - 1] : 0;
+    if (n == 0) h->firstLsn = 0;
+    h->lastLsn = mark.lastLsn;
+    h->sealed = 0;
+    h->count = n;
+    msync(map, SEGMENT_FILE_SIZE, MS_SYNC);
+  }
+  munmap(map, SEGMENT_FILE_SIZE);
+  return dropped;
+}
+
+// A series the checkpoint never saw: started after it if its first segment
+// carries a later lsn (or never got a valid header); older series without
+// WAL lsns are left alone
+static bool dropIfNew(const std::string& dir, uint64_t checkpointLsn) {
+  SegmentHeader h;
+  bool valid = readHeader(segmentPath(dir, 1), h);
+  struct stat st;
+  bool exists = stat(segmentPath(dir, 1).c_str(), &st) == 0;
+  if (!exists || (valid && h.firstLsn <= checkpointLsn && h.count > 0)) return false;
+  unlink((dir + "/" INDEX_FILE).c_str());
+  removeSegmentsAfter(dir, 0);
+  return true;
+}
+
+bool columnStoreRecover(ColumnStore& store, uint64_t& checkpointLsn) {
+  store.checkpointing = true;
+  checkpointLsn = 0;
+  store.marks.clear();
+  std::string path = store.root + "/" CHECKPOINT_FILE;
+  struct stat st;
+  if (stat(path.c_str(), &st) == 0 && !readMarks(path, true, checkpointLsn, store.marks)) return false;
+  readMarks(store.root + "/" BASELINE_FILE, false, checkpointLsn, store.marks);
+
+  DIR* root = opendir(store.root.c_str());
+  if (!root) return false;
+  while (struct dirent* desk = readdir(root)) {
+    if (strncmp(desk->d_name, "desk-", 5) != 0) continue;
+    std::string deskDir = store.root + "/" + desk->d_name;
+    DIR* d = opendir(deskDir.c_str());
+    if (!d) continue;
+    while (struct dirent* metric = readdir(d)) {
+      if (metric->d_name[0] == '.') continue;
+      std::string series = std::string(desk->d_name) + "/" + metric->d_name;
+      auto it = store.marks.find(series);
+      if (it != store.marks.end()) {
+        store.stats.rolledBack += rollbackSeries(store, deskDir + "/" + metric->d_name, it->second);
+      } else if (dropIfNew(deskDir + "/" + metric->d_name, checkpointLsn)) {
+        store.stats.droppedSeries++;
+      }
+    }
+    closedir(d);
+  }
+  closedir(root);
+  return true;
+}
+
+// ---- Reader ------------------------------------------------------------
+
+bool segmentViewOpen(SegmentView& view, const std::string& seriesDir, uint32_t segmentId) {
+  view.fd = open(segmentPath(seriesDir, segmentId).c_str(), O_RDONLY);
+  view.map = nullptr;
+  if (view.fd < 0) return false;
+  struct stat st;
+  if (fstat(view.fd, &st) != 0 || (size_t)st.st_size < SEGMENT_HEADER_SIZE) {
+    close(view.fd);
+    return false;
+  }
+  view.mapLength = st.st_size;
+  void* map = mmap(nullptr, view.mapLength, PROT_READ, MAP_SHARED, view.fd, 0);
+  // The mapping outlives the descriptor, so long-lived views hold no fd
+  close(view.fd);
+  view.fd = -1;
+  if (map == MAP_FAILED) return false;
+  view.map = (const uint8_t*)map;
+  const SegmentHeader* h = (const SegmentHeader*)map;
+  if (__atomic_load_n(&h->magic, __ATOMIC_ACQUIRE) != SEGMENT_MAGIC || h->version != SEGMENT_VERSION ||
+      SEGMENT_HEADER_SIZE + (size_t)h->capacity * 16 > view.mapLength) {
+    segmentViewClose(view);
+    return false;
+  }
+  bindColumns((uint8_t*)map, view.header, view.times, view.values);
+  view.count = __atomic_load_n(&h->count, __ATOMIC_ACQUIRE);
+  if (view.count > h->capacity) view.count = h->capacity;
+  return true;
+}
+
+void segmentViewClose(SegmentView& view) {
+  if (view.map) munmap((void*)view.map, view.mapLength);
+  if (view.fd >= 0) close(view.fd);
+  view.map = nullptr;
+  view.fd = -1;
+}
+
+uint32_t segmentLowerBound(const SegmentView& view, int64_t t) {
+  uint32_t lo = 0, hi = view.count;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if (view.times[mid] < t) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+uint32_t segmentUpperBound(const SegmentView& view, int64_t t) {
+  uint32_t lo = 0, hi = view.count;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if (view.times[mid] <= t) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+// Visits one segment's slice in [fromMs, toMs]; false stops the scan
+static bool scanSegment(const std::string& dir, uint32_t id, int64_t fromMs, int64_t toMs,
+                        ColumnVisitor visit, void* context, bool& stopped) {
+  SegmentView view;
+  if (!segmentViewOpen(view, dir, id)) return false;
+  uint32_t first = segmentLowerBound(view, fromMs);
+  uint32_t last = segmentUpperBound(view, toMs);
+  if (first < last && !visit(context, view.times + first, view.values + first, last - first)) {
+    stopped = true;
+  }
+  segmentViewClose(view);
+  return true;
+}
+
+bool columnStoreScan(const char* root, const std::string& series, int64_t fromMs, int64_t toMs,
+                     ColumnVisitor visit, void* context) {
+  std::string dir = std::string(root) + "/" + series;
+  std::vector<SegmentIndexEntry> sealed;
+  uint32_t activeId;
+  if (!columnListSegments(dir, sealed, activeId)) return false;
+
+  bool stopped = false;
+  for (const SegmentIndexEntry& e : sealed) {
+    if (e.lastTime < fromMs) continue;
+    if (e.firstTime > toMs) return true;
+    scanSegment(dir, e.segmentId, fromMs, toMs, visit, context, stopped);
+    if (stopped) return true;
+  }
+  // The active segment is not indexed yet and may be missing entirely
+  scanSegment(dir, activeId, fromMs, toMs, visit, context, stopped);
+  return true;
+}
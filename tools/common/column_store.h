@@ -0,0 +1,153 @@
+#ifndef COLUMN_STORE_H
+#define COLUMN_STORE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Columnar on-disk store for the host tools. One directory per series
+// (<root>/desk-<n>/<metric>), holding fixed-capacity segment files and an
+// append-only index of sealed segments:
+//
+//   seg-<id>.col   SegmentHeader | int64 timeMs[capacity] | double value[capacity]
+//   segments.idx   SegmentIndexEntry per sealed segment, in id order
+//
+// Segments are created sparse at full size and written through a shared
+// mapping, so readers mmap the same file and see every point once the
+// header count covers it. Times within a segment never go backwards (a late
+// point is clamped to the previous time), so a range is two binary searches.
+// Filled column pages are dropped from the writer's mapping as it moves on,
+// so a series costs a few resident pages; at most maxOpen segments stay
+// mapped and the least recently used are unmapped beyond that.
+
+#define SEGMENT_MAGIC         0x4C4F4342u  // "BCOL"
+#define SEGMENT_VERSION       1
+#define SEGMENT_HEADER_SIZE   4096         // One page, so both columns are page aligned
+#define SEGMENT_CAPACITY      65536        // Points per segment, 1 MB per file
+#define COLUMN_STORE_MAX_OPEN 4096
+
+struct SegmentHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t headerSize;
+  uint32_t capacity;
+  uint32_t count;        // Points written; stored with release ordering, last
+  int64_t firstTime;
+  int64_t lastTime;
+  double minValue;
+  double maxValue;
+  double sum;
+  uint32_t segmentId;
+  uint32_t sealed;
+  uint64_t firstLsn;     // WAL lsn of the first/last point, 0 without a WAL
+  uint64_t lastLsn;
+};
+static_assert(sizeof(SegmentHeader) <= SEGMENT_HEADER_SIZE, "segment header too large");
+
+struct SegmentIndexEntry {
+  int64_t firstTime;
+  int64_t lastTime;
+  uint32_t segmentId;
+  uint32_t count;
+  double minValue;
+  double maxValue;
+  double sum;
+};
+
+struct SeriesWriter {
+  std::string dir;
+  uint32_t segmentId;
+  int fd;
+  uint8_t* map;
+  SegmentHeader* header;
+  int64_t* times;
+  double* values;
+  int64_t lastTime;      // Carried across segments so time never goes back
+  uint64_t lastLsn;
+  uint32_t count;        // Mirror of header->count, valid while unmapped
+  bool dirty;            // Written since the last columnStoreSync
+  uint64_t lastUse;
+};
+
+// Where a series stood at a checkpoint
+struct SeriesMark {
+  std::string series;
+  uint32_t segmentId;
+  uint32_t count;
+  uint64_t lastLsn;
+};
+
+struct ColumnStoreStats {
+  uint64_t points;
+  uint64_t reordered;      // Late points clamped to the previous time
+  uint64_t segmentsSealed;
+  uint64_t segmentOpens;
+  uint64_t evictions;
+  uint64_t rolledBack;     // Points past the checkpoint removed by recovery
+  uint64_t droppedSeries;  // Series started after the checkpoint
+  uint64_t errors;
+};
+
+struct ColumnStore {
+  std::string root;
+  size_t maxOpen;
+  size_t openCount;
+  uint64_t useClock;
+  std::unordered_map<std::string, SeriesWriter> series;
+  std::vector<std::string> unsynced;  // Segment files unmapped while dirty
+  bool checkpointing;                 // Set by columnStoreRecover
+  std::unordered_map<std::string, SeriesMark> marks;  // Last checkpoint
+  ColumnStoreStats stats;
+};
+
+bool columnStoreOpen(ColumnStore& store, const char* root, size_t maxOpen = COLUMN_STORE_MAX_OPEN);
+// series is "desk-<n>/<metric>"; creates the directory on first use. lsn is
+// the WAL record the point came from (0 without a WAL).
+bool columnStoreAppend(ColumnStore& store, const std::string& series, int64_t timeMs, double value,
+                       uint64_t lsn = 0);
+void columnStoreFlush(ColumnStore& store);   // msync(MS_ASYNC) every mapped segment
+void columnStoreClose(ColumnStore& store);   // Unmaps; the active segments stay open for appends
+
+// Checkpoints against a WAL. columnStoreRecover (before the first append)
+// cuts the store back to the last checkpoint - series marks, plus the
+// baseline of any series first written after it - and drops series started
+// since, so the WAL replays from checkpointLsn + 1 without duplicates or
+// torn points. columnStoreCheckpoint makes every point so far durable and
+// atomically records where each series stands at lsn.
+bool columnStoreRecover(ColumnStore& store, uint64_t& checkpointLsn);
+bool columnStoreCheckpoint(ColumnStore& store, uint64_t lsn);
+
+std::string columnSeriesName(int desk, const char* metric);
+
+// ---- Read side: mmap, zero-copy --------------------------------------
+
+struct SegmentView {
+  int fd;                // -1 once mapped
+  size_t mapLength;
+  const uint8_t* map;
+  const SegmentHeader* header;
+  const int64_t* times;
+  const double* values;
+  uint32_t count;        // Snapshot of header->count at open
+};
+
+bool segmentViewOpen(SegmentView& view, const std::string& seriesDir, uint32_t segmentId);
+void segmentViewClose(SegmentView& view);
+// First index with time >= t / > t within the view
+uint32_t segmentLowerBound(const SegmentView& view, int64_t t);
+uint32_t segmentUpperBound(const SegmentView& view, int64_t t);
+
+// Segment list of a series: sealed ones from the index plus the active one
+// (activeId may not exist on disk yet)
+bool columnListSegments(const std::string& seriesDir, std::vector<SegmentIndexEntry>& sealed,
+                        uint32_t& activeId);
+
+// Calls visit with contiguous column slices covering [fromMs, toMs]; return
+// false from visit to stop early. Returns false if the series does not exist.
+typedef bool (*ColumnVisitor)(void* context, const int64_t* times, const double* values, size_t count);
+bool columnStoreScan(const char* root, const std::string& series, int64_t fromMs, int64_t toMs,
+                     ColumnVisitor visit, void* context);
+
+#endif
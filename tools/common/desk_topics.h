@@ -0,0 +1,50 @@
+#ifndef DESK_TOPICS_H
+#define DESK_TOPICS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+// Multi-desk topic layout used by the host tools. A desk's three nodes use
+// the normal sketch topics with "bille/" replaced by "bille/desk/<n>/";
+// desk 0 keeps the plain "bille/..." topics so a single real desk is
+// indistinguishable from desk 0 of a simulated fleet.
+
+#define DESK_TOPIC_ROOT  "bille/"
+#define DESK_TOPIC_FLEET "bille/desk/"
+
+inline std::string deskTopic(int desk, const char* suffix) {
+  if (desk == 0) return std::string(DESK_TOPIC_ROOT) + suffix;
+  char prefix[32];
+  snprintf(prefix, sizeof(prefix), DESK_TOPIC_FLEET "%d/", desk);
+  return std::string(prefix) + suffix;
+}
+
+// Splits a topic into desk number and the sketch-relative suffix
+// ("data/environment"). Returns -1 for topics outside the bille tree.
+inline int deskFromTopic(const char* topic, size_t length, const char** suffix, size_t* suffixLength) {
+  const size_t fleetLength = sizeof(DESK_TOPIC_FLEET) - 1;
+  const size_t rootLength = sizeof(DESK_TOPIC_ROOT) - 1;
+  if (length > fleetLength && memcmp(topic, DESK_TOPIC_FLEET, fleetLength) == 0) {
+    size_t pos = fleetLength;
+    int desk = 0;
+    if (topic[pos] < '0' || topic[pos] > '9') return -1;
+    while (pos < length && topic[pos] >= '0' && topic[pos] <= '9') {
+      desk = desk * 10 + (topic[pos] - '0');
+      pos++;
+    }
+    if (pos >= length || topic[pos] != '/') return -1;
+    *suffix = topic + pos + 1;
+    *suffixLength = length - pos - 1;
+    return desk;
+  }
+  if (length > rootLength && memcmp(topic, DESK_TOPIC_ROOT, rootLength) == 0) {
+    *suffix = topic + rootLength;
+    *suffixLength = length - rootLength;
+    return 0;
+  }
+  return -1;
+}
+
+#endif
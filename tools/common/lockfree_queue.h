@@ -0,0 +1,179 @@
+#ifndef LOCKFREE_QUEUE_H
+#define LOCKFREE_QUEUE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <memory>
+
+// Bounded lock-free queues for the host tools' worker pipelines.
+//
+// BoundedQueue is a ring of slots, each with a sequence number (Vyukov's
+// bounded queue). Producers claim a slot with one CAS on the tail and
+// publish it by bumping its sequence, so any number of threads can push. A
+// queue with one consumer pops with boundedPopSingle, which needs no CAS;
+// boundedPopShared lets several consumers pop. Items are copied in and out,
+// so T should be plain data.
+//
+// StealDeque is a fixed-capacity Chase-Lev deque: the owning worker pushes
+// and pops at the bottom, other workers steal from the top. It never grows,
+// so callers size it for the most items that can be queued at once.
+
+#define LOCKFREE_CACHE_LINE 64
+
+template <typename T>
+struct BoundedQueue {
+  struct Slot {
+    std::atomic<size_t> sequence;
+    T item;
+  };
+  std::unique_ptr<Slot[]> slots;
+  size_t mask;
+  alignas(LOCKFREE_CACHE_LINE) std::atomic<size_t> tail;  // Next slot to claim
+  alignas(LOCKFREE_CACHE_LINE) std::atomic<size_t> head;  // Next slot to pop
+};
+
+inline size_t lockfreeRoundUp(size_t n) {
+  size_t capacity = 2;
+  while (capacity < n) capacity <<= 1;
+  return capacity;
+}
+
+// Capacity is rounded up to a power of two
+template <typename T>
+void boundedInit(BoundedQueue<T>& q, size_t capacity) {
+  capacity = lockfreeRoundUp(capacity);
+  q.slots.reset(new typename BoundedQueue<T>::Slot[capacity]);
+  for (size_t i = 0; i < capacity; i++) q.slots[i].sequence.store(i, std::memory_order_relaxed);
+  q.mask = capacity - 1;
+  q.tail.store(0, std::memory_order_relaxed);
+  q.head.store(0, std::memory_order_relaxed);
+}
+
+// False if the queue is full
+template <typename T>
+bool boundedPush(BoundedQueue<T>& q, const T& item) {
+  size_t pos = q.tail.load(std::memory_order_relaxed);
+  for (;;) {
+    typename BoundedQueue<T>::Slot& slot = q.slots[pos & q.mask];
+    size_t sequence = slot.sequence.load(std::memory_order_acquire);
+    intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+    if (diff == 0) {
+      if (q.tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+        slot.item = item;
+        slot.sequence.store(pos + 1, std::memory_order_release);
+        return true;
+      }
+    } else if (diff < 0) {
+      return false;  // The slot still holds an item from the previous lap
+    } else {
+      pos = q.tail.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+// Only one thread may pop at a time
+template <typename T>
+bool boundedPopSingle(BoundedQueue<T>& q, T& item) {
+  size_t pos = q.head.load(std::memory_order_relaxed);
+  typename BoundedQueue<T>::Slot& slot = q.slots[pos & q.mask];
+  if (slot.sequence.load(std::memory_order_acquire) != pos + 1) return false;
+  item = slot.item;
+  slot.sequence.store(pos + q.mask + 1, std::memory_order_release);
+  q.head.store(pos + 1, std::memory_order_relaxed);
+  return true;
+}
+
+template <typename T>
+bool boundedPopShared(BoundedQueue<T>& q, T& item) {
+  size_t pos = q.head.load(std::memory_order_relaxed);
+  for (;;) {
+    typename BoundedQueue<T>::Slot& slot = q.slots[pos & q.mask];
+    size_t sequence = slot.sequence.load(std::memory_order_acquire);
+    intptr_t diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+    if (diff == 0) {
+      if (q.head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+        item = slot.item;
+        slot.sequence.store(pos + q.mask + 1, std::memory_order_release);
+        return true;
+      }
+    } else if (diff < 0) {
+      return false;
+    } else {
+      pos = q.head.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+// Whether a pop would find an item (for one consumer re-checking its queue)
+template <typename T>
+bool boundedHasItem(BoundedQueue<T>& q) {
+  size_t pos = q.head.load(std::memory_order_relaxed);
+  return q.slots[pos & q.mask].sequence.load(std::memory_order_acquire) == pos + 1;
+}
+
+template <typename T>
+struct StealDeque {
+  std::unique_ptr<std::atomic<T*>[]> items;
+  int64_t mask;
+  alignas(LOCKFREE_CACHE_LINE) std::atomic<int64_t> top;     // Thieves take here
+  alignas(LOCKFREE_CACHE_LINE) std::atomic<int64_t> bottom;  // Owner pushes and pops here
+};
+
+template <typename T>
+void stealInit(StealDeque<T>& d, size_t capacity) {
+  capacity = lockfreeRoundUp(capacity);
+  d.items.reset(new std::atomic<T*>[capacity]);
+  for (size_t i = 0; i < capacity; i++) d.items[i].store(nullptr, std::memory_order_relaxed);
+  d.mask = (int64_t)capacity - 1;
+  d.top.store(0, std::memory_order_relaxed);
+  d.bottom.store(0, std::memory_order_relaxed);
+}
+
+// Owner only. False if full.
+template <typename T>
+bool stealPush(StealDeque<T>& d, T* item) {
+  int64_t b = d.bottom.load(std::memory_order_relaxed);
+  int64_t t = d.top.load(std::memory_order_acquire);
+  if (b - t > d.mask) return false;
+  d.items[b & d.mask].store(item, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  d.bottom.store(b + 1, std::memory_order_relaxed);
+  return true;
+}
+
+// Owner only; newest first
+template <typename T>
+T* stealPop(StealDeque<T>& d) {
+  int64_t b = d.bottom.load(std::memory_order_relaxed) - 1;
+  d.bottom.store(b, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  int64_t t = d.top.load(std::memory_order_relaxed);
+  if (t > b) {
+    d.bottom.store(b + 1, std::memory_order_relaxed);
+    return nullptr;
+  }
+  T* item = d.items[b & d.mask].load(std::memory_order_relaxed);
+  if (t == b) {
+    // Last item: race the thieves for it
+    if (!d.top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+      item = nullptr;
+    d.bottom.store(b + 1, std::memory_order_relaxed);
+  }
+  return item;
+}
+
+// Any thread; oldest first. nullptr if empty or another thread won the race.
+template <typename T>
+T* stealTake(StealDeque<T>& d) {
+  int64_t t = d.top.load(std::memory_order_acquire);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  int64_t b = d.bottom.load(std::memory_order_acquire);
+  if (t >= b) return nullptr;
+  T* item = d.items[t & d.mask].load(std::memory_order_relaxed);
+  if (!d.top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+    return nullptr;
+  return item;
+}
+
+#endif
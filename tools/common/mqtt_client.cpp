@@ -0,0 +1,324 @@
+#include "mqtt_client.h"
+
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CONNACK_TIMEOUT_MS 5000
+
+uint64_t mqttNowMicros() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+size_t mqttEncodeLength(uint8_t* out, size_t length) {
+  size_t n = 0;
+  do {
+    uint8_t b = length & 0x7F;
+    length >>= 7;
+    if (length) b |= 0x80;
+    out[n++] = b;
+  } while (length && n < 4);
+  return n;
+}
+
+int mqttDecodeLength(const uint8_t* in, size_t available, size_t& length) {
+  length = 0;
+  for (size_t i = 0; i < 4; i++) {
+    if (i >= available) return 0;
+    length |= (size_t)(in[i] & 0x7F) << (7 * i);
+    if (!(in[i] & 0x80)) return (int)i + 1;
+  }
+  return -1;
+}
+
+// '+' matches one level, '#' the rest (including the parent level itself)
+bool mqttTopicMatches(const char* filter, const char* topic, size_t topicLength) {
+  size_t t = 0;
+  while (*filter) {
+    if (*filter == '#') return true;
+    if (*filter == '+') {
+      while (t < topicLength && topic[t] != '/') t++;
+      filter++;
+    } else {
+      while (*filter && *filter != '/') {
+        if (t >= topicLength || topic[t] != *filter) return false;
+        t++;
+        filter++;
+      }
+    }
+    if (*filter == '/') {
+      if (t >= topicLength) return filter[1] == '#';
+      if (topic[t] != '/') return false;
+      filter++;
+      t++;
+    } else if (*filter) {
+      return false;
+    }
+  }
+  return t == topicLength;
+}
+
+static void putU16(std::vector<uint8_t>& b, uint16_t v) {
+  b.push_back(v >> 8);
+  b.push_back(v & 0xFF);
+}
+
+static void putString(std::vector<uint8_t>& b, const char* s, size_t n) {
+  putU16(b, (uint16_t)n);
+  b.insert(b.end(), (const uint8_t*)s, (const uint8_t*)s + n);
+}
+
+static bool sendAll(MqttClient& c, const uint8_t* data, size_t length) {
+  while (length > 0) {
+    ssize_t n = send(c.fd, data, length, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        struct pollfd p = {c.fd, POLLOUT, 0};
+        poll(&p, 1, 100);
+        continue;
+      }
+      c.connected = false;
+      return false;
+    }
+    data += n;
+    length -= n;
+  }
+  c.lastSendMicros = mqttNowMicros();
+  c.packetsOut++;
+  return true;
+}
+
+// Prepends the fixed header to a body already in c.tx (after 5 reserved bytes)
+static bool sendPacket(MqttClient& c, uint8_t header) {
+  size_t body = c.tx.size() - 5;
+  uint8_t len[4];
+  size_t n = mqttEncodeLength(len, body);
+  size_t start = 5 - 1 - n;
+  c.tx[start] = header;
+  memcpy(&c.tx[start + 1], len, n);
+  return sendAll(c, &c.tx[start], c.tx.size() - start);
+}
+
+static void beginPacket(MqttClient& c) {
+  c.tx.assign(5, 0);
+}
+
+void mqttInit(MqttClient& c) {
+  c.fd = -1;
+  c.connected = false;
+  c.sessionPresent = false;
+  c.dup = false;
+  c.keepAliveSeconds = 0;
+  c.nextPacketId = 1;
+  c.lastSendMicros = 0;
+  c.rx.clear();
+  c.tx.clear();
+  c.packetsIn = 0;
+  c.packetsOut = 0;
+  c.pubacksPending = 0;
+}
+
+static int openSocket(const char* host, int port) {
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  char service[8];
+  snprintf(service, sizeof(service), "%d", port);
+
+  struct addrinfo* result = nullptr;
+  if (getaddrinfo(host, service, &hints, &result) != 0) return -1;
+
+  int fd = -1;
+  for (struct addrinfo* ai = result; ai; ai = ai->ai_next) {
+    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0) continue;
+    if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) break;
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(result);
+  if (fd >= 0) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  }
+  return fd;
+}
+
+bool mqttConnect(MqttClient& c, const char* host, int port, const char* clientId,
+                 const char* user, const char* password, uint16_t keepAliveSeconds,
+                 bool cleanSession) {
+  mqttInit(c);
+  c.fd = openSocket(host, port);
+  if (c.fd < 0) return false;
+  c.connected = true;
+  c.keepAliveSeconds = keepAliveSeconds;
+
+  uint8_t flags = cleanSession ? 0x02 : 0x00;
+  if (user && *user) flags |= 0x80;
+  if (password && *password) flags |= 0x40;
+
+  beginPacket(c);
+  putString(c.tx, "MQTT", 4);
+  c.tx.push_back(4);  // Protocol level 3.1.1
+  c.tx.push_back(flags);
+  putU16(c.tx, keepAliveSeconds);
+  putString(c.tx, clientId, strlen(clientId));
+  if (flags & 0x80) putString(c.tx, user, strlen(user));
+  if (flags & 0x40) putString(c.tx, password, strlen(password));
+  if (!sendPacket(c, MQTT_CONNECT << 4)) {
+    mqttDisconnect(c);
+    return false;
+  }
+
+  // CONNACK is always 4 bytes: 0x20 0x02 flags code
+  uint8_t ack[4];
+  size_t got = 0;
+  uint64_t deadline = mqttNowMicros() + CONNACK_TIMEOUT_MS * 1000ULL;
+  while (got < sizeof(ack)) {
+    uint64_t now = mqttNowMicros();
+    if (now >= deadline) break;
+    struct pollfd p = {c.fd, POLLIN, 0};
+    if (poll(&p, 1, (int)((deadline - now) / 1000) + 1) <= 0) continue;
+    ssize_t n = recv(c.fd, ack + got, sizeof(ack) - got, 0);
+    if (n <= 0) break;
+    got += n;
+  }
+  if (got < sizeof(ack) || ack[0] != (MQTT_CONNACK << 4) || ack[3] != 0) {
+    mqttDisconnect(c);
+    return false;
+  }
+  c.sessionPresent = ack[2] & 0x01;
+  c.packetsIn++;
+  return true;
+}
+
+bool mqttPublish(MqttClient& c, const char* topic, const uint8_t* payload, size_t length,
+                 uint8_t qos, bool retain) {
+  if (!c.connected) return false;
+  beginPacket(c);
+  putString(c.tx, topic, strlen(topic));
+  if (qos > 0) {
+    putU16(c.tx, c.nextPacketId);
+    if (++c.nextPacketId == 0) c.nextPacketId = 1;
+    c.pubacksPending++;
+  }
+  c.tx.insert(c.tx.end(), payload, payload + length);
+  return sendPacket(c, (MQTT_PUBLISH << 4) | (qos << 1) | (retain ? 1 : 0));
+}
+
+bool mqttPublish(MqttClient& c, const char* topic, const char* payload, uint8_t qos, bool retain) {
+  return mqttPublish(c, topic, (const uint8_t*)payload, strlen(payload), qos, retain);
+}
+
+bool mqttSubscribe(MqttClient& c, const char* filter, uint8_t qos) {
+  if (!c.connected) return false;
+  beginPacket(c);
+  putU16(c.tx, c.nextPacketId);
+  if (++c.nextPacketId == 0) c.nextPacketId = 1;
+  putString(c.tx, filter, strlen(filter));
+  c.tx.push_back(qos);
+  return sendPacket(c, (MQTT_SUBSCRIBE << 4) | 0x02);
+}
+
+static void handlePacket(MqttClient& c, uint8_t header, const uint8_t* body, size_t length,
+                         MqttMessageHandler handler, void* context) {
+  c.packetsIn++;
+  uint8_t type = header >> 4;
+  if (type == MQTT_PUBACK) {
+    if (c.pubacksPending) c.pubacksPending--;
+    return;
+  }
+  if (type != MQTT_PUBLISH || length < 2) return;
+
+  size_t topicLength = ((size_t)body[0] << 8) | body[1];
+  size_t pos = 2 + topicLength;
+  uint8_t qos = (header >> 1) & 0x03;
+  uint16_t packetId = 0;
+  if (qos > 0) {
+    if (pos + 2 > length) return;
+    packetId = ((uint16_t)body[pos] << 8) | body[pos + 1];
+    pos += 2;
+  }
+  if (pos > length) return;
+
+  if (handler) {
+    c.dup = header & 0x08;
+    handler(context, (const char*)body + 2, topicLength, body + pos, length - pos);
+  }
+  if (qos == 1) {
+    uint8_t ack[4] = {MQTT_PUBACK << 4, 2, (uint8_t)(packetId >> 8), (uint8_t)(packetId & 0xFF)};
+    sendAll(c, ack, sizeof(ack));
+  }
+}
+
+bool mqttPoll(MqttClient& c, int timeoutMs, MqttMessageHandler handler, void* context) {
+  if (!c.connected) return false;
+
+  if (timeoutMs > 0) {
+    struct pollfd p = {c.fd, POLLIN, 0};
+    poll(&p, 1, timeoutMs);
+  }
+
+  uint8_t chunk[16384];
+  for (;;) {
+    ssize_t n = recv(c.fd, chunk, sizeof(chunk), MSG_DONTWAIT);
+    if (n > 0) {
+      c.rx.insert(c.rx.end(), chunk, chunk + n);
+      if ((size_t)n < sizeof(chunk)) break;
+      continue;
+    }
+    if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+      c.connected = false;
+    }
+    break;
+  }
+
+  size_t pos = 0;
+  while (c.rx.size() - pos >= 2) {
+    size_t length;
+    int used = mqttDecodeLength(&c.rx[pos + 1], c.rx.size() - pos - 1, length);
+    if (used < 0 || length > MQTT_MAX_PACKET_SIZE) {
+      c.connected = false;
+      break;
+    }
+    if (used == 0 || c.rx.size() - pos < 1 + used + length) break;
+    handlePacket(c, c.rx[pos], &c.rx[pos + 1 + used], length, handler, context);
+    pos += 1 + used + length;
+  }
+  if (pos) c.rx.erase(c.rx.begin(), c.rx.begin() + pos);
+
+  // Keep-alive: ping at half the interval if nothing else went out
+  if (c.connected && c.keepAliveSeconds &&
+      mqttNowMicros() - c.lastSendMicros > c.keepAliveSeconds * 500000ULL) {
+    uint8_t ping[2] = {MQTT_PINGREQ << 4, 0};
+    sendAll(c, ping, sizeof(ping));
+  }
+
+  if (!c.connected) {
+    close(c.fd);
+    c.fd = -1;
+  }
+  return c.connected;
+}
+
+void mqttDisconnect(MqttClient& c) {
+  if (c.fd >= 0) {
+    if (c.connected) {
+      uint8_t bye[2] = {MQTT_DISCONNECT << 4, 0};
+      sendAll(c, bye, sizeof(bye));
+    }
+    close(c.fd);
+  }
+  c.fd = -1;
+  c.connected = false;
+}
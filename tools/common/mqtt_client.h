@@ -0,0 +1,76 @@
+#ifndef MQTT_CLIENT_H
+#define MQTT_CLIENT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+// Minimal MQTT 3.1.1 client for the host tools (POSIX sockets, no TLS).
+// One blocking TCP connection per client; mqttPoll() reads whatever has
+// arrived and hands complete PUBLISH packets to a callback, so one thread
+// can drive hundreds of clients. Enough protocol for the Bill-E topics:
+// CONNECT, PUBLISH QoS 0/1, SUBSCRIBE, PINGREQ, DISCONNECT.
+
+#define MQTT_DEFAULT_PORT     1883
+#define MQTT_MAX_PACKET_SIZE  (256 * 1024)
+
+// Control packet types (high nibble of the fixed header)
+#define MQTT_CONNECT      1
+#define MQTT_CONNACK      2
+#define MQTT_PUBLISH      3
+#define MQTT_PUBACK       4
+#define MQTT_PUBREC       5
+#define MQTT_PUBREL       6
+#define MQTT_PUBCOMP      7
+#define MQTT_SUBSCRIBE    8
+#define MQTT_SUBACK       9
+#define MQTT_UNSUBSCRIBE  10
+#define MQTT_UNSUBACK     11
+#define MQTT_PINGREQ      12
+#define MQTT_PINGRESP     13
+#define MQTT_DISCONNECT   14
+
+typedef void (*MqttMessageHandler)(void* context, const char* topic, size_t topicLength,
+                                   const uint8_t* payload, size_t length);
+
+struct MqttClient {
+  int fd;
+  bool connected;
+  bool sessionPresent;          // From CONNACK
+  bool dup;                     // DUP flag of the PUBLISH being handed to the callback
+  uint16_t keepAliveSeconds;
+  uint16_t nextPacketId;
+  uint64_t lastSendMicros;
+  std::vector<uint8_t> rx;      // Partial packet carried between polls
+  std::vector<uint8_t> tx;      // Scratch for building packets
+  unsigned long packetsIn;
+  unsigned long packetsOut;
+  unsigned long pubacksPending; // QoS 1 publishes without a PUBACK yet
+};
+
+void mqttInit(MqttClient& c);
+bool mqttConnect(MqttClient& c, const char* host, int port, const char* clientId,
+                 const char* user, const char* password, uint16_t keepAliveSeconds,
+                 bool cleanSession = true);
+bool mqttPublish(MqttClient& c, const char* topic, const uint8_t* payload, size_t length,
+                 uint8_t qos = 0, bool retain = false);
+bool mqttPublish(MqttClient& c, const char* topic, const char* payload,
+                 uint8_t qos = 0, bool retain = false);
+bool mqttSubscribe(MqttClient& c, const char* filter, uint8_t qos = 0);
+
+// Waits up to timeoutMs for data (0 = just drain), dispatches PUBLISH packets,
+// answers QoS 1 with PUBACK and sends PINGREQ when the keep-alive is due.
+// Returns false once the connection is gone.
+bool mqttPoll(MqttClient& c, int timeoutMs, MqttMessageHandler handler, void* context);
+void mqttDisconnect(MqttClient& c);
+
+// Shared with the broker: remaining-length varint and topic filter matching
+size_t mqttEncodeLength(uint8_t* out, size_t length);
+// Returns bytes used, 0 if more input is needed, -1 if malformed
+int mqttDecodeLength(const uint8_t* in, size_t available, size_t& length);
+bool mqttTopicMatches(const char* filter, const char* topic, size_t topicLength);
+
+uint64_t mqttNowMicros();
+
+#endif
@@ -0,0 +1,396 @@
+#include "range_query.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+struct BlockFileHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t blockPoints;
+  uint32_t segmentId;
+  uint32_t count;        // The segments.idx entry the summaries were built from
+  int64_t firstTime;
+  int64_t lastTime;
+  double sum;
+  uint32_t blocks;
+  uint32_t reserved;
+};
+
+static const char* stateNames[] = {"idle", "work", "short_break", "long_break"};
+
+const char* rangeStateName(int state) {
+  return state >= 0 && state < 4 ? stateNames[state] : "any";
+}
+
+int rangeStateCode(const char* name) {
+  for (int i = 0; i < 4; i++)
+    if (strcmp(name, stateNames[i]) == 0) return i;
+  return -1;
+}
+
+void rangeMergeStats(RollupStats& into, const RollupStats& from) {
+  into.count += from.count;
+  into.invalid += from.invalid;
+  if (from.min < into.min) into.min = from.min;
+  if (from.max > into.max) into.max = from.max;
+  into.sum += from.sum;
+}
+
+// Length of [from, to] in ms, saturating for open-ended ranges
+static int64_t spanMs(int64_t from, int64_t to) {
+  if (to < from) return 0;
+  uint64_t span = (uint64_t)to - (uint64_t)from;
+  return span >= (uint64_t)INT64_MAX ? INT64_MAX : (int64_t)span + 1;
+}
+
+static int64_t addSaturating(int64_t a, int64_t b) {
+  return a > INT64_MAX - b ? INT64_MAX : a + b;
+}
+
+// ---- Block index ---------------------------------------------------------
+
+static std::string blockPath(const std::string& dir, uint32_t id) {
+  char name[32];
+  snprintf(name, sizeof(name), "/seg-%06u.blk", id);
+  return dir + name;
+}
+
+static void summarize(SeriesIndex& index, const SegmentView& view, uint32_t position) {
+  for (uint32_t offset = 0; offset < view.count; offset += RANGE_BLOCK_POINTS) {
+    uint32_t n = std::min<uint32_t>(RANGE_BLOCK_POINTS, view.count - offset);
+    BlockSummary b;
+    b.firstTime = view.times[offset];
+    b.lastTime = view.times[offset + n - 1];
+    b.segment = position;
+    b.offset = offset;
+    b.count = n;
+    rollupReset(b.stats);
+    rollupAccumulate(view.values + offset, n, b.stats);
+    index.blocks.push_back(b);
+  }
+}
+
+// The sum is compared bitwise: it is NaN for any segment holding a NaN
+static bool matchesEntry(const BlockFileHeader& h, const SegmentIndexEntry& e) {
+  return h.magic == RANGE_BLOCK_MAGIC && h.version == RANGE_BLOCK_VERSION && h.blockPoints == RANGE_BLOCK_POINTS &&
+         h.segmentId == e.segmentId && h.count == e.count && h.firstTime == e.firstTime &&
+         h.lastTime == e.lastTime && memcmp(&h.sum, &e.sum, sizeof(h.sum)) == 0 &&
+         h.blocks == (e.count + RANGE_BLOCK_POINTS - 1) / RANGE_BLOCK_POINTS;
+}
+
+static bool readBlockFile(SeriesIndex& index, const SegmentIndexEntry& e, uint32_t position) {
+  int fd = open(blockPath(index.dir, e.segmentId).c_str(), O_RDONLY);
+  if (fd < 0) return false;
+  BlockFileHeader h;
+  struct stat st;
+  bool ok = pread(fd, &h, sizeof(h), 0) == (ssize_t)sizeof(h) && matchesEntry(h, e) && fstat(fd, &st) == 0 &&
+            (size_t)st.st_size == sizeof(h) + (size_t)h.blocks * sizeof(BlockSummary);
+  if (ok) {
+    size_t first = index.blocks.size();
+    index.blocks.resize(first + h.blocks);
+    size_t bytes = (size_t)h.blocks * sizeof(BlockSummary);
+    ok = pread(fd, &index.blocks[first], bytes, sizeof(h)) == (ssize_t)bytes;
+    if (!ok) index.blocks.resize(first);
+    for (size_t i = first; ok && i < index.blocks.size(); i++) index.blocks[i].segment = position;
+  }
+  close(fd);
+  return ok;
+}
+
+// Best effort: a read-only store just gets re-indexed on every open
+static void writeBlockFile(const SeriesIndex& index, const SegmentIndexEntry& e, size_t firstBlock) {
+  BlockFileHeader h;
+  memset(&h, 0, sizeof(h));
+  h.magic = RANGE_BLOCK_MAGIC;
+  h.version = RANGE_BLOCK_VERSION;
+  h.blockPoints = RANGE_BLOCK_POINTS;
+  h.segmentId = e.segmentId;
+  h.count = e.count;
+  h.firstTime = e.firstTime;
+  h.lastTime = e.lastTime;
+  h.sum = e.sum;
+  h.blocks = (uint32_t)(index.blocks.size() - firstBlock);
+
+  std::string path = blockPath(index.dir, e.segmentId);
+  char suffix[24];
+  snprintf(suffix, sizeof(suffix), ".%d.tmp", (int)getpid());
+  std::string tmp = path + suffix;
+  int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) return;
+  size_t bytes = (size_t)h.blocks * sizeof(BlockSummary);
+  bool ok = write(fd, &h, sizeof(h)) == (ssize_t)sizeof(h) &&
+            (bytes == 0 || write(fd, &index.blocks[firstBlock], bytes) == (ssize_t)bytes);
+  close(fd);
+  // A torn file after a crash fails the size check and is rebuilt
+  if (!ok || rename(tmp.c_str(), path.c_str()) != 0) unlink(tmp.c_str());
+}
+
+bool seriesIndexOpen(SeriesIndex& index, const char* root, const std::string& series) {
+  index.dir = std::string(root) + "/" + series;
+  index.segments.clear();
+  index.blocks.clear();
+  index.cachedSegments = 0;
+  index.builtSegments = 0;
+  std::vector<SegmentIndexEntry> sealed;
+  uint32_t activeId;
+  if (!columnListSegments(index.dir, sealed, activeId)) return false;
+
+  for (const SegmentIndexEntry& e : sealed) {
+    uint32_t position = (uint32_t)index.segments.size();
+    IndexedSegment s;
+    s.segmentId = e.segmentId;
+    s.mapped = false;
+    if (readBlockFile(index, e, position)) {
+      index.segments.push_back(s);
+      index.cachedSegments++;
+      continue;
+    }
+    if (!segmentViewOpen(s.view, index.dir, e.segmentId)) continue;
+    s.mapped = true;
+    size_t firstBlock = index.blocks.size();
+    summarize(index, s.view, position);
+    index.segments.push_back(s);
+    index.builtSegments++;
+    if (s.view.count == e.count) writeBlockFile(index, e, firstBlock);
+  }
+
+  // The active segment is still growing: summarised as it stands, not cached
+  IndexedSegment active;
+  active.segmentId = activeId;
+  if (segmentViewOpen(active.view, index.dir, activeId)) {
+    active.mapped = true;
+    summarize(index, active.view, (uint32_t)index.segments.size());
+    index.segments.push_back(active);
+  }
+  return true;
+}
+
+void seriesIndexClose(SeriesIndex& index) {
+  for (IndexedSegment& s : index.segments) {
+    if (s.mapped) segmentViewClose(s.view);
+    s.mapped = false;
+  }
+  index.segments.clear();
+  index.blocks.clear();
+}
+
+static void scanBlock(SeriesIndex& index, const BlockSummary& b, int64_t fromMs, int64_t toMs, RollupStats& out,
+                      RangeQueryStats* stats) {
+  IndexedSegment& s = index.segments[b.segment];
+  if (!s.mapped) {
+    if (!segmentViewOpen(s.view, index.dir, s.segmentId)) return;
+    s.mapped = true;
+  }
+  if (b.offset >= s.view.count) return;
+  const int64_t* times = s.view.times + b.offset;
+  uint32_t n = std::min(b.count, s.view.count - b.offset);
+  uint32_t first = (uint32_t)(std::lower_bound(times, times + n, fromMs) - times);
+  uint32_t last = (uint32_t)(std::upper_bound(times + first, times + n, toMs) - times);
+  if (first < last) rollupAccumulate(s.view.values + b.offset + first, last - first, out);
+  if (stats) {
+    stats->blocksScanned++;
+    stats->pointsScanned += last - first;
+  }
+}
+
+void seriesIndexAggregate(SeriesIndex& index, int64_t fromMs, int64_t toMs, RollupStats& out,
+                          RangeQueryStats* stats) {
+  if (fromMs > toMs) return;
+  // Block times never go backwards, so the first block ending at or after
+  // fromMs is where the range starts
+  auto it = std::lower_bound(index.blocks.begin(), index.blocks.end(), fromMs,
+                             [](const BlockSummary& b, int64_t t) { return b.lastTime < t; });
+  for (; it != index.blocks.end() && it->firstTime <= toMs; ++it) {
+    if (it->firstTime >= fromMs && it->lastTime <= toMs) {
+      rangeMergeStats(out, it->stats);
+      if (stats) stats->blocksSummarized++;
+    } else {
+      scanBlock(index, *it, fromMs, toMs, out, stats);
+    }
+  }
+}
+
+// ---- Interval tree -------------------------------------------------------
+
+static int64_t buildMaxEnd(IntervalTree& tree, size_t lo, size_t hi) {
+  if (lo >= hi) return INT64_MIN;
+  size_t mid = lo + (hi - lo) / 2;
+  int64_t end = std::max(tree.intervals[mid].end, std::max(buildMaxEnd(tree, lo, mid), buildMaxEnd(tree, mid + 1, hi)));
+  tree.maxEnd[mid] = end;
+  return end;
+}
+
+void intervalTreeBuild(IntervalTree& tree, std::vector<RangeInterval> intervals) {
+  std::sort(intervals.begin(), intervals.end(), [](const RangeInterval& a, const RangeInterval& b) {
+    return a.start != b.start ? a.start < b.start : a.desk < b.desk;
+  });
+  tree.intervals.swap(intervals);
+  tree.maxEnd.assign(tree.intervals.size(), INT64_MIN);
+  buildMaxEnd(tree, 0, tree.intervals.size());
+}
+
+static void queryTree(const IntervalTree& tree, size_t lo, size_t hi, int64_t fromMs, int64_t toMs,
+                      std::vector<RangeInterval>& out) {
+  if (lo >= hi) return;
+  size_t mid = lo + (hi - lo) / 2;
+  if (tree.maxEnd[mid] <= fromMs) return;   // Everything below ended before the range
+  queryTree(tree, lo, mid, fromMs, toMs, out);
+  const RangeInterval& iv = tree.intervals[mid];
+  if (iv.start > toMs) return;              // So does everything to the right
+  if (iv.end > fromMs) out.push_back(iv);
+  queryTree(tree, mid + 1, hi, fromMs, toMs, out);
+}
+
+void intervalTreeQuery(const IntervalTree& tree, int64_t fromMs, int64_t toMs, std::vector<RangeInterval>& out) {
+  if (fromMs <= toMs) queryTree(tree, 0, tree.intervals.size(), fromMs, toMs, out);
+}
+
+// ---- Session intervals ---------------------------------------------------
+
+struct ChangePoint {
+  int64_t time;
+  int series;            // 0 pomodoro.state, 1 session.active, 2 session.user
+  double value;
+};
+
+struct ChangeScan {
+  std::vector<ChangePoint>* points;
+  int series;
+};
+
+static bool collectChanges(void* context, const int64_t* times, const double* values, size_t count) {
+  ChangeScan& scan = *(ChangeScan*)context;
+  for (size_t i = 0; i < count; i++) scan.points->push_back({times[i], scan.series, values[i]});
+  return true;
+}
+
+// Pomodoro transitions and session start/stop are published on change
+// (retained), so each value holds until the next point. Points from one
+// message share a receive time and are applied together.
+bool rangeSessionIntervals(const char* root, int desk, std::vector<RangeInterval>& out) {
+  static const char* metrics[] = {"pomodoro.state", "session.active", "session.user"};
+  std::vector<ChangePoint> points;
+  bool found = false;
+  for (int m = 0; m < 3; m++) {
+    ChangeScan scan = {&points, m};
+    found |= columnStoreScan(root, columnSeriesName(desk, metrics[m]), INT64_MIN, INT64_MAX, collectChanges, &scan);
+  }
+  if (!found) return false;
+  std::stable_sort(points.begin(), points.end(),
+                   [](const ChangePoint& a, const ChangePoint& b) { return a.time < b.time; });
+
+  int state = RANGE_STATE_IDLE;
+  bool active = false;
+  uint32_t user = 0;
+  bool open = false;
+  RangeInterval run = {};
+  for (size_t i = 0; i < points.size();) {
+    int64_t t = points[i].time;
+    for (; i < points.size() && points[i].time == t; i++) {
+      double v = points[i].value;
+      if (v != v) continue;
+      if (points[i].series == 0) state = (int)v;
+      else if (points[i].series == 1) active = v != 0;
+      else user = v > 0 && v <= UINT32_MAX ? (uint32_t)v : 0;
+    }
+    uint32_t sessionUser = active ? user : 0;
+    if (open && state == run.state && sessionUser == run.user) continue;
+    if (open) {
+      run.end = t;
+      out.push_back(run);
+    }
+    run.start = t;
+    run.end = INT64_MAX;
+    run.desk = desk;
+    run.state = state;
+    run.user = sessionUser;
+    open = true;
+  }
+  if (open) out.push_back(run);
+  return true;
+}
+
+// ---- Engine ----------------------------------------------------------------
+
+bool rangeEngineOpen(RangeEngine& engine, const char* root) {
+  engine.root = root;
+  engine.desks.clear();
+  engine.series.clear();
+  DIR* d = opendir(root);
+  if (!d) return false;
+  while (struct dirent* e = readdir(d)) {
+    int desk;
+    char rest;
+    if (sscanf(e->d_name, "desk-%d%c", &desk, &rest) == 1 && desk >= 0) engine.desks.push_back(desk);
+  }
+  closedir(d);
+  std::sort(engine.desks.begin(), engine.desks.end());
+
+  std::vector<RangeInterval> intervals;
+  for (int desk : engine.desks) rangeSessionIntervals(root, desk, intervals);
+  intervalTreeBuild(engine.sessions, std::move(intervals));
+  return true;
+}
+
+void rangeEngineClose(RangeEngine& engine) {
+  for (auto& s : engine.series) seriesIndexClose(s.second);
+  engine.series.clear();
+}
+
+// A missing series is remembered as an empty index
+static SeriesIndex& seriesFor(RangeEngine& engine, int desk, const std::string& metric) {
+  std::string name = columnSeriesName(desk, metric.c_str());
+  auto it = engine.series.find(name);
+  if (it != engine.series.end()) return it->second;
+  SeriesIndex& index = engine.series[name];
+  seriesIndexOpen(index, engine.root.c_str(), name);
+  return index;
+}
+
+bool rangeEngineQuery(RangeEngine& engine, const RangeQuery& query, RangeResult& result,
+                      std::vector<RangeIntervalResult>* perInterval) {
+  memset(&result, 0, sizeof(result));
+  rollupReset(result.stats);
+  if (query.metric.empty()) return false;
+  if (query.fromMs > query.toMs) return true;
+
+  if (query.state == RANGE_ANY_STATE && query.user == 0) {
+    for (int desk : engine.desks) {
+      if (query.desk >= 0 && desk != query.desk) continue;
+      seriesIndexAggregate(seriesFor(engine, desk, query.metric), query.fromMs, query.toMs, result.stats,
+                           &result.query);
+    }
+    result.coveredMs = spanMs(query.fromMs, query.toMs);
+    return true;
+  }
+
+  std::vector<RangeInterval> hits;
+  intervalTreeQuery(engine.sessions, query.fromMs, query.toMs, hits);
+  // Intervals of all desks interleave; look each desk's series up once
+  std::vector<SeriesIndex*> deskSeries(engine.desks.empty() ? 0 : engine.desks.back() + 1, nullptr);
+  for (const RangeInterval& iv : hits) {
+    if (query.desk >= 0 && iv.desk != query.desk) continue;
+    if (query.state != RANGE_ANY_STATE && iv.state != query.state) continue;
+    if (query.user != 0 && iv.user != query.user) continue;
+    SeriesIndex*& index = deskSeries[iv.desk];
+    if (!index) index = &seriesFor(engine, iv.desk, query.metric);
+    int64_t from = std::max(iv.start, query.fromMs);
+    int64_t to = std::min(iv.end - 1, query.toMs);
+    RangeIntervalResult r;
+    r.interval = iv;
+    rollupReset(r.stats);
+    seriesIndexAggregate(*index, from, to, r.stats, &result.query);
+    rangeMergeStats(result.stats, r.stats);
+    result.intervals++;
+    result.coveredMs = addSaturating(result.coveredMs, spanMs(from, to));
+    if (perInterval) perInterval->push_back(r);
+  }
+  result.query.intervals = result.intervals;
+  return true;
+}
@@ -0,0 +1,146 @@
+#ifndef RANGE_QUERY_H
+#define RANGE_QUERY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "column_store.h"
+#include "rollup.h"
+
+// Time-range queries over recorded sessions, for questions like "mean noise
+// during work sessions for user X last month" without scanning every point.
+//
+// Two indexes:
+//   - A sparse block index per series: count/min/max/sum (rollup.h rules,
+//     so NaN and -999 are invalid) and first/last time of every
+//     RANGE_BLOCK_POINTS points. Blocks wholly inside a range are answered
+//     from the summary; only the two edge blocks are read, and those only
+//     between their binary-searched bounds. Summaries of sealed segments are
+//     cached next to them as seg-<id>.blk and checked against segments.idx,
+//     so a rewritten segment is re-indexed; the active segment is indexed
+//     on open.
+//   - An interval tree of session intervals: runs of constant Pomodoro
+//     state and session user, from the pomodoro.state, session.active and
+//     session.user series of each desk.
+//
+// Both are snapshots taken at open; reopen to see points written since.
+
+#define RANGE_BLOCK_POINTS   256
+#define RANGE_BLOCK_MAGIC    0x4B4C4242u  // "BBLK"
+#define RANGE_BLOCK_VERSION  1
+#define RANGE_ANY_STATE      -1
+
+// PomodoroState order (main_brain/data_structures.h)
+#define RANGE_STATE_IDLE         0
+#define RANGE_STATE_WORK         1
+#define RANGE_STATE_SHORT_BREAK  2
+#define RANGE_STATE_LONG_BREAK   3
+
+struct BlockSummary {
+  int64_t firstTime;
+  int64_t lastTime;
+  uint32_t segment;      // Position in SeriesIndex::segments
+  uint32_t offset;       // First point within the segment
+  uint32_t count;
+  RollupStats stats;
+};
+
+struct IndexedSegment {
+  uint32_t segmentId;
+  bool mapped;
+  SegmentView view;      // Opened on the first edge-block read
+};
+
+struct SeriesIndex {
+  std::string dir;
+  std::vector<IndexedSegment> segments;
+  std::vector<BlockSummary> blocks;   // Time order
+  uint32_t cachedSegments;            // Summaries read from seg-<id>.blk
+  uint32_t builtSegments;             // Summaries computed from the columns
+};
+
+struct RangeQueryStats {
+  uint64_t blocksSummarized;   // Answered from the block index
+  uint64_t blocksScanned;      // Edge blocks read from the columns
+  uint64_t pointsScanned;
+  uint64_t intervals;          // Session intervals matched
+};
+
+// Returns false if the series does not exist
+bool seriesIndexOpen(SeriesIndex& index, const char* root, const std::string& series);
+void seriesIndexClose(SeriesIndex& index);
+// Adds the points in [fromMs, toMs] to out
+void seriesIndexAggregate(SeriesIndex& index, int64_t fromMs, int64_t toMs, RollupStats& out,
+                          RangeQueryStats* stats = nullptr);
+
+// ---- Session intervals ---------------------------------------------------
+
+struct RangeInterval {
+  int64_t start;
+  int64_t end;           // Exclusive; INT64_MAX for a state still running
+  int32_t desk;
+  int32_t state;         // PomodoroState
+  uint32_t user;         // billeUserCode of the session's user, 0 outside a session
+};
+
+// Static augmented interval tree: intervals sorted by start, laid out as an
+// implicit balanced tree (the middle of each range is its root) with the
+// largest end below every node
+struct IntervalTree {
+  std::vector<RangeInterval> intervals;
+  std::vector<int64_t> maxEnd;
+};
+
+void intervalTreeBuild(IntervalTree& tree, std::vector<RangeInterval> intervals);
+// Appends the intervals overlapping [fromMs, toMs], in start order
+void intervalTreeQuery(const IntervalTree& tree, int64_t fromMs, int64_t toMs, std::vector<RangeInterval>& out);
+
+// A desk's intervals from its session series; false if it has none of them
+bool rangeSessionIntervals(const char* root, int desk, std::vector<RangeInterval>& out);
+
+// ---- Engine ----------------------------------------------------------------
+
+struct RangeQuery {
+  std::string metric;    // e.g. environment.noiseLevel
+  int64_t fromMs;
+  int64_t toMs;          // Inclusive
+  int desk;              // -1 for every desk
+  int state;             // RANGE_ANY_STATE for no state filter
+  uint32_t user;         // 0 for any user; otherwise only that user's sessions
+};
+
+struct RangeIntervalResult {
+  RangeInterval interval;
+  RollupStats stats;
+};
+
+struct RangeResult {
+  RollupStats stats;
+  uint64_t intervals;
+  int64_t coveredMs;     // Time inside the range and the matched intervals
+  RangeQueryStats query;
+};
+
+struct RangeEngine {
+  std::string root;
+  std::vector<int> desks;
+  IntervalTree sessions;                                   // Every desk
+  std::unordered_map<std::string, SeriesIndex> series;    // Opened on first use
+};
+
+bool rangeEngineOpen(RangeEngine& engine, const char* root);
+void rangeEngineClose(RangeEngine& engine);
+// Without a state or user filter the whole range counts; otherwise only the
+// matching session intervals inside it. perInterval, if given, gets one
+// entry per matched interval.
+bool rangeEngineQuery(RangeEngine& engine, const RangeQuery& query, RangeResult& result,
+                      std::vector<RangeIntervalResult>* perInterval = nullptr);
+
+void rangeMergeStats(RollupStats& into, const RollupStats& from);
+const char* rangeStateName(int state);
+int rangeStateCode(const char* name);   // -1 if unknown
+
+#endif
@@ -0,0 +1,319 @@
+#include "rollup.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "column_store.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ROLLUP_X86 1
+#include <immintrin.h>
+#endif
+
+// ---- Kernels -----------------------------------------------------------
+
+typedef void (*RollupKernel)(const double* values, size_t n, RollupStats& stats);
+
+static inline bool isValid(double v) {
+  return v == v && v != ROLLUP_SENTINEL;
+}
+
+// Branch-free so the loop does not stall on the odd NaN; also the tail of
+// the SIMD kernels
+static void accumulateScalar(const double* values, size_t n, RollupStats& stats) {
+  double lo = stats.min, hi = stats.max, sum = stats.sum;
+  uint64_t count = 0;
+  for (size_t i = 0; i < n; i++) {
+    double v = values[i];
+    bool ok = isValid(v);
+    double forMin = ok ? v : INFINITY;
+    double forMax = ok ? v : -INFINITY;
+    lo = forMin < lo ? forMin : lo;
+    hi = forMax > hi ? forMax : hi;
+    sum += ok ? v : 0.0;
+    count += ok;
+  }
+  stats.min = lo;
+  stats.max = hi;
+  stats.sum = sum;
+  stats.count += count;
+  stats.invalid += n - count;
+}
+
+#ifdef ROLLUP_X86
+
+// Two vectors per step, each with its own accumulators, to cover add latency
+static void accumulateSse2(const double* values, size_t n, RollupStats& stats) {
+  const __m128d sentinel = _mm_set1_pd(ROLLUP_SENTINEL);
+  const __m128d posInf = _mm_set1_pd(INFINITY);
+  const __m128d negInf = _mm_set1_pd(-INFINITY);
+  __m128d lo0 = posInf, lo1 = posInf, hi0 = negInf, hi1 = negInf;
+  __m128d sum0 = _mm_setzero_pd(), sum1 = _mm_setzero_pd();
+  __m128i count0 = _mm_setzero_si128(), count1 = _mm_setzero_si128();
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128d a = _mm_loadu_pd(values + i);
+    __m128d b = _mm_loadu_pd(values + i + 2);
+    // cmpneq is true for NaN, so it is combined with the ordered test
+    __m128d okA = _mm_and_pd(_mm_cmpord_pd(a, a), _mm_cmpneq_pd(a, sentinel));
+    __m128d okB = _mm_and_pd(_mm_cmpord_pd(b, b), _mm_cmpneq_pd(b, sentinel));
+    lo0 = _mm_min_pd(lo0, _mm_or_pd(_mm_and_pd(okA, a), _mm_andnot_pd(okA, posInf)));
+    lo1 = _mm_min_pd(lo1, _mm_or_pd(_mm_and_pd(okB, b), _mm_andnot_pd(okB, posInf)));
+    hi0 = _mm_max_pd(hi0, _mm_or_pd(_mm_and_pd(okA, a), _mm_andnot_pd(okA, negInf)));
+    hi1 = _mm_max_pd(hi1, _mm_or_pd(_mm_and_pd(okB, b), _mm_andnot_pd(okB, negInf)));
+    sum0 = _mm_add_pd(sum0, _mm_and_pd(okA, a));
+    sum1 = _mm_add_pd(sum1, _mm_and_pd(okB, b));
+    // A true lane is all ones, -1 as an integer
+    count0 = _mm_sub_epi64(count0, _mm_castpd_si128(okA));
+    count1 = _mm_sub_epi64(count1, _mm_castpd_si128(okB));
+  }
+  uint64_t counts[2];
+  _mm_storeu_si128((__m128i*)counts, _mm_add_epi64(count0, count1));
+  uint64_t count = counts[0] + counts[1];
+  double lanes[2];
+  _mm_storeu_pd(lanes, _mm_min_pd(lo0, lo1));
+  stats.min = std::min(stats.min, std::min(lanes[0], lanes[1]));
+  _mm_storeu_pd(lanes, _mm_max_pd(hi0, hi1));
+  stats.max = std::max(stats.max, std::max(lanes[0], lanes[1]));
+  _mm_storeu_pd(lanes, _mm_add_pd(sum0, sum1));
+  stats.sum += lanes[0] + lanes[1];
+  stats.count += count;
+  stats.invalid += i - count;
+  accumulateScalar(values + i, n - i, stats);
+}
+
+__attribute__((target("avx2")))
+static void accumulateAvx2(const double* values, size_t n, RollupStats& stats) {
+  const __m256d sentinel = _mm256_set1_pd(ROLLUP_SENTINEL);
+  const __m256d posInf = _mm256_set1_pd(INFINITY);
+  const __m256d negInf = _mm256_set1_pd(-INFINITY);
+  __m256d lo0 = posInf, lo1 = posInf, hi0 = negInf, hi1 = negInf;
+  __m256d sum0 = _mm256_setzero_pd(), sum1 = _mm256_setzero_pd();
+  __m256i count0 = _mm256_setzero_si256(), count1 = _mm256_setzero_si256();
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256d a = _mm256_loadu_pd(values + i);
+    __m256d b = _mm256_loadu_pd(values + i + 4);
+    // Ordered and not equal: false for NaN and for the sentinel
+    __m256d okA = _mm256_cmp_pd(a, sentinel, _CMP_NEQ_OQ);
+    __m256d okB = _mm256_cmp_pd(b, sentinel, _CMP_NEQ_OQ);
+    lo0 = _mm256_min_pd(lo0, _mm256_blendv_pd(posInf, a, okA));
+    lo1 = _mm256_min_pd(lo1, _mm256_blendv_pd(posInf, b, okB));
+    hi0 = _mm256_max_pd(hi0, _mm256_blendv_pd(negInf, a, okA));
+    hi1 = _mm256_max_pd(hi1, _mm256_blendv_pd(negInf, b, okB));
+    sum0 = _mm256_add_pd(sum0, _mm256_and_pd(okA, a));
+    sum1 = _mm256_add_pd(sum1, _mm256_and_pd(okB, b));
+    count0 = _mm256_sub_epi64(count0, _mm256_castpd_si256(okA));
+    count1 = _mm256_sub_epi64(count1, _mm256_castpd_si256(okB));
+  }
+  uint64_t counts[4];
+  _mm256_storeu_si256((__m256i*)counts, _mm256_add_epi64(count0, count1));
+  uint64_t count = (counts[0] + counts[1]) + (counts[2] + counts[3]);
+  double lanes[4];
+  _mm256_storeu_pd(lanes, _mm256_min_pd(lo0, lo1));
+  stats.min = std::min(stats.min, std::min(std::min(lanes[0], lanes[1]), std::min(lanes[2], lanes[3])));
+  _mm256_storeu_pd(lanes, _mm256_max_pd(hi0, hi1));
+  stats.max = std::max(stats.max, std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3])));
+  _mm256_storeu_pd(lanes, _mm256_add_pd(sum0, sum1));
+  stats.sum += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+  stats.count += count;
+  stats.invalid += i - count;
+  // The tail and the caller are SSE code; dirty upper halves would make
+  // every SSE instruction after this pay a state transition
+  _mm256_zeroupper();
+  accumulateScalar(values + i, n - i, stats);
+}
+
+#endif
+
+static RollupKernel kernelFor(RollupIsa isa) {
+#ifdef ROLLUP_X86
+  if (isa == ROLLUP_AVX2) return accumulateAvx2;
+  if (isa == ROLLUP_SSE2) return accumulateSse2;
+#endif
+  return isa == ROLLUP_SCALAR ? accumulateScalar : nullptr;
+}
+
+static bool isaSupported(RollupIsa isa) {
+#ifdef ROLLUP_X86
+  __builtin_cpu_init();
+  if (isa == ROLLUP_AVX2) return __builtin_cpu_supports("avx2");
+  if (isa == ROLLUP_SSE2) return __builtin_cpu_supports("sse2");
+#endif
+  return isa == ROLLUP_SCALAR;
+}
+
+static bool selected = false;
+static RollupIsa activeIsa = ROLLUP_SCALAR;
+static RollupKernel activeKernel = accumulateScalar;
+
+RollupIsa rollupDetectIsa() {
+  if (isaSupported(ROLLUP_AVX2)) return ROLLUP_AVX2;
+  if (isaSupported(ROLLUP_SSE2)) return ROLLUP_SSE2;
+  return ROLLUP_SCALAR;
+}
+
+bool rollupSetIsa(RollupIsa isa) {
+  if (!isaSupported(isa)) return false;
+  activeIsa = isa;
+  activeKernel = kernelFor(isa);
+  selected = true;
+  return true;
+}
+
+RollupIsa rollupIsa() {
+  if (!selected) rollupSetIsa(rollupDetectIsa());
+  return activeIsa;
+}
+
+const char* rollupIsaName(RollupIsa isa) {
+  switch (isa) {
+    case ROLLUP_AVX2: return "avx2";
+    case ROLLUP_SSE2: return "sse2";
+    default: return "scalar";
+  }
+}
+
+void rollupReset(RollupStats& stats) {
+  stats.count = 0;
+  stats.invalid = 0;
+  stats.min = INFINITY;
+  stats.max = -INFINITY;
+  stats.sum = 0;
+}
+
+void rollupAccumulate(const double* values, size_t n, RollupStats& stats) {
+  if (!selected) rollupSetIsa(rollupDetectIsa());
+  activeKernel(values, n, stats);
+}
+
+bool rollupAccumulateWith(RollupIsa isa, const double* values, size_t n, RollupStats& stats) {
+  if (!isaSupported(isa)) return false;
+  kernelFor(isa)(values, n, stats);
+  return true;
+}
+
+// ---- Buckets -----------------------------------------------------------
+
+// Value at a fractional rank, rank in [from, n - 1]. Elements before from
+// must already be <= everything after it (an earlier call's nth_element).
+static double valueAtRank(double* values, size_t n, size_t from, double rank) {
+  size_t lo = (size_t)rank;
+  std::nth_element(values + from, values + lo, values + n);
+  double below = values[lo];
+  double fraction = rank - lo;
+  if (fraction == 0) return below;
+  // Everything after lo is >= below once nth_element has run
+  double above = *std::min_element(values + lo + 1, values + n);
+  return above == below ? below : below + (above - below) * fraction;
+}
+
+static double rankOf(double percentile, size_t n) {
+  double rank = percentile / 100.0 * (n - 1);
+  return rank < 0 ? 0 : rank > n - 1 ? n - 1 : rank;
+}
+
+double rollupPercentile(double* values, size_t n, double percentile) {
+  if (n == 0) return NAN;
+  return valueAtRank(values, n, 0, rankOf(percentile, n));
+}
+
+// First index in [from, last) with times[index] >= t. Galloping from the
+// front, so short buckets cost a few compares rather than a search of the
+// whole slice.
+static size_t gallop(const int64_t* times, size_t from, size_t last, int64_t t) {
+  size_t lo = from, step = 1;
+  while (lo + step < last && times[lo + step] < t) {
+    lo += step;
+    step <<= 1;
+  }
+  size_t hi = lo + step < last ? lo + step : last;
+  return std::lower_bound(times + lo, times + hi, t) - times;
+}
+
+static int64_t bucketStart(int64_t t, int64_t width) {
+  int64_t q = t / width;
+  if (t % width != 0 && t < 0) q--;
+  return q * width;
+}
+
+static void closeBucket(Rollup& r) {
+  if (!r.open) return;
+  RollupBucket& b = r.current;
+  for (int p = 0; p < ROLLUP_MAX_PERCENTILES; p++) b.percentiles[p] = NAN;
+  // Percentiles ascend, so each selection starts at the previous rank
+  size_t n = r.scratch.size();
+  size_t from = 0;
+  for (int p = 0; p < r.query.percentileCount && n > 0; p++) {
+    double rank = rankOf(r.query.percentiles[p], n);
+    b.percentiles[p] = valueAtRank(r.scratch.data(), n, from, rank);
+    from = (size_t)rank;
+  }
+  r.buckets.push_back(b);
+  r.scratch.clear();
+  r.open = false;
+}
+
+void rollupBegin(Rollup& r, const RollupQuery& query) {
+  r.query = query;
+  if (r.query.bucketMs <= 0) r.query.bucketMs = 1;
+  if (r.query.percentileCount < 0) r.query.percentileCount = 0;
+  if (r.query.percentileCount > ROLLUP_MAX_PERCENTILES) r.query.percentileCount = ROLLUP_MAX_PERCENTILES;
+  std::sort(r.query.percentiles, r.query.percentiles + r.query.percentileCount);
+  r.buckets.clear();
+  r.scratch.clear();
+  r.open = false;
+}
+
+void rollupAdd(Rollup& r, const int64_t* times, const double* values, size_t n) {
+  // Trim to the query range; times are sorted, so two searches do it
+  size_t first = std::lower_bound(times, times + n, r.query.fromMs) - times;
+  size_t last = std::upper_bound(times + first, times + n, r.query.toMs) - times;
+  const int64_t width = r.query.bucketMs;
+  size_t i = first;
+  while (i < last) {
+    int64_t start = bucketStart(times[i], width);
+    if (!r.open || start != r.current.startMs) {
+      closeBucket(r);
+      r.current.startMs = start;
+      rollupReset(r.current.stats);
+      r.open = true;
+    }
+    int64_t end = start > INT64_MAX - width ? INT64_MAX : start + width;
+    size_t runEnd = end == INT64_MAX ? last : gallop(times, i, last, end);
+    rollupAccumulate(values + i, runEnd - i, r.current.stats);
+    if (r.query.percentileCount > 0) {
+      size_t base = r.scratch.size();
+      r.scratch.resize(base + (runEnd - i));
+      double* out = r.scratch.data() + base;
+      size_t kept = 0;
+      for (size_t k = i; k < runEnd; k++) {
+        out[kept] = values[k];
+        kept += isValid(values[k]);
+      }
+      r.scratch.resize(base + kept);
+    }
+    i = runEnd;
+  }
+}
+
+void rollupFinish(Rollup& r) {
+  closeBucket(r);
+}
+
+static bool addSlice(void* context, const int64_t* times, const double* values, size_t count) {
+  rollupAdd(*(Rollup*)context, times, values, count);
+  return true;
+}
+
+bool rollupSeries(const char* root, const std::string& series, const RollupQuery& query,
+                  std::vector<RollupBucket>& out) {
+  Rollup r;
+  rollupBegin(r, query);
+  if (!columnStoreScan(root, series, r.query.fromMs, r.query.toMs, addSlice, &r)) return false;
+  rollupFinish(r);
+  out.swap(r.buckets);
+  return true;
+}
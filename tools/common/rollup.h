@@ -0,0 +1,83 @@
+#ifndef ROLLUP_H
+#define ROLLUP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+// Bucketed min/max/mean/percentile rollups over column-store series, for
+// charting months of history. The inner loop (count/min/max/sum of the valid
+// values in a slice) has AVX2, SSE2 and scalar kernels; the best one the CPU
+// supports is picked at first use (rollupSetIsa overrides it). The kernels
+// are compiled with per-function target attributes, so the library builds
+// without -mavx2 and still runs on any x86-64 or non-x86 host.
+//
+// NaN and ROLLUP_SENTINEL (the environment monitor's DHT failure value) are
+// not readings: they are counted as invalid and left out of every statistic.
+// Infinities are ordinary values.
+
+#define ROLLUP_SENTINEL         -999.0
+#define ROLLUP_MAX_PERCENTILES  8
+
+enum RollupIsa {
+  ROLLUP_SCALAR,
+  ROLLUP_SSE2,
+  ROLLUP_AVX2
+};
+
+struct RollupStats {
+  uint64_t count;      // Valid values
+  uint64_t invalid;    // NaN or sentinel
+  double min;          // +inf / -inf while count is 0
+  double max;
+  double sum;
+};
+
+struct RollupBucket {
+  int64_t startMs;     // Multiple of the bucket width
+  RollupStats stats;
+  double percentiles[ROLLUP_MAX_PERCENTILES];  // NaN for a bucket without valid values
+};
+
+struct RollupQuery {
+  int64_t fromMs;
+  int64_t toMs;
+  int64_t bucketMs;
+  int percentileCount;
+  double percentiles[ROLLUP_MAX_PERCENTILES];  // 0..100, ascending
+};
+
+// Incremental builder: feed slices in time order (as columnStoreScan does)
+struct Rollup {
+  RollupQuery query;
+  std::vector<RollupBucket> buckets;
+  std::vector<double> scratch;   // Valid values of the open bucket, for percentiles
+  bool open;
+  RollupBucket current;
+};
+
+RollupIsa rollupDetectIsa();           // Best kernel this CPU runs
+bool rollupSetIsa(RollupIsa isa);      // False if the CPU lacks it
+RollupIsa rollupIsa();                 // Kernel in use
+const char* rollupIsaName(RollupIsa isa);
+
+void rollupReset(RollupStats& stats);
+// Adds values[0..n) to stats with the selected kernel
+void rollupAccumulate(const double* values, size_t n, RollupStats& stats);
+// Same, with a given kernel (benchmarks and cross-checks); false if unsupported
+bool rollupAccumulateWith(RollupIsa isa, const double* values, size_t n, RollupStats& stats);
+
+void rollupBegin(Rollup& r, const RollupQuery& query);
+// times must not go backwards across calls; points outside the query range are skipped
+void rollupAdd(Rollup& r, const int64_t* times, const double* values, size_t n);
+void rollupFinish(Rollup& r);           // Closes the last bucket
+
+// Whole series from the column store. Returns false if the series does not exist.
+bool rollupSeries(const char* root, const std::string& series, const RollupQuery& query,
+                  std::vector<RollupBucket>& out);
+
+// Linear interpolation between the closest ranks; values[0..n) is reordered
+double rollupPercentile(double* values, size_t n, double percentile);
+
+#endif
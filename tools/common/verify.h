@@ -0,0 +1,19 @@
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include <stdio.h>
+
+// Self-check helpers for the host tools' --verify modes. check() reports a
+// failed expectation and keeps going, so one run lists every failure; the
+// tool exits non-zero if verifyFailures is set at the end.
+
+inline int verifyFailures = 0;
+
+inline void check(bool ok, const char* what) {
+  if (!ok) {
+    fprintf(stderr, "verify: FAILED %s\n", what);
+    verifyFailures++;
+  }
+}
+
+#endif
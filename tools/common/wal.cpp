@@ -0,0 +1,410 @@
+#include "wal.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#define WAL_PAGE 4096
+
+struct WalSegmentHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t segmentSize;
+  uint64_t firstLsn;
+};
+
+static uint64_t nowMicros() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static size_t align8(size_t n) {
+  return (n + 7) & ~(size_t)7;
+}
+
+// ---- CRC32C (Castagnoli) -----------------------------------------------
+
+static uint32_t crcTable[8][256];
+static bool crcReady = false;
+
+static void crcInit() {
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t c = i;
+    for (int k = 0; k < 8; k++) c = (c >> 1) ^ (0x82F63B78u & (0u - (c & 1)));
+    crcTable[0][i] = c;
+  }
+  for (uint32_t i = 0; i < 256; i++) {
+    for (int t = 1; t < 8; t++) crcTable[t][i] = (crcTable[t - 1][i] >> 8) ^ crcTable[0][crcTable[t - 1][i] & 0xFF];
+  }
+  crcReady = true;
+}
+
+// Slice-by-8, little-endian hosts
+static uint32_t crc32cSoftware(uint32_t crc, const uint8_t* p, size_t n) {
+  if (!crcReady) crcInit();
+  while (n >= 8) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    v ^= crc;
+    crc = crcTable[7][v & 0xFF] ^ crcTable[6][(v >> 8) & 0xFF] ^ crcTable[5][(v >> 16) & 0xFF] ^
+          crcTable[4][(v >> 24) & 0xFF] ^ crcTable[3][(v >> 32) & 0xFF] ^ crcTable[2][(v >> 40) & 0xFF] ^
+          crcTable[1][(v >> 48) & 0xFF] ^ crcTable[0][v >> 56];
+    p += 8;
+    n -= 8;
+  }
+  while (n--) crc = (crc >> 8) ^ crcTable[0][(crc ^ *p++) & 0xFF];
+  return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static uint32_t crc32cHardware(uint32_t crc, const uint8_t* p, size_t n) {
+  uint64_t c = crc;
+  while (n >= 8) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    c = __builtin_ia32_crc32di(c, v);
+    p += 8;
+    n -= 8;
+  }
+  uint32_t c32 = (uint32_t)c;
+  while (n--) c32 = __builtin_ia32_crc32qi(c32, *p++);
+  return c32;
+}
+#endif
+
+uint32_t crc32c(uint32_t crc, const void* data, size_t length) {
+  crc = ~crc;
+#if defined(__x86_64__)
+  static const bool hardware = __builtin_cpu_supports("sse4.2");
+  if (hardware) return ~crc32cHardware(crc, (const uint8_t*)data, length);
+#endif
+  return ~crc32cSoftware(crc, (const uint8_t*)data, length);
+}
+
+// ---- Segments ----------------------------------------------------------
+
+static std::string segmentName(const std::string& dir, uint64_t firstLsn) {
+  char name[40];
+  snprintf(name, sizeof(name), "/wal-%016" PRIx64 ".log", firstLsn);
+  return dir + name;
+}
+
+static std::vector<uint64_t> listSegments(const std::string& dir) {
+  std::vector<uint64_t> out;
+  DIR* d = opendir(dir.c_str());
+  if (!d) return out;
+  while (struct dirent* e = readdir(d)) {
+    uint64_t lsn;
+    char tail[8];
+    if (sscanf(e->d_name, "wal-%16" SCNx64 ".%4s", &lsn, tail) == 2 && strcmp(tail, "log") == 0) out.push_back(lsn);
+  }
+  closedir(d);
+  std::sort(out.begin(), out.end());
+  return out;
+}
+
+static void syncDir(const std::string& dir) {
+  int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+  if (fd >= 0) {
+    fsync(fd);
+    close(fd);
+  }
+}
+
+// Parses the record at pos; false if it is not an intact record with this lsn
+static bool readRecord(const uint8_t* map, size_t size, size_t pos, uint64_t lsn, WalRecord& out, size_t& next) {
+  if (pos + WAL_RECORD_HEADER > size) return false;
+  const uint8_t* r = map + pos;
+  uint32_t crc, length;
+  uint16_t topicLength;
+  memcpy(&crc, r, 4);
+  memcpy(&length, r + 4, 4);
+  memcpy(&out.lsn, r + 8, 8);
+  memcpy(&out.receivedMs, r + 16, 8);
+  memcpy(&topicLength, r + 24, 2);
+  out.flags = r[26];
+  if (out.lsn != lsn || topicLength > WAL_MAX_TOPIC) return false;
+  size_t body = WAL_RECORD_HEADER + topicLength + (size_t)length;
+  if (body > size - pos) return false;
+  if (crc32c(0, r + 4, body - 4) != crc) return false;
+  out.topic = (const char*)r + WAL_RECORD_HEADER;
+  out.topicLength = topicLength;
+  out.payload = r + WAL_RECORD_HEADER + topicLength;
+  out.length = length;
+  next = pos + align8(body);
+  return true;
+}
+
+// SEGMENT_INVALID: the file is shorter than a header or its magic/version
+// is wrong, i.e. it was cut off while being created. SEGMENT_ERROR: it could
+// not be opened or mapped (errno is set); it may well hold records.
+enum SegmentMap { SEGMENT_MAPPED, SEGMENT_INVALID, SEGMENT_ERROR };
+
+static SegmentMap mapSegment(Wal& wal, const std::string& path, bool create, uint64_t firstLsn) {
+  int fd = open(path.c_str(), O_RDWR | (create ? O_CREAT | O_EXCL : 0), 0644);
+  if (fd < 0) return SEGMENT_ERROR;
+  if (create) {
+    // Preallocate so syncing appends never has to update the block map
+    if (posix_fallocate(fd, 0, wal.segmentSize) != 0 && ftruncate(fd, wal.segmentSize) != 0) {
+      close(fd);
+      return SEGMENT_ERROR;
+    }
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    int error = errno;
+    close(fd);
+    errno = error;
+    return SEGMENT_ERROR;
+  }
+  if ((size_t)st.st_size < WAL_HEADER_SIZE) {
+    close(fd);
+    return SEGMENT_INVALID;
+  }
+  wal.mapSize = create ? wal.segmentSize : (size_t)st.st_size;
+  void* map = mmap(nullptr, wal.mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    int error = errno;
+    close(fd);
+    errno = error;
+    return SEGMENT_ERROR;
+  }
+  WalSegmentHeader* h = (WalSegmentHeader*)map;
+  if (create) {
+    h->magic = WAL_MAGIC;
+    h->version = WAL_VERSION;
+    h->segmentSize = wal.mapSize;
+    h->firstLsn = firstLsn;
+    msync(map, WAL_PAGE, MS_SYNC);
+    fsync(fd);
+    syncDir(wal.dir);
+    wal.stats.segmentsCreated++;
+  } else if (h->magic != WAL_MAGIC || h->version != WAL_VERSION) {
+    munmap(map, wal.mapSize);
+    close(fd);
+    return SEGMENT_INVALID;
+  }
+  wal.fd = fd;
+  wal.map = (uint8_t*)map;
+  wal.segmentFirstLsn = h->firstLsn;
+  wal.writePos = WAL_HEADER_SIZE;
+  wal.syncedPos = WAL_HEADER_SIZE;
+  return SEGMENT_MAPPED;
+}
+
+static void unmapSegment(Wal& wal) {
+  if (!wal.map) return;
+  munmap(wal.map, wal.mapSize);
+  close(wal.fd);
+  wal.map = nullptr;
+  wal.fd = -1;
+}
+
+// Clears a torn tail so the next appends start from clean zeros. Stops at the
+// first all-zero page past the tail: nothing beyond it was ever written.
+static void clearTail(Wal& wal) {
+  size_t pos = wal.writePos;
+  while (pos < wal.mapSize) {
+    size_t pageEnd = std::min((pos / WAL_PAGE + 1) * WAL_PAGE, wal.mapSize);
+    bool dirty = false;
+    for (size_t i = pos; i + 8 <= pageEnd && !dirty; i += 8) {
+      uint64_t v;
+      memcpy(&v, wal.map + i, 8);
+      dirty = v != 0;
+    }
+    if (!dirty && pos % WAL_PAGE == 0) break;
+    if (dirty) {
+      wal.stats.tornBytes += pageEnd - pos;
+      memset(wal.map + pos, 0, pageEnd - pos);
+    }
+    pos = pageEnd;
+  }
+  if (wal.stats.tornBytes) msync(wal.map, wal.mapSize, MS_SYNC);
+}
+
+bool walOpen(Wal& wal, const char* dir, size_t segmentSize, int syncIntervalMs, uint64_t firstLsn) {
+  wal.dir = dir;
+  wal.segmentSize = segmentSize < 2 * WAL_HEADER_SIZE ? 2 * WAL_HEADER_SIZE : segmentSize;
+  wal.syncIntervalMicros = syncIntervalMs * 1000ULL;
+  wal.fd = -1;
+  wal.map = nullptr;
+  wal.pendingRecords = 0;
+  memset(&wal.stats, 0, sizeof(wal.stats));
+  if (mkdir(dir, 0755) != 0 && errno != EEXIST) return false;
+
+  uint64_t start = nowMicros();
+  std::vector<uint64_t> segments = listSegments(wal.dir);
+  if (firstLsn == 0) firstLsn = 1;
+  if (segments.empty()) {
+    wal.nextLsn = firstLsn;
+    if (mapSegment(wal, segmentName(wal.dir, firstLsn), true, firstLsn) != SEGMENT_MAPPED) return false;
+  } else {
+    // Only the newest segment can have a torn tail; older ones were synced
+    // in full before the log moved on. A newest segment without a valid
+    // header was cut off while being created and holds no records. One that
+    // cannot be opened or mapped is left alone and the open fails.
+    SegmentMap mapped;
+    while ((mapped = mapSegment(wal, segmentName(wal.dir, segments.back()), false, 0)) == SEGMENT_INVALID) {
+      uint64_t first = segments.back();
+      if (unlink(segmentName(wal.dir, first).c_str()) != 0) return false;
+      segments.pop_back();
+      if (segments.empty()) {
+        wal.nextLsn = first;
+        if (mapSegment(wal, segmentName(wal.dir, first), true, first) != SEGMENT_MAPPED) return false;
+        wal.stats.recoveryMicros = nowMicros() - start;
+        wal.lastSyncMicros = nowMicros();
+        return true;
+      }
+    }
+    if (mapped == SEGMENT_ERROR) return false;
+    uint64_t lsn = wal.segmentFirstLsn;
+    size_t pos = WAL_HEADER_SIZE, next;
+    WalRecord record;
+    while (readRecord(wal.map, wal.mapSize, pos, lsn, record, next)) {
+      pos = next;
+      lsn++;
+      wal.stats.recoveredRecords++;
+    }
+    wal.writePos = pos;
+    wal.syncedPos = pos;
+    wal.nextLsn = lsn;
+    clearTail(wal);
+  }
+  wal.stats.recoveryMicros = nowMicros() - start;
+  wal.lastSyncMicros = nowMicros();
+  return true;
+}
+
+bool walSync(Wal& wal) {
+  if (!wal.map || wal.writePos == wal.syncedPos) return true;
+  size_t start = wal.syncedPos & ~(size_t)(WAL_PAGE - 1);
+  bool ok = msync(wal.map + start, wal.writePos - start, MS_SYNC) == 0;
+  if (ok) {
+    // Synced whole pages are clean; drop them so the log costs no resident memory
+    size_t end = wal.writePos & ~(size_t)(WAL_PAGE - 1);
+    if (end > start) madvise(wal.map + start, end - start, MADV_DONTNEED);
+    wal.stats.syncs++;
+    if (wal.pendingRecords > wal.stats.maxGroup) wal.stats.maxGroup = wal.pendingRecords;
+    wal.syncedPos = wal.writePos;
+    wal.pendingRecords = 0;
+  }
+  wal.lastSyncMicros = nowMicros();
+  return ok;
+}
+
+bool walMaybeSync(Wal& wal) {
+  if (wal.pendingRecords == 0) return true;
+  if (nowMicros() - wal.lastSyncMicros < wal.syncIntervalMicros) return true;
+  return walSync(wal);
+}
+
+static bool rollover(Wal& wal) {
+  if (!walSync(wal)) return false;
+  unmapSegment(wal);
+  return mapSegment(wal, segmentName(wal.dir, wal.nextLsn), true, wal.nextLsn) == SEGMENT_MAPPED;
+}
+
+uint64_t walAppend(Wal& wal, const char* topic, size_t topicLength, const uint8_t* payload,
+                   size_t length, int64_t receivedMs, bool durable) {
+  if (!wal.map || topicLength > WAL_MAX_TOPIC) return 0;
+  size_t body = WAL_RECORD_HEADER + topicLength + length;
+  size_t size = align8(body);
+  if (size > wal.segmentSize - WAL_HEADER_SIZE) return 0;
+  if (wal.writePos + size > wal.mapSize && !rollover(wal)) return 0;
+
+  uint8_t* r = wal.map + wal.writePos;
+  uint32_t length32 = (uint32_t)length;
+  uint16_t topic16 = (uint16_t)topicLength;
+  uint64_t lsn = wal.nextLsn;
+  memcpy(r + 4, &length32, 4);
+  memcpy(r + 8, &lsn, 8);
+  memcpy(r + 16, &receivedMs, 8);
+  memcpy(r + 24, &topic16, 2);
+  r[26] = durable ? WAL_FLAG_DURABLE : 0;
+  r[27] = 0;
+  memcpy(r + WAL_RECORD_HEADER, topic, topicLength);
+  memcpy(r + WAL_RECORD_HEADER + topicLength, payload, length);
+  memset(r + body, 0, size - body);
+  uint32_t crc = crc32c(0, r + 4, body - 4);
+  memcpy(r, &crc, 4);
+
+  wal.writePos += size;
+  wal.nextLsn++;
+  wal.pendingRecords++;
+  wal.stats.records++;
+  wal.stats.bytes += size;
+
+  if (durable) {
+    if (!walSync(wal)) return 0;
+    wal.stats.durableSyncs++;
+  }
+  return lsn;
+}
+
+void walTruncateBefore(Wal& wal, uint64_t lsn) {
+  std::vector<uint64_t> segments = listSegments(wal.dir);
+  // A segment is dead once the next one starts at or below lsn
+  for (size_t i = 0; i + 1 < segments.size(); i++) {
+    if (segments[i + 1] > lsn || segments[i] == wal.segmentFirstLsn) break;
+    if (unlink(segmentName(wal.dir, segments[i]).c_str()) == 0) wal.stats.segmentsRemoved++;
+  }
+}
+
+void walClose(Wal& wal) {
+  walSync(wal);
+  unmapSegment(wal);
+}
+
+uint64_t walReplay(const char* dir, uint64_t fromLsn, WalVisitor visit, void* context) {
+  std::string d = dir;
+  std::vector<uint64_t> segments = listSegments(d);
+  uint64_t visited = 0;
+  uint64_t expected = 0;
+
+  for (size_t i = 0; i < segments.size(); i++) {
+    if (i + 1 < segments.size() && segments[i + 1] <= fromLsn) continue;
+    if (expected && segments[i] != expected) break;  // Gap: nothing after it can be trusted
+
+    int fd = open(segmentName(d, segments[i]).c_str(), O_RDONLY);
+    if (fd < 0) break;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < WAL_HEADER_SIZE) {
+      close(fd);
+      break;
+    }
+    size_t size = st.st_size;
+    void* map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) break;
+    madvise(map, size, MADV_SEQUENTIAL);
+
+    const WalSegmentHeader* h = (const WalSegmentHeader*)map;
+    bool stop = h->magic != WAL_MAGIC || h->firstLsn != segments[i];
+    uint64_t lsn = segments[i];
+    size_t pos = WAL_HEADER_SIZE, next;
+    WalRecord record;
+    while (!stop && readRecord((const uint8_t*)map, size, pos, lsn, record, next)) {
+      if (lsn >= fromLsn) {
+        visited++;
+        if (!visit(context, record)) stop = true;
+      }
+      pos = next;
+      lsn++;
+    }
+    munmap(map, size);
+    if (stop) break;
+    expected = lsn;
+  }
+  return visited;
+}
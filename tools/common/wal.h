@@ -0,0 +1,101 @@
+#ifndef WAL_H
+#define WAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+// Append-only write-ahead log for captured MQTT traffic. Records go into
+// memory-mapped segment files; durability is by group commit: walSync()
+// msyncs everything appended since the last sync in one call, and
+// walMaybeSync() does so once the flush interval has passed. A record
+// appended with durable=true is synced before walAppend returns - used for
+// session and Pomodoro transitions, which must survive power loss.
+//
+// Segment  wal-<first lsn, 16 hex>.log, preallocated to segmentSize
+//   header (one page): magic, version, segment size, first lsn
+//   records, 8-byte aligned:
+//     u32 crc32c of everything after this field (header + topic + payload)
+//     u32 payload length
+//     u64 lsn (consecutive across segments)
+//     i64 receive time, ms
+//     u16 topic length, u8 flags, u8 reserved
+//     topic bytes, payload bytes, zero padding
+//
+// Recovery (walOpen) scans the newest segment and stops at the first record
+// whose CRC, length or lsn does not check out; everything before it is
+// intact, everything after is treated as never written.
+
+#define WAL_MAGIC              0x314C4157u   // "WAL1"
+#define WAL_VERSION            1
+#define WAL_HEADER_SIZE        4096
+#define WAL_RECORD_HEADER      28
+#define WAL_DEFAULT_SEGMENT    (64u << 20)
+#define WAL_DEFAULT_SYNC_MS    50
+#define WAL_MAX_TOPIC          512
+
+#define WAL_FLAG_DURABLE       0x01   // Synced on append
+
+struct WalRecord {
+  uint64_t lsn;
+  int64_t receivedMs;
+  uint8_t flags;
+  const char* topic;
+  size_t topicLength;
+  const uint8_t* payload;
+  size_t length;
+};
+
+struct WalStats {
+  uint64_t records;
+  uint64_t bytes;
+  uint64_t syncs;             // Group commits
+  uint64_t durableSyncs;      // Forced by a durable record
+  uint64_t maxGroup;          // Most records made durable by one sync
+  uint64_t segmentsCreated;
+  uint64_t segmentsRemoved;
+  uint64_t recoveredRecords;  // Found intact by walOpen
+  uint64_t recoveryMicros;
+  uint64_t tornBytes;         // Discarded after the last intact record
+};
+
+struct Wal {
+  std::string dir;
+  size_t segmentSize;         // For new segments
+  size_t mapSize;             // Of the segment being appended to
+  uint64_t syncIntervalMicros;
+  int fd;
+  uint8_t* map;
+  uint64_t segmentFirstLsn;
+  size_t writePos;
+  size_t syncedPos;
+  uint64_t nextLsn;
+  uint64_t pendingRecords;    // Appended since the last sync
+  uint64_t lastSyncMicros;
+  WalStats stats;
+};
+
+// Opens (or creates) the log in dir and recovers its tail. A new log starts
+// at firstLsn, so one recreated after a checkpoint does not reuse lsns.
+// False (with errno) if a segment cannot be opened or mapped; nothing is
+// deleted then.
+bool walOpen(Wal& wal, const char* dir, size_t segmentSize = WAL_DEFAULT_SEGMENT,
+             int syncIntervalMs = WAL_DEFAULT_SYNC_MS, uint64_t firstLsn = 1);
+// Returns the record's lsn, 0 on failure
+uint64_t walAppend(Wal& wal, const char* topic, size_t topicLength, const uint8_t* payload,
+                   size_t length, int64_t receivedMs, bool durable);
+bool walSync(Wal& wal);
+bool walMaybeSync(Wal& wal);
+// Deletes whole segments that only hold records below lsn (after a checkpoint)
+void walTruncateBefore(Wal& wal, uint64_t lsn);
+void walClose(Wal& wal);
+
+// Calls visit for every intact record with lsn >= fromLsn, in order. The
+// record's pointers are only valid during the call. Returns records visited.
+typedef bool (*WalVisitor)(void* context, const WalRecord& record);
+uint64_t walReplay(const char* dir, uint64_t fromLsn, WalVisitor visit, void* context);
+
+uint32_t crc32c(uint32_t crc, const void* data, size_t length);
+
+#endif
@@ -0,0 +1,371 @@
+/*
+===============================================================
+Bill-E Fan Controller Simulator
+Room thermal model for the environment monitor's fan controller
+===============================================================
+
+Runs sketches/environment_monitor/fan_controller.cpp, compiled in place,
+against a first-order thermal model of a study room. The room relaxes
+towards an equilibrium that follows the day: outside temperature plus
+heat from the occupant and a PC during working hours. The fan pulls it
+down at a fixed rate while the relay is on. The sensor is read every
+10 s like the firmware's loop(), with uniform noise of --noise °C and an
+occasional failed read (-999), and each reading goes through the same
+calls as controlFan().
+
+The old fixed 22/24 °C hysteresis on the raw reading runs on the same
+day as the baseline. Both are scored on:
+- Relay actuations
+- Overshoot: how far the true room temperature rises above FAN_ON_TEMP
+- Shortest ON and OFF periods (the dwell protection)
+
+--verify checks the model's fit on exact ramps and the dwell, failed-read
+and steady-room cases. It then asserts the actuation and overshoot bounds
+over a week of simulated days at ±0.6 °C and at the DHT11's rated ±2 °C.
+--bench prints both controllers' figures per day as JSON.
+
+BUILD (from the repository root):
+  g++ -O2 -std=c++17 -Itools/common -Isketches/environment_monitor \
+      -o bille-fan tools/fan/fan.cpp sketches/environment_monitor/fan_controller.cpp
+
+USAGE:
+  ./bille-fan --verify
+  ./bille-fan --bench                  # 8 h days, 30 seeds
+  ./bille-fan --bench --days 100 --noise 1.0
+===============================================================
+*/
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <string>
+
+#include "config.h"
+#include "fan_controller.h"
+#include "verify.h"
+
+#define SIM_STEP_MS          1000UL
+#define SIM_READ_MS          10000UL      // environment_monitor.ino reads every 10 s
+#define SIM_DAY_MS           (8 * 3600000UL)
+#define ROOM_TAU_MIN         25.0f        // Room time constant towards equilibrium
+#define FAN_COOLING_PER_MIN  0.35f        // °C per minute the fan removes
+#define FAILED_READ_RATE     0.01f        // Fraction of DHT reads that fail
+
+struct Options {
+  bool bench = false;
+  bool verify = false;
+  int days = 30;
+  float noise = 0.6f;                     // ± °C, uniform
+};
+
+static Options opts;
+
+// ---- Room model ----------------------------------------------------------
+
+struct Rng {
+  uint64_t state;
+  uint32_t next() {
+    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (uint32_t)(state >> 33);
+  }
+  float uniform() { return next() / 2147483648.0f; }   // [0, 1)
+};
+
+struct Day {
+  float outside;                          // Equilibrium at the start of the day
+  float warming;                          // Rise of the equilibrium by mid-afternoon
+  float occupantHeat;                     // Extra equilibrium while someone is at the desk
+};
+
+static Day makeDay(Rng& rng) {
+  Day d;
+  d.outside = 20.5f + 2.0f * rng.uniform();
+  d.warming = 2.0f + 3.0f * rng.uniform();
+  d.occupantHeat = 1.0f + 1.0f * rng.uniform();
+  return d;
+}
+
+// Occupied in two blocks with a lunch break; equilibrium peaks at ~5 h
+static float equilibrium(const Day& d, unsigned long t) {
+  float hours = t / 3600000.0f;
+  float sun = sinf((float)M_PI * std::min(hours / 10.0f, 1.0f));
+  bool occupied = (hours >= 0.25f && hours < 3.5f) || (hours >= 4.25f && hours < 7.75f);
+  return d.outside + d.warming * sun + (occupied ? d.occupantHeat : 0);
+}
+
+// Returns the next reading: -999 for a failed read
+static float readSensor(Rng& rng, float temperature, float noise) {
+  if (rng.uniform() < FAILED_READ_RATE) return -999;
+  return temperature + noise * (2 * rng.uniform() - 1);
+}
+
+struct DayResult {
+  unsigned long actuations;
+  float overshoot;                        // Peak true temperature above FAN_ON_TEMP, >= 0
+  float minutesAbove;                     // Minutes with the true temperature above FAN_ON_TEMP + 0.5
+  unsigned long shortestOnMs;             // ULONG_MAX if the relay never completed a period
+  unsigned long shortestOffMs;
+  unsigned long onMs;
+  unsigned long samples;
+  double controllerNs;                    // Add sample + decision, per reading
+};
+
+enum Controller { PREDICTIVE, HYSTERESIS };
+
+static double nowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// The firmware starts with the relay off and the controller initialised at
+// boot, which is the start of the simulated day
+static DayResult simulateDay(Controller controller, const Day& day, uint64_t seed, float noise,
+                             unsigned long lengthMs) {
+  Rng rng = {seed};
+  FanController fc;
+  fanControllerInit(fc, 0);
+  bool fanOn = false;
+  float room = equilibrium(day, 0);
+  unsigned long lastSwitch = 0;
+  bool switched = false;
+
+  DayResult r = {};
+  r.shortestOnMs = r.shortestOffMs = ~0UL;
+  double spentNs = 0;
+
+  for (unsigned long t = 0; t < lengthMs; t += SIM_STEP_MS) {
+    float perMinute = (equilibrium(day, t) - room) / ROOM_TAU_MIN - (fanOn ? FAN_COOLING_PER_MIN : 0);
+    room += perMinute * (SIM_STEP_MS / 60000.0f);
+    r.overshoot = std::max(r.overshoot, room - (float)FAN_ON_TEMP);
+    if (room > FAN_ON_TEMP + 0.5f) r.minutesAbove += SIM_STEP_MS / 60000.0f;
+    if (fanOn) r.onMs += SIM_STEP_MS;
+    if (t % SIM_READ_MS != 0) continue;
+
+    float reading = readSensor(rng, room, noise);
+    bool want = fanOn;
+    double started = nowNs();
+    if (controller == PREDICTIVE) {
+      fanControllerAddSample(fc, reading, t);
+      want = fanControllerDesiredState(fc, t);
+    } else {
+      // environmental_analysis.cpp before the predictive controller; a
+      // failed read (-999) counted as cold
+      if (reading >= FAN_ON_TEMP) want = true;
+      else if (reading <= FAN_OFF_TEMP) want = false;
+    }
+    spentNs += nowNs() - started;
+    r.samples++;
+
+    if (want != fanOn) {
+      if (switched) {
+        unsigned long period = t - lastSwitch;
+        unsigned long& shortest = fanOn ? r.shortestOnMs : r.shortestOffMs;
+        shortest = std::min(shortest, period);
+      }
+      fanOn = want;
+      if (controller == PREDICTIVE) fanControllerSetRelay(fc, fanOn, t);
+      lastSwitch = t;
+      switched = true;
+      r.actuations++;
+    }
+  }
+  if (controller == PREDICTIVE && fc.actuations != r.actuations) r.actuations = ~0UL;   // Bookkeeping broke
+  r.controllerNs = r.samples ? spentNs / r.samples : 0;
+  return r;
+}
+
+struct Totals {
+  unsigned long actuations = 0;
+  unsigned long maxActuations = 0;
+  float worstOvershoot = 0;
+  float minutesAbove = 0;
+  unsigned long shortestOnMs = ~0UL;
+  unsigned long shortestOffMs = ~0UL;
+  double onHours = 0;
+  double controllerNs = 0;
+};
+
+static void addDay(Totals& t, const DayResult& r) {
+  t.actuations += r.actuations;
+  t.maxActuations = std::max(t.maxActuations, r.actuations);
+  t.worstOvershoot = std::max(t.worstOvershoot, r.overshoot);
+  t.minutesAbove += r.minutesAbove;
+  t.shortestOnMs = std::min(t.shortestOnMs, r.shortestOnMs);
+  t.shortestOffMs = std::min(t.shortestOffMs, r.shortestOffMs);
+  t.onHours += r.onMs / 3600000.0;
+  t.controllerNs += r.controllerNs;
+}
+
+static void runDays(int days, float noise, Totals& predictive, Totals& hysteresis) {
+  Rng dayRng = {20250601};
+  for (int i = 0; i < days; i++) {
+    Day day = makeDay(dayRng);
+    uint64_t seed = 1000 + i;
+    addDay(predictive, simulateDay(PREDICTIVE, day, seed, noise, SIM_DAY_MS));
+    addDay(hysteresis, simulateDay(HYSTERESIS, day, seed, noise, SIM_DAY_MS));
+  }
+}
+
+// ---- Bench ---------------------------------------------------------------
+
+static double seconds(unsigned long ms) {
+  return ms == ~0UL ? -1 : ms / 1000.0;
+}
+
+static void printTotals(const char* name, const Totals& t, int days, bool last) {
+  printf("  \"%s\": {\"actuationsPerDay\": %.1f, \"maxActuationsPerDay\": %lu, \"worstOvershootC\": %.2f, "
+         "\"minutesAboveOnPlus05PerDay\": %.1f, \"shortestOnS\": %.0f, \"shortestOffS\": %.0f, "
+         "\"fanOnHoursPerDay\": %.2f, \"nsPerReading\": %.0f}%s\n",
+         name, (double)t.actuations / days, t.maxActuations, t.worstOvershoot, t.minutesAbove / days,
+         seconds(t.shortestOnMs), seconds(t.shortestOffMs), t.onHours / days, t.controllerNs / days,
+         last ? "" : ",");
+}
+
+static int runBench() {
+  Totals predictive, hysteresis;
+  runDays(opts.days, opts.noise, predictive, hysteresis);
+  printf("{\"days\": %d, \"dayHours\": %.0f, \"noiseC\": %.2f, \"readIntervalS\": %lu,\n", opts.days,
+         SIM_DAY_MS / 3600000.0, opts.noise, SIM_READ_MS / 1000);
+  printTotals("predictive", predictive, opts.days, false);
+  printTotals("hysteresis", hysteresis, opts.days, true);
+  printf("}\n");
+  return 0;
+}
+
+// ---- Self-check ----------------------------------------------------------
+
+static bool near(float a, float b, float tolerance) {
+  return fabsf(a - b) <= tolerance;
+}
+
+static int runVerify() {
+  // Exact ramp: the fit recovers the slope and the current value, and the
+  // prediction is FAN_PREDICT_HORIZON_S ahead on the same line
+  FanController fc;
+  fanControllerInit(fc, 0);
+  for (int i = 0; i < FAN_HISTORY_SIZE + 3; i++) fanControllerAddSample(fc, 20.0f + 0.05f * i, i * SIM_READ_MS);
+  float slope = 0.05f * 60000.0f / SIM_READ_MS;
+  check(near(fc.slope, slope, 1e-3f), "ramp slope");
+  check(near(fc.smoothedTemp, 20.0f + 0.05f * (FAN_HISTORY_SIZE + 2), 1e-3f), "ramp intercept");
+  check(near(fc.predictedTemp, fc.smoothedTemp + slope * FAN_PREDICT_HORIZON_S / 60.0f, 1e-3f), "ramp prediction");
+
+  // Failed reads and repeated timestamps never reach the model
+  int count = fc.count;
+  unsigned long t = (FAN_HISTORY_SIZE + 2) * SIM_READ_MS;
+  fanControllerAddSample(fc, -999, t + SIM_READ_MS);
+  fanControllerAddSample(fc, NAN, t + 2 * SIM_READ_MS);
+  fanControllerAddSample(fc, 40, t);
+  check(fc.count == count && near(fc.slope, slope, 1e-3f), "failed and repeated reads ignored");
+
+  // A rising trend switches on before the threshold is reached
+  fanControllerInit(fc, 0);
+  bool on = false;
+  unsigned long switchedAt = 0;
+  float switchedTemp = 0;
+  for (unsigned long ms = 0; ms < 30 * 60000UL && !on; ms += SIM_READ_MS) {
+    float temperature = 22.0f + 0.5f * ms / 60000.0f;
+    fanControllerAddSample(fc, temperature, ms);
+    if (fanControllerDesiredState(fc, ms)) {
+      on = true;
+      switchedAt = ms;
+      switchedTemp = temperature;
+      fanControllerSetRelay(fc, true, ms);
+    }
+  }
+  check(on && switchedTemp < FAN_ON_TEMP && strcmp(fc.reason, "predicted_high") == 0, "predictive switch-on");
+
+  // Dwell: a sudden cold reading cannot switch it off inside FAN_MIN_ON_TIME_MS
+  bool heldOn = true;
+  unsigned long ms = switchedAt + SIM_READ_MS;
+  for (; ms < switchedAt + FAN_MIN_ON_TIME_MS; ms += SIM_READ_MS) {
+    fanControllerAddSample(fc, 18, ms);
+    heldOn = heldOn && fanControllerDesiredState(fc, ms);
+  }
+  check(heldOn && strcmp(fc.reason, "min_on_time") == 0, "minimum on time");
+  fanControllerAddSample(fc, 18, ms);
+  check(!fanControllerDesiredState(fc, ms), "switches off after the dwell");
+  check(fanControllerDwellRemaining(fc, switchedAt + 1000) == FAN_MIN_ON_TIME_MS - 1000, "dwell remaining");
+
+  // Steady rooms: never on when cool, on once and held when warm
+  Day cool = {19.0f, 0, 0};
+  Day warm = {25.5f, 0, 0};
+  DayResult coolDay = simulateDay(PREDICTIVE, cool, 1, opts.noise, SIM_DAY_MS);
+  check(coolDay.actuations == 0, "cool room never switches");
+  Day hot = {35.0f, 0, 0};      // Above 22 °C even with the fan running
+  DayResult hotDay = simulateDay(PREDICTIVE, hot, 1, opts.noise, SIM_DAY_MS);
+  check(hotDay.actuations == 1, "hot room switches on once");
+  DayResult warmDay = simulateDay(PREDICTIVE, warm, 1, opts.noise, SIM_DAY_MS);
+  check(warmDay.actuations > 0 && warmDay.shortestOnMs >= FAN_MIN_ON_TIME_MS &&
+        warmDay.shortestOffMs >= FAN_MIN_OFF_TIME_MS, "warm room cycles within the dwell");
+
+  // A week of days against the old hysteresis. With little sensor noise
+  // both track the room and switch about as often; at the DHT11's rated
+  // ±2 °C the raw hysteresis chatters and the fitted model does not.
+  Totals predictive, hysteresis;
+  runDays(7, 0.6f, predictive, hysteresis);
+  check(predictive.shortestOnMs >= FAN_MIN_ON_TIME_MS, "predictive minimum ON period");
+  check(predictive.shortestOffMs >= FAN_MIN_OFF_TIME_MS, "predictive minimum OFF period");
+  check(predictive.actuations * 10 <= hysteresis.actuations * 13, "±0.6 °C: within 1.3x the hysteresis actuations");
+  check(predictive.worstOvershoot <= 0.5f, "±0.6 °C: overshoot within 0.5 °C of FAN_ON_TEMP");
+
+  Totals noisyPredictive, noisyHysteresis;
+  runDays(7, 2.0f, noisyPredictive, noisyHysteresis);
+  check(noisyPredictive.shortestOnMs >= FAN_MIN_ON_TIME_MS && noisyPredictive.shortestOffMs >= FAN_MIN_OFF_TIME_MS,
+        "±2 °C: dwell respected");
+  check(noisyPredictive.actuations * 3 <= noisyHysteresis.actuations, "±2 °C: at most a third of the hysteresis actuations");
+  check(noisyPredictive.maxActuations <= 160, "±2 °C: at most 160 actuations in a day");
+  check(noisyPredictive.worstOvershoot <= 0.5f, "±2 °C: overshoot within 0.5 °C of FAN_ON_TEMP");
+
+  if (verifyFailures) {
+    fprintf(stderr, "verify: %d check(s) failed\n", verifyFailures);
+    return 1;
+  }
+  printf("verify: ok\n");
+  return 0;
+}
+
+// ---- Main ----------------------------------------------------------------
+
+static void usage() {
+  fprintf(stderr,
+          "usage: bille-fan MODE [options]\n"
+          "  --bench              predictive controller vs. the old hysteresis, JSON\n"
+          "    --days N           simulated 8 h days (default 30)\n"
+          "    --noise C          sensor noise, ± °C uniform (default 0.6)\n"
+          "  --verify             controller and simulation self-check\n");
+}
+
+static bool parseArgs(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    if (a == "--bench") {
+      opts.bench = true;
+      continue;
+    }
+    if (a == "--verify") {
+      opts.verify = true;
+      continue;
+    }
+    if (i + 1 >= argc) return false;
+    const char* v = argv[++i];
+    if (a == "--days") opts.days = atoi(v);
+    else if (a == "--noise") opts.noise = atof(v);
+    else return false;
+  }
+  return opts.days > 0 && opts.noise >= 0 && (opts.bench || opts.verify);
+}
+
+int main(int argc, char** argv) {
+  if (!parseArgs(argc, argv)) {
+    usage();
+    return 2;
+  }
+  if (opts.verify) return runVerify();
+  return runBench();
+}
@@ -0,0 +1,790 @@
+/*
+===============================================================
+Bill-E Fleet Load Generator
+Host-side benchmark for one broker + one main brain serving many desks
+===============================================================
+
+Simulates N desks, each with an environment monitor and a wearable, as
+separate MQTT connections publishing the real payloads:
+- bille/desk/<n>/data/environment      JSON, same fields as mqtt_client.cpp
+- bille/desk/<n>/data/biometric        JSON state, same fields as the wearable
+- bille/desk/<n>/data/biometric_batch  binary batch (biometric_batch.h in both sketches)
+Desk 0 uses the plain bille/... topics (tools/common/desk_topics.h).
+
+A sink thread plays the main brain's ingest side: it subscribes to the
+data topics, parses the JSON and decodes every batch with the main brain's
+own biometric_batch.cpp. Each sent message is logged per device; the sink
+matches what it receives against that log to measure end-to-end latency
+(publisher send -> broker -> sink decode) and losses. With --sink-off the
+tool only generates load, e.g. while a real main brain is subscribed.
+
+Report (JSON, --report FILE or stdout): broker connect time, messages and
+bytes published, ingest throughput, latency percentiles, drops, batch
+sequence gaps and CPU time per ingested message.
+
+BUILD (from the repository root):
+  g++ -O2 -std=c++17 -pthread -Itools/common -Isketches/main_brain \
+      -o bille-loadgen tools/loadgen/loadgen.cpp tools/common/mqtt_client.cpp \
+      sketches/main_brain/biometric_batch.cpp
+
+USAGE:
+  ./bille-loadgen --desks 200 --duration 60 --speedup 10 --report run.json
+  ./bille-loadgen --verify        # codec/topic self-check, no broker needed
+===============================================================
+*/
+
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mqtt_client.h"
+#include "desk_topics.h"
+#include "biometric_batch.h"
+#include "verify.h"
+
+// Firmware rates (environment_monitor.ino, wearable_tracker config.h)
+#define ENV_INTERVAL_MS        10000
+#define WEARABLE_SAMPLE_MS     5000
+#define BATCH_INTERVAL_MS      60000
+#define SUMMARY_INTERVAL_MS    60000
+
+#define SEND_LOG_SIZE          4096    // Per stream, must be a power of two
+#define PUBLISHER_POLL_MS      100     // Drain PINGRESP/PUBACK this often
+#define MAX_BATCH_SAMPLES      255
+#define REPORT_VERSION         1
+
+enum StreamKind {
+  STREAM_ENVIRONMENT = 0,
+  STREAM_BIOMETRIC,
+  STREAM_BATCH,
+  STREAM_COUNT
+};
+
+static const char* streamSuffix[STREAM_COUNT] = {
+  "data/environment", "data/biometric", "data/biometric_batch"
+};
+
+static const char* activityNames[] = {"Sitting", "Still", "Moving", "Walking", "Running"};
+
+struct Options {
+  std::string host = "127.0.0.1";
+  int port = MQTT_DEFAULT_PORT;
+  std::string user;
+  std::string password;
+  int desks = 10;
+  int firstDesk = 1;
+  double durationS = 30;
+  double speedup = 1;           // Divides every firmware interval
+  int envIntervalMs = ENV_INTERVAL_MS;
+  int batchIntervalMs = BATCH_INTERVAL_MS;
+  int summaryIntervalMs = SUMMARY_INTERVAL_MS;
+  int samplesPerBatch = BATCH_INTERVAL_MS / WEARABLE_SAMPLE_MS;
+  int threads = 1;
+  int drainMs = 2000;
+  int qos = 0;
+  bool sink = true;
+  bool verify = false;
+  std::string report;
+};
+
+// Send log: publisher writes, sink reads. Keyed by the value the sink can
+// recover from the payload (JSON timestamp or batch seq).
+struct SendEntry {
+  std::atomic<uint32_t> key;
+  std::atomic<uint64_t> micros;
+};
+
+struct SendLog {
+  SendEntry entries[SEND_LOG_SIZE];
+  std::atomic<uint64_t> head;   // Messages logged
+  uint64_t cursor;              // Sink only: next entry to match
+  uint64_t matched;             // Sink only
+  uint64_t overrun;             // Sink only: entries overwritten before matching
+  int lastSeq;                  // Sink only: batch seq gap detection
+};
+
+struct Device {
+  int desk;
+  bool wearable;
+  MqttClient client;
+  std::string topics[STREAM_COUNT];
+  uint64_t nextDue[STREAM_COUNT];   // Host micros, 0 = stream unused
+  uint64_t bootOffsetMs;            // Device millis() at generator start
+  uint32_t lastTimestamp;
+  uint16_t bootId;
+  uint16_t batchSeq;
+  uint32_t steps;
+  uint8_t activity;
+  uint32_t lastMovementMs;
+  uint32_t rng;
+};
+
+struct PublisherStats {
+  uint64_t messages[STREAM_COUNT] = {};
+  uint64_t bytes = 0;
+  uint64_t errors = 0;
+  uint64_t disconnects = 0;
+};
+
+struct SinkStats {
+  uint64_t messages = 0;
+  uint64_t bytes = 0;
+  uint64_t samples = 0;
+  uint64_t unmatched = 0;
+  uint64_t malformed = 0;
+  uint64_t seqGaps = 0;
+  uint64_t cpuNanos = 0;
+  std::vector<uint32_t> latencyUs;
+};
+
+static Options opts;
+static std::vector<Device> devices;
+static std::vector<SendLog*> sendLogs;  // devices.size() * STREAM_COUNT
+static uint64_t startMicros;
+static std::atomic<bool> running(true);
+static std::atomic<bool> sinkRunning(true);
+static volatile sig_atomic_t interrupted = 0;
+
+static void onSignal(int) {
+  interrupted = 1;
+  running = false;
+}
+
+static uint32_t nextRandom(uint32_t& state) {
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+static uint64_t threadCpuNanos() {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t intervalMicros(int firmwareMs) {
+  double us = firmwareMs * 1000.0 / opts.speedup;
+  return us < 1 ? 1 : (uint64_t)us;
+}
+
+// Device millis() as the firmware would report it (virtual time, sped up)
+static uint32_t deviceMillis(Device& d, uint64_t now) {
+  uint32_t t = (uint32_t)(d.bootOffsetMs + (uint64_t)((now - startMicros) * opts.speedup / 1000.0));
+  if (t <= d.lastTimestamp) t = d.lastTimestamp + 1;  // Keys must be unique
+  d.lastTimestamp = t;
+  return t;
+}
+
+static void logSend(int deviceIndex, int stream, uint32_t key, uint64_t micros) {
+  SendLog* log = sendLogs[deviceIndex * STREAM_COUNT + stream];
+  uint64_t i = log->head.load(std::memory_order_relaxed);
+  SendEntry& e = log->entries[i & (SEND_LOG_SIZE - 1)];
+  e.key.store(key, std::memory_order_relaxed);
+  e.micros.store(micros, std::memory_order_relaxed);
+  log->head.store(i + 1, std::memory_order_release);
+}
+
+// ---- Payload generators ------------------------------------------------
+
+static size_t buildEnvironment(Device& d, uint32_t timestamp, char* out, size_t size) {
+  uint32_t r = nextRandom(d.rng);
+  float temperature = 21.0f + (r % 60) / 10.0f;
+  float humidity = 40.0f + (r >> 8) % 200 / 10.0f;
+  int light = 200 + (r >> 16) % 600;
+  int noise = 30 + (r >> 24) % 50;
+  return snprintf(out, size,
+                  "{\"nodeType\":\"ENVIRONMENT\",\"timestamp\":%" PRIu32 ",\"temperature\":%.2f,"
+                  "\"humidity\":%.2f,\"lightLevel\":%d,\"noiseLevel\":%d,\"soundDetected\":%s}",
+                  timestamp, temperature, humidity, light, noise, noise > 70 ? "true" : "false");
+}
+
+static size_t buildBiometric(Device& d, uint32_t timestamp, char* out, size_t size) {
+  return snprintf(out, size,
+                  "{\"nodeType\":\"WEARABLE\",\"timestamp\":%" PRIu32 ",\"activity\":\"%s\","
+                  "\"stepCount\":%" PRIu32 ",\"acceleration\":%.2f,\"lastMovement\":%" PRIu32 ","
+                  "\"idleSeconds\":%" PRIu32 ",\"sessionActive\":true,\"currentUser\":\"desk%d\"}",
+                  timestamp, activityNames[d.activity], d.steps,
+                  1.0 + (nextRandom(d.rng) % 40) / 100.0, d.lastMovementMs,
+                  timestamp > d.lastMovementMs ? (timestamp - d.lastMovementMs) / 1000 : 0, d.desk);
+}
+
+// One sample per WEARABLE_SAMPLE_MS of device time, ending at `timestamp`
+static void simulateSamples(Device& d, uint32_t timestamp, BatchRecord* records, int count) {
+  for (int i = 0; i < count; i++) {
+    uint32_t r = nextRandom(d.rng);
+    if (r % 8 == 0) d.activity = (r >> 8) % 5;  // Mostly keep the current class
+    BatchRecord& rec = records[i];
+    rec.timestamp = timestamp - (uint32_t)(count - 1 - i) * WEARABLE_SAMPLE_MS;
+    if (d.activity >= 2) d.lastMovementMs = rec.timestamp;
+    if (d.activity >= 3) d.steps += 5 + (r >> 12) % (d.activity == 4 ? 15 : 8);
+    rec.steps = d.steps;
+    rec.activity = d.activity;
+    rec.accelMg = (uint16_t)((d.activity >= 3 ? 1300 : 1000) + (r >> 20) % 300);
+    rec.idleSeconds = rec.timestamp > d.lastMovementMs ? (rec.timestamp - d.lastMovementMs) / 1000 : 0;
+  }
+}
+
+static size_t buildBatch(Device& d, uint32_t timestamp, uint8_t* out, size_t size, int* sampleCount) {
+  BatchRecord records[MAX_BATCH_SAMPLES];
+  int count = opts.samplesPerBatch;
+  simulateSamples(d, timestamp, records, count);
+
+  BatchWriter writer;
+  batchBegin(writer, out, size, d.bootId, d.batchSeq, records[0].timestamp, records[0].steps);
+  for (int i = 0; i < count; i++) {
+    if (!batchAdd(writer, records[i])) break;
+  }
+  *sampleCount = writer.count;
+  return batchFinish(writer);
+}
+
+// ---- Publishers --------------------------------------------------------
+
+static void publishDue(int index, uint64_t now, PublisherStats& stats) {
+  Device& d = devices[index];
+  char json[512];
+  uint8_t batch[BATCH_HEADER_SIZE + MAX_BATCH_SAMPLES * BATCH_MAX_SAMPLE_SIZE];
+
+  for (int s = 0; s < STREAM_COUNT; s++) {
+    if (!d.nextDue[s] || now < d.nextDue[s]) continue;
+
+    uint32_t timestamp = deviceMillis(d, now);
+    const uint8_t* payload;
+    size_t length;
+    uint32_t key = timestamp;
+    int interval;
+    if (s == STREAM_ENVIRONMENT) {
+      length = buildEnvironment(d, timestamp, json, sizeof(json));
+      payload = (const uint8_t*)json;
+      interval = opts.envIntervalMs;
+    } else if (s == STREAM_BIOMETRIC) {
+      length = buildBiometric(d, timestamp, json, sizeof(json));
+      payload = (const uint8_t*)json;
+      interval = opts.summaryIntervalMs;
+    } else {
+      int samples;
+      length = buildBatch(d, timestamp, batch, sizeof(batch), &samples);
+      payload = batch;
+      key = d.batchSeq++;
+      interval = opts.batchIntervalMs;
+    }
+
+    // Log before sending: the sink may see the message before publish returns
+    uint64_t sent = mqttNowMicros();
+    logSend(index, s, key, sent);
+    if (mqttPublish(d.client, d.topics[s].c_str(), payload, length, opts.qos)) {
+      stats.messages[s]++;
+      stats.bytes += length;
+    } else {
+      stats.errors++;
+    }
+    // Fixed cadence; if we fell behind, skip ahead instead of bursting
+    d.nextDue[s] += intervalMicros(interval);
+    if (d.nextDue[s] < now) d.nextDue[s] = now + intervalMicros(interval);
+  }
+}
+
+static void publisherThread(int first, int last, PublisherStats* stats) {
+  uint64_t endMicros = startMicros + (uint64_t)(opts.durationS * 1e6);
+  uint64_t lastPoll = 0;
+
+  while (running) {
+    uint64_t now = mqttNowMicros();
+    if (now >= endMicros) break;
+
+    uint64_t nextWake = now + PUBLISHER_POLL_MS * 1000;
+    for (int i = first; i < last; i++) {
+      Device& d = devices[i];
+      if (!d.client.connected) continue;
+      publishDue(i, now, *stats);
+      for (int s = 0; s < STREAM_COUNT; s++) {
+        if (d.nextDue[s] && d.nextDue[s] < nextWake) nextWake = d.nextDue[s];
+      }
+    }
+
+    if (now - lastPoll > PUBLISHER_POLL_MS * 1000ULL) {
+      for (int i = first; i < last; i++) {
+        if (devices[i].client.connected && !mqttPoll(devices[i].client, 0, nullptr, nullptr)) {
+          stats->disconnects++;
+        }
+      }
+      lastPoll = now;
+    }
+
+    now = mqttNowMicros();
+    if (nextWake > now) {
+      uint64_t wait = std::min<uint64_t>(nextWake - now, 5000);
+      struct timespec ts = {0, (long)wait * 1000};
+      nanosleep(&ts, nullptr);
+    }
+  }
+}
+
+// ---- Sink (main brain ingest side) -------------------------------------
+
+// Value after "key": in a JSON object, as a number. Enough for the flat
+// payloads the nodes publish; the real main brain uses ArduinoJson.
+static bool jsonNumber(const char* json, const char* key, double& out) {
+  char pattern[40];
+  snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+  const char* p = strstr(json, pattern);
+  if (!p) return false;
+  char* end;
+  out = strtod(p + strlen(pattern), &end);
+  return end != p + strlen(pattern);
+}
+
+static int deviceIndexForDesk(int desk, int stream) {
+  int slot = desk - opts.firstDesk;
+  if (slot < 0 || slot >= opts.desks) return -1;
+  return slot * 2 + (stream == STREAM_ENVIRONMENT ? 0 : 1);
+}
+
+static void matchReceived(SinkStats& stats, int deviceIndex, int stream, uint32_t key, uint64_t now) {
+  SendLog* log = sendLogs[deviceIndex * STREAM_COUNT + stream];
+  uint64_t head = log->head.load(std::memory_order_acquire);
+  if (head > log->cursor + SEND_LOG_SIZE) {
+    log->overrun += head - SEND_LOG_SIZE - log->cursor;
+    log->cursor = head - SEND_LOG_SIZE;
+  }
+  // Per-connection order is preserved, so anything skipped here was lost
+  for (uint64_t i = log->cursor; i < head; i++) {
+    SendEntry& e = log->entries[i & (SEND_LOG_SIZE - 1)];
+    if (e.key.load(std::memory_order_relaxed) != key) continue;
+    uint64_t sent = e.micros.load(std::memory_order_relaxed);
+    stats.latencyUs.push_back(now > sent ? (uint32_t)std::min<uint64_t>(now - sent, UINT32_MAX) : 0);
+    log->cursor = i + 1;
+    log->matched++;
+    return;
+  }
+  stats.unmatched++;
+}
+
+static void onSinkMessage(void* context, const char* topic, size_t topicLength,
+                          const uint8_t* payload, size_t length) {
+  SinkStats& stats = *(SinkStats*)context;
+  uint64_t now = mqttNowMicros();
+  stats.messages++;
+  stats.bytes += length;
+
+  const char* suffix;
+  size_t suffixLength;
+  int desk = deskFromTopic(topic, topicLength, &suffix, &suffixLength);
+  if (desk < 0) return;
+
+  int stream = -1;
+  for (int s = 0; s < STREAM_COUNT; s++) {
+    if (suffixLength == strlen(streamSuffix[s]) && memcmp(suffix, streamSuffix[s], suffixLength) == 0) {
+      stream = s;
+    }
+  }
+  int deviceIndex = stream >= 0 ? deviceIndexForDesk(desk, stream) : -1;
+  if (deviceIndex < 0) return;
+
+  if (stream == STREAM_BATCH) {
+    BatchReader reader;
+    if (!batchOpen(reader, payload, length)) {
+      stats.malformed++;
+      return;
+    }
+    BatchRecord record;
+    uint64_t sum = 0;
+    while (batchNext(reader, record)) {
+      sum += record.steps + record.accelMg;  // Touch every field like the history copy does
+      stats.samples++;
+    }
+    SendLog* log = sendLogs[deviceIndex * STREAM_COUNT + stream];
+    if (log->lastSeq >= 0 && reader.seq != (uint16_t)(log->lastSeq + 1)) stats.seqGaps++;
+    log->lastSeq = reader.seq;
+    if (sum == UINT64_MAX) stats.malformed++;  // Keeps the decode from being optimised out
+    matchReceived(stats, deviceIndex, stream, reader.seq, now);
+    return;
+  }
+
+  char json[1024];
+  if (length >= sizeof(json)) {
+    stats.malformed++;
+    return;
+  }
+  memcpy(json, payload, length);
+  json[length] = '\0';
+  double timestamp, value;
+  if (!jsonNumber(json, "timestamp", timestamp)) {
+    stats.malformed++;
+    return;
+  }
+  if (stream == STREAM_ENVIRONMENT) {
+    jsonNumber(json, "temperature", value);
+    jsonNumber(json, "humidity", value);
+    jsonNumber(json, "lightLevel", value);
+    jsonNumber(json, "noiseLevel", value);
+  } else {
+    jsonNumber(json, "stepCount", value);
+    jsonNumber(json, "lastMovement", value);
+  }
+  matchReceived(stats, deviceIndex, stream, (uint32_t)timestamp, now);
+}
+
+static void sinkThread(MqttClient* client, SinkStats* stats) {
+  uint64_t cpuStart = threadCpuNanos();
+  while (sinkRunning) {
+    if (!mqttPoll(*client, 10, onSinkMessage, stats)) {
+      fprintf(stderr, "loadgen: sink lost the broker connection\n");
+      break;
+    }
+  }
+  stats->cpuNanos = threadCpuNanos() - cpuStart;
+}
+
+// ---- Report ------------------------------------------------------------
+
+static uint32_t percentile(const std::vector<uint32_t>& sorted, double p) {
+  if (sorted.empty()) return 0;
+  size_t i = (size_t)ceil(p / 100.0 * sorted.size());
+  if (i > 0) i--;
+  return sorted[std::min(i, sorted.size() - 1)];
+}
+
+static void writeReport(FILE* out, double elapsedS, double connectMs, int connectFailed,
+                        const PublisherStats& pub, SinkStats& sink, uint64_t lost, uint64_t overrun) {
+  uint64_t published = pub.messages[0] + pub.messages[1] + pub.messages[2];
+  std::vector<uint32_t>& lat = sink.latencyUs;
+  std::sort(lat.begin(), lat.end());
+  double mean = 0;
+  for (uint32_t v : lat) mean += v;
+  if (!lat.empty()) mean /= lat.size();
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  double userS = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+  double sysS = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+  uint64_t handled = published + sink.messages;
+
+  fprintf(out, "{\n");
+  fprintf(out, "  \"tool\": \"bille-loadgen\",\n  \"reportVersion\": %d,\n", REPORT_VERSION);
+  fprintf(out, "  \"config\": {\"broker\": \"%s:%d\", \"desks\": %d, \"clients\": %zu, "
+               "\"durationS\": %.1f, \"speedup\": %.2f, \"qos\": %d,\n"
+               "             \"envIntervalMs\": %d, \"summaryIntervalMs\": %d, "
+               "\"batchIntervalMs\": %d, \"samplesPerBatch\": %d, \"publisherThreads\": %d, \"sink\": %s},\n",
+          opts.host.c_str(), opts.port, opts.desks, devices.size(), opts.durationS, opts.speedup, opts.qos,
+          opts.envIntervalMs, opts.summaryIntervalMs, opts.batchIntervalMs, opts.samplesPerBatch,
+          opts.threads, opts.sink ? "true" : "false");
+  fprintf(out, "  \"connect\": {\"ms\": %.1f, \"failed\": %d},\n", connectMs, connectFailed);
+  fprintf(out, "  \"published\": {\"messages\": %" PRIu64 ", \"bytes\": %" PRIu64 ", \"environment\": %" PRIu64
+               ", \"biometric\": %" PRIu64 ", \"biometricBatch\": %" PRIu64 ", \"errors\": %" PRIu64
+               ", \"disconnects\": %" PRIu64 "},\n",
+          published, pub.bytes, pub.messages[STREAM_ENVIRONMENT], pub.messages[STREAM_BIOMETRIC],
+          pub.messages[STREAM_BATCH], pub.errors, pub.disconnects);
+  fprintf(out, "  \"received\": {\"messages\": %" PRIu64 ", \"bytes\": %" PRIu64 ", \"samples\": %" PRIu64
+               ", \"matched\": %zu, \"unmatched\": %" PRIu64 ", \"malformed\": %" PRIu64 "},\n",
+          sink.messages, sink.bytes, sink.samples, lat.size(), sink.unmatched, sink.malformed);
+  fprintf(out, "  \"dropped\": %" PRIu64 ",\n  \"dropRate\": %.6f,\n  \"untracked\": %" PRIu64 ",\n"
+               "  \"batchSeqGaps\": %" PRIu64 ",\n",
+          lost, published ? (double)lost / published : 0.0, overrun, sink.seqGaps);
+  fprintf(out, "  \"throughput\": {\"publishedPerS\": %.1f, \"ingestPerS\": %.1f, \"samplesPerS\": %.1f, "
+               "\"ingestBytesPerS\": %.1f},\n",
+          published / elapsedS, sink.messages / elapsedS, sink.samples / elapsedS, sink.bytes / elapsedS);
+  fprintf(out, "  \"latencyUs\": {\"count\": %zu, \"min\": %u, \"p50\": %u, \"p90\": %u, \"p99\": %u, "
+               "\"p999\": %u, \"max\": %u, \"mean\": %.1f},\n",
+          lat.size(), lat.empty() ? 0 : lat.front(), percentile(lat, 50), percentile(lat, 90),
+          percentile(lat, 99), percentile(lat, 99.9), lat.empty() ? 0 : lat.back(), mean);
+  fprintf(out, "  \"cpu\": {\"sinkUsPerMsg\": %.3f, \"processUsPerMsg\": %.3f, \"userS\": %.3f, \"sysS\": %.3f}\n",
+          sink.messages ? sink.cpuNanos / 1000.0 / sink.messages : 0.0,
+          handled ? (userS + sysS) * 1e6 / handled : 0.0, userS, sysS);
+  fprintf(out, "}\n");
+}
+
+// ---- Self-check --------------------------------------------------------
+
+static int runVerify() {
+  // Remaining length: boundaries of each varint width
+  const size_t lengths[] = {0, 127, 128, 16383, 16384, 2097151, 2097152, 268435455};
+  for (size_t v : lengths) {
+    uint8_t buf[4];
+    size_t n = mqttEncodeLength(buf, v);
+    size_t decoded;
+    check(mqttDecodeLength(buf, n, decoded) == (int)n && decoded == v, "remaining length round trip");
+    check(n < 2 || mqttDecodeLength(buf, n - 1, decoded) == 0, "remaining length needs more input");
+  }
+
+  struct { const char* filter; const char* topic; bool match; } topics[] = {
+    {"bille/data/#", "bille/data/environment", true},
+    {"bille/data/#", "bille/data", true},
+    {"bille/desk/+/data/#", "bille/desk/17/data/biometric_batch", true},
+    {"bille/desk/+/data/#", "bille/desk/17/status/system", false},
+    {"bille/+/state", "bille/session/state", true},
+    {"bille/+/state", "bille/session/state/x", false},
+    {"bille/session/state", "bille/session/stat", false},
+    {"bille/session/stat", "bille/session/state", false},
+    {"#", "bille/anything", true},
+  };
+  for (auto& t : topics) {
+    check(mqttTopicMatches(t.filter, t.topic, strlen(t.topic)) == t.match, t.topic);
+  }
+
+  for (int desk : {0, 1, 42, 1000}) {
+    std::string topic = deskTopic(desk, "data/biometric_batch");
+    const char* suffix = "";
+    size_t suffixLength = 0;
+    int parsed = deskFromTopic(topic.c_str(), topic.size(), &suffix, &suffixLength);
+    check(parsed == desk && std::string(suffix, suffixLength) == "data/biometric_batch", "desk topic round trip");
+  }
+
+  // Generated batches decode to exactly the simulated samples
+  Device d = {};
+  d.rng = 12345;
+  for (int round = 0; round < 200; round++) {
+    int count = 1 + round % 24;
+    BatchRecord records[MAX_BATCH_SAMPLES];
+    simulateSamples(d, 100000 + round * 60000, records, count);
+    uint8_t buf[BATCH_HEADER_SIZE + MAX_BATCH_SAMPLES * BATCH_MAX_SAMPLE_SIZE];
+    BatchWriter writer;
+    batchBegin(writer, buf, sizeof(buf), (uint16_t)(round * 977), (uint16_t)round, records[0].timestamp,
+               records[0].steps);
+    for (int i = 0; i < count; i++) batchAdd(writer, records[i]);
+    size_t length = batchFinish(writer);
+
+    BatchReader reader;
+    check(batchOpen(reader, buf, length) && reader.seq == round && reader.boot == (uint16_t)(round * 977) &&
+          reader.count == count, "batch header");
+    BatchRecord out;
+    int i = 0;
+    while (batchNext(reader, out)) {
+      const BatchRecord& in = records[i++];
+      check(out.timestamp == in.timestamp && out.steps == in.steps && out.activity == in.activity &&
+            out.idleSeconds == in.idleSeconds && abs((int)out.accelMg - (int)in.accelMg) <= 8,
+            "batch sample");  // 1/64 g quantization
+    }
+    check(i == count, "batch sample count");
+
+    // The same batch as version 1: no boot field, read back as boot 0
+    uint8_t old[sizeof(buf)];
+    memcpy(old, buf, 4);
+    memcpy(old + 4, buf + 6, length - 6);
+    old[0] = 1;
+    BatchReader oldReader;
+    check(batchOpen(oldReader, old, length - 2) && oldReader.seq == round && oldReader.boot == 0,
+          "batch version 1 header");
+    i = 0;
+    while (batchNext(oldReader, out)) check(out.steps == records[i++].steps, "batch version 1 sample");
+    check(i == count, "batch version 1 sample count");
+  }
+
+  char json[512];
+  buildEnvironment(d, 4000000000u, json, sizeof(json));
+  double timestamp;
+  check(jsonNumber(json, "timestamp", timestamp) && (uint32_t)timestamp == 4000000000u, "environment timestamp");
+
+  if (verifyFailures) {
+    fprintf(stderr, "verify: %d check(s) failed\n", verifyFailures);
+    return 1;
+  }
+  printf("verify: ok\n");
+  return 0;
+}
+
+// ---- Main --------------------------------------------------------------
+
+static void usage() {
+  fprintf(stderr,
+          "usage: bille-loadgen [options]\n"
+          "  --host H / --port P         broker (default 127.0.0.1:1883)\n"
+          "  --user U / --password P     broker credentials\n"
+          "  --desks N                   simulated desks, 2 clients each (default 10)\n"
+          "  --first-desk N              desk number of the first simulated desk (default 1)\n"
+          "  --duration S                publish for S seconds (default 30)\n"
+          "  --speedup X                 divide every firmware interval by X (default 1)\n"
+          "  --env-interval-ms MS        environment period (default %d)\n"
+          "  --batch-interval-ms MS      wearable batch period (default %d)\n"
+          "  --summary-interval-ms MS    wearable JSON period (default %d)\n"
+          "  --samples-per-batch N       samples per batch (default %d)\n"
+          "  --threads N                 publisher threads (default 1)\n"
+          "  --qos 0|1                   publish QoS (default 0)\n"
+          "  --drain-ms MS               wait for stragglers after publishing (default 2000)\n"
+          "  --sink-off                  do not subscribe; the real main brain is the consumer\n"
+          "  --report FILE               write the JSON report to FILE (default stdout)\n"
+          "  --verify                    run the codec/topic self-check and exit\n",
+          ENV_INTERVAL_MS, BATCH_INTERVAL_MS, SUMMARY_INTERVAL_MS, BATCH_INTERVAL_MS / WEARABLE_SAMPLE_MS);
+}
+
+static bool parseArgs(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (a == "--verify") opts.verify = true;
+    else if (a == "--sink-off") opts.sink = false;
+    else if (!hasValue) return false;
+    else if (a == "--host") opts.host = argv[++i];
+    else if (a == "--port") opts.port = atoi(argv[++i]);
+    else if (a == "--user") opts.user = argv[++i];
+    else if (a == "--password") opts.password = argv[++i];
+    else if (a == "--desks") opts.desks = atoi(argv[++i]);
+    else if (a == "--first-desk") opts.firstDesk = atoi(argv[++i]);
+    else if (a == "--duration") opts.durationS = atof(argv[++i]);
+    else if (a == "--speedup") opts.speedup = atof(argv[++i]);
+    else if (a == "--env-interval-ms") opts.envIntervalMs = atoi(argv[++i]);
+    else if (a == "--batch-interval-ms") opts.batchIntervalMs = atoi(argv[++i]);
+    else if (a == "--summary-interval-ms") opts.summaryIntervalMs = atoi(argv[++i]);
+    else if (a == "--samples-per-batch") opts.samplesPerBatch = atoi(argv[++i]);
+    else if (a == "--threads") opts.threads = atoi(argv[++i]);
+    else if (a == "--qos") opts.qos = atoi(argv[++i]);
+    else if (a == "--drain-ms") opts.drainMs = atoi(argv[++i]);
+    else if (a == "--report") opts.report = argv[++i];
+    else return false;
+  }
+  return opts.desks > 0 && opts.firstDesk >= 0 && opts.durationS > 0 && opts.speedup > 0 &&
+         opts.samplesPerBatch > 0 && opts.samplesPerBatch <= MAX_BATCH_SAMPLES &&
+         opts.threads > 0 && (opts.qos == 0 || opts.qos == 1);
+}
+
+int main(int argc, char** argv) {
+  if (!parseArgs(argc, argv)) {
+    usage();
+    return 2;
+  }
+  if (opts.verify) return runVerify();
+
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+
+  // Raise the fd limit: two sockets per desk plus the sink
+  struct rlimit lim;
+  if (getrlimit(RLIMIT_NOFILE, &lim) == 0 && lim.rlim_cur < lim.rlim_max) {
+    lim.rlim_cur = lim.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &lim);
+  }
+
+  const char* user = opts.user.empty() ? nullptr : opts.user.c_str();
+  const char* password = opts.password.empty() ? nullptr : opts.password.c_str();
+
+  MqttClient sinkClient;
+  mqttInit(sinkClient);
+  if (opts.sink) {
+    if (!mqttConnect(sinkClient, opts.host.c_str(), opts.port, "loadgen_brain", user, password, 30)) {
+      fprintf(stderr, "loadgen: cannot connect to %s:%d\n", opts.host.c_str(), opts.port);
+      return 1;
+    }
+    mqttSubscribe(sinkClient, "bille/data/#", opts.qos);
+    mqttSubscribe(sinkClient, "bille/desk/+/data/#", opts.qos);
+    // Wait for both SUBACKs so the first publishes are not missed
+    uint64_t deadline = mqttNowMicros() + 2000000;
+    while (sinkClient.packetsIn < 3 && mqttNowMicros() < deadline) {
+      mqttPoll(sinkClient, 10, nullptr, nullptr);
+    }
+  }
+
+  devices.resize(opts.desks * 2);
+  sendLogs.resize(devices.size() * STREAM_COUNT);
+  for (SendLog*& log : sendLogs) {
+    log = new SendLog();
+    log->lastSeq = -1;
+  }
+
+  uint64_t connectStart = mqttNowMicros();
+  int connectFailed = 0;
+  uint32_t seed = 0x9E3779B9u;
+  for (size_t i = 0; i < devices.size(); i++) {
+    Device& d = devices[i];
+    d.desk = opts.firstDesk + (int)i / 2;
+    d.wearable = i % 2;
+    d.rng = nextRandom(seed) | 1;
+    d.bootOffsetMs = 60000 + nextRandom(d.rng) % 3600000;
+    d.lastTimestamp = 0;
+    d.bootId = (uint16_t)nextRandom(d.rng);
+    d.batchSeq = 0;
+    d.steps = 0;
+    d.activity = 0;
+    d.lastMovementMs = (uint32_t)d.bootOffsetMs;
+    for (int s = 0; s < STREAM_COUNT; s++) {
+      d.topics[s] = deskTopic(d.desk, streamSuffix[s]);
+      d.nextDue[s] = 0;
+    }
+
+    char clientId[48];
+    snprintf(clientId, sizeof(clientId), "loadgen_%s_%d", d.wearable ? "wearable" : "env", d.desk);
+    if (!mqttConnect(d.client, opts.host.c_str(), opts.port, clientId, user, password, 60)) {
+      connectFailed++;
+    }
+  }
+  double connectMs = (mqttNowMicros() - connectStart) / 1000.0;
+
+  // Stagger first publishes across one period, as real nodes boot at random times
+  startMicros = mqttNowMicros();
+  for (Device& d : devices) {
+    if (d.wearable) {
+      d.nextDue[STREAM_BIOMETRIC] = startMicros + nextRandom(d.rng) % intervalMicros(opts.summaryIntervalMs);
+      d.nextDue[STREAM_BATCH] = startMicros + nextRandom(d.rng) % intervalMicros(opts.batchIntervalMs);
+    } else {
+      d.nextDue[STREAM_ENVIRONMENT] = startMicros + nextRandom(d.rng) % intervalMicros(opts.envIntervalMs);
+    }
+  }
+
+  SinkStats sinkStats;
+  std::thread sink;
+  if (opts.sink) sink = std::thread(sinkThread, &sinkClient, &sinkStats);
+
+  int threads = std::min<int>(opts.threads, devices.size());
+  std::vector<PublisherStats> pubStats(threads);
+  std::vector<std::thread> publishers;
+  for (int t = 0; t < threads; t++) {
+    int first = (int)(devices.size() * t / threads);
+    int last = (int)(devices.size() * (t + 1) / threads);
+    publishers.emplace_back(publisherThread, first, last, &pubStats[t]);
+  }
+  for (std::thread& t : publishers) t.join();
+  double elapsedS = (mqttNowMicros() - startMicros) / 1e6;
+
+  if (opts.sink) {
+    if (!interrupted) usleep(opts.drainMs * 1000);
+    sinkRunning = false;
+    sink.join();
+  }
+  for (Device& d : devices) mqttDisconnect(d.client);
+  mqttDisconnect(sinkClient);
+
+  PublisherStats total;
+  for (const PublisherStats& p : pubStats) {
+    for (int s = 0; s < STREAM_COUNT; s++) total.messages[s] += p.messages[s];
+    total.bytes += p.bytes;
+    total.errors += p.errors;
+    total.disconnects += p.disconnects;
+  }
+  uint64_t lost = 0, overrun = 0;
+  if (opts.sink) {
+    for (SendLog* log : sendLogs) {
+      lost += log->head.load() - log->matched - log->overrun;
+      overrun += log->overrun;
+    }
+  }
+
+  FILE* out = stdout;
+  if (!opts.report.empty()) {
+    out = fopen(opts.report.c_str(), "w");
+    if (!out) {
+      fprintf(stderr, "loadgen: cannot write %s: %s\n", opts.report.c_str(), strerror(errno));
+      out = stdout;
+    }
+  }
+  writeReport(out, elapsedS, connectMs, connectFailed, total, sinkStats, lost, overrun);
+  if (out != stdout) fclose(out);
+
+  fprintf(stderr, "loadgen: %d desks, %.1f s, %" PRIu64 " published, %" PRIu64 " received, %" PRIu64 " dropped\n",
+          opts.desks, elapsedS, total.messages[0] + total.messages[1] + total.messages[2],
+          sinkStats.messages, lost);
+  for (SendLog* log : sendLogs) delete log;
+  return connectFailed ? 1 : 0;
+}
@@ -0,0 +1,693 @@
+/*
+===============================================================
+Bill-E Range Query Tool
+Session-aware aggregates over column-store history
+===============================================================
+
+Answers questions like "mean noise during work sessions for user X
+last month" from the aggregator's column store without a full scan.
+Session intervals (runs of one Pomodoro state and session user) come
+from each desk's pomodoro.state, session.active and session.user series
+and sit in an interval tree; every metric series gets a sparse block
+index (count/min/max/sum per 256 points, tools/common/range_query.h), so
+only the edge blocks of each interval are read. Block summaries of
+sealed segments are cached as seg-<id>.blk beside the segments.
+
+Users are the RFID card UID as the main brain publishes it in
+session/state (userId); the store keeps billeUserCode() of it.
+
+--bench writes a synthetic year of 100 desks (weekday sessions with
+25/5/15-minute Pomodoros, one to three users per desk, a sample a
+minute of noise, temperature and acceleration) and times indexed
+queries against a full scan. --verify checks the engine against a
+naive scan on a small store: random ranges, block and segment edges,
+-999/NaN, the active segment and stale block caches.
+
+BUILD (from the repository root):
+  g++ -O2 -std=c++17 -Itools/common -Isketches/main_brain \
+      -o bille-query tools/query/query.cpp tools/common/range_query.cpp tools/common/rollup.cpp \
+      tools/common/column_store.cpp tools/common/bille_decode.cpp sketches/main_brain/biometric_batch.cpp
+
+USAGE:
+  ./bille-query --root /var/lib/bille --metric environment.noiseLevel --state work \
+                --user 9c13c3 --from 2025-05-01 --to 2025-06-01
+  ./bille-query --root /var/lib/bille --metric biometric.acceleration --state short_break --desk 3 --per-interval
+  ./bille-query --bench [--desks 100 --days 365 --interval 60 --bench-root DIR]
+  ./bille-query --verify
+===============================================================
+*/
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "range_query.h"
+#include "bille_decode.h"
+#include "column_store.h"
+#include "verify.h"
+
+#define DAY_MS                 (24 * 3600 * 1000LL)
+#define MINUTE_MS              (60 * 1000LL)
+#define BENCH_START_MS         1736121600000LL    // Monday 2025-01-06 00:00 UTC
+#define WORK_MINUTES           25                 // main_brain/config.h Pomodoro lengths
+#define SHORT_BREAK_MINUTES    5
+#define LONG_BREAK_MINUTES     15
+#define CYCLES_BEFORE_LONG     4
+
+struct Options {
+  bool bench = false;
+  bool verify = false;
+  bool perInterval = false;
+  std::string root;
+  std::string metric;
+  std::string state;
+  std::string user;
+  std::string from;
+  std::string to;
+  int desk = -1;
+  int benchDesks = 100;
+  int benchDays = 365;
+  int benchIntervalS = 60;
+  std::string benchRoot;
+};
+
+static Options opts;
+
+static uint64_t nowMicros() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static uint32_t randomState = 12345;
+static double uniform() {
+  randomState ^= randomState << 13;
+  randomState ^= randomState >> 17;
+  randomState ^= randomState << 5;
+  return (randomState & 0xFFFFFF) / (double)0x1000000;
+}
+
+// Wall-clock ms, or a UTC date as YYYY-MM-DD[THH:MM]
+static bool parseTime(const std::string& text, int64_t& out, bool& isDate) {
+  char* end;
+  long long ms = strtoll(text.c_str(), &end, 10);
+  isDate = false;
+  if (!text.empty() && *end == 0) {
+    out = ms;
+    return true;
+  }
+  struct tm tm;
+  memset(&tm, 0, sizeof(tm));
+  int n = sscanf(text.c_str(), "%d-%d-%dT%d:%d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &tm.tm_hour, &tm.tm_min);
+  if (n != 3 && n != 5) return false;
+  tm.tm_year -= 1900;
+  tm.tm_mon -= 1;
+  out = (int64_t)timegm(&tm) * 1000;
+  isDate = true;
+  return true;
+}
+
+static std::string formatTime(int64_t ms) {
+  if (ms == INT64_MAX) return "open";
+  time_t s = (time_t)(ms / 1000);
+  struct tm tm;
+  gmtime_r(&s, &tm);
+  char buf[32];
+  strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", &tm);
+  return buf;
+}
+
+static double mean(const RollupStats& s) {
+  return s.count ? s.sum / s.count : NAN;
+}
+
+// ---- Naive reference -----------------------------------------------------
+
+// What a report script would do: read every point of every desk and test
+// it against the range and that desk's matching session intervals
+struct NaiveScan {
+  const std::vector<RangeInterval>* intervals;   // Null: the whole range counts
+  size_t cursor;
+  int64_t fromMs;
+  int64_t toMs;
+  RollupStats* stats;
+  uint64_t points;
+};
+
+static bool naiveVisit(void* context, const int64_t* times, const double* values, size_t count) {
+  NaiveScan& scan = *(NaiveScan*)context;
+  for (size_t i = 0; i < count; i++) {
+    scan.points++;
+    int64_t t = times[i];
+    if (t < scan.fromMs || t > scan.toMs) continue;
+    if (scan.intervals) {
+      const std::vector<RangeInterval>& iv = *scan.intervals;
+      while (scan.cursor < iv.size() && iv[scan.cursor].end <= t) scan.cursor++;
+      if (scan.cursor == iv.size() || iv[scan.cursor].start > t) continue;
+    }
+    double v = values[i];
+    if (std::isnan(v) || v == ROLLUP_SENTINEL) {
+      scan.stats->invalid++;
+      continue;
+    }
+    if (v < scan.stats->min) scan.stats->min = v;
+    if (v > scan.stats->max) scan.stats->max = v;
+    scan.stats->sum += v;
+    scan.stats->count++;
+  }
+  return true;
+}
+
+static void naiveQuery(const char* root, const std::vector<int>& desks, const RangeQuery& q, RollupStats& out,
+                       uint64_t& points) {
+  rollupReset(out);
+  points = 0;
+  bool filtered = q.state != RANGE_ANY_STATE || q.user != 0;
+  for (int desk : desks) {
+    if (q.desk >= 0 && desk != q.desk) continue;
+    std::vector<RangeInterval> all, matching;
+    if (filtered) {
+      rangeSessionIntervals(root, desk, all);
+      for (const RangeInterval& iv : all)
+        if ((q.state == RANGE_ANY_STATE || iv.state == q.state) && (q.user == 0 || iv.user == q.user))
+          matching.push_back(iv);
+    }
+    NaiveScan scan = {filtered ? &matching : nullptr, 0, q.fromMs, q.toMs, &out, 0};
+    columnStoreScan(root, columnSeriesName(desk, q.metric.c_str()), INT64_MIN, INT64_MAX, naiveVisit, &scan);
+    points += scan.points;
+  }
+}
+
+// ---- Query -----------------------------------------------------------------
+
+static bool buildQuery(RangeQuery& q) {
+  q.metric = opts.metric;
+  q.desk = opts.desk;
+  q.fromMs = INT64_MIN;
+  q.toMs = INT64_MAX;
+  q.state = RANGE_ANY_STATE;
+  q.user = opts.user.empty() ? 0 : billeUserCode(opts.user.c_str(), opts.user.size());
+  if (!opts.state.empty() && opts.state != "any") {
+    q.state = rangeStateCode(opts.state.c_str());
+    if (q.state < 0) {
+      fprintf(stderr, "query: unknown --state %s\n", opts.state.c_str());
+      return false;
+    }
+  }
+  bool fromDate, toDate = false;
+  if ((!opts.from.empty() && !parseTime(opts.from, q.fromMs, fromDate)) ||
+      (!opts.to.empty() && !parseTime(opts.to, q.toMs, toDate))) {
+    fprintf(stderr, "query: bad --from/--to (ms or YYYY-MM-DD[THH:MM], UTC)\n");
+    return false;
+  }
+  // A date as --to means up to that day, not into it
+  if (toDate) q.toMs--;
+  return true;
+}
+
+static int runQuery() {
+  RangeQuery q;
+  if (!buildQuery(q)) return 2;
+
+  uint64_t start = nowMicros();
+  RangeEngine engine;
+  if (!rangeEngineOpen(engine, opts.root.c_str())) {
+    fprintf(stderr, "query: cannot open %s\n", opts.root.c_str());
+    return 1;
+  }
+  uint64_t opened = nowMicros();
+  RangeResult r;
+  std::vector<RangeIntervalResult> intervals;
+  rangeEngineQuery(engine, q, r, opts.perInterval ? &intervals : nullptr);
+  uint64_t done = nowMicros();
+
+  if (opts.perInterval) {
+    printf("desk,start,end,state,user,count,invalid,min,max,mean\n");
+    for (const RangeIntervalResult& i : intervals) {
+      printf("%d,%s,%s,%s,%08x,%" PRIu64 ",%" PRIu64, i.interval.desk, formatTime(i.interval.start).c_str(),
+             formatTime(i.interval.end).c_str(), rangeStateName(i.interval.state), i.interval.user, i.stats.count,
+             i.stats.invalid);
+      if (i.stats.count) printf(",%.6g,%.6g,%.6g\n", i.stats.min, i.stats.max, mean(i.stats));
+      else printf(",,,\n");
+    }
+  } else {
+    printf("metric,state,intervals,coveredS,count,invalid,min,max,mean\n");
+    printf("%s,%s,%" PRIu64 ",%" PRId64 ",%" PRIu64 ",%" PRIu64, q.metric.c_str(), rangeStateName(q.state), r.intervals,
+           r.coveredMs / 1000, r.stats.count, r.stats.invalid);
+    if (r.stats.count) printf(",%.6g,%.6g,%.6g\n", r.stats.min, r.stats.max, mean(r.stats));
+    else printf(",,,\n");
+  }
+  fprintf(stderr,
+          "query: %zu intervals indexed, %" PRIu64 " blocks from the index, %" PRIu64 " read (%" PRIu64
+          " points); open %.1f ms, query %.1f ms\n",
+          engine.sessions.intervals.size(), r.query.blocksSummarized, r.query.blocksScanned, r.query.pointsScanned,
+          (opened - start) / 1000.0, (done - opened) / 1000.0);
+  rangeEngineClose(engine);
+  return 0;
+}
+
+// ---- Synthetic history -----------------------------------------------------
+
+static const char* benchMetrics[] = {"environment.noiseLevel", "environment.temperature", "biometric.acceleration"};
+
+struct DeskUsers {
+  std::vector<std::string> ids;
+  std::vector<uint32_t> codes;
+};
+
+// Weekday sessions from about 9 to 17 UTC, Pomodoro cycles inside them,
+// published the way the main brain does (session/state then pomodoro/state,
+// on change only). Sensors sample all day at intervalS; temperature has the
+// odd failed DHT read (-999) and acceleration the odd NaN.
+static uint64_t writeDesk(ColumnStore& store, int desk, int days, int intervalS, const DeskUsers& users) {
+  std::string stateSeries = columnSeriesName(desk, "pomodoro.state");
+  std::string activeSeries = columnSeriesName(desk, "session.active");
+  std::string userSeries = columnSeriesName(desk, "session.user");
+  uint64_t points = 0;
+
+  // Per-minute activity flag, for sensors that follow the session
+  std::vector<uint8_t> working((size_t)days * 1440, 0);
+  for (int day = 0; day < days; day++) {
+    if (day % 7 >= 5 || uniform() < 0.1) continue;     // Weekends and days off
+    int64_t dayStart = BENCH_START_MS + day * DAY_MS;
+    int startMin = 9 * 60 + (int)(uniform() * 60);
+    int endMin = 16 * 60 + (int)(uniform() * 120);
+    uint32_t user = users.codes[(size_t)(uniform() * users.codes.size()) % users.codes.size()];
+
+    int64_t t = dayStart + startMin * MINUTE_MS;
+    columnStoreAppend(store, activeSeries, t, 1);
+    columnStoreAppend(store, userSeries, t, user);
+    points += 2;
+    int minute = startMin, cycles = 0;
+    while (minute < endMin) {
+      columnStoreAppend(store, stateSeries, dayStart + minute * MINUTE_MS, RANGE_STATE_WORK);
+      int workEnd = std::min(minute + WORK_MINUTES, endMin);
+      for (int m = minute; m < workEnd; m++) working[(size_t)day * 1440 + m] = 1;
+      minute = workEnd;
+      points++;
+      if (minute >= endMin) break;
+      cycles++;
+      bool longBreak = cycles % CYCLES_BEFORE_LONG == 0;
+      columnStoreAppend(store, stateSeries, dayStart + minute * MINUTE_MS,
+                        longBreak ? RANGE_STATE_LONG_BREAK : RANGE_STATE_SHORT_BREAK);
+      int breakEnd = std::min(minute + (longBreak ? LONG_BREAK_MINUTES : SHORT_BREAK_MINUTES), endMin);
+      for (int m = minute; m < breakEnd; m++) working[(size_t)day * 1440 + m] = 2;
+      minute = breakEnd;
+      points++;
+    }
+    t = dayStart + endMin * MINUTE_MS;
+    columnStoreAppend(store, stateSeries, t, RANGE_STATE_IDLE);
+    columnStoreAppend(store, activeSeries, t, 0);
+    columnStoreAppend(store, userSeries, t, 0);
+    points += 3;
+  }
+
+  std::string noise = columnSeriesName(desk, benchMetrics[0]);
+  std::string temperature = columnSeriesName(desk, benchMetrics[1]);
+  std::string accel = columnSeriesName(desk, benchMetrics[2]);
+  double noiseLevel = 2, temp = 21;
+  int64_t end = BENCH_START_MS + days * DAY_MS;
+  for (int64_t t = BENCH_START_MS; t < end; t += intervalS * 1000LL) {
+    size_t minute = (size_t)((t - BENCH_START_MS) / MINUTE_MS);
+    int activity = working[minute];
+    noiseLevel += (uniform() - 0.5) + (activity ? 0.05 : -0.05);
+    noiseLevel = std::min(10.0, std::max(0.0, noiseLevel));
+    double hour = (double)((t - BENCH_START_MS) % DAY_MS) / 3600000.0;
+    temp += (uniform() - 0.5) * 0.1 + (21 + 2 * sin((hour - 9) * M_PI / 12) - temp) * 0.01;
+    columnStoreAppend(store, noise, t, round(noiseLevel));
+    columnStoreAppend(store, temperature, t, uniform() < 0.005 ? ROLLUP_SENTINEL : round(temp * 10) / 10);
+    double g = activity == 2 ? 1.0 + uniform() * 0.8 : activity == 1 ? 1.0 + uniform() * 0.05 : 1.0 + uniform() * 0.02;
+    columnStoreAppend(store, accel, t, uniform() < 0.001 ? NAN : round(g * 1000) / 1000);
+    points += 3;
+  }
+  return points;
+}
+
+static uint64_t writeHistory(const char* root, int desks, int days, int intervalS, std::vector<DeskUsers>& users) {
+  ColumnStore store;
+  columnStoreOpen(store, root);
+  users.assign(desks, DeskUsers());
+  uint64_t points = 0;
+  for (int desk = 0; desk < desks; desk++) {
+    int count = 1 + desk % 3;
+    for (int i = 0; i < count; i++) {
+      char id[16];
+      snprintf(id, sizeof(id), "%02x%02x%02x%02x", (int)(uniform() * 256), (int)(uniform() * 256), desk & 0xFF, i);
+      users[desk].ids.push_back(id);
+      users[desk].codes.push_back(billeUserCode(id, strlen(id)));
+    }
+    points += writeDesk(store, desk, days, intervalS, users[desk]);
+  }
+  columnStoreClose(store);
+  return points;
+}
+
+static bool makeTempRoot(std::string& root) {
+  char path[] = "/tmp/bille-query-XXXXXX";
+  if (!mkdtemp(path)) return false;
+  root = path;
+  return true;
+}
+
+static void removeTree(const std::string& root) {
+  std::string cmd = "rm -rf '" + root + "'";
+  if (system(cmd.c_str()) != 0) fprintf(stderr, "query: could not remove %s\n", root.c_str());
+}
+
+static void removeBlockFiles(const std::string& root) {
+  std::string cmd = "find '" + root + "' -name 'seg-*.blk' -delete";
+  if (system(cmd.c_str()) != 0) fprintf(stderr, "query: could not clear block caches under %s\n", root.c_str());
+}
+
+// Sums differ only in addition order
+static bool sameStats(const RollupStats& a, const RollupStats& b) {
+  if (a.count != b.count || a.invalid != b.invalid || a.min != b.min || a.max != b.max) return false;
+  return fabs(a.sum - b.sum) <= 1e-9 * (fabs(a.sum) + fabs(b.sum)) + 1e-9;
+}
+
+// ---- Bench -----------------------------------------------------------------
+
+struct BenchQuery {
+  const char* name;
+  RangeQuery query;
+};
+
+static int runBench() {
+  std::string root = opts.benchRoot;
+  bool temporary = root.empty();
+  if (temporary && !makeTempRoot(root)) {
+    fprintf(stderr, "query: cannot create a temp store\n");
+    return 1;
+  }
+  std::vector<DeskUsers> users;
+  uint64_t start = nowMicros();
+  uint64_t points = writeHistory(root.c_str(), opts.benchDesks, opts.benchDays, opts.benchIntervalS, users);
+  double writeS = (nowMicros() - start) / 1e6;
+
+  RangeEngine engine;
+  start = nowMicros();
+  rangeEngineOpen(engine, root.c_str());
+  double sessionsMs = (nowMicros() - start) / 1000.0;
+
+  // Block indexes: built from the columns, then opened from their caches
+  removeBlockFiles(root);
+  double buildMs = 0, cachedMs = 0;
+  size_t blocks = 0, segments = 0;
+  for (int pass = 0; pass < 2; pass++) {
+    start = nowMicros();
+    for (int desk : engine.desks) {
+      for (const char* metric : benchMetrics) {
+        SeriesIndex& index = engine.series[columnSeriesName(desk, metric)];
+        seriesIndexClose(index);
+        seriesIndexOpen(index, root.c_str(), columnSeriesName(desk, metric));
+        if (pass == 1) {
+          blocks += index.blocks.size();
+          segments += index.cachedSegments;
+        }
+      }
+    }
+    (pass == 0 ? buildMs : cachedMs) = (nowMicros() - start) / 1000.0;
+  }
+
+  int64_t end = BENCH_START_MS + opts.benchDays * DAY_MS - 1;
+  int64_t lastMonth = end - 30 * DAY_MS + 1;
+  int64_t lastQuarter = end - 91 * DAY_MS + 1;
+  int userDesk = std::min(7, opts.benchDesks - 1);
+  BenchQuery queries[] = {
+    {"noise, work, one user, last month", {benchMetrics[0], lastMonth, end, -1, RANGE_STATE_WORK, users[userDesk].codes[0]}},
+    {"noise, work, all desks, last month", {benchMetrics[0], lastMonth, end, -1, RANGE_STATE_WORK, 0}},
+    {"acceleration, short break, last quarter", {benchMetrics[2], lastQuarter, end, -1, RANGE_STATE_SHORT_BREAK, 0}},
+    {"temperature, one desk, last month", {benchMetrics[1], lastMonth, end, 3 % opts.benchDesks, RANGE_ANY_STATE, 0}},
+    {"temperature, all desks, whole year", {benchMetrics[1], INT64_MIN, INT64_MAX, -1, RANGE_ANY_STATE, 0}},
+  };
+
+  printf("{\"desks\": %d, \"days\": %d, \"intervalS\": %d, \"points\": %" PRIu64 ", \"writeS\": %.1f, "
+         "\"sessionIntervals\": %zu, \"sessionTreeMs\": %.1f, \"indexBuildMs\": %.1f, \"indexCachedMs\": %.1f, "
+         "\"blocks\": %zu, \"cachedSegments\": %zu, \"queries\": [",
+         opts.benchDesks, opts.benchDays, opts.benchIntervalS, points, writeS, engine.sessions.intervals.size(),
+         sessionsMs, buildMs, cachedMs, blocks, segments);
+  bool allMatch = true;
+  for (size_t i = 0; i < sizeof(queries) / sizeof(queries[0]); i++) {
+    const RangeQuery& q = queries[i].query;
+    RangeResult r;
+    double engineMs = 1e30;
+    for (int run = 0; run < 3; run++) {
+      start = nowMicros();
+      rangeEngineQuery(engine, q, r);
+      engineMs = std::min(engineMs, (nowMicros() - start) / 1000.0);
+    }
+    RollupStats expect;
+    uint64_t naivePoints;
+    start = nowMicros();
+    naiveQuery(root.c_str(), engine.desks, q, expect, naivePoints);
+    double naiveMs = (nowMicros() - start) / 1000.0;
+    bool match = sameStats(r.stats, expect);
+    allMatch &= match;
+    printf("%s{\"query\": \"%s\", \"intervals\": %" PRIu64 ", \"values\": %" PRIu64 ", \"mean\": %.4f, "
+           "\"engineMs\": %.3f, \"naiveMs\": %.1f, \"speedup\": %.0f, \"blocksSummarized\": %" PRIu64
+           ", \"pointsScanned\": %" PRIu64 ", \"naivePoints\": %" PRIu64 ", \"match\": %s}",
+           i ? ", " : "", queries[i].name, r.intervals, r.stats.count, mean(r.stats), engineMs, naiveMs,
+           engineMs > 0 ? naiveMs / engineMs : 0, r.query.blocksSummarized, r.query.pointsScanned, naivePoints,
+           match ? "true" : "false");
+  }
+  printf("]}\n");
+  rangeEngineClose(engine);
+  if (temporary) removeTree(root);
+  return allMatch ? 0 : 1;
+}
+
+// ---- Self-check ------------------------------------------------------------
+
+static void verifyTree() {
+  std::vector<RangeInterval> intervals;
+  for (int i = 0; i < 2000; i++) {
+    RangeInterval iv;
+    iv.start = (int64_t)(uniform() * 1e6);
+    iv.end = uniform() < 0.02 ? INT64_MAX : iv.start + 1 + (int64_t)(uniform() * (uniform() < 0.1 ? 2e5 : 2e3));
+    iv.desk = i;
+    iv.state = i % 4;
+    iv.user = 0;
+    intervals.push_back(iv);
+  }
+  IntervalTree tree;
+  intervalTreeBuild(tree, intervals);
+  bool ok = true;
+  for (int q = 0; q < 500; q++) {
+    int64_t from = (int64_t)(uniform() * 1.1e6) - 50000;
+    int64_t to = from + (int64_t)(uniform() * (q % 10 ? 5000 : 300000));
+    std::vector<RangeInterval> got;
+    intervalTreeQuery(tree, from, to, got);
+    size_t expect = 0;
+    for (const RangeInterval& iv : intervals)
+      if (iv.start <= to && iv.end > from) expect++;
+    ok &= got.size() == expect;
+    for (size_t i = 0; i < got.size(); i++) {
+      ok &= got[i].start <= to && got[i].end > from;
+      if (i) ok &= got[i - 1].start <= got[i].start;
+    }
+  }
+  check(ok, "interval tree matches a linear filter");
+  std::vector<RangeInterval> none;
+  intervalTreeQuery(tree, 10, 5, none);
+  IntervalTree empty;
+  intervalTreeBuild(empty, {});
+  intervalTreeQuery(empty, INT64_MIN, INT64_MAX, none);
+  check(none.empty(), "empty range and empty tree");
+}
+
+static void captureUser(void* context, int desk, const char* metric, int64_t timeMs, double value) {
+  (void)desk;
+  (void)timeMs;
+  if (strcmp(metric, "session.user") == 0) *(double*)context = value;
+}
+
+static void verifyDecode() {
+  const char* on = "{\"active\":true,\"userId\":\"9c13c3\",\"timestamp\":5000,\"sessionDuration\":12}";
+  const char* off = "{\"active\":false,\"userId\":\"\",\"timestamp\":9000}";
+  const char* topic = "bille/desk/3/session/state";
+  double user = -1;
+  billeDecode(topic, strlen(topic), (const uint8_t*)on, strlen(on), 1000, captureUser, &user);
+  check(user == billeUserCode("9c13c3", 6) && user > 0, "session.user from userId");
+  billeDecode(topic, strlen(topic), (const uint8_t*)off, strlen(off), 2000, captureUser, &user);
+  check(user == 0, "no user after the session");
+}
+
+static RangeQuery randomQuery(const RangeEngine& engine, const std::vector<DeskUsers>& users, int64_t end) {
+  RangeQuery q;
+  q.metric = benchMetrics[(size_t)(uniform() * 3) % 3];
+  q.desk = uniform() < 0.5 ? -1 : engine.desks[(size_t)(uniform() * engine.desks.size()) % engine.desks.size()];
+  q.state = uniform() < 0.3 ? RANGE_ANY_STATE : (int)(uniform() * 4);
+  q.user = 0;
+  double r = uniform();
+  if (r < 0.3) {
+    const DeskUsers& u = users[(size_t)(uniform() * users.size()) % users.size()];
+    q.user = u.codes[(size_t)(uniform() * u.codes.size()) % u.codes.size()];
+  } else if (r < 0.35) {
+    q.user = 0xDEADBEEF;   // Nobody
+  }
+  int64_t span = end - BENCH_START_MS;
+  q.fromMs = BENCH_START_MS - DAY_MS + (int64_t)(uniform() * (span + 2 * DAY_MS));
+  q.toMs = q.fromMs + (int64_t)(uniform() * uniform() * span);
+  if (uniform() < 0.1) q.fromMs = INT64_MIN;
+  if (uniform() < 0.1) q.toMs = INT64_MAX;
+  if (uniform() < 0.05) std::swap(q.fromMs, q.toMs);   // Empty
+  return q;
+}
+
+static void compareWithNaive(RangeEngine& engine, const RangeQuery& q, const char* what) {
+  RangeResult r;
+  rangeEngineQuery(engine, q, r);
+  RollupStats expect;
+  uint64_t points;
+  naiveQuery(engine.root.c_str(), engine.desks, q, expect, points);
+  if (!sameStats(r.stats, expect)) {
+    fprintf(stderr, "verify: %s %s state %d user %08x desk %d [%" PRId64 ", %" PRId64 "]: count %" PRIu64 "/%" PRIu64
+            " invalid %" PRIu64 "/%" PRIu64 " sum %.6f/%.6f\n", what, q.metric.c_str(), q.state, q.user, q.desk,
+            q.fromMs, q.toMs, r.stats.count, expect.count, r.stats.invalid, expect.invalid, r.stats.sum, expect.sum);
+    check(false, what);
+  }
+}
+
+static int runVerify() {
+  verifyTree();
+  verifyDecode();
+
+  std::string root;
+  if (!makeTempRoot(root)) {
+    check(false, "temp store");
+    printf("{\"verify\": \"failed\", \"failures\": %d}\n", verifyFailures);
+    return 1;
+  }
+  // 10 s samples for 12 days: each series has a sealed segment and an active one
+  const int desks = 4, days = 12, intervalS = 10;
+  std::vector<DeskUsers> users;
+  writeHistory(root.c_str(), desks, days, intervalS, users);
+  int64_t end = BENCH_START_MS + days * DAY_MS;
+
+  RangeEngine engine;
+  check(rangeEngineOpen(engine, root.c_str()) && (int)engine.desks.size() == desks, "engine open");
+  check(!engine.sessions.intervals.empty(), "session intervals");
+  bool sane = true;
+  for (const RangeInterval& iv : engine.sessions.intervals)
+    sane &= iv.end > iv.start && (iv.state == RANGE_STATE_IDLE || iv.user != 0);
+  check(sane, "intervals are non-empty and Pomodoro states carry a user");
+
+  int queries = 0;
+  for (int i = 0; i < 400; i++, queries++) compareWithNaive(engine, randomQuery(engine, users, end), "random query");
+
+  // Ranges starting and ending exactly on block and segment edges
+  SeriesIndex& index = engine.series[columnSeriesName(0, benchMetrics[1])];
+  seriesIndexOpen(index, root.c_str(), columnSeriesName(0, benchMetrics[1]));
+  check(index.segments.size() >= 2 && index.blocks.size() > 300, "index spans segments");
+  for (int i = 0; i < 200 && index.blocks.size() > 1; i++, queries++) {
+    const BlockSummary& a = index.blocks[(size_t)(uniform() * index.blocks.size()) % index.blocks.size()];
+    const BlockSummary& b = index.blocks[(size_t)(uniform() * index.blocks.size()) % index.blocks.size()];
+    RangeQuery q = {benchMetrics[1], std::min(a.firstTime, b.firstTime) + (i % 3) - 1,
+                    std::max(a.lastTime, b.lastTime) + (i % 2), 0, RANGE_ANY_STATE, 0};
+    compareWithNaive(engine, q, "block-aligned query");
+  }
+  RangeQuery whole = {benchMetrics[1], INT64_MIN, INT64_MAX, -1, RANGE_ANY_STATE, 0};
+  RangeResult r;
+  rangeEngineQuery(engine, whole, r);
+  check(r.query.blocksScanned == 0 && r.stats.invalid > 0, "whole range from summaries, -999 counted invalid");
+  compareWithNaive(engine, whole, "whole range");
+  rangeEngineClose(engine);
+
+  // Second open reads the caches; the active segment is always rebuilt
+  SeriesIndex cached;
+  check(seriesIndexOpen(cached, root.c_str(), columnSeriesName(0, benchMetrics[1])) && cached.cachedSegments > 0 &&
+        cached.builtSegments == 0, "block caches reused");
+  seriesIndexClose(cached);
+
+  // A rewritten series behind stale caches: same times, other values
+  std::string dir = root + "/" + columnSeriesName(0, benchMetrics[0]);
+  std::string cmd = "rm -f '" + dir + "'/seg-*.col '" + dir + "'/segments.idx";
+  check(system(cmd.c_str()) == 0, "remove segments");
+  ColumnStore store;
+  columnStoreOpen(store, root.c_str());
+  for (int64_t t = BENCH_START_MS; t < end; t += intervalS * 1000LL)
+    columnStoreAppend(store, columnSeriesName(0, benchMetrics[0]), t, (double)((t / 1000) % 7));
+  columnStoreClose(store);
+  SeriesIndex stale;
+  check(seriesIndexOpen(stale, root.c_str(), columnSeriesName(0, benchMetrics[0])) && stale.cachedSegments == 0 &&
+        stale.builtSegments > 0, "stale block caches rebuilt");
+  seriesIndexClose(stale);
+  check(rangeEngineOpen(engine, root.c_str()), "engine reopen");
+  for (int i = 0; i < 100; i++, queries++) {
+    RangeQuery q = randomQuery(engine, users, end);
+    q.metric = benchMetrics[0];
+    compareWithNaive(engine, q, "query after rewrite");
+  }
+  rangeEngineClose(engine);
+  check(!rangeEngineOpen(engine, (root + "/missing").c_str()), "missing root");
+  removeTree(root);
+
+  printf("{\"verify\": \"%s\", \"queries\": %d, \"failures\": %d}\n", verifyFailures ? "failed" : "ok", queries,
+         verifyFailures);
+  return verifyFailures ? 1 : 0;
+}
+
+static void usage() {
+  fprintf(stderr,
+          "usage: bille-query MODE [options]\n"
+          "  --root DIR --metric METRIC      aggregate of one metric over every desk\n"
+          "    --state idle|work|short_break|long_break\n"
+          "    --user UID                    RFID user id as in session/state\n"
+          "    --desk N                      one desk\n"
+          "    --from T / --to T             ms or YYYY-MM-DD[THH:MM] (UTC); a date --to is exclusive\n"
+          "    --per-interval                one CSV row per session interval\n"
+          "  --bench                         synthetic history, indexed queries vs a full scan\n"
+          "    --desks N --days N --interval S --bench-root DIR (empty; kept)\n"
+          "  --verify                        engine against a naive scan\n");
+}
+
+static bool parseArgs(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    if (a == "--bench") {
+      opts.bench = true;
+      continue;
+    }
+    if (a == "--verify") {
+      opts.verify = true;
+      continue;
+    }
+    if (a == "--per-interval") {
+      opts.perInterval = true;
+      continue;
+    }
+    if (i + 1 >= argc) return false;
+    const char* v = argv[++i];
+    if (a == "--root") opts.root = v;
+    else if (a == "--metric") opts.metric = v;
+    else if (a == "--state") opts.state = v;
+    else if (a == "--user") opts.user = v;
+    else if (a == "--from") opts.from = v;
+    else if (a == "--to") opts.to = v;
+    else if (a == "--desk") opts.desk = atoi(v);
+    else if (a == "--desks") opts.benchDesks = atoi(v);
+    else if (a == "--days") opts.benchDays = atoi(v);
+    else if (a == "--interval") opts.benchIntervalS = atoi(v);
+    else if (a == "--bench-root") opts.benchRoot = v;
+    else return false;
+  }
+  if (!opts.bench && !opts.verify && (opts.root.empty() || opts.metric.empty())) return false;
+  return opts.benchDesks > 0 && opts.benchDays > 0 && opts.benchIntervalS > 0;
+}
+
+int main(int argc, char** argv) {
+  if (!parseArgs(argc, argv)) {
+    usage();
+    return 2;
+  }
+  if (opts.verify) return runVerify();
+  if (opts.bench) return runBench();
+  return runQuery();
+}
@@ -0,0 +1,538 @@
+/*
+===============================================================
+Bill-E Rollup Tool
+Bucketed min/max/mean/percentiles over column-store history
+===============================================================
+
+Charts of months of per-desk history (environment.temperature,
+environment.noiseLevel, environment.lightLevel, wearable.accel...) do not
+need every point, only per-bucket statistics. This tool computes them
+with the SIMD kernels in tools/common/rollup.h straight from the mmap'd
+column store the aggregator writes.
+
+NaN and -999 (the environment monitor's DHT failure value) are counted
+per bucket as "invalid" and left out of min/max/mean/percentiles.
+
+--bench compares the kernels (naive loop, scalar, SSE2, AVX2) on
+generated sensor data, both on cache-resident slices and streaming
+from memory, and times whole bucketed rollups against a naive
+per-point loop. --verify cross-checks every kernel against the naive
+loop, including NaN/-999 placement, odd lengths and misaligned slices.
+
+BUILD (from the repository root):
+  g++ -O2 -std=c++17 -Itools/common \
+      -o bille-rollup tools/rollup/rollup.cpp tools/common/rollup.cpp tools/common/column_store.cpp
+
+USAGE:
+  ./bille-rollup --root /var/lib/bille --series desk-0/environment.temperature --bucket 3600
+  ./bille-rollup --root /var/lib/bille --series desk-3/wearable.accel --bucket 60 --percentiles 50,95,99
+  ./bille-rollup --bench [--points N]
+  ./bille-rollup --verify
+  Any mode takes --isa scalar|sse2|avx2 to force a kernel.
+===============================================================
+*/
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "rollup.h"
+#include "column_store.h"
+#include "verify.h"
+
+#define DEFAULT_BENCH_POINTS  (16 * 1024 * 1024)
+#define HOT_SLICE             2048      // 16 KB of values, stays in L1
+#define SAMPLE_INTERVAL_MS    5000      // Environment monitor reading interval
+
+struct Options {
+  bool bench = false;
+  bool verify = false;
+  std::string root;
+  std::string series;
+  int64_t bucketMs = 3600 * 1000LL;
+  int64_t from = INT64_MIN;
+  int64_t to = INT64_MAX;
+  std::string percentiles;
+  std::string isa;
+  size_t points = DEFAULT_BENCH_POINTS;
+};
+
+static Options opts;
+
+static uint64_t nowMicros() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static bool parsePercentiles(const std::string& list, RollupQuery& q) {
+  q.percentileCount = 0;
+  const char* p = list.c_str();
+  while (*p) {
+    char* end;
+    double v = strtod(p, &end);
+    if (end == p || v < 0 || v > 100 || q.percentileCount == ROLLUP_MAX_PERCENTILES) return false;
+    q.percentiles[q.percentileCount++] = v;
+    p = *end == ',' ? end + 1 : end;
+    if (*end && *end != ',') return false;
+  }
+  return true;
+}
+
+// ---- Naive reference ---------------------------------------------------
+
+// The loop a chart backend would write first: one branch per point
+static void naiveAccumulate(const double* values, size_t n, RollupStats& s) {
+  for (size_t i = 0; i < n; i++) {
+    double v = values[i];
+    if (std::isnan(v) || v == ROLLUP_SENTINEL) {
+      s.invalid++;
+      continue;
+    }
+    if (v < s.min) s.min = v;
+    if (v > s.max) s.max = v;
+    s.sum += v;
+    s.count++;
+  }
+}
+
+static double naivePercentile(std::vector<double>& sorted, double percentile) {
+  if (sorted.empty()) return NAN;
+  double rank = percentile / 100.0 * (sorted.size() - 1);
+  size_t lo = (size_t)rank;
+  if (lo + 1 >= sorted.size()) return sorted.back();
+  double fraction = rank - lo;
+  if (fraction == 0 || sorted[lo] == sorted[lo + 1]) return sorted[lo];
+  return sorted[lo] + (sorted[lo + 1] - sorted[lo]) * fraction;
+}
+
+static int64_t floorBucket(int64_t t, int64_t width) {
+  int64_t q = t / width;
+  if (t % width != 0 && t < 0) q--;
+  return q * width;
+}
+
+// Point-at-a-time bucketing with a full sort per bucket for percentiles
+static void naiveRollup(const int64_t* times, const double* values, size_t n, const RollupQuery& q,
+                        std::vector<RollupBucket>& out) {
+  out.clear();
+  std::vector<double> bucketValues;
+  auto close = [&]() {
+    if (out.empty()) return;
+    std::sort(bucketValues.begin(), bucketValues.end());
+    for (int p = 0; p < ROLLUP_MAX_PERCENTILES; p++)
+      out.back().percentiles[p] = p < q.percentileCount ? naivePercentile(bucketValues, q.percentiles[p]) : NAN;
+    bucketValues.clear();
+  };
+  for (size_t i = 0; i < n; i++) {
+    if (times[i] < q.fromMs || times[i] > q.toMs) continue;
+    int64_t start = floorBucket(times[i], q.bucketMs);
+    if (out.empty() || out.back().startMs != start) {
+      close();
+      RollupBucket b;
+      b.startMs = start;
+      rollupReset(b.stats);
+      out.push_back(b);
+    }
+    naiveAccumulate(values + i, 1, out.back().stats);
+    if (q.percentileCount > 0 && !std::isnan(values[i]) && values[i] != ROLLUP_SENTINEL)
+      bucketValues.push_back(values[i]);
+  }
+  close();
+}
+
+// ---- Query -------------------------------------------------------------
+
+static int runQuery() {
+  RollupQuery q;
+  q.fromMs = opts.from;
+  q.toMs = opts.to;
+  q.bucketMs = opts.bucketMs;
+  if (!parsePercentiles(opts.percentiles, q)) {
+    fprintf(stderr, "rollup: bad --percentiles %s\n", opts.percentiles.c_str());
+    return 2;
+  }
+  std::sort(q.percentiles, q.percentiles + q.percentileCount);
+
+  std::vector<RollupBucket> buckets;
+  uint64_t start = nowMicros();
+  if (!rollupSeries(opts.root.c_str(), opts.series, q, buckets)) {
+    fprintf(stderr, "rollup: no series %s under %s\n", opts.series.c_str(), opts.root.c_str());
+    return 1;
+  }
+  uint64_t elapsed = nowMicros() - start;
+
+  printf("startMs,count,invalid,min,max,mean");
+  for (int p = 0; p < q.percentileCount; p++) printf(",p%g", q.percentiles[p]);
+  printf("\n");
+  uint64_t points = 0;
+  for (const RollupBucket& b : buckets) {
+    points += b.stats.count + b.stats.invalid;
+    if (b.stats.count == 0) {
+      printf("%" PRId64 ",0,%" PRIu64 ",,,", b.startMs, b.stats.invalid);
+    } else {
+      printf("%" PRId64 ",%" PRIu64 ",%" PRIu64 ",%.6g,%.6g,%.6g", b.startMs, b.stats.count, b.stats.invalid,
+             b.stats.min, b.stats.max, b.stats.sum / b.stats.count);
+    }
+    for (int p = 0; p < q.percentileCount; p++) {
+      if (b.stats.count == 0) printf(",");
+      else printf(",%.6g", b.percentiles[p]);
+    }
+    printf("\n");
+  }
+  fprintf(stderr, "rollup: %" PRIu64 " points in %zu buckets, %.1f ms (%s)\n", points, buckets.size(),
+          elapsed / 1000.0, rollupIsaName(rollupIsa()));
+  return 0;
+}
+
+// ---- Bench -------------------------------------------------------------
+
+static uint32_t randomState = 12345;
+static double uniform() {
+  randomState ^= randomState << 13;
+  randomState ^= randomState >> 17;
+  randomState ^= randomState << 5;
+  return (randomState & 0xFFFFFF) / (double)0x1000000;
+}
+
+// Temperature-like random walk with the odd DHT failure (-999) and NaN
+static void generate(size_t n, std::vector<int64_t>& times, std::vector<double>& values, double badRate) {
+  times.resize(n);
+  values.resize(n);
+  double temp = 22.5;
+  for (size_t i = 0; i < n; i++) {
+    times[i] = (int64_t)i * SAMPLE_INTERVAL_MS;
+    temp += (uniform() - 0.5) * 0.2;
+    double r = uniform();
+    values[i] = r < badRate / 2 ? ROLLUP_SENTINEL : r < badRate ? NAN : round(temp * 10) / 10;
+  }
+}
+
+static volatile double benchSink;
+
+typedef void (*AccumulateFn)(const double*, size_t, RollupStats&);
+
+static double kernelMpts(AccumulateFn fn, RollupIsa isa, const double* values, size_t n, size_t total) {
+  RollupStats s;
+  rollupReset(s);
+  uint64_t start = nowMicros();
+  for (size_t done = 0; done < total; done += n) {
+    if (fn) fn(values, n, s);
+    else rollupAccumulateWith(isa, values, n, s);
+  }
+  uint64_t elapsed = nowMicros() - start;
+  benchSink = s.sum + s.min + s.max + s.count;
+  return elapsed ? total / (double)elapsed : 0;
+}
+
+static double rollupMs(const std::vector<int64_t>& times, const std::vector<double>& values, const RollupQuery& q,
+                       bool naive, size_t& buckets) {
+  std::vector<RollupBucket> out;
+  uint64_t start = nowMicros();
+  if (naive) {
+    naiveRollup(times.data(), values.data(), values.size(), q, out);
+  } else {
+    Rollup r;
+    rollupBegin(r, q);
+    rollupAdd(r, times.data(), values.data(), values.size());
+    rollupFinish(r);
+    out.swap(r.buckets);
+  }
+  uint64_t elapsed = nowMicros() - start;
+  buckets = out.size();
+  return elapsed / 1000.0;
+}
+
+static int runBench() {
+  std::vector<int64_t> times;
+  std::vector<double> values;
+  generate(opts.points, times, values, 0.01);
+  const size_t n = values.size();
+  const size_t hotTotal = std::max(n, (size_t)HOT_SLICE * 16384);
+
+  printf("{\"points\": %zu, \"invalidRate\": 0.01, \"isa\": \"%s\", \"kernels\": {", n, rollupIsaName(rollupDetectIsa()));
+  struct {
+    const char* name;
+    AccumulateFn fn;
+    RollupIsa isa;
+  } kernels[] = {
+    {"naive", naiveAccumulate, ROLLUP_SCALAR},
+    {"scalar", nullptr, ROLLUP_SCALAR},
+    {"sse2", nullptr, ROLLUP_SSE2},
+    {"avx2", nullptr, ROLLUP_AVX2},
+  };
+  bool first = true;
+  for (auto& k : kernels) {
+    RollupStats probe;
+    rollupReset(probe);
+    if (!k.fn && !rollupAccumulateWith(k.isa, values.data(), 0, probe)) continue;
+    // Hot: an L1-resident slice over and over; stream: the whole array from memory
+    double hot = kernelMpts(k.fn, k.isa, values.data(), HOT_SLICE, hotTotal);
+    double stream = kernelMpts(k.fn, k.isa, values.data(), n, n * 4);
+    printf("%s\"%s\": {\"hotMpts\": %.0f, \"streamMpts\": %.0f, \"streamGBs\": %.2f}", first ? "" : ", ", k.name,
+           hot, stream, stream * 8 / 1000.0);
+    first = false;
+  }
+  printf("}, \"rollups\": [");
+
+  const int64_t widths[] = {60 * 1000, 3600 * 1000, 24 * 3600 * 1000LL};
+  first = true;
+  for (int64_t width : widths) {
+    for (int withPercentiles = 0; withPercentiles < 2; withPercentiles++) {
+      RollupQuery q;
+      q.fromMs = INT64_MIN;
+      q.toMs = INT64_MAX;
+      q.bucketMs = width;
+      q.percentileCount = 0;
+      if (withPercentiles) {
+        q.percentiles[0] = 50;
+        q.percentiles[1] = 95;
+        q.percentileCount = 2;
+      }
+      size_t buckets = 0;
+      double naiveMs = rollupMs(times, values, q, true, buckets);
+      double simdMs = rollupMs(times, values, q, false, buckets);
+      printf("%s{\"bucketS\": %" PRId64 ", \"percentiles\": %s, \"buckets\": %zu, \"naiveMs\": %.1f, "
+             "\"rollupMs\": %.1f, \"speedup\": %.1f}",
+             first ? "" : ", ", width / 1000, withPercentiles ? "\"50,95\"" : "null", buckets, naiveMs, simdMs,
+             simdMs > 0 ? naiveMs / simdMs : 0);
+      first = false;
+    }
+  }
+  printf("]}\n");
+  return 0;
+}
+
+// ---- Self-check --------------------------------------------------------
+
+// Sums differ only in addition order, so compare within rounding of the magnitudes
+static bool sameStats(const RollupStats& a, const RollupStats& b, double magnitude) {
+  if (a.count != b.count || a.invalid != b.invalid) return false;
+  if (a.min != b.min || a.max != b.max) return false;
+  if (std::isinf(a.sum) || std::isinf(b.sum) || std::isnan(a.sum) || std::isnan(b.sum))
+    return std::isnan(a.sum) == std::isnan(b.sum) && (std::isnan(a.sum) || a.sum == b.sum);
+  return fabs(a.sum - b.sum) <= 1e-12 * magnitude + 1e-300;
+}
+
+static bool sameValue(double a, double b) {
+  if (std::isnan(a) || std::isnan(b)) return std::isnan(a) && std::isnan(b);
+  return a == b || fabs(a - b) <= 1e-12 * std::max(fabs(a), fabs(b));
+}
+
+static bool sameBuckets(const std::vector<RollupBucket>& a, const std::vector<RollupBucket>& b,
+                        const RollupQuery& q) {
+  if (a.size() != b.size()) return false;
+  for (size_t i = 0; i < a.size(); i++) {
+    if (a[i].startMs != b[i].startMs) return false;
+    double magnitude = fabs(a[i].stats.min) + fabs(a[i].stats.max);
+    if (!sameStats(a[i].stats, b[i].stats, magnitude * (a[i].stats.count + 1))) return false;
+    for (int p = 0; p < q.percentileCount; p++)
+      if (!sameValue(a[i].percentiles[p], b[i].percentiles[p])) return false;
+  }
+  return true;
+}
+
+static const RollupIsa allIsas[] = {ROLLUP_SCALAR, ROLLUP_SSE2, ROLLUP_AVX2};
+
+static int runVerify() {
+  // Every length and start offset across the unrolled widths and tails,
+  // with NaN (both signs, payloads), -999, near-sentinels, infinities, -0.0
+  uint64_t nanPayload = 0x7FF8000000000123ULL;
+  double quietNan;
+  memcpy(&quietNan, &nanPayload, sizeof(quietNan));
+  const double specials[] = {NAN, -NAN, quietNan, ROLLUP_SENTINEL, -999.0000001, -998.9999999,
+                             INFINITY, -INFINITY, -0.0, 0.0, 1e300, -1e300, 22.5};
+  std::vector<double> data(256);
+  int tested = 0;
+  for (int round = 0; round < 200; round++) {
+    for (size_t i = 0; i < data.size(); i++) {
+      double r = uniform();
+      data[i] = r < 0.3 ? specials[(size_t)(uniform() * 13) % 13] : (uniform() - 0.5) * 100;
+    }
+    // Runs of nothing but invalid values
+    if (round % 5 == 0)
+      for (size_t i = 10; i < 60; i++) data[i] = i % 2 ? NAN : ROLLUP_SENTINEL;
+    for (size_t offset = 0; offset < 4; offset++) {
+      for (size_t n = 0; n + offset <= 70; n++) {
+        RollupStats expect;
+        rollupReset(expect);
+        naiveAccumulate(data.data() + offset, n, expect);
+        double magnitude = 0;
+        for (size_t i = 0; i < n; i++)
+          if (!std::isnan(data[offset + i]) && !std::isinf(data[offset + i])) magnitude += fabs(data[offset + i]);
+        for (RollupIsa isa : allIsas) {
+          RollupStats got;
+          rollupReset(got);
+          if (!rollupAccumulateWith(isa, data.data() + offset, n, got)) continue;
+          if (!sameStats(got, expect, magnitude)) {
+            fprintf(stderr, "verify: %s n=%zu offset=%zu count %" PRIu64 "/%" PRIu64 " min %g/%g max %g/%g sum %g/%g\n",
+                    rollupIsaName(isa), n, offset, got.count, expect.count, got.min, expect.min, got.max, expect.max,
+                    got.sum, expect.sum);
+            check(false, "kernel matches naive loop");
+          }
+          tested++;
+        }
+      }
+    }
+  }
+  check(tested > 0, "kernels ran");
+
+  // Only invalid values: nothing but the invalid count moves
+  double bad[37];
+  for (int i = 0; i < 37; i++) bad[i] = i % 3 ? ROLLUP_SENTINEL : NAN;
+  for (RollupIsa isa : allIsas) {
+    RollupStats s;
+    rollupReset(s);
+    if (!rollupAccumulateWith(isa, bad, 37, s)) continue;
+    check(s.count == 0 && s.invalid == 37 && std::isinf(s.min) && s.min > 0 && std::isinf(s.max) && s.max < 0 &&
+          s.sum == 0, "all-invalid slice");
+  }
+
+  // Sentinel is exact: neighbours are readings
+  double near[3] = {-999.0000001, ROLLUP_SENTINEL, -998.9999999};
+  RollupStats ns;
+  rollupReset(ns);
+  rollupAccumulate(near, 3, ns);
+  check(ns.count == 2 && ns.invalid == 1 && ns.min == -999.0000001 && ns.max == -998.9999999, "sentinel is exact");
+
+  // Percentiles against a full sort
+  std::vector<double> pv = {5, 1, 4, 2, 3};
+  check(rollupPercentile(pv.data(), pv.size(), 50) == 3, "p50 of 1..5");
+  pv = {5, 1, 4, 2, 3};
+  check(rollupPercentile(pv.data(), pv.size(), 90) == 4.6, "p90 interpolates");
+  pv = {7};
+  check(rollupPercentile(pv.data(), pv.size(), 95) == 7, "single value");
+  check(std::isnan(rollupPercentile(nullptr, 0, 50)), "empty percentile");
+
+  // Whole rollups, fed in arbitrary slices, match the naive per-point loop
+  std::vector<int64_t> times;
+  std::vector<double> values;
+  generate(50000, times, values, 0.05);
+  for (size_t i = 0; i < times.size(); i++) times[i] -= 7 * 3600 * 1000LL;  // Negative times floor correctly
+  for (size_t i = 1000; i < 3000; i++) values[i] = i % 2 ? NAN : ROLLUP_SENTINEL;  // Buckets with no readings
+  const int64_t widths[] = {1, 7000, 60000, 3600000};
+  for (int64_t width : widths) {
+    RollupQuery q;
+    q.fromMs = -3 * 3600 * 1000LL + 1;
+    q.toMs = 40 * 3600 * 1000LL;
+    q.bucketMs = width;
+    q.percentileCount = 4;
+    q.percentiles[0] = 0;
+    q.percentiles[1] = 50;
+    q.percentiles[2] = 95;
+    q.percentiles[3] = 100;
+    std::vector<RollupBucket> expect;
+    naiveRollup(times.data(), values.data(), values.size(), q, expect);
+    for (RollupIsa isa : allIsas) {
+      if (!rollupSetIsa(isa)) continue;
+      Rollup r;
+      rollupBegin(r, q);
+      for (size_t i = 0; i < values.size();) {
+        size_t n = std::min(values.size() - i, (size_t)(uniform() * 5000) + 1);
+        rollupAdd(r, times.data() + i, values.data() + i, n);
+        i += n;
+      }
+      rollupFinish(r);
+      check(sameBuckets(r.buckets, expect, q), "sliced rollup matches naive");
+    }
+    rollupSetIsa(rollupDetectIsa());
+  }
+
+  // Through the column store, across segments
+  char rootPath[] = "/tmp/bille-rollup-XXXXXX";
+  if (mkdtemp(rootPath)) {
+    ColumnStore store;
+    columnStoreOpen(store, rootPath, 16);
+    const std::string series = "desk-0/environment.temperature";
+    size_t n = SEGMENT_CAPACITY * 2 + 1234;
+    std::vector<int64_t> st;
+    std::vector<double> sv;
+    generate(n, st, sv, 0.02);
+    for (size_t i = 0; i < n; i++) columnStoreAppend(store, series, st[i] + 1, sv[i]);
+    columnStoreClose(store);
+    RollupQuery q;
+    q.fromMs = 3600 * 1000LL;
+    q.toMs = st.back() - 3600 * 1000LL;
+    q.bucketMs = 3600 * 1000LL;
+    q.percentileCount = 1;
+    q.percentiles[0] = 95;
+    std::vector<RollupBucket> got, expect;
+    for (size_t i = 0; i < n; i++) st[i] += 1;
+    naiveRollup(st.data(), sv.data(), n, q, expect);
+    check(rollupSeries(rootPath, series, q, got) && sameBuckets(got, expect, q), "store rollup across segments");
+    check(!rollupSeries(rootPath, "desk-9/none", q, got), "missing series");
+    std::string cmd = std::string("rm -rf '") + rootPath + "'";
+    if (system(cmd.c_str()) != 0) fprintf(stderr, "verify: could not remove %s\n", rootPath);
+  } else {
+    check(false, "temp store");
+  }
+
+  printf("{\"verify\": \"%s\", \"isa\": \"%s\", \"kernelCases\": %d, \"failures\": %d}\n",
+         verifyFailures ? "failed" : "ok", rollupIsaName(rollupDetectIsa()), tested, verifyFailures);
+  return verifyFailures ? 1 : 0;
+}
+
+static void usage() {
+  fprintf(stderr,
+          "usage: bille-rollup MODE [options]\n"
+          "  --series SERIES --root DIR  rollup of desk-<n>/<metric> as CSV\n"
+          "    --bucket S                bucket width in seconds (default 3600)\n"
+          "    --from MS / --to MS       range, wall-clock ms\n"
+          "    --percentiles LIST        e.g. 50,95 (at most %d)\n"
+          "  --bench                     kernel and rollup throughput vs a naive loop\n"
+          "    --points N                generated points (default %d)\n"
+          "  --verify                    kernel and rollup self-check\n"
+          "  --isa scalar|sse2|avx2      force a kernel\n",
+          ROLLUP_MAX_PERCENTILES, DEFAULT_BENCH_POINTS);
+}
+
+static bool parseArgs(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    if (a == "--bench") {
+      opts.bench = true;
+      continue;
+    }
+    if (a == "--verify") {
+      opts.verify = true;
+      continue;
+    }
+    if (i + 1 >= argc) return false;
+    const char* v = argv[++i];
+    if (a == "--root") opts.root = v;
+    else if (a == "--series") opts.series = v;
+    else if (a == "--bucket") opts.bucketMs = (int64_t)(atof(v) * 1000);
+    else if (a == "--from") opts.from = strtoll(v, nullptr, 10);
+    else if (a == "--to") opts.to = strtoll(v, nullptr, 10);
+    else if (a == "--percentiles") opts.percentiles = v;
+    else if (a == "--isa") opts.isa = v;
+    else if (a == "--points") opts.points = strtoull(v, nullptr, 10);
+    else return false;
+  }
+  if (!opts.bench && !opts.verify && (opts.series.empty() || opts.root.empty())) return false;
+  return opts.bucketMs > 0 && opts.points > 0;
+}
+
+int main(int argc, char** argv) {
+  if (!parseArgs(argc, argv)) {
+    usage();
+    return 2;
+  }
+  if (!opts.isa.empty()) {
+    RollupIsa isa = opts.isa == "avx2" ? ROLLUP_AVX2 : opts.isa == "sse2" ? ROLLUP_SSE2 : ROLLUP_SCALAR;
+    if (strcmp(rollupIsaName(isa), opts.isa.c_str()) != 0 || !rollupSetIsa(isa)) {
+      fprintf(stderr, "rollup: kernel %s not available\n", opts.isa.c_str());
+      return 2;
+    }
+  }
+  if (opts.verify) return runVerify();
+  if (opts.bench) return runBench();
+  return runQuery();
+}
@@ -0,0 +1,40 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+// Host stand-in for the few Arduino/ESP8266 pieces bout_tracker.cpp uses, so
+// tools/wearable can run it unchanged. millis() reads the simulation's clock
+// and RTC user memory is a plain array that outlives a simulated reset.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define PGM_P    const char*
+#define PSTR(s)  (s)
+
+extern unsigned long hostMillis;
+
+inline unsigned long millis() {
+  return hostMillis;
+}
+
+class EspClass {
+ public:
+  uint8_t rtcUserMemory[512];
+
+  // Offsets are in 4-byte blocks, as on the ESP8266
+  bool rtcUserMemoryRead(uint32_t offset, uint32_t* data, size_t size) {
+    if (offset * 4 + size > sizeof(rtcUserMemory)) return false;
+    memcpy(data, rtcUserMemory + offset * 4, size);
+    return true;
+  }
+  bool rtcUserMemoryWrite(uint32_t offset, uint32_t* data, size_t size) {
+    if (offset * 4 + size > sizeof(rtcUserMemory)) return false;
+    memcpy(rtcUserMemory + offset * 4, data, size);
+    return true;
+  }
+};
+
+extern EspClass ESP;
+
+#endif
@@ -0,0 +1,7 @@
+#ifndef PUBSUBCLIENT_H
+#define PUBSUBCLIENT_H
+
+// Host stand-in: logger.h only names the type
+class PubSubClient;
+
+#endif
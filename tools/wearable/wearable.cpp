@@ -0,0 +1,941 @@
+/*
+===============================================================
+Bill-E Wearable Motion Check
+Step detector, activity classifier and bout tracker on the host
+===============================================================
+
+Runs sketches/wearable_tracker/step_detector.cpp and activity_classifier.cpp,
+compiled in place, over the 50 Hz MPU6050 traces in tools/wearable/traces/
+and scores the step count and every window's activity class against each
+trace's labels. Samples go through both the way processMotionSamples()
+feeds them: counted steps and motion windows refresh the idle timer the
+classifier sees, and so does an approximation of the MPU6050 motion
+interrupt: any axis over MOTION_INT_THRESHOLD after a 5 Hz high-pass.
+
+A trace is a CSV of raw x,y,z samples (±4 g, 8192 LSB/g, the firmware's
+range) after a few "# key: value" header lines:
+  # activity: walking        sitting, still, moving, walking, running or -
+  # steps: 40                steps actually taken
+  # idle_s: 120              seconds since the last movement at the start
+A recorded trace in this format can be dropped into the directory as is.
+
+The committed traces are synthetic, written by --make-traces from a fixed
+seed: gaits at 1.6-3.0 Hz with per-step cadence and amplitude jitter, a
+heel-strike spike, arm swing across gravity, sensor noise and, on some,
+a slowly rotating wrist; a weak 0.12 g shuffle; walking with pauses and a
+3-step shuffle the detector is meant to drop; and sitting, typing,
+standing, arm gestures and mouse work, which have no steps at all.
+
+The classifier's thresholds are fitted on the labelled windows: the five
+features and the label of every window of a trace with an activity, as
+committed in tools/wearable/windows.csv. --windows FILE rewrites them from
+the traces for retuning ACTIVITY_TREE; traces labelled "-" are left out.
+tools/wearable/heldout/ holds the same scenarios from another seed, with
+1.5x the noise and shifted cadence, amplitude and wrist angle; it is never
+used for fitting and is scored separately.
+
+--verify asserts the count error per trace (5% for walking and running,
+15% for the weak and interrupted gaits), 0 false steps on the non-gait
+traces, 5% overall, and the per-sample cost. It then checks that
+windows.csv matches the traces, prints the confusion matrices of both
+sets, and asserts the accuracy per class (90% fitting, 80% held out), that
+no gait is taken for rest or rest for a gait, and the cost per window. The
+step checks also run on the held-out set. --bench prints the per-trace figures and the
+confusion matrix as JSON.
+
+--verify also drives bout_tracker.cpp with scripted classifier decisions
+every 1.28 s: fidgets and flicker shorter than BOUT_SWITCH_MS, the switch
+boundary itself, session totals with the bout in progress, the day
+rollover, and a reset that restores the RTC state against a corrupt or
+power-lost one. tools/wearable/host/ stands in for Arduino.h (millis() and
+RTC user memory) so the file compiles unchanged.
+
+BUILD (from the repository root):
+  g++ -O2 -std=c++17 -Itools/common -Isketches/wearable_tracker -Itools/wearable/host \
+      -o bille-wearable tools/wearable/wearable.cpp sketches/wearable_tracker/step_detector.cpp \
+      sketches/wearable_tracker/activity_classifier.cpp sketches/wearable_tracker/bout_tracker.cpp
+
+USAGE:
+  ./bille-wearable --verify
+  ./bille-wearable --bench [--traces tools/wearable/traces]
+  ./bille-wearable --windows tools/wearable/windows.csv
+  ./bille-wearable --bench --traces tools/wearable/heldout
+  ./bille-wearable --make-traces [--traces DIR] [--heldout DIR]
+===============================================================
+*/
+
+#include <dirent.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "config.h"
+#include "logger.h"
+#include "step_detector.h"
+#include "activity_classifier.h"
+#include "bout_tracker.h"
+#include "verify.h"
+
+#define TRACE_RATE_HZ        MOTION_SAMPLE_RATE_HZ
+#define TRACE_LSB_PER_G      ((int)MOTION_LSB_PER_G)   // ±4 g
+#define INT_HIGH_PASS_HZ     5.0f         // The motion detector's DHPF (MPU6050_DHPF_5)
+#define GAIT_TOLERANCE       0.05         // Walking and running traces
+#define OTHER_TOLERANCE      0.15         // Weak or interrupted gaits
+#define BENCH_PASSES         200          // Over all traces for the per-sample cost
+#define MAX_NS_PER_SAMPLE    1000.0       // Host canary; ~80 ns on a desktop core
+#define MIN_CLASS_ACCURACY   0.90         // Per class, over its windows
+#define MIN_HELDOUT_ACCURACY 0.80         // The same on the held-out traces
+#define MAX_NS_PER_WINDOW    20000.0      // Host canary for one classification
+
+struct Options {
+  bool bench = false;
+  bool verify = false;
+  bool makeTraces = false;
+  std::string traces = "tools/wearable/traces";
+  std::string heldOut = "tools/wearable/heldout";
+  std::string windows = "tools/wearable/windows.csv";
+  bool writeWindows = false;
+};
+
+static Options opts;
+
+struct Sample {
+  int16_t x, y, z;
+};
+
+struct Trace {
+  std::string name;
+  std::string activity;                   // "-" when the trace has no single label
+  int steps = 0;
+  int idleSeconds = 0;
+  std::vector<Sample> samples;
+};
+
+// ---- Trace generator -----------------------------------------------------
+
+struct Rng {
+  uint64_t state;
+  uint32_t next() {
+    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (uint32_t)(state >> 33);
+  }
+  float uniform() { return next() / 2147483648.0f; }   // [0, 1)
+  float gaussian() {
+    float u = std::max(uniform(), 1e-7f);
+    return sqrtf(-2.0f * logf(u)) * cosf(2.0f * (float)M_PI * uniform());
+  }
+};
+
+struct Vec3 {
+  float x, y, z;
+};
+
+static Vec3 add(Vec3 a, Vec3 b, float k) {
+  return {a.x + k * b.x, a.y + k * b.y, a.z + k * b.z};
+}
+
+// Gravity direction in the device frame; pitch 0 / roll 0 is flat, face up
+static Vec3 gravityDir(float pitchDeg, float rollDeg) {
+  float p = pitchDeg * (float)M_PI / 180.0f, r = rollDeg * (float)M_PI / 180.0f;
+  return {sinf(p), cosf(p) * sinf(r), cosf(p) * cosf(r)};
+}
+
+// A unit vector across gravity, for arm swing and gestures
+static Vec3 acrossDir(Vec3 g) {
+  Vec3 c = {g.y, -g.x, 0};                // g x Z
+  float n = sqrtf(c.x * c.x + c.y * c.y);
+  if (n < 0.2f) return {1, 0, 0};
+  return {c.x / n, c.y / n, 0};
+}
+
+struct Wrist {
+  float pitch, roll;                      // Resting orientation, degrees
+  float rotate;                           // Slow roll swing amplitude, degrees (0 = none)
+  float noise;                            // Sensor noise per axis, g
+};
+
+struct TraceWriter {
+  Trace& trace;
+  Rng& rng;
+  Wrist wrist;
+  double t = 0;
+
+  Vec3 gravity(float extraPitch = 0) const {
+    float roll = wrist.roll + wrist.rotate * sinf(2.0f * (float)M_PI * 0.07f * (float)t);
+    return gravityDir(wrist.pitch + extraPitch, roll);
+  }
+
+  void emit(Vec3 a) {
+    a = add(a, {rng.gaussian(), rng.gaussian(), rng.gaussian()}, wrist.noise);
+    auto lsb = [](float g) {
+      long v = lroundf(g * TRACE_LSB_PER_G);
+      return (int16_t)std::min(32767L, std::max(-32768L, v));
+    };
+    trace.samples.push_back({lsb(a.x), lsb(a.y), lsb(a.z)});
+    t += 1.0 / TRACE_RATE_HZ;
+  }
+};
+
+// One step is one cycle of vertical acceleration at the step rate, with a
+// short heel-strike spike near its peak; the arm swings across gravity at
+// half the step rate. Cadence and amplitude vary by step.
+static void walk(TraceWriter& w, int steps, float hz, float amplitude) {
+  for (int s = 0; s < steps; s++) {
+    float stepHz = hz * (1.0f + 0.12f * (w.rng.uniform() - 0.5f));
+    float a = amplitude * (1.0f + 0.3f * (w.rng.uniform() - 0.5f));
+    int n = std::max(2, (int)lroundf(TRACE_RATE_HZ / stepHz));
+    for (int i = 0; i < n; i++) {
+      float phase = 2.0f * (float)M_PI * i / n;
+      float sinceStrike = (i - n / 4) / (float)TRACE_RATE_HZ;
+      float spike = sinceStrike >= 0 ? 0.3f * a * expf(-sinceStrike / 0.03f) : 0;
+      float vertical = a * (sinf(phase) + 0.3f * sinf(2 * phase)) + spike;
+      float swing = 0.5f * a * sinf((phase + 2.0f * (float)M_PI * (s & 1)) / 2);
+      Vec3 g = w.gravity();
+      w.emit(add(add({0, 0, 0}, g, 1.0f + vertical), acrossDir(g), swing));
+    }
+    w.trace.steps++;
+  }
+}
+
+static void rest(TraceWriter& w, float seconds) {
+  for (int i = 0; i < (int)(seconds * TRACE_RATE_HZ); i++) w.emit(w.gravity());
+}
+
+// Key presses: short ~20 Hz ringing bursts at ~6 per second, damped by the
+// wrist resting on the desk
+static void typing(TraceWriter& w, float seconds) {
+  float ring = 0;
+  Vec3 axis = {0, 0, 1};
+  for (int i = 0; i < (int)(seconds * TRACE_RATE_HZ); i++) {
+    if (w.rng.uniform() < 6.0f / TRACE_RATE_HZ) {
+      ring = 0.03f + 0.04f * w.rng.uniform();
+      axis = {w.rng.uniform() - 0.5f, w.rng.uniform() - 0.5f, 1};
+    }
+    float burst = ring * ((i & 1) ? 1.0f : -1.0f);
+    ring *= 0.6f;
+    w.emit(add(w.gravity(), axis, burst));
+  }
+}
+
+// Raising a hand, waving, putting it down: the wrist pitches up by 50° over
+// ~1.5 s, waves across gravity at ~1.5 Hz, then lowers; ~1 s pauses between
+static void gestures(TraceWriter& w, float seconds) {
+  int total = (int)(seconds * TRACE_RATE_HZ);
+  int i = 0;
+  while (i < total) {
+    int raise = (int)(1.5f * TRACE_RATE_HZ), wave = (int)((1.0f + 2.0f * w.rng.uniform()) * TRACE_RATE_HZ);
+    float waveHz = 1.2f + 0.6f * w.rng.uniform();
+    for (int k = 0; k < raise && i < total; k++, i++) w.emit(w.gravity(50.0f * k / raise));
+    for (int k = 0; k < wave && i < total; k++, i++) {
+      Vec3 g = w.gravity(50.0f);
+      w.emit(add(g, acrossDir(g), 0.35f * sinf(2.0f * (float)M_PI * waveHz * k / TRACE_RATE_HZ)));
+    }
+    for (int k = 0; k < raise && i < total; k++, i++) w.emit(w.gravity(50.0f * (raise - k) / raise));
+    int pause = (int)((0.5f + 1.0f * w.rng.uniform()) * TRACE_RATE_HZ);
+    for (int k = 0; k < pause && i < total; k++, i++) w.emit(w.gravity());
+  }
+}
+
+// Working the mouse: a stroke across the desk every 0.3-1 s, accelerating
+// then braking over 0.2-0.5 s, with the wrist turning a little as it goes
+static void mouseWork(TraceWriter& w, float seconds) {
+  int total = (int)(seconds * TRACE_RATE_HZ);
+  int i = 0;
+  while (i < total) {
+    int stroke = (int)((0.2f + 0.3f * w.rng.uniform()) * TRACE_RATE_HZ);
+    float a = 0.1f + 0.2f * w.rng.uniform();
+    float turn = 15.0f * (w.rng.uniform() - 0.5f);
+    for (int k = 0; k < stroke && i < total; k++, i++) {
+      float phase = 2.0f * (float)M_PI * k / stroke;
+      Vec3 g = w.gravity(turn * (1 - cosf(phase)) / 2);
+      w.emit(add(g, acrossDir(g), a * sinf(phase)));
+    }
+    int pause = (int)((0.1f + 0.5f * w.rng.uniform()) * TRACE_RATE_HZ);
+    for (int k = 0; k < pause && i < total; k++, i++) w.emit(w.gravity());
+  }
+}
+
+static bool writeTrace(const std::string& dir, const Trace& trace, const char* description, bool heldOut) {
+  std::string path = dir + "/" + trace.name + ".csv";
+  FILE* f = fopen(path.c_str(), "w");
+  if (!f) {
+    perror(path.c_str());
+    return false;
+  }
+  fprintf(f, "# Bill-E wearable trace: %s\n", description);
+  fprintf(f, "# source: synthetic%s, bille-wearable --make-traces\n", heldOut ? " held-out set" : "");
+  fprintf(f, "# rate_hz: %d\n# lsb_per_g: %d\n", TRACE_RATE_HZ, TRACE_LSB_PER_G);
+  fprintf(f, "# activity: %s\n# steps: %d\n# idle_s: %d\n", trace.activity.c_str(), trace.steps,
+          trace.idleSeconds);
+  fprintf(f, "x,y,z\n");
+  for (const Sample& s : trace.samples) fprintf(f, "%d,%d,%d\n", s.x, s.y, s.z);
+  bool ok = fclose(f) == 0;
+  printf("%s: %zu samples, %d steps\n", path.c_str(), trace.samples.size(), trace.steps);
+  return ok;
+}
+
+enum TraceKind { WALK, PAUSES, REST, TYPING, GESTURES, MOUSE };
+
+struct TraceSpec {
+  const char* name;
+  const char* activity;
+  int idleSeconds;                        // Since the last movement when the trace starts
+  TraceKind kind;
+  float hz;
+  float amplitude;                        // g
+  Wrist wrist;
+  const char* description;
+};
+
+#define TRACE_SECONDS  20
+
+static const TraceSpec TRACE_SPECS[] = {
+  {"walk_1.6hz", "walking", 0, WALK, 1.6f, 0.30f, {-20, 70, 0, 0.012f}, "slow walk, arm at the side"},
+  {"walk_2.0hz", "walking", 0, WALK, 2.0f, 0.35f, {-15, 80, 0, 0.012f}, "walk"},
+  {"walk_2.2hz_rotating", "walking", 0, WALK, 2.2f, 0.40f, {-10, 70, 35, 0.012f}, "brisk walk, wrist rotating"},
+  {"run_2.6hz", "running", 0, WALK, 2.6f, 0.90f, {40, 30, 0, 0.015f}, "jog, forearm raised"},
+  {"run_2.8hz_rotating", "running", 0, WALK, 2.8f, 1.00f, {45, 20, 30, 0.015f}, "run, wrist rotating"},
+  {"run_3.0hz", "running", 0, WALK, 3.0f, 1.10f, {50, 25, 0, 0.015f}, "fast run"},
+  {"walk_weak_0.12g", "-", 0, WALK, 1.8f, 0.12f, {-15, 75, 0, 0.012f}, "shuffle, 0.12 g gait"},
+  {"walk_pauses", "-", 0, PAUSES, 2.0f, 0.35f, {-15, 80, 20, 0.012f}, "walk, stops, 3-step shuffle, walk"},
+  {"sitting_desk", "sitting", 120, REST, 0, 0, {8, 12, 0, 0.010f}, "forearm flat on a desk"},
+  {"sitting_reading", "sitting", 120, REST, 0, 0, {30, 25, 5, 0.010f}, "resting on a desk, wrist tilted"},
+  {"standing_arm_down", "still", 120, REST, 0, 0, {-10, 85, 0, 0.010f}, "standing, arm hanging"},
+  {"standing_drifting", "still", 120, REST, 0, 0, {-20, 75, 5, 0.010f}, "standing, wrist drifting"},
+  // Typing is desk work: the wrist rests and the bout tracker must see it as sedentary
+  {"typing", "sitting", 120, TYPING, 0, 0, {10, 10, 0, 0.010f}, "typing on a keyboard"},
+  {"arm_gestures", "moving", 0, GESTURES, 0, 0, {10, 15, 0, 0.012f}, "raising a hand and waving"},
+  {"mouse_work", "moving", 0, MOUSE, 0, 0, {15, 20, 0, 0.012f}, "working the mouse"},
+  {"paused_at_desk", "still", 5, REST, 0, 0, {10, 15, 0, 0.010f}, "sat down a few seconds ago"},
+};
+
+// The held-out set reruns every spec from another seed with 1.5x the
+// noise, cadence and amplitude shifted by up to ±8% and ±20%, and the wrist
+// turned by up to ±15° each way
+static int makeTraceSet(const std::string& dir, uint64_t seed, bool heldOut) {
+  Rng rng = {seed};
+  Rng shift = {seed ^ 0x5DEECE66DULL};
+  for (TraceSpec spec : TRACE_SPECS) {
+    if (heldOut) {
+      spec.hz *= 1.0f + 0.16f * (shift.uniform() - 0.5f);
+      spec.amplitude *= 1.0f + 0.4f * (shift.uniform() - 0.5f);
+      spec.wrist.pitch += 30.0f * (shift.uniform() - 0.5f);
+      spec.wrist.roll += 30.0f * (shift.uniform() - 0.5f);
+      spec.wrist.noise *= 1.5f;
+    }
+    Trace trace;
+    trace.name = spec.name;
+    trace.activity = spec.activity;
+    trace.idleSeconds = spec.idleSeconds;
+    TraceWriter w = {trace, rng, spec.wrist};
+    switch (spec.kind) {
+      case WALK:
+        walk(w, (int)(TRACE_SECONDS * spec.hz), spec.hz, spec.amplitude);
+        break;
+      case PAUSES:
+        rest(w, 2);
+        walk(w, 24, spec.hz, spec.amplitude);
+        rest(w, 6);
+        walk(w, 3, 1.6f, 0.25f);
+        rest(w, 6);
+        walk(w, 22, 1.8f, spec.amplitude);
+        rest(w, 2);
+        break;
+      case REST:
+        rest(w, TRACE_SECONDS);
+        break;
+      case TYPING:
+        typing(w, TRACE_SECONDS);
+        break;
+      case GESTURES:
+        gestures(w, TRACE_SECONDS);
+        break;
+      case MOUSE:
+        mouseWork(w, TRACE_SECONDS);
+        break;
+    }
+    if (!writeTrace(dir, trace, spec.description, heldOut)) return 1;
+  }
+  return 0;
+}
+
+static int makeTraces() {
+  if (makeTraceSet(opts.traces, 20241018, false) != 0) return 1;
+  return makeTraceSet(opts.heldOut, 20250611, true);
+}
+
+// ---- Trace files ---------------------------------------------------------
+
+static bool loadTrace(const std::string& path, Trace& trace) {
+  FILE* f = fopen(path.c_str(), "r");
+  if (!f) {
+    perror(path.c_str());
+    return false;
+  }
+  char line[256];
+  bool ok = true;
+  int lineNo = 0;
+  while (fgets(line, sizeof(line), f)) {
+    lineNo++;
+    if (line[0] == '#') {
+      char key[32], value[128];
+      if (sscanf(line, "# %31[^:]: %127s", key, value) == 2) {
+        if (strcmp(key, "activity") == 0) trace.activity = value;
+        else if (strcmp(key, "steps") == 0) trace.steps = atoi(value);
+        else if (strcmp(key, "idle_s") == 0) trace.idleSeconds = atoi(value);
+        else if (strcmp(key, "rate_hz") == 0 && atoi(value) != TRACE_RATE_HZ) ok = false;
+        else if (strcmp(key, "lsb_per_g") == 0 && atoi(value) != TRACE_LSB_PER_G) ok = false;
+      }
+      continue;
+    }
+    if (strncmp(line, "x,y,z", 5) == 0) continue;
+    int x, y, z;
+    if (sscanf(line, "%d,%d,%d", &x, &y, &z) != 3) {
+      fprintf(stderr, "%s:%d: expected x,y,z\n", path.c_str(), lineNo);
+      ok = false;
+      break;
+    }
+    trace.samples.push_back({(int16_t)x, (int16_t)y, (int16_t)z});
+  }
+  fclose(f);
+  if (!ok) fprintf(stderr, "%s: not a %d Hz, %d LSB/g trace\n", path.c_str(), TRACE_RATE_HZ, TRACE_LSB_PER_G);
+  return ok;
+}
+
+static bool loadTraces(const std::string& dir, std::vector<Trace>& traces) {
+  DIR* d = opendir(dir.c_str());
+  if (!d) {
+    perror(dir.c_str());
+    return false;
+  }
+  std::vector<std::string> names;
+  while (struct dirent* e = readdir(d)) {
+    std::string name = e->d_name;
+    if (name.size() > 4 && name.compare(name.size() - 4, 4, ".csv") == 0) names.push_back(name);
+  }
+  closedir(d);
+  std::sort(names.begin(), names.end());
+
+  for (const std::string& name : names) {
+    Trace trace;
+    trace.name = name.substr(0, name.size() - 4);
+    if (!loadTrace(dir + "/" + name, trace)) return false;
+    traces.push_back(trace);
+  }
+  if (traces.empty()) fprintf(stderr, "%s: no traces\n", dir.c_str());
+  return !traces.empty();
+}
+
+// ---- Scoring -------------------------------------------------------------
+
+struct StepResult {
+  int counted;
+  double error;                           // Relative to the true count; 0 for no-step traces
+};
+
+static StepResult countSteps(const Trace& trace) {
+  StepDetector sd;
+  stepDetectorInit(sd, TRACE_RATE_HZ, TRACE_LSB_PER_G);
+  int counted = 0;
+  for (const Sample& s : trace.samples) counted += stepDetectorAddSample(sd, s.x, s.y, s.z);
+  double error = trace.steps > 0 ? (double)(counted - trace.steps) / trace.steps : 0;
+  return {counted, error};
+}
+
+static bool isGait(const Trace& trace) {
+  return trace.activity == "walking" || trace.activity == "running";
+}
+
+// ---- Activity windows ----------------------------------------------------
+
+static const char* const CLASS_LABELS[] = {"sitting", "still", "moving", "walking", "running"};
+#define CLASS_COUNT  5
+
+// ACTIVITY_* for a trace label, -1 for "-" or an unknown one
+static int classOf(const std::string& activity) {
+  for (int c = 0; c < CLASS_COUNT; c++) {
+    if (activity == CLASS_LABELS[c]) return c;
+  }
+  return -1;
+}
+
+struct Window {
+  std::string trace;
+  int index;
+  int32_t features[FEATURE_COUNT];
+  int label;                              // From the trace
+  int predicted;                          // activityClassify()
+};
+
+// Feeds the trace through the step detector and the classifier like
+// processMotionSamples(): steps and motion windows move lastMovement on
+static void classifyTrace(const Trace& trace, std::vector<Window>& windows) {
+  StepDetector sd;
+  ActivityClassifier ac;
+  stepDetectorInit(sd, TRACE_RATE_HZ, TRACE_LSB_PER_G);
+  activityClassifierInit(ac, TRACE_RATE_HZ, TRACE_LSB_PER_G);
+  long lastMovementMs = -1000L * trace.idleSeconds;
+  int label = classOf(trace.activity);
+  int index = 0;
+
+  // Motion interrupt: per-axis one-pole high-pass, threshold at 2 mg per LSB
+  const float alpha = 1.0f - expf(-2.0f * (float)M_PI * INT_HIGH_PASS_HZ / TRACE_RATE_HZ);
+  const float intThreshold = MOTION_INT_THRESHOLD * 2 * TRACE_LSB_PER_G / 1000.0f;
+  float slow[3] = {0, 0, 0};
+  if (!trace.samples.empty()) {
+    slow[0] = trace.samples[0].x;
+    slow[1] = trace.samples[0].y;
+    slow[2] = trace.samples[0].z;
+  }
+
+  for (size_t i = 0; i < trace.samples.size(); i++) {
+    const Sample& s = trace.samples[i];
+    long sampleMs = (long)i * 1000 / TRACE_RATE_HZ;
+    const float axes[3] = {(float)s.x, (float)s.y, (float)s.z};
+    for (int a = 0; a < 3; a++) {
+      slow[a] += alpha * (axes[a] - slow[a]);
+      if (fabsf(axes[a] - slow[a]) > intThreshold) lastMovementMs = sampleMs;
+    }
+    if (stepDetectorAddSample(sd, s.x, s.y, s.z) > 0) lastMovementMs = sampleMs;
+    if (!activityClassifierAddSample(ac, s.x, s.y, s.z)) continue;
+
+    uint32_t idle = sampleMs > lastMovementMs ? (sampleMs - lastMovementMs) / 1000 : 0;
+    ActivityClass activity = activityClassify(ac, idle);
+    if (activity >= ACTIVITY_MOVING) lastMovementMs = sampleMs;
+
+    Window w;
+    w.trace = trace.name;
+    w.index = index++;
+    memcpy(w.features, ac.features, sizeof(w.features));
+    w.label = label;
+    w.predicted = activity;
+    windows.push_back(w);
+  }
+}
+
+// Windows of the traces with a class label
+static std::vector<Window> labelledWindows(const std::vector<Trace>& traces) {
+  std::vector<Window> all, labelled;
+  for (const Trace& trace : traces) classifyTrace(trace, all);
+  for (const Window& w : all) {
+    if (w.label >= 0) labelled.push_back(w);
+  }
+  return labelled;
+}
+
+static std::string windowLine(const Window& w) {
+  char line[160];
+  snprintf(line, sizeof(line), "%s,%d,%d,%d,%d,%d,%d,%s", w.trace.c_str(), w.index,
+           (int)w.features[FEATURE_VARIANCE], (int)w.features[FEATURE_SMA], (int)w.features[FEATURE_FREQUENCY],
+           (int)w.features[FEATURE_TILT], (int)w.features[FEATURE_IDLE], CLASS_LABELS[w.label]);
+  return line;
+}
+
+#define WINDOWS_HEADER  "trace,window,variance_mg2,sma_mg,frequency_0.1hz,tilt_deg,idle_s,label"
+
+static int writeWindows(const std::vector<Trace>& traces) {
+  FILE* f = fopen(opts.windows.c_str(), "w");
+  if (!f) {
+    perror(opts.windows.c_str());
+    return 1;
+  }
+  std::vector<Window> windows = labelledWindows(traces);
+  fprintf(f, "# Bill-E activity windows: %d samples every %d, features from activity_classifier.cpp,\n",
+          ACTIVITY_WINDOW, ACTIVITY_HOP);
+  fprintf(f, "# label from the trace; written by bille-wearable --windows\n");
+  fprintf(f, "%s\n", WINDOWS_HEADER);
+  for (const Window& w : windows) fprintf(f, "%s\n", windowLine(w).c_str());
+  if (fclose(f) != 0) return 1;
+  printf("%s: %zu windows\n", opts.windows.c_str(), windows.size());
+  return 0;
+}
+
+// The committed windows are the fitting set; they must be what the traces
+// and the feature code produce today
+static bool windowsMatch(const std::vector<Window>& windows) {
+  FILE* f = fopen(opts.windows.c_str(), "r");
+  if (!f) {
+    perror(opts.windows.c_str());
+    return false;
+  }
+  char line[256];
+  size_t n = 0;
+  bool ok = true;
+  while (ok && fgets(line, sizeof(line), f)) {
+    line[strcspn(line, "\r\n")] = 0;
+    if (line[0] == '#' || strcmp(line, WINDOWS_HEADER) == 0) continue;
+    ok = n < windows.size() && windowLine(windows[n]) == line;
+    if (!ok) fprintf(stderr, "%s: differs at \"%s\"\n", opts.windows.c_str(), line);
+    n++;
+  }
+  fclose(f);
+  return ok && n == windows.size();
+}
+
+struct Confusion {
+  unsigned long counts[CLASS_COUNT][CLASS_COUNT] = {};   // [label][predicted]
+
+  unsigned long labelled(int c) const {
+    unsigned long n = 0;
+    for (int p = 0; p < CLASS_COUNT; p++) n += counts[c][p];
+    return n;
+  }
+  double accuracy(int c) const {
+    unsigned long n = labelled(c);
+    return n ? (double)counts[c][c] / n : 0;
+  }
+};
+
+static Confusion confusion(const std::vector<Window>& windows) {
+  Confusion m;
+  for (const Window& w : windows) m.counts[w.label][w.predicted]++;
+  return m;
+}
+
+static void printConfusion(const Confusion& m) {
+  printf("%-8s", "label");
+  for (int p = 0; p < CLASS_COUNT; p++) printf(" %8s", CLASS_LABELS[p]);
+  printf("  accuracy\n");
+  for (int c = 0; c < CLASS_COUNT; c++) {
+    printf("%-8s", CLASS_LABELS[c]);
+    for (int p = 0; p < CLASS_COUNT; p++) printf(" %8lu", m.counts[c][p]);
+    printf("  %5.1f%%\n", m.accuracy(c) * 100);
+  }
+}
+
+static double nowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double stepNsPerSample(const std::vector<Trace>& traces) {
+  unsigned long samples = 0;
+  volatile int sink = 0;
+  double start = nowNs();
+  for (int pass = 0; pass < BENCH_PASSES; pass++) {
+    for (const Trace& trace : traces) {
+      sink += countSteps(trace).counted;
+      samples += trace.samples.size();
+    }
+  }
+  return (nowNs() - start) / samples;
+}
+
+static double classifyNsPerWindow(const std::vector<Trace>& traces) {
+  ActivityClassifier ac;
+  activityClassifierInit(ac, TRACE_RATE_HZ, TRACE_LSB_PER_G);
+  for (const Sample& s : traces[0].samples) activityClassifierAddSample(ac, s.x, s.y, s.z);
+  volatile int sink = 0;
+  const int rounds = 100000;
+  double start = nowNs();
+  for (int i = 0; i < rounds; i++) sink += activityClassify(ac, i & 63);
+  return (nowNs() - start) / rounds;
+}
+
+static int runBench() {
+  std::vector<Trace> traces;
+  if (!loadTraces(opts.traces, traces)) return 1;
+  Confusion m = confusion(labelledWindows(traces));
+  int steps = 0, counted = 0;
+  printf("{\"traces\": [\n");
+  for (size_t i = 0; i < traces.size(); i++) {
+    const Trace& trace = traces[i];
+    StepResult r = countSteps(trace);
+    steps += trace.steps;
+    counted += r.counted;
+    printf("  {\"name\": \"%s\", \"activity\": \"%s\", \"seconds\": %.1f, \"steps\": %d, \"counted\": %d, "
+           "\"errorPct\": %.1f}%s\n",
+           trace.name.c_str(), trace.activity.c_str(), trace.samples.size() / (double)TRACE_RATE_HZ, trace.steps,
+           r.counted, r.error * 100, i + 1 < traces.size() ? "," : "");
+  }
+  printf("],\n \"steps\": %d, \"counted\": %d, \"errorPct\": %.1f, \"stepNsPerSample\": %.0f,\n", steps, counted,
+         steps ? (counted - steps) * 100.0 / steps : 0.0, stepNsPerSample(traces));
+  printf(" \"classes\": {\n");
+  for (int c = 0; c < CLASS_COUNT; c++) {
+    printf("  \"%s\": {\"windows\": %lu, \"accuracyPct\": %.1f, \"predicted\": [", CLASS_LABELS[c], m.labelled(c),
+           m.accuracy(c) * 100);
+    for (int p = 0; p < CLASS_COUNT; p++) printf("%lu%s", m.counts[c][p], p + 1 < CLASS_COUNT ? ", " : "");
+    printf("]}%s\n", c + 1 < CLASS_COUNT ? "," : "");
+  }
+  printf(" },\n \"classifyNsPerWindow\": %.0f}\n", classifyNsPerWindow(traces));
+  return 0;
+}
+
+// ---- Self-check ----------------------------------------------------------
+
+// Bout tracker host side: the clock, RTC memory and a silent logger
+unsigned long hostMillis = 0;
+EspClass ESP;
+uint8_t logLevels[LOG_MODULE_COUNT] = {};
+void logWrite(uint8_t, uint8_t, PGM_P, ...) {}
+
+#define DECISION_MS  (1000UL * ACTIVITY_HOP / TRACE_RATE_HZ)
+#define MINUTE_MS    60000UL
+
+static unsigned long boutScripted = 0;   // Nominal end of the script so far, on millis()
+
+// One classifier decision every DECISION_MS until ms more of the script
+static void boutRun(ActivityClass activity, unsigned long ms) {
+  boutScripted += ms;
+  while (hostMillis + DECISION_MS <= boutScripted) {
+    hostMillis += DECISION_MS;
+    boutTrackerUpdate(activity, hostMillis);
+  }
+}
+
+// Reset or crash: millis() starts over, RTC user memory is kept
+static void boutReset() {
+  hostMillis = 0;
+  boutScripted = 0;
+  boutTrackerInit();
+}
+
+// Power on: RTC user memory holds whatever the chip came up with
+static void boutPowerOn() {
+  memset(ESP.rtcUserMemory, 0xA5, sizeof(ESP.rtcUserMemory));
+  boutReset();
+}
+
+static bool nearMs(unsigned long a, unsigned long b) {
+  return labs((long)a - (long)b) <= (long)(2 * DECISION_MS);
+}
+
+static void verifyBouts() {
+  BoutTotals today;
+
+  // 30 min sitting with a 20 s fidget every 5 min, a 5 min walk, 10 min
+  // sitting: the fidgets stay inside one sitting bout, and the last one
+  // runs straight into the walk, so the switch begins 20 s before it
+  boutPowerOn();
+  boutTrackerSessionStart();
+  for (int i = 0; i < 6; i++) {
+    boutRun(ACTIVITY_SITTING, 5 * MINUTE_MS - 20000);
+    boutRun(ACTIVITY_MOVING, 20000);
+  }
+  boutRun(ACTIVITY_WALKING, 5 * MINUTE_MS);
+  boutRun(ACTIVITY_SITTING, 10 * MINUTE_MS);
+  boutTrackerToday(today);
+  check(today.sitBouts == 1 && nearMs(today.longestSitMs, 30 * MINUTE_MS - 20000),
+        "bouts: fidgets shorter than BOUT_SWITCH_MS stay in the sitting bout");
+  check(today.activeBouts == 1 && nearMs(today.activeMs, 5 * MINUTE_MS + 20000), "bouts: active bout from the fidget");
+  check(boutSitHistogram()[4] == 1 && boutActiveHistogram()[2] == 1, "bouts: histogram bins (20-30, 5-10 min)");
+  check(nearMs(boutCurrentSitMs(), 10 * MINUTE_MS), "bouts: sitting bout in progress");
+
+  BoutTotals session;
+  unsigned long sessionMs;
+  boutTrackerSessionEnd(session, sessionMs);
+  check(nearMs(sessionMs, 45 * MINUTE_MS) && nearMs(session.sedentaryMs, 40 * MINUTE_MS - 20000) &&
+        nearMs(session.activeMs, 5 * MINUTE_MS + 20000), "bouts: session totals include the open bout");
+
+  // The switch boundary: the opposite state must last BOUT_SWITCH_MS, and
+  // the bout closes where it began
+  boutPowerOn();
+  boutRun(ACTIVITY_SITTING, 10 * MINUTE_MS);
+  boutRun(ACTIVITY_WALKING, BOUT_SWITCH_MS - 2 * DECISION_MS);
+  boutRun(ACTIVITY_STILL, 10000);
+  boutTrackerToday(today);
+  check(today.sitBouts == 0 && today.activeBouts == 0, "bouts: shorter than BOUT_SWITCH_MS does not switch");
+  unsigned long walkFrom = boutScripted;
+  boutRun(ACTIVITY_WALKING, BOUT_SWITCH_MS + 2 * DECISION_MS);
+  boutTrackerToday(today);
+  check(today.sitBouts == 1 && nearMs(today.longestSitMs, walkFrom) && boutCurrentSitMs() == 0,
+        "bouts: BOUT_SWITCH_MS switches, closed where the switch began");
+
+  // Flicker: a minute of walking broken by a sitting decision every 30 s
+  // never confirms a switch
+  boutRun(ACTIVITY_SITTING, 5 * MINUTE_MS);
+  boutTrackerToday(today);
+  int activeBouts = today.activeBouts;
+  for (int i = 0; i < 10; i++) {
+    boutRun(ACTIVITY_WALKING, 30000);
+    boutRun(ACTIVITY_SITTING, DECISION_MS);
+  }
+  boutTrackerToday(today);
+  check(today.activeBouts == activeBouts && boutCurrentSitMs() > 10 * MINUTE_MS,
+        "bouts: walking broken every 30 s does not switch");
+
+  // Day rollover after 24 h of tracked time: today moves to yesterday
+  boutPowerOn();
+  boutRun(ACTIVITY_SITTING, 120 * MINUTE_MS);
+  boutRun(ACTIVITY_WALKING, 30 * MINUTE_MS);
+  boutRun(ACTIVITY_SITTING, 22 * 60 * MINUTE_MS);
+  BoutTotals yesterday;
+  boutTrackerYesterday(yesterday);
+  boutTrackerToday(today);
+  check(yesterday.sitBouts == 1 && yesterday.activeBouts == 1 && nearMs(yesterday.activeMs, 30 * MINUTE_MS),
+        "bouts: day rollover keeps yesterday");
+  check(today.sitBouts == 0 && today.activeBouts == 0 && boutSitHistogram()[6] == 0 &&
+        boutHoursTracked() < 1, "bouts: day rollover starts today empty");
+
+  // Reset mid-session: the RTC copy restores the day, the open bout and the
+  // session, losing at most the time since the last save; time switched
+  // off is not counted
+  boutPowerOn();
+  boutTrackerSessionStart();
+  boutRun(ACTIVITY_SITTING, 20 * MINUTE_MS);
+  boutRun(ACTIVITY_WALKING, 3 * MINUTE_MS);
+  boutRun(ACTIVITY_SITTING, 7 * MINUTE_MS + 30000);
+  BoutTotals before;
+  boutTrackerToday(before);
+  unsigned long sitBefore = boutCurrentSitMs();
+  boutReset();
+  boutTrackerToday(today);
+  unsigned long sitAfter = boutCurrentSitMs();
+  check(today.sitBouts == before.sitBouts && today.activeBouts == before.activeBouts &&
+        today.activeMs == before.activeMs, "bouts: reset restores today's bouts");
+  check(sitAfter <= sitBefore && sitAfter + BOUT_SAVE_INTERVAL_MS >= sitBefore,
+        "bouts: reset keeps the open bout, up to one save interval lost");
+  boutTrackerSessionStart();                        // The retained session/state arriving again
+  boutRun(ACTIVITY_SITTING, 5 * MINUTE_MS);
+  boutTrackerSessionEnd(session, sessionMs);
+  check(session.sitBouts == 1 && session.activeBouts == 1 && nearMs(session.activeMs, 3 * MINUTE_MS) &&
+        sessionMs + BOUT_SAVE_INTERVAL_MS >= 35 * MINUTE_MS + 30000 && sessionMs <= 35 * MINUTE_MS + 30000,
+        "bouts: reset resumes the session");
+
+  // A corrupt RTC copy or a power loss starts fresh
+  boutRun(ACTIVITY_WALKING, 5 * MINUTE_MS);
+  ESP.rtcUserMemory[RTC_BOUT_BLOCK * 4 + 8] ^= 0x40;
+  boutReset();
+  boutTrackerToday(today);
+  check(today.sitBouts == 0 && today.activeBouts == 0 && boutHoursTracked() == 0, "bouts: corrupt RTC state starts fresh");
+  boutRun(ACTIVITY_WALKING, 5 * MINUTE_MS);
+  boutPowerOn();
+  boutTrackerToday(today);
+  check(today.sitBouts == 0 && today.activeMs == 0 && boutCurrentSitMs() == 0, "bouts: power loss starts fresh");
+}
+
+static void checkSteps(const char* set, const std::vector<Trace>& traces) {
+  int steps = 0, counted = 0;
+  for (const Trace& trace : traces) {
+    StepResult r = countSteps(trace);
+    std::string what = std::string(set) + " " + trace.name + ": ";
+    if (trace.steps == 0) {
+      check(r.counted == 0, (what + "no false steps").c_str());
+      continue;
+    }
+    double tolerance = isGait(trace) ? GAIT_TOLERANCE : OTHER_TOLERANCE;
+    char bound[64];
+    snprintf(bound, sizeof(bound), "step count within %.0f%% (%d of %d)", tolerance * 100, r.counted, trace.steps);
+    check(fabs(r.error) <= tolerance, (what + bound).c_str());
+    steps += trace.steps;
+    counted += r.counted;
+  }
+  check(steps > 0 && abs(counted - steps) <= steps * GAIT_TOLERANCE, (std::string(set) + ": overall step count within 5%").c_str());
+}
+
+// Every class mostly right, and the mistakes stay between neighbouring classes
+static void checkClasses(const char* set, const Confusion& m, double minAccuracy) {
+  printf("%s windows:\n", set);
+  printConfusion(m);
+  unsigned long correct = 0, total = 0;
+  for (int c = 0; c < CLASS_COUNT; c++) {
+    char what[96];
+    snprintf(what, sizeof(what), "%s %s: accuracy at least %.0f%%", set, CLASS_LABELS[c], minAccuracy * 100);
+    check(m.labelled(c) > 0 && m.accuracy(c) >= minAccuracy, what);
+    correct += m.counts[c][c];
+    total += m.labelled(c);
+  }
+  check(correct >= total * (1 + minAccuracy) / 2, (std::string(set) + ": overall accuracy").c_str());
+  unsigned long gaitAsRest = 0, restAsGait = 0;
+  for (int c = ACTIVITY_WALKING; c <= ACTIVITY_RUNNING; c++) {
+    gaitAsRest += m.counts[c][ACTIVITY_SITTING] + m.counts[c][ACTIVITY_STILL];
+  }
+  for (int c = ACTIVITY_SITTING; c <= ACTIVITY_STILL; c++) {
+    restAsGait += m.counts[c][ACTIVITY_WALKING] + m.counts[c][ACTIVITY_RUNNING];
+  }
+  check(gaitAsRest == 0, (std::string(set) + ": no walking or running window taken for sitting or still").c_str());
+  check(restAsGait == 0, (std::string(set) + ": no sitting or still window taken for walking or running").c_str());
+}
+
+static int runVerify() {
+  std::vector<Trace> traces;
+  if (!loadTraces(opts.traces, traces)) return 1;
+  checkSteps("fitting", traces);
+
+  // Cost: the ESP8266 runs this once per sample, 50 times a second
+  check(stepNsPerSample(traces) <= MAX_NS_PER_SAMPLE, "step detector cost per sample");
+
+  // Activity windows: the committed fitting set is current, and both it
+  // and the held-out set the thresholds never saw pass the class checks
+  std::vector<Window> windows = labelledWindows(traces);
+  check(windowsMatch(windows), "windows.csv matches the traces (rewrite with --windows)");
+  checkClasses("fitting", confusion(windows), MIN_CLASS_ACCURACY);
+  check(classifyNsPerWindow(traces) <= MAX_NS_PER_WINDOW, "classifier cost per window");
+
+  std::vector<Trace> heldOut;
+  if (!loadTraces(opts.heldOut, heldOut)) return 1;
+  checkSteps("held-out", heldOut);
+  checkClasses("held-out", confusion(labelledWindows(heldOut)), MIN_HELDOUT_ACCURACY);
+
+  verifyBouts();
+
+  if (verifyFailures) {
+    fprintf(stderr, "verify: %d check(s) failed\n", verifyFailures);
+    return 1;
+  }
+  printf("verify: ok\n");
+  return 0;
+}
+
+// ---- Main ----------------------------------------------------------------
+
+static void usage() {
+  fprintf(stderr,
+          "usage: bille-wearable MODE [options]\n"
+          "  --bench              step counts per trace, JSON\n"
+          "  --verify             step count, activity class, bout tracker and cost checks\n"
+          "  --windows FILE       write the labelled activity windows as CSV\n"
+          "  --make-traces        regenerate the synthetic traces\n"
+          "    --traces DIR       fitting traces (default tools/wearable/traces)\n"
+          "    --heldout DIR      held-out traces (default tools/wearable/heldout)\n");
+}
+
+static bool parseArgs(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    if (a == "--bench") {
+      opts.bench = true;
+      continue;
+    }
+    if (a == "--verify") {
+      opts.verify = true;
+      continue;
+    }
+    if (a == "--make-traces") {
+      opts.makeTraces = true;
+      continue;
+    }
+    if (i + 1 >= argc) return false;
+    const char* v = argv[++i];
+    if (a == "--traces") opts.traces = v;
+    else if (a == "--heldout") opts.heldOut = v;
+    else if (a == "--windows") {
+      opts.windows = v;
+      opts.writeWindows = true;
+    } else return false;
+  }
+  return opts.bench || opts.verify || opts.makeTraces || opts.writeWindows;
+}
+
+int main(int argc, char** argv) {
+  if (!parseArgs(argc, argv)) {
+    usage();
+    return 2;
+  }
+  if (opts.makeTraces) return makeTraces();
+  if (opts.writeWindows) {
+    std::vector<Trace> traces;
+    if (!loadTraces(opts.traces, traces)) return 1;
+    return writeWindows(traces);
+  }
+  if (opts.verify) return runVerify();
+  return runBench();
+}